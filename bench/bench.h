@@ -0,0 +1,24 @@
+#include "mach_ipc.h"
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#define BENCH_SERVICE "com.example.bench"
+
+enum {
+    BENCH_MSG_ONEWAY = 1U,      // Counted, no reply
+    BENCH_MSG_BARRIER,          // Replies with the one-way count since the last barrier
+    BENCH_MSG_REQUEST,          // Replies with 8 bytes
+    BENCH_MSG_SHM_SETUP,        // Maps the memory entry carried as port
+    BENCH_MSG_SHM_ECHO          // Copies the first half of the mapping into the second
+};
+
+#define BENCH_MSG_ID_ONEWAY     (MSG_ID_USER(BENCH_MSG_ONEWAY))
+#define BENCH_MSG_ID_BARRIER    (MSG_ID_USER(BENCH_MSG_BARRIER))
+#define BENCH_MSG_ID_REQUEST    (MSG_ID_USER(BENCH_MSG_REQUEST))
+#define BENCH_MSG_ID_SHM_SETUP  (SET_FEATURE(MSG_ID_USER(BENCH_MSG_SHM_SETUP), INTERNAL_FEATURE_LPCY))
+#define BENCH_MSG_ID_SHM_ECHO   (MSG_ID_USER(BENCH_MSG_SHM_ECHO))
+
+#define BENCH_STATUS_OK (IPC_USER_BASE + 1)
+
+#endif // BENCH_H
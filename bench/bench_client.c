@@ -0,0 +1,528 @@
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+
+/* ============================================================================
+ * RESULTS
+ * ============================================================================ */
+
+typedef struct {
+    const char *suite;
+    const char *transport;      // inline, ool, shm (or mixed)
+    int clients;
+    size_t size;
+    uint64_t iterations;
+    double seconds;
+    bool has_latency;
+    uint64_t p50_ns;
+    uint64_t p99_ns;
+    uint64_t p999_ns;
+    uint64_t max_ns;
+} bench_result_t;
+
+typedef enum {
+    BENCH_FORMAT_CSV,
+    BENCH_FORMAT_JSON
+} bench_format_t;
+
+static FILE *g_out = NULL;
+static bench_format_t g_format = BENCH_FORMAT_CSV;
+static int g_results = 0;
+static int g_quick = 0;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+// Sorts samples and fills the percentiles
+static void fill_latency(bench_result_t *result, uint64_t *samples, size_t count) {
+    if (count == 0) return;
+
+    qsort(samples, count, sizeof(uint64_t), compare_u64);
+    result->has_latency = true;
+    result->p50_ns = samples[(size_t)(count * 0.50)];
+    result->p99_ns = samples[(size_t)(count * 0.99)];
+    result->p999_ns = samples[(size_t)(count * 0.999)];
+    result->max_ns = samples[count - 1];
+}
+
+static void report_begin(void) {
+    if (g_format == BENCH_FORMAT_JSON) {
+        fprintf(g_out, "[\n");
+    } else {
+        fprintf(g_out, "suite,transport,clients,size,iterations,seconds,ops_per_sec,"
+                       "mb_per_sec,p50_us,p99_us,p999_us,max_us\n");
+    }
+}
+
+static void report(const bench_result_t *result) {
+    double ops = result->seconds > 0 ? result->iterations / result->seconds : 0;
+    double mbps = ops * result->size / (1024.0 * 1024.0);
+
+    if (g_format == BENCH_FORMAT_JSON) {
+        fprintf(g_out, "%s  {\"suite\": \"%s\", \"transport\": \"%s\", \"clients\": %d, "
+                       "\"size\": %zu, \"iterations\": %llu, \"seconds\": %.6f, "
+                       "\"ops_per_sec\": %.1f, \"mb_per_sec\": %.2f",
+                g_results ? ",\n" : "", result->suite, result->transport, result->clients,
+                result->size, (unsigned long long)result->iterations, result->seconds, ops, mbps);
+        if (result->has_latency) {
+            fprintf(g_out, ", \"p50_us\": %.2f, \"p99_us\": %.2f, \"p999_us\": %.2f, \"max_us\": %.2f}",
+                    result->p50_ns / 1000.0, result->p99_ns / 1000.0,
+                    result->p999_ns / 1000.0, result->max_ns / 1000.0);
+        } else {
+            fprintf(g_out, ", \"p50_us\": null, \"p99_us\": null, \"p999_us\": null, \"max_us\": null}");
+        }
+    } else {
+        fprintf(g_out, "%s,%s,%d,%zu,%llu,%.6f,%.1f,%.2f,",
+                result->suite, result->transport, result->clients, result->size,
+                (unsigned long long)result->iterations, result->seconds, ops, mbps);
+        if (result->has_latency) {
+            fprintf(g_out, "%.2f,%.2f,%.2f,%.2f\n",
+                    result->p50_ns / 1000.0, result->p99_ns / 1000.0,
+                    result->p999_ns / 1000.0, result->max_ns / 1000.0);
+        } else {
+            fprintf(g_out, ",,,\n");
+        }
+    }
+    fflush(g_out);
+    g_results++;
+
+    // Human readable progress on stderr
+    fprintf(stderr, "  %-10s %-7s clients=%-3d size=%-9zu %10.0f ops/s %9.2f MB/s",
+            result->suite, result->transport, result->clients, result->size, ops, mbps);
+    if (result->has_latency) {
+        fprintf(stderr, "  p50=%.1fus p99=%.1fus p999=%.1fus",
+                result->p50_ns / 1000.0, result->p99_ns / 1000.0, result->p999_ns / 1000.0);
+    }
+    fprintf(stderr, "\n");
+}
+
+static void report_end(void) {
+    if (g_format == BENCH_FORMAT_JSON) {
+        fprintf(g_out, "\n]\n");
+    }
+}
+
+static const char* transport_for(size_t size) {
+    return size <= ipc_get_inline_threshold() ? "inline" : "ool";
+}
+
+// Fewer iterations for large payloads, about 256 MiB moved per data point
+static uint64_t iterations_for(size_t size, uint64_t base) {
+    uint64_t iterations = base;
+    if (size > 4096) {
+        iterations = (256ULL * 1024 * 1024) / size;
+        if (iterations > base) iterations = base;
+        if (iterations < 10) iterations = 10;
+    }
+    return g_quick && iterations >= 100 ? iterations / 10 : iterations;
+}
+
+static mach_client_t* connect_client(void) {
+    mach_client_t *client = mach_client_create(NULL, NULL);
+    if (!client) return NULL;
+
+    ipc_status_t status = mach_client_connect(client, BENCH_SERVICE, 5000);
+    if (status != IPC_SUCCESS) {
+        fprintf(stderr, "Failed to connect: %s\n", ipc_status_string(status));
+        mach_client_destroy(client);
+        return NULL;
+    }
+    return client;
+}
+
+/* ============================================================================
+ * BENCHMARKS
+ * ============================================================================ */
+
+// One-way throughput, completed by a barrier round trip. owned: every
+// message is filled into a fresh buffer and moved with mach_client_send_owned
+static void bench_oneway(mach_client_t *client, size_t size, uint64_t count, bool owned) {
+    uint8_t *data = calloc(1, size ? size : 1);
+    if (!data) return;
+
+    uint64_t start = now_ns();
+    for (uint64_t i = 0; i < count; i++) {
+        if (owned) {
+            void *buffer = ipc_payload_alloc(size);
+            if (!buffer) break;
+            memset(buffer, (int)i, size);
+            mach_client_send_owned(client, BENCH_MSG_ID_ONEWAY, buffer, size);
+        } else {
+            memset(data, (int)i, size);
+            mach_client_send(client, BENCH_MSG_ID_ONEWAY, data, size);
+        }
+    }
+
+    const void *reply = NULL;
+    size_t reply_size = 0;
+    ipc_status_t status = mach_client_send_with_reply(client, BENCH_MSG_ID_BARRIER, NULL, 0,
+                                                      &reply, &reply_size, 30000);
+    uint64_t end = now_ns();
+
+    uint64_t received = 0;
+    if (status == BENCH_STATUS_OK && reply && reply_size == sizeof(received)) {
+        memcpy(&received, reply, sizeof(received));
+    }
+    ply_free((void*)reply, reply_size);
+
+    bench_result_t result = {
+        .suite = owned ? "oneway_owned" : "oneway",
+        .transport = transport_for(size),
+        .clients = 1,
+        .size = size,
+        .iterations = received,
+        .seconds = (end - start) / 1e9
+    };
+    report(&result);
+    free(data);
+}
+
+// mach_client_send_with_reply or mach_client_call
+typedef ipc_status_t (*request_fn_t)(mach_client_t *client, uint32_t msg_type,
+                                     const void *data, size_t size,
+                                     const void **reply_data, size_t *reply_size,
+                                     uint32_t timeout_ms);
+
+// Request-reply round trips, samples must hold iterations entries
+static bool run_round_trips(mach_client_t *client, request_fn_t request, const void *data,
+                            size_t size, uint64_t iterations, uint64_t *samples) {
+    for (uint64_t i = 0; i < iterations; i++) {
+        const void *reply = NULL;
+        size_t reply_size = 0;
+
+        uint64_t start = now_ns();
+        ipc_status_t status = request(client, BENCH_MSG_ID_REQUEST, data, size,
+                                      &reply, &reply_size, 30000);
+        samples[i] = now_ns() - start;
+
+        ply_free((void*)reply, reply_size);
+        if (status != BENCH_STATUS_OK) {
+            fprintf(stderr, "Request failed: %s\n", ipc_status_string(status));
+            return false;
+        }
+    }
+    return true;
+}
+
+static void bench_rtt(mach_client_t *client, request_fn_t request, const char *suite,
+                      const char *transport, size_t size, uint64_t iterations) {
+    uint8_t *data = calloc(1, size ? size : 1);
+    uint64_t *samples = malloc(iterations * sizeof(uint64_t));
+    if (!data || !samples) {
+        fprintf(stderr, "Skipping %s size=%zu, out of memory\n", suite, size);
+        free(data);
+        free(samples);
+        return;
+    }
+
+    uint64_t start = now_ns();
+    bool ok = run_round_trips(client, request, data, size, iterations, samples);
+    uint64_t end = now_ns();
+
+    if (ok) {
+        bench_result_t result = {
+            .suite = suite,
+            .transport = transport,
+            .clients = 1,
+            .size = size,
+            .iterations = iterations,
+            .seconds = (end - start) / 1e9
+        };
+        fill_latency(&result, samples, iterations);
+        report(&result);
+    }
+
+    free(samples);
+    free(data);
+}
+
+// Start gate (macOS has no pthread barriers)
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int waiting;
+} bench_gate_t;
+
+static void gate_wait(bench_gate_t *gate) {
+    pthread_mutex_lock(&gate->lock);
+    if (--gate->waiting == 0) {
+        pthread_cond_broadcast(&gate->cond);
+    }
+    while (gate->waiting > 0) {
+        pthread_cond_wait(&gate->cond, &gate->lock);
+    }
+    pthread_mutex_unlock(&gate->lock);
+}
+
+typedef struct {
+    bench_gate_t *ready;
+    uint64_t iterations;
+    uint64_t *samples;
+    bool ok;
+} scaling_worker_t;
+
+static void* scaling_thread(void *arg) {
+    scaling_worker_t *worker = (scaling_worker_t*)arg;
+    uint8_t data[64] = {0};
+
+    mach_client_t *client = connect_client();
+    gate_wait(worker->ready);
+    if (client) {
+        worker->ok = run_round_trips(client, mach_client_send_with_reply, data, sizeof(data),
+                                     worker->iterations, worker->samples);
+        mach_client_disconnect(client);
+        mach_client_destroy(client);
+    }
+    return NULL;
+}
+
+// Aggregate round trips with concurrent clients (one connection per thread)
+static void bench_scaling(int clients, uint64_t iterations) {
+    scaling_worker_t *workers = calloc(clients, sizeof(scaling_worker_t));
+    pthread_t *threads = calloc(clients, sizeof(pthread_t));
+    uint64_t *samples = malloc(clients * iterations * sizeof(uint64_t));
+    if (!workers || !threads || !samples) {
+        free(workers);
+        free(threads);
+        free(samples);
+        return;
+    }
+
+    // Workers connect first, the clock starts once everyone is ready
+    bench_gate_t ready = {
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .cond = PTHREAD_COND_INITIALIZER,
+        .waiting = clients + 1
+    };
+
+    for (int i = 0; i < clients; i++) {
+        workers[i] = (scaling_worker_t){
+            .ready = &ready,
+            .iterations = iterations,
+            .samples = samples + i * iterations
+        };
+        pthread_create(&threads[i], NULL, scaling_thread, &workers[i]);
+    }
+
+    gate_wait(&ready);
+    uint64_t start = now_ns();
+    bool ok = true;
+    for (int i = 0; i < clients; i++) {
+        pthread_join(threads[i], NULL);
+        ok = ok && workers[i].ok;
+    }
+    uint64_t end = now_ns();
+
+    if (ok) {
+        bench_result_t result = {
+            .suite = "scaling",
+            .transport = transport_for(64),
+            .clients = clients,
+            .size = 64,
+            .iterations = clients * iterations,
+            .seconds = (end - start) / 1e9
+        };
+        fill_latency(&result, samples, clients * iterations);
+        report(&result);
+    }
+
+    free(samples);
+    free(threads);
+    free(workers);
+}
+
+// Echo through a mapping shared with the server, only the size travels by message
+static void bench_shm_echo(mach_client_t *client, const size_t *sizes, int size_count) {
+    size_t max_size = 0;
+    for (int i = 0; i < size_count; i++) {
+        if (sizes[i] > max_size) max_size = sizes[i];
+    }
+
+    uint64_t shm_size = 2 * max_size;
+    shared_memory_t *shmem = NULL;
+    kern_return_t kr = shared_memory_create(shm_size, &shmem);
+    if (kr != KERN_SUCCESS) {
+        fprintf(stderr, "Failed to create shared memory: %s\n", mach_error_string(kr));
+        return;
+    }
+
+    ipc_status_t status = mach_client_send_with_port_and_reply(
+        client, shared_memory_get_port(shmem), BENCH_MSG_ID_SHM_SETUP,
+        &shm_size, sizeof(shm_size), NULL, NULL, 5000
+    );
+    if (status != BENCH_STATUS_OK) {
+        fprintf(stderr, "Shared memory setup failed: %s\n", ipc_status_string(status));
+        shared_memory_destroy(shmem);
+        return;
+    }
+
+    uint8_t *base = shared_memory_get_data(shmem);
+    uint8_t *scratch = malloc(max_size);
+    for (int s = 0; s < size_count && scratch; s++) {
+        uint64_t size = sizes[s];
+        uint64_t iterations = iterations_for(size, 10000);
+        uint64_t *samples = malloc(iterations * sizeof(uint64_t));
+        if (!samples) break;
+
+        memset(scratch, 0x5A, size);
+        bool ok = true;
+        uint64_t start = now_ns();
+        for (uint64_t i = 0; i < iterations && ok; i++) {
+            uint64_t t0 = now_ns();
+            memcpy(base, scratch, size);
+            status = mach_client_send_with_reply(client, BENCH_MSG_ID_SHM_ECHO,
+                                                 &size, sizeof(size), NULL, NULL, 30000);
+            memcpy(scratch, base + max_size, size);
+            samples[i] = now_ns() - t0;
+            ok = status == BENCH_STATUS_OK;
+        }
+        uint64_t end = now_ns();
+
+        if (ok) {
+            bench_result_t result = {
+                .suite = "shm_echo",
+                .transport = "shm",
+                .clients = 1,
+                .size = size,
+                .iterations = iterations,
+                .seconds = (end - start) / 1e9
+            };
+            fill_latency(&result, samples, iterations);
+            report(&result);
+        } else {
+            fprintf(stderr, "Shared memory echo failed: %s\n", ipc_status_string(status));
+        }
+        free(samples);
+    }
+
+    free(scratch);
+    shared_memory_destroy(shmem);
+}
+
+/* ============================================================================
+ * MAIN
+ * ============================================================================ */
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [--format csv|json] [--output FILE] [--quick]\n", name);
+}
+
+int main(int argc, char *argv[]) {
+    const char *output = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            const char *format = argv[++i];
+            if (strcmp(format, "json") == 0) {
+                g_format = BENCH_FORMAT_JSON;
+            } else if (strcmp(format, "csv") == 0) {
+                g_format = BENCH_FORMAT_CSV;
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if (strcmp(argv[i], "--quick") == 0) {
+            g_quick = 1;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    g_out = output && strcmp(output, "-") != 0 ? fopen(output, "w") : stdout;
+    if (!g_out) {
+        perror("fopen");
+        return 1;
+    }
+
+    mach_client_t *client = connect_client();
+    if (!client) {
+        if (g_out != stdout) fclose(g_out);
+        return 1;
+    }
+
+    report_begin();
+
+    fprintf(stderr, "=== One-way throughput ===\n");
+    const size_t oneway_sizes[] = { 0, 64, 256, 4096, 65536 };
+    for (size_t i = 0; i < sizeof(oneway_sizes) / sizeof(oneway_sizes[0]); i++) {
+        bench_oneway(client, oneway_sizes[i], iterations_for(oneway_sizes[i], 100000), false);
+    }
+
+    fprintf(stderr, "=== One-way copied vs moved ===\n");
+    const size_t owned_sizes[] = { 65536, 1024 * 1024, 16 * 1024 * 1024 };
+    for (size_t i = 0; i < sizeof(owned_sizes) / sizeof(owned_sizes[0]); i++) {
+        bench_oneway(client, owned_sizes[i], iterations_for(owned_sizes[i], 100000), false);
+        bench_oneway(client, owned_sizes[i], iterations_for(owned_sizes[i], 100000), true);
+    }
+
+    fprintf(stderr, "=== Round trip size sweep ===\n");
+    const size_t sweep_sizes[] = {
+        0, 64, 256, 257, 1024, 4096, 16384, 65536,
+        256 * 1024, 1024 * 1024, 4 * 1024 * 1024, 16 * 1024 * 1024, 64 * 1024 * 1024
+    };
+    for (size_t i = 0; i < sizeof(sweep_sizes) / sizeof(sweep_sizes[0]); i++) {
+        size_t size = sweep_sizes[i];
+        bench_rtt(client, mach_client_send_with_reply, "rtt", transport_for(size), size,
+                  iterations_for(size, 10000));
+    }
+
+    fprintf(stderr, "=== Inline vs OOL ===\n");
+    size_t threshold = ipc_get_inline_threshold();
+    const size_t small_sizes[] = { 0, 64, 256 };
+    for (size_t i = 0; i < sizeof(small_sizes) / sizeof(small_sizes[0]); i++) {
+        if (small_sizes[i] > threshold) continue;
+        ipc_set_inline_threshold(0);
+        bench_rtt(client, mach_client_send_with_reply, "rtt_ool", "ool", small_sizes[i],
+                  iterations_for(small_sizes[i], 10000));
+        ipc_set_inline_threshold(threshold);
+        bench_rtt(client, mach_client_send_with_reply, "rtt_inline", "inline", small_sizes[i],
+                  iterations_for(small_sizes[i], 10000));
+    }
+
+    fprintf(stderr, "=== Receiver thread vs direct call ===\n");
+    const size_t call_sizes[] = { 0, 64, 4096, 65536 };
+    for (size_t i = 0; i < sizeof(call_sizes) / sizeof(call_sizes[0]); i++) {
+        size_t size = call_sizes[i];
+        bench_rtt(client, mach_client_send_with_reply, "rtt_ack", transport_for(size), size,
+                  iterations_for(size, 10000));
+        bench_rtt(client, mach_client_call, "rtt_call", transport_for(size), size,
+                  iterations_for(size, 10000));
+    }
+
+    fprintf(stderr, "=== Client scaling ===\n");
+    const int client_counts[] = { 1, 2, 4, 8, 16 };
+    for (size_t i = 0; i < sizeof(client_counts) / sizeof(client_counts[0]); i++) {
+        bench_scaling(client_counts[i], iterations_for(64, 5000));
+    }
+
+    fprintf(stderr, "=== Shared memory echo ===\n");
+    const size_t shm_sizes[] = { 64, 4096, 65536, 1024 * 1024, 16 * 1024 * 1024 };
+    bench_shm_echo(client, shm_sizes, sizeof(shm_sizes) / sizeof(shm_sizes[0]));
+
+    report_end();
+
+    mach_client_disconnect(client);
+    mach_client_destroy(client);
+
+    if (g_out != stdout) {
+        fclose(g_out);
+        fprintf(stderr, "Results written to %s\n", output);
+    }
+    return 0;
+}
@@ -0,0 +1,174 @@
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+
+static mach_server_t *g_server = NULL;
+
+// Per client slot, only touched from the client's queue
+typedef struct {
+    uint64_t oneway_count;
+    shared_memory_t *shmem;
+} bench_client_state_t;
+
+static bench_client_state_t *g_clients = NULL;
+static size_t g_max_clients = 0;
+
+void signal_handler(int sig) {
+    (void)sig;
+    if (g_server) {
+        mach_server_stop(g_server);
+    }
+}
+
+static bench_client_state_t* client_state(client_handle_t client) {
+    return client.slot >= 0 && (size_t)client.slot < g_max_clients ? &g_clients[client.slot] : NULL;
+}
+
+void on_client_disconnected(mach_server_t *server, client_handle_t client, void *data) {
+    (void)server;
+    (void)data;
+    
+    bench_client_state_t *state = client_state(client);
+    if (state) {
+        shared_memory_destroy(state->shmem);
+        *state = (bench_client_state_t){0};
+    }
+}
+
+void on_message(mach_server_t *server, client_handle_t client,
+                mach_port_t *remote_port, uint32_t msg_type, const void *data, size_t size, void *user_data) {
+    (void)server;
+    (void)remote_port;
+    (void)data;
+    (void)size;
+    (void)user_data;
+    
+    bench_client_state_t *state = client_state(client);
+    if (state && msg_type == BENCH_MSG_ONEWAY) {
+        state->oneway_count++;
+    }
+}
+
+void* on_message_with_reply(mach_server_t *server, client_handle_t client,
+                            mach_port_t *remote_port, uint32_t msg_type, const void *data, size_t size,
+                            size_t *reply_size, void *user_data, int *reply_status) {
+    (void)user_data;
+    
+    bench_client_state_t *state = client_state(client);
+    if (!state) {
+        *reply_status = IPC_ERROR_INTERNAL;
+        return NULL;
+    }
+    
+    switch (msg_type) {
+        case BENCH_MSG_BARRIER: {
+            uint64_t *count = ipc_reply_alloc(server, sizeof(uint64_t));
+            if (!count) {
+                *reply_status = IPC_ERROR_NO_MEMORY;
+                return NULL;
+            }
+            *count = state->oneway_count;
+            state->oneway_count = 0;
+            *reply_size = sizeof(uint64_t);
+            *reply_status = BENCH_STATUS_OK;
+            return count;
+        }
+        
+        case BENCH_MSG_REQUEST: {
+            uint64_t *echo = ipc_reply_alloc(server, sizeof(uint64_t));
+            if (!echo) {
+                *reply_status = IPC_ERROR_NO_MEMORY;
+                return NULL;
+            }
+            *echo = 0;
+            memcpy(echo, data, size < sizeof(uint64_t) ? size : sizeof(uint64_t));
+            *reply_size = sizeof(uint64_t);
+            *reply_status = BENCH_STATUS_OK;
+            return echo;
+        }
+        
+        case BENCH_MSG_SHM_SETUP: {
+            uint64_t shm_size = 0;
+            if (state->shmem || size != sizeof(shm_size) || *remote_port == MACH_PORT_NULL) {
+                *reply_status = IPC_ERROR_INVALID_PARAM;
+                return NULL;
+            }
+            memcpy(&shm_size, data, sizeof(shm_size));
+            if (shared_memory_map(*remote_port, shm_size, &state->shmem) != KERN_SUCCESS) {
+                *reply_status = IPC_ERROR_INTERNAL;
+                return NULL;
+            }
+            *remote_port = MACH_PORT_NULL;
+            *reply_status = BENCH_STATUS_OK;
+            return NULL;
+        }
+        
+        case BENCH_MSG_SHM_ECHO: {
+            uint64_t echo_size = 0;
+            size_t half = shared_memory_get_size(state->shmem) / 2;
+            if (size == sizeof(echo_size)) {
+                memcpy(&echo_size, data, sizeof(echo_size));
+            }
+            if (!state->shmem || echo_size > half) {
+                *reply_status = IPC_ERROR_INVALID_PARAM;
+                return NULL;
+            }
+            uint8_t *base = shared_memory_get_data(state->shmem);
+            memcpy(base + half, base, echo_size);
+            *reply_status = BENCH_STATUS_OK;
+            return NULL;
+        }
+        
+        default:
+            *reply_status = IPC_ERROR_INVALID_PARAM;
+            return NULL;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
+    
+    server_options_t options = {
+        .receiver_threads = argc > 1 ? atoi(argv[1]) : 1,
+        .max_clients = 0
+    };
+    
+    server_callbacks_t callbacks = {
+        .on_client_connected = NULL,
+        .on_client_disconnected = on_client_disconnected,
+        .on_message = on_message,
+        .on_message_with_reply = on_message_with_reply
+    };
+    
+    g_server = mach_server_create_with_options(BENCH_SERVICE, &callbacks, &options, NULL);
+    if (!g_server) {
+        fprintf(stderr, "Failed to create server\n");
+        return 1;
+    }
+    
+    // Stateless, so requests of one client may overlap on the worker pool
+    mach_server_set_unordered(g_server, BENCH_MSG_REQUEST, true);
+    
+    g_max_clients = mach_server_max_clients(g_server);
+    g_clients = calloc(g_max_clients, sizeof(bench_client_state_t));
+    if (!g_clients) {
+        fprintf(stderr, "Failed to allocate client state\n");
+        mach_server_destroy(g_server);
+        return 1;
+    }
+    
+    printf("Bench server started (%d receiver threads)\n", options.receiver_threads);
+    
+    ipc_status_t status = mach_server_run(g_server);
+    printf("Bench server stopped: %s\n", ipc_status_string(status));
+    
+    mach_server_destroy(g_server);
+    for (size_t i = 0; i < g_max_clients; i++) {
+        shared_memory_destroy(g_clients[i].shmem);
+    }
+    free(g_clients);
+    return 0;
+}
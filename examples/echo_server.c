@@ -9,8 +9,10 @@
 
 static mach_server_t *g_server = NULL;
 
+// Region of the client, mapped through the server's region cache
 typedef struct {
-    shared_memory_t *shmem;
+    void *data;
+    size_t size;
     uint32_t client_id;
 } shmem_pool_entry_t;
 
@@ -36,16 +38,7 @@ void on_client_disconnected(mach_server_t *server, client_handle_t client, void
 
     printf("Client %u disconnected\n", client.id);
 
-    // Lock the entry before destroying
-    if (linear_ts_pool_lock_entry(&shmem_pool, client.slot)) {
-        shmem_pool_entry_t *entry = (shmem_pool_entry_t*)linear_ts_pool_get(&shmem_pool, client.slot);
-        if (entry && entry->shmem) {
-            shared_memory_destroy(entry->shmem);
-            entry->shmem = NULL;
-        }
-        linear_ts_pool_unlock_entry(&shmem_pool, client.slot);
-    }
-    
+    // The framework unmaps the client's regions after this returns
     linear_ts_pool_remove(&shmem_pool, client.slot);
 }
 
@@ -63,39 +56,41 @@ void on_message(mach_server_t *server, client_handle_t client,
 void* on_message_with_reply(mach_server_t *server, client_handle_t client,
                             mach_port_t *remote_port, uint32_t msg_type, const void *data, size_t size,
                             size_t *reply_size, void *user_data, int *reply_status) {
-    (void)server;
     (void)reply_size;
     (void)user_data;
     void *reply = NULL;
 
     if (msg_type == MSG_TYPE_SET_ECHO_SHM) {
-        if (linear_ts_pool_is_active(&shmem_pool, client.slot)) {
-            *reply_status = IPC_ERROR_INTERNAL;
-            return NULL;
-        }
-        
         shmem_pool_entry_t entry = {0};
         entry.client_id = client.id;
+        entry.size = *((size_t*)data);
         
-        kern_return_t kr = shared_memory_map(
-            *remote_port,
-            *((size_t*)data),
-            &entry.shmem
-        );
-        
-        if (kr != KERN_SUCCESS) {
-            *reply_status = IPC_ERROR_INTERNAL;
+        // Sending the same region again is served from the cache
+        ipc_status_t status = mach_server_map_region(server, client, *remote_port,
+                                                     entry.size, &entry.data);
+        *remote_port = MACH_PORT_NULL;
+        if (status != IPC_SUCCESS) {
+            *reply_status = status;
             return NULL;
         }
         
+        // Replace the previous region, it stays cached for reuse
+        if (linear_ts_pool_lock_entry(&shmem_pool, client.slot)) {
+            shmem_pool_entry_t *previous = (shmem_pool_entry_t*)linear_ts_pool_get(&shmem_pool, client.slot);
+            if (previous && previous->data) {
+                mach_server_release_region(server, client, previous->data);
+            }
+            linear_ts_pool_unlock_entry(&shmem_pool, client.slot);
+            linear_ts_pool_remove(&shmem_pool, client.slot);
+        }
+        
         if (!linear_ts_pool_set(&shmem_pool, client.slot, &entry)) {
-            shared_memory_destroy(entry.shmem);
+            mach_server_release_region(server, client, entry.data);
             *reply_status = IPC_ERROR_INTERNAL;
             return NULL;
         }
         
-        *remote_port = MACH_PORT_NULL;
-        printf("Shared memory with %" PRIu64 " bytes has been mapped!\n", entry.shmem->size);
+        printf("Shared memory with %zu bytes has been mapped!\n", entry.size);
         return NULL;
     }
 
@@ -107,20 +102,16 @@ void* on_message_with_reply(mach_server_t *server, client_handle_t client,
         }
         
         shmem_pool_entry_t *entry = (shmem_pool_entry_t*)linear_ts_pool_get(&shmem_pool, client.slot);
-        if (!entry || !entry->shmem) {
+        if (!entry || !entry->data) {
             *reply_status = IPC_ERROR_INTERNAL;
             linear_ts_pool_unlock_entry(&shmem_pool, client.slot);
             return NULL;
         }
         
-        printf("Client %u: %.*s\n", client.id,
-               (int)shared_memory_get_size(entry->shmem), 
-               (char*)shared_memory_get_data(entry->shmem));
+        printf("Client %u: %.*s\n", client.id, (int)entry->size, (char*)entry->data);
         
         const char *echo_message = "Hello from server! Data in shared memory.";
-        snprintf(shared_memory_get_data(entry->shmem), 
-                 shared_memory_get_size(entry->shmem),
-                 "%s", echo_message);
+        snprintf(entry->data, entry->size, "%s", echo_message);
         
         *reply_status = ECHO_CUSTOM_STATUS;
         
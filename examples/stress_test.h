@@ -14,6 +14,11 @@
 #define MSG_TYPE_SHARE_MEMORY   (8UL)
 #define MSG_TYPE_STATS_REQ      (9UL)
 #define MSG_TYPE_STATS_RESP     (10UL)
+#define MSG_TYPE_STREAM         (11UL)
+#define MSG_TYPE_PUBLISH_REQ    (12UL)
+
+// Topics
+#define STRESS_TOPIC_TICKS      (42U)
 
 // Message IDs
 #define MSG_ID_PING             (MSG_ID_USER(MSG_TYPE_PING))
@@ -26,6 +31,7 @@
 // #define MSG_ID_SHARE_MEMORY     (SET_FEATURE(MSG_ID_USER(MSG_TYPE_SHARE_MEMORY), INTERNAL_FEATURE_UPSH))
 #define MSG_ID_STATS_REQ        (MSG_ID_USER(MSG_TYPE_STATS_REQ))
 #define MSG_ID_STATS_RESP       (MSG_ID_USER(MSG_TYPE_STATS_RESP))
+#define MSG_ID_PUBLISH_REQ      (MSG_ID_USER(MSG_TYPE_PUBLISH_REQ))
 
 // Custom status codes
 #define STRESS_STATUS_PING_OK       (IPC_USER_BASE + 1)
@@ -5,6 +5,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <sched.h>
 #include <sys/time.h>
 
 static volatile int g_running = 1;
@@ -16,6 +17,7 @@ typedef struct {
     uint32_t pings_sent;
     uint32_t pings_received;
     uint32_t broadcasts_received;
+    uint32_t publishes_received;
     uint32_t echos_received;
     uint32_t timeouts;
     uint32_t errors;
@@ -31,6 +33,7 @@ void signal_handler(int sig) {
     printf("  Pings Sent: %u\n", g_stats.pings_sent);
     printf("  Pings Received: %u\n", g_stats.pings_received);
     printf("  Broadcasts Received: %u\n", g_stats.broadcasts_received);
+    printf("  Publishes Received: %u\n", g_stats.publishes_received);
     printf("  Echos Received: %u\n", g_stats.echos_received);
     printf("  Timeouts: %u\n", g_stats.timeouts);
     printf("  Errors: %u\n", g_stats.errors);
@@ -38,6 +41,25 @@ void signal_handler(int sig) {
         printf("  Average Latency: %llu us\n", 
                g_stats.total_latency_us / g_stats.pings_received);
     }
+    
+    ipc_stats_t ipc_stats;
+    if (g_client && mach_client_get_stats(g_client, &ipc_stats) == IPC_SUCCESS &&
+        ipc_stats.enabled) {
+        printf("Framework Statistics:\n");
+        printf("  Messages: %llu received, %llu sent, %llu send failures\n",
+               ipc_stats.messages_received, ipc_stats.messages_sent,
+               ipc_stats.send_failures);
+        printf("  Acks: %llu matched, %llu discarded, peak %u of %u pending\n",
+               ipc_stats.acks_matched, ipc_stats.acks_discarded,
+               ipc_stats.acks_pending_peak, ipc_stats.acks_capacity);
+        printf("  Queue: peak depth %u, %llu deadline rejections\n",
+               ipc_stats.queue_depth_peak, ipc_stats.deadline_expired);
+        if (ipc_stats.round_trip.count > 0) {
+            printf("  Round Trip: avg %llu us, max %llu us\n",
+                   ipc_stats.round_trip.sum_ns / ipc_stats.round_trip.count / 1000,
+                   ipc_stats.round_trip.max_ns / 1000);
+        }
+    }
     printf("============================\n");
     g_running = 0;
 }
@@ -55,6 +77,17 @@ void on_disconnected(mach_client_t *client, void *data) {
     g_running = 0;
 }
 
+void on_publish(mach_client_t *client, uint32_t topic,
+                const void *data, size_t size, void *user_data) {
+    (void)client;
+    (void)user_data;
+    
+    pthread_mutex_lock(&g_stats.lock);
+    g_stats.publishes_received++;
+    pthread_mutex_unlock(&g_stats.lock);
+    printf("[PUBLISH] Topic %u: %.*s\n", topic, (int)size, (const char*)data);
+}
+
 void on_message(mach_client_t *client, mach_port_t *remote_port, uint32_t msg_type,
                 const void *data, size_t size, void *user_data) {
     (void)client;
@@ -347,8 +380,9 @@ void test_get_stats(mach_client_t *client) {
     const void *reply_data = NULL;
     size_t reply_size = 0;
     
+    // Answered ahead of the bulk traffic still queued on the server
     ipc_status_t status = mach_client_send_with_reply(
-        client, MSG_ID_STATS_REQ,
+        client, MSG_ID_STATS_REQ | IPC_MSG_PRIORITY,
         NULL, 0,
         &reply_data, &reply_size,
         2000
@@ -369,6 +403,220 @@ void test_get_stats(mach_client_t *client) {
     ply_free((void*)reply_data, reply_size);
 }
 
+// Average round-trip latency of count pings, 0 if none succeeded
+static uint64_t measure_ping_latency(mach_client_t *client, int count) {
+    uint64_t total_us = 0;
+    int received = 0;
+    
+    for (int i = 0; i < count && g_running; i++) {
+        ping_payload_t ping;
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        ping.sequence = i;
+        ping.timestamp = tv.tv_sec * 1000000ULL + tv.tv_usec;
+        ping.client_id = 0;
+        
+        const void *reply_data = NULL;
+        size_t reply_size = 0;
+        
+        ipc_status_t status = mach_client_send_with_reply(
+            client, MSG_ID_PING,
+            &ping, sizeof(ping),
+            &reply_data, &reply_size,
+            2000
+        );
+        
+        if (status == STRESS_STATUS_PING_OK && reply_data) {
+            gettimeofday(&tv, NULL);
+            total_us += (tv.tv_sec * 1000000ULL + tv.tv_usec) - ping.timestamp;
+            received++;
+        }
+        
+        ply_free((void*)reply_data, reply_size);
+    }
+    
+    return received ? total_us / received : 0;
+}
+
+// Test 8: Inline vs out-of-line latency
+void test_inline_latency(mach_client_t *client, int count) {
+    printf("\n=== Test 8: Inline vs OOL Latency (%d pings each) ===\n", count);
+    
+    size_t threshold = ipc_get_inline_threshold();
+    
+    // Requests travel out-of-line (replies follow the server's threshold)
+    ipc_set_inline_threshold(0);
+    uint64_t ool_us = measure_ping_latency(client, count);
+    
+    ipc_set_inline_threshold(threshold);
+    uint64_t inline_us = measure_ping_latency(client, count);
+    
+    printf("  OOL requests:    %llu us average\n", ool_us);
+    printf("  Inline requests: %llu us average (threshold %zu bytes)\n", inline_us, threshold);
+    if (ool_us > 0 && inline_us > 0) {
+        printf("  Difference:      %.1f%%\n",
+               100.0 * ((double)ool_us - (double)inline_us) / (double)ool_us);
+    }
+}
+
+// Completion tracking for pipelined pings
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+    int pending;
+    int received;
+    int failed;
+} pipeline_state_t;
+
+static void on_async_pong(mach_client_t *client, ipc_status_t status,
+                          const void *reply_data, size_t reply_size, void *context) {
+    (void)client;
+    (void)reply_data;
+    (void)reply_size;
+    pipeline_state_t *state = (pipeline_state_t*)context;
+    
+    pthread_mutex_lock(&state->lock);
+    if (status == STRESS_STATUS_PING_OK) {
+        state->received++;
+    } else {
+        state->failed++;
+    }
+    state->pending--;
+    pthread_cond_signal(&state->done);
+    pthread_mutex_unlock(&state->lock);
+}
+
+// Test 9: Pipelined pings over one connection
+void test_async_pipeline(mach_client_t *client, int count, int window) {
+    printf("\n=== Test 9: Async Pipeline (%d pings, %d in flight) ===\n", count, window);
+    
+    pipeline_state_t state = {0};
+    pthread_mutex_init(&state.lock, NULL);
+    pthread_cond_init(&state.done, NULL);
+    
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+    
+    for (int i = 0; i < count && g_running; i++) {
+        pthread_mutex_lock(&state.lock);
+        while (state.pending >= window) {
+            pthread_cond_wait(&state.done, &state.lock);
+        }
+        state.pending++;
+        pthread_mutex_unlock(&state.lock);
+        
+        ping_payload_t ping = { .sequence = i, .timestamp = 0, .client_id = 0 };
+        ipc_status_t status = mach_client_send_async(
+            client, MSG_ID_PING, &ping, sizeof(ping), 2000, on_async_pong, &state
+        );
+        if (status != IPC_SUCCESS) {
+            pthread_mutex_lock(&state.lock);
+            state.pending--;
+            state.failed++;
+            pthread_mutex_unlock(&state.lock);
+        }
+    }
+    
+    pthread_mutex_lock(&state.lock);
+    while (state.pending > 0) {
+        pthread_cond_wait(&state.done, &state.lock);
+    }
+    pthread_mutex_unlock(&state.lock);
+    
+    gettimeofday(&end, NULL);
+    double elapsed = (end.tv_sec - start.tv_sec) + 
+                     (end.tv_usec - start.tv_usec) / 1000000.0;
+    printf("  Received: %d, failed: %d\n", state.received, state.failed);
+    printf("Completed in %.2f seconds (%.0f msg/s)\n", elapsed, count / elapsed);
+    
+    pthread_cond_destroy(&state.done);
+    pthread_mutex_destroy(&state.lock);
+}
+
+// Test 10: Burst mode with coalesced sends
+void test_coalesced_burst(mach_client_t *client, int count) {
+    printf("\n=== Test 10: Coalesced Burst (4KB / 1ms batches) ===\n");
+    
+    ipc_status_t status = mach_client_set_coalescing(client, 4096, 1000);
+    if (status != IPC_SUCCESS) {
+        printf("  Failed to enable coalescing: %s\n", ipc_status_string(status));
+        return;
+    }
+    
+    test_burst_mode(client, count);
+    
+    mach_client_set_coalescing(client, 0, 0);
+}
+
+// Test 11: Streaming through the shared memory channel
+void test_channel_stream(mach_client_t *client, int count, size_t size) {
+    printf("\n=== Test 11: Channel Stream (%d x %zu bytes) ===\n", count, size);
+    
+    ipc_status_t status = mach_client_open_channel(client, 1024 * 1024, 2000);
+    if (status != IPC_SUCCESS) {
+        printf("  Failed to open channel: %s\n", ipc_status_string(status));
+        return;
+    }
+    
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+    
+    int sent = 0;
+    int stalls = 0;
+    for (int i = 0; i < count && g_running; i++) {
+        uint32_t *record = mach_client_channel_reserve(client, size);
+        if (!record) {
+            // Ring full, give the server time to drain
+            stalls++;
+            i--;
+            sched_yield();
+            continue;
+        }
+        
+        // Written in place, no copy
+        record[0] = (uint32_t)i;
+        memset(record + 1, 0xAB, size - sizeof(uint32_t));
+        
+        if (mach_client_channel_commit(client, MSG_TYPE_STREAM, size) == IPC_SUCCESS) {
+            sent++;
+        } else {
+            pthread_mutex_lock(&g_stats.lock);
+            g_stats.errors++;
+            pthread_mutex_unlock(&g_stats.lock);
+        }
+    }
+    
+    gettimeofday(&end, NULL);
+    double elapsed = (end.tv_sec - start.tv_sec) + 
+                     (end.tv_usec - start.tv_usec) / 1000000.0;
+    
+    printf("Streamed %d messages in %.2f seconds (%.0f msg/s, %.1f MB/s)\n",
+           sent, elapsed, sent / elapsed, sent * size / elapsed / (1024 * 1024));
+    printf("  Ring full stalls: %d\n", stalls);
+}
+
+// Test 12: Topic publish (only subscribed clients receive it)
+void test_publish(mach_client_t *client) {
+    printf("\n=== Test 12: Topic Publish ===\n");
+    
+    ipc_status_t status = mach_client_subscribe(client, STRESS_TOPIC_TICKS, 1000);
+    if (status != IPC_SUCCESS) {
+        printf("  Subscribe failed: %s\n", ipc_status_string(status));
+        return;
+    }
+    
+    uint32_t before = g_stats.publishes_received;
+    mach_client_send(client, MSG_ID_PUBLISH_REQ, NULL, 0);
+    sleep(1);
+    
+    // Unsubscribed, so the second publish must not arrive
+    mach_client_unsubscribe(client, STRESS_TOPIC_TICKS, 1000);
+    mach_client_send(client, MSG_ID_PUBLISH_REQ, NULL, 0);
+    sleep(1);
+    
+    printf("  Received %u publish(es), expected 1\n", g_stats.publishes_received - before);
+}
+
 int main(int argc, char *argv[]) {
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
@@ -387,7 +635,8 @@ int main(int argc, char *argv[]) {
         .on_connected = on_connected,
         .on_disconnected = on_disconnected,
         .on_message = on_message,
-        .on_message_with_reply = NULL
+        .on_message_with_reply = NULL,
+        .on_publish = on_publish
     };
     
     g_client = mach_client_create(&callbacks, NULL);
@@ -436,6 +685,26 @@ int main(int argc, char *argv[]) {
         test_get_stats(g_client);
     }
     
+    if (test_mode == 0 || test_mode == 8) {
+        test_inline_latency(g_client, 1000);
+    }
+    
+    if (test_mode == 0 || test_mode == 9) {
+        test_async_pipeline(g_client, 1000, 64);
+    }
+    
+    if (test_mode == 0 || test_mode == 10) {
+        test_coalesced_burst(g_client, 500);
+    }
+    
+    if (test_mode == 0 || test_mode == 11) {
+        test_channel_stream(g_client, 100000, 256);
+    }
+    
+    if (test_mode == 0 || test_mode == 12) {
+        test_publish(g_client);
+    }
+    
     printf("\n=== All Tests Complete ===\n");
     printf("Press Ctrl+C to exit or wait for disconnect...\n");
     
@@ -39,15 +39,16 @@ void signal_handler(int sig) {
 }
 
 void on_client_connected(mach_server_t *server, client_handle_t client, void *data) {
-    (void)server;
     (void)data;
     
     pthread_mutex_lock(&g_stats.lock);
     g_stats.active_clients++;
     pthread_mutex_unlock(&g_stats.lock);
     
-    printf("[CONNECT] Client %u connected (slot %d) - Total: %u\n", 
-           client.id, client.slot, g_stats.active_clients);
+    pid_t pid = 0;
+    mach_server_get_client_pid(server, client, &pid);
+    printf("[CONNECT] Client %u connected (slot %d, pid %d) - Total: %u\n", 
+           client.id, client.slot, (int)pid, g_stats.active_clients);
 }
 
 void on_client_disconnected(mach_server_t *server, client_handle_t client, void *data) {
@@ -109,6 +110,25 @@ void on_message(mach_server_t *server, client_handle_t client,
             break;
         }
         
+        case MSG_TYPE_PUBLISH_REQ: {
+            // Client requested a publish to the ticks topic
+            const char *msg = "TICK from server!";
+            ipc_status_t status = mach_server_publish(
+                server, STRESS_TOPIC_TICKS, msg, strlen(msg) + 1
+            );
+            if (status != IPC_SUCCESS) {
+                printf("[ERROR] Publish failed: %s\n", ipc_status_string(status));
+                pthread_mutex_lock(&g_stats.lock);
+                g_stats.errors++;
+                pthread_mutex_unlock(&g_stats.lock);
+            }
+            break;
+        }
+        
+        case MSG_TYPE_STREAM:
+            // Channel records, counted above
+            break;
+        
         default:
             printf("[UNKNOWN] Client %u sent unknown message type: %u\n", 
                    client.id, msg_type);
@@ -4,6 +4,8 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
 #include <mach/mach.h>
 #include <mach/mach_vm.h>
 
@@ -26,6 +28,12 @@
 #define INTERNAL_FEATURE_IACK   (1UL << 10)  // Is an acknowledgment (will be set/unset automatically)
 #define INTERNAL_FEATURE_LPCY   (1UL << 11)  // copy local copy instead of moving
 // #define INTERNAL_FEATURE_UPSH   (1UL << 12)  // User payload share instead of copy
+#define INTERNAL_FEATURE_INLN   (1UL << 13)  // Payloads are carried inline in the message body (will be set/unset automatically)
+#define INTERNAL_FEATURE_BTCH   (1UL << 14)  // User payload holds a batch of framed user messages (will be set/unset automatically)
+#define INTERNAL_FEATURE_SHRD   (1UL << 15)  // User payload is a read-only memory entry mapped on receive (will be set/unset automatically)
+#define INTERNAL_FEATURE_RPLY   (1UL << 16)  // Reply goes to the send-once right in the local port, not the client port (will be set/unset automatically)
+#define INTERNAL_FEATURE_PRIO   (1UL << 17)  // Handled on the priority lane of the sender, ahead of its queued messages
+#define INTERNAL_FEATURE_CMPT   (1UL << 18)  // Compact header inline in the body instead of internal_payload_t (will be set/unset automatically)
 
 /* Check if message ID belongs to our protocol */
 #define IS_THIS_PROTOCOL_MSG(id) \
@@ -47,6 +55,24 @@
 // #define HAS_FEATURE_UPSH(id) \
 //     (((id) & INTERNAL_FEATURE_UPSH) != 0)
 
+#define HAS_FEATURE_INLN(id) \
+    (((id) & INTERNAL_FEATURE_INLN) != 0)
+
+#define HAS_FEATURE_BTCH(id) \
+    (((id) & INTERNAL_FEATURE_BTCH) != 0)
+
+#define HAS_FEATURE_SHRD(id) \
+    (((id) & INTERNAL_FEATURE_SHRD) != 0)
+
+#define HAS_FEATURE_RPLY(id) \
+    (((id) & INTERNAL_FEATURE_RPLY) != 0)
+
+#define HAS_FEATURE_PRIO(id) \
+    (((id) & INTERNAL_FEATURE_PRIO) != 0)
+
+#define HAS_FEATURE_CMPT(id) \
+    (((id) & INTERNAL_FEATURE_CMPT) != 0)
+
 /* Check specific message type (ignoring features except internal/external) */
 #define IS_INTERNAL_MSG_TYPE(id, type) \
     (((id) & (0xFFF000FFUL | (INTERNAL_FEATURE_ITRN))) == ((INTERNAL_MSG_MAGIC) | (INTERNAL_FEATURE_ITRN) | (type)))
@@ -67,8 +93,16 @@
 /* Internal message types (framework control messages) */
 typedef enum {
     INTERNAL_MSG_TYPE_CONNECT = 1,
-    // INTERNAL_MSG_TYPE_DISCONNECT = 2,
+    INTERNAL_MSG_TYPE_DISCONNECT = 2,
     // INTERNAL_MSG_TYPE_DEATH_NOTIFY = 3,
+    INTERNAL_MSG_TYPE_CHANNEL = 4,
+    INTERNAL_MSG_TYPE_DOORBELL = 5,
+    INTERNAL_MSG_TYPE_SUBSCRIBE = 6,
+    INTERNAL_MSG_TYPE_UNSUBSCRIBE = 7,
+    INTERNAL_MSG_TYPE_PUBLISH = 8,
+    INTERNAL_MSG_TYPE_CREDIT = 9,
+    INTERNAL_MSG_TYPE_REPLY_PORT = 10,
+    INTERNAL_MSG_TYPE_WAKEUP = 11,
 } internal_msg_type_t;
 
 /* Construct internal message IDs */
@@ -79,10 +113,24 @@ typedef enum {
 
 /* Common message IDs */
 #define MSG_ID_CONNECT      INTERNAL_MSG_ID(INTERNAL_MSG_TYPE_CONNECT)
+#define MSG_ID_DISCONNECT   INTERNAL_MSG_ID(INTERNAL_MSG_TYPE_DISCONNECT)
+#define MSG_ID_CHANNEL      INTERNAL_MSG_ID(INTERNAL_MSG_TYPE_CHANNEL)
+#define MSG_ID_DOORBELL     INTERNAL_MSG_ID(INTERNAL_MSG_TYPE_DOORBELL)
+#define MSG_ID_SUBSCRIBE    INTERNAL_MSG_ID(INTERNAL_MSG_TYPE_SUBSCRIBE)
+#define MSG_ID_UNSUBSCRIBE  INTERNAL_MSG_ID(INTERNAL_MSG_TYPE_UNSUBSCRIBE)
+#define MSG_ID_PUBLISH      INTERNAL_MSG_ID(INTERNAL_MSG_TYPE_PUBLISH)
+#define MSG_ID_CREDIT       INTERNAL_MSG_ID(INTERNAL_MSG_TYPE_CREDIT)
+#define MSG_ID_REPLY_PORT   INTERNAL_MSG_ID(INTERNAL_MSG_TYPE_REPLY_PORT)
+#define MSG_ID_WAKEUP       INTERNAL_MSG_ID(INTERNAL_MSG_TYPE_WAKEUP)
 
 /* User message ID (pass through user's type, defaults to external unless internal is already set) */
 #define MSG_ID_USER(type)   EXTERNAL_MSG_ID(type)
 
+/* OR into a msg_type to have the server handle it before the messages of the
+ * client still queued (order is kept among priority messages). Handlers of
+ * one client still never run concurrently */
+#define IPC_MSG_PRIORITY    INTERNAL_FEATURE_PRIO
+
 /* ============================================================================
  * MACH IPC FRAMEWORK - Public API
  * 
@@ -94,6 +142,7 @@ typedef enum {
 /* Forward declarations - implementation details hidden */
 typedef struct mach_server mach_server_t;
 typedef struct mach_client mach_client_t;
+typedef struct mach_client_context mach_client_context_t;
 typedef struct mach_message mach_message_t;
 
 /* Client identifier - opaque to users */
@@ -123,9 +172,64 @@ typedef enum {
     IPC_ERROR_SEND_FAILED = -5,
     IPC_ERROR_INTERNAL = -6,
     IPC_ERROR_CLIENT_FULL = -7,
+    IPC_ERROR_WOULD_BLOCK = -8,
+    IPC_ERROR_QUOTA_EXCEEDED = -9,
     IPC_USER_BASE = 1000 // 1000+ space ment for custom user status codes
 } ipc_status_t;
 
+/* ============================================================================
+ * STATISTICS
+ * ============================================================================ */
+
+#define IPC_STATS_BUCKETS 32
+
+/* Latency histogram, bucket i counts samples in [2^i, 2^(i+1)) ns */
+typedef struct {
+    uint64_t count;
+    uint64_t sum_ns;
+    uint64_t max_ns;
+    uint64_t buckets[IPC_STATS_BUCKETS];
+} ipc_histogram_t;
+
+/* Counters since creation, all zero unless built with IPC_STATS=1 (default).
+ * Rates follow from two snapshots and their timestamps */
+typedef struct {
+    bool enabled;
+    uint64_t timestamp_ns;              // Monotonic time of the snapshot
+    
+    // Received user messages (a batch counts once, channel records singly)
+    uint64_t messages_received;
+    uint64_t bytes_received;
+    uint64_t deadline_expired;          // Rejected, user payload deadline passed
+    uint64_t deadline_dropped;          // Of these, rejected on arrival (never queued)
+    uint64_t flow_blocked;              // Sends refused for lack of credits
+    
+    // Sends of the whole process (the transport is shared)
+    uint64_t messages_sent;
+    uint64_t send_failures;
+    
+    // Acknowledgments
+    uint64_t acks_matched;
+    uint64_t acks_discarded;            // Late (after timeout) or unknown
+    uint32_t acks_pending;              // Requests waiting for an ack
+    uint32_t acks_pending_peak;
+    uint32_t acks_capacity;
+    
+    // Receive queues (the server sums its client queues)
+    uint32_t queue_depth;               // Dispatched, handler not finished yet
+    uint32_t queue_depth_peak;          // Deepest single queue seen
+    
+    // User payloads of queued messages (server only)
+    uint64_t queued_bytes;              // Summed over the clients
+    uint64_t queued_bytes_peak;         // Most one client had queued
+    uint64_t quota_rejected;            // Refused over a hard quota
+    uint64_t quota_disconnects;         // Clients dropped over a hard quota
+    
+    ipc_histogram_t queue_latency;      // Receive to handler start
+    ipc_histogram_t handler_latency;    // Handler duration
+    ipc_histogram_t round_trip;         // Request sent to ack received
+} ipc_stats_t;
+
 /* ============================================================================
  * SERVER API
  * ============================================================================ */
@@ -150,13 +254,57 @@ typedef struct {
                                    size_t *reply_size, void *user_data, int *reply_status);
 } server_callbacks_t;
 
+/* Server options - zero-initialize for defaults */
+typedef struct {
+    /* Number of receive threads (0 or 1 = only the thread calling mach_server_run).
+     * Each client is pinned to one thread, so per-client ordering is kept. */
+    int receiver_threads;
+    /* Maximum number of connected clients (0 = default of 100) */
+    int max_clients;
+    /* Unhandled messages a client may have queued at once (0 = unlimited),
+     * its sends fail with IPC_ERROR_WOULD_BLOCK beyond that */
+    uint32_t receive_window;
+    /* Time sends to a client wait for a credit (0 = fail at once) */
+    uint32_t send_wait_ms;
+    /* Queue length of the service and lane ports (0 = system default) */
+    uint32_t port_queue_limit;
+    /* Address space the cached regions of one client may take before unused
+     * ones are unmapped (0 = default of 256 MB) */
+    mach_vm_size_t region_cache_bytes;
+    /* Handlers of unordered message types running at once, over all
+     * clients (0 = number of CPUs) */
+    int worker_threads;
+    /* User payload bytes of the messages a client may have queued for its
+     * handlers (0 = unlimited). Over the soft quota its credits are held
+     * back until the backlog shrinks (needs receive_window). A message
+     * that would take it past the hard quota, or past client_quota_messages
+     * queued messages, is refused with IPC_ERROR_QUOTA_EXCEEDED, and with
+     * quota_disconnect the client is dropped on top */
+    mach_vm_size_t client_soft_quota_bytes;
+    mach_vm_size_t client_hard_quota_bytes;
+    uint32_t client_quota_messages;
+    bool quota_disconnect;
+} server_options_t;
+
 /* Create a server bound to a service name */
 mach_server_t* mach_server_create(const char *service_name, 
                                    const server_callbacks_t *callbacks,
                                    void *user_data);
 
+/* Create a server bound to a service name with options (NULL = defaults) */
+mach_server_t* mach_server_create_with_options(const char *service_name,
+                                               const server_callbacks_t *callbacks,
+                                               const server_options_t *options,
+                                               void *user_data);
+
 size_t mach_server_max_clients(mach_server_t *server);
 
+/* Handle messages of msg_type (without a batch) on the worker pool, so
+ * they run concurrently with any other message of the same client and
+ * in no particular order. Set before mach_server_run */
+ipc_status_t mach_server_set_unordered(mach_server_t *server, uint32_t msg_type,
+                                       bool unordered);
+
 /* Start the server (blocks until stopped or error) */
 ipc_status_t mach_server_run(mach_server_t *server);
 
@@ -167,19 +315,105 @@ void mach_server_stop(mach_server_t *server);
 ipc_status_t mach_server_send(mach_server_t *server, client_handle_t client,
                               uint32_t msg_type, const void *data, size_t size);
 
+/* mach_server_send with the data gathered from iovcnt segments. Several
+ * segments are gathered once, a large payload then moves to the client
+ * instead of being copied again. on_message gets it contiguous */
+ipc_status_t mach_server_sendv(mach_server_t *server, client_handle_t client,
+                               uint32_t msg_type, const struct iovec *iov, int iovcnt);
+
+/* One message of a batch */
+typedef struct {
+    uint32_t msg_type;
+    const void *data;
+    size_t size;
+} ipc_batch_entry_t;
+
+/* Send several messages to a client in one mach_msg (non-blocking),
+ * delivered to on_message one by one and in order */
+ipc_status_t mach_server_send_batch(mach_server_t *server, client_handle_t client,
+                                    const ipc_batch_entry_t *entries, size_t count);
+
 /* Send a message to a client and wait for reply (blocking with timeout) */
 ipc_status_t mach_server_send_with_reply(mach_server_t *server, client_handle_t client,
                                          uint32_t msg_type, const void *data, size_t size,
                                          const void **reply_data, size_t *reply_size,
                                          uint32_t timeout_ms);
 
-/* Broadcast to all connected clients */
+/* mach_server_send_with_reply with the data gathered from iovcnt segments */
+ipc_status_t mach_server_sendv_with_reply(mach_server_t *server, client_handle_t client,
+                                          uint32_t msg_type, const struct iovec *iov,
+                                          int iovcnt, const void **reply_data,
+                                          size_t *reply_size, uint32_t timeout_ms);
+
+/* Completion of an asynchronous request, runs on the client's queue.
+ * reply_data is only valid during the call. With IPC_ERROR_NOT_CONNECTED the
+ * client went away and the handle is dead, it must not be used anymore */
+typedef void (*server_reply_callback_t)(mach_server_t *server, client_handle_t client,
+                                        ipc_status_t status, const void *reply_data,
+                                        size_t reply_size, void *context);
+
+/* Send a message to a client without blocking, completion runs once the reply
+ * arrives or timeout_ms (0 = none) passes. Not called if sending fails */
+ipc_status_t mach_server_send_async(mach_server_t *server, client_handle_t client,
+                                    uint32_t msg_type, const void *data, size_t size,
+                                    uint32_t timeout_ms, server_reply_callback_t completion,
+                                    void *context);
+
+/* Client a broadcast could not be delivered to */
+typedef struct {
+    client_handle_t client;
+    ipc_status_t status;
+} broadcast_failure_t;
+
+/* Broadcast to all connected clients without blocking, clients with a full
+ * queue are skipped. Returns the status of the first failure */
 ipc_status_t mach_server_broadcast(mach_server_t *server, uint32_t msg_type,
                                    const void *data, size_t size);
 
+/* Broadcast waiting at most timeout_ms per client (0 = never block). The
+ * first failures_capacity failed clients are stored in failures, the total
+ * number of failures in *failure_count (optional) */
+ipc_status_t mach_server_broadcast_with_report(mach_server_t *server, uint32_t msg_type,
+                                               const void *data, size_t size,
+                                               uint32_t timeout_ms,
+                                               broadcast_failure_t *failures,
+                                               size_t failures_capacity,
+                                               size_t *failure_count);
+
+/* Send to the clients subscribed to topic without blocking (see
+ * mach_server_broadcast), they receive it through on_publish */
+ipc_status_t mach_server_publish(mach_server_t *server, uint32_t topic,
+                                 const void *data, size_t size);
+
 /* Get number of connected clients */
 int mach_server_client_count(mach_server_t *server);
 
+/* Map a memory entry the client sent (e.g. the remote port of a message) through
+ * the client's region cache, taking the send right. Mapping the same entry again
+ * hands out the cached address without a syscall. Mappings stay valid until
+ * released and evicted, or until the client disconnects */
+ipc_status_t mach_server_map_region(mach_server_t *server, client_handle_t client,
+                                    mach_port_t mem_object, mach_vm_size_t size, void **address);
+
+/* Done with a region of mach_server_map_region, it stays cached for reuse */
+ipc_status_t mach_server_release_region(mach_server_t *server, client_handle_t client,
+                                        const void *address);
+
+/* Process id of a client, taken from the kernel audit trailer of its connect */
+ipc_status_t mach_server_get_client_pid(mach_server_t *server, client_handle_t client, pid_t *pid);
+
+/* What a client has queued right now, against the quotas of server_options_t */
+typedef struct {
+    uint32_t queued_messages;
+    uint64_t queued_bytes;
+} ipc_client_usage_t;
+
+ipc_status_t mach_server_get_client_usage(mach_server_t *server, client_handle_t client,
+                                          ipc_client_usage_t *usage);
+
+/* Snapshot the server statistics (see ipc_stats_t) */
+ipc_status_t mach_server_get_stats(mach_server_t *server, ipc_stats_t *stats);
+
 /* Disconnect a specific client */
 void mach_server_disconnect_client(mach_server_t *server, client_handle_t client);
 
@@ -206,6 +440,10 @@ typedef struct {
     void* (*on_message_with_reply)(mach_client_t *client, mach_port_t *remote_port, uint32_t msg_type,
                                    const void *data, size_t size,
                                    size_t *reply_size, void *user_data, int *reply_status);
+    
+    /* Called when a message published to a subscribed topic arrives (optional) */
+    void (*on_publish)(mach_client_t *client, uint32_t topic,
+                       const void *data, size_t size, void *user_data);
 } client_callbacks_t;
 
 /* Create a client (doesn't connect yet) */
@@ -226,6 +464,72 @@ ipc_status_t mach_client_send_with_port(mach_client_t *client, mach_port_t local
 ipc_status_t mach_client_send(mach_client_t *client, uint32_t msg_type,
                               const void *data, size_t size);
 
+/* mach_client_send with the data gathered from iovcnt segments, e.g. a
+ * header and a body. Several segments are gathered once, a large payload
+ * then moves to the server instead of being copied again. on_message gets
+ * it contiguous */
+ipc_status_t mach_client_sendv(mach_client_t *client, uint32_t msg_type,
+                               const struct iovec *iov, int iovcnt);
+
+/* Send several messages to server in one mach_msg (non-blocking),
+ * delivered to on_message one by one and in order */
+ipc_status_t mach_client_send_batch(mach_client_t *client,
+                                    const ipc_batch_entry_t *entries, size_t count);
+
+/* Coalesce messages sent with mach_client_send into batches. Pending messages
+ * are flushed once max_bytes are buffered, max_delay_us after the first one
+ * was buffered (0 = no timer), or before any other send. max_bytes 0 disables
+ * coalescing. Errors of timer flushes are only logged */
+ipc_status_t mach_client_set_coalescing(mach_client_t *client, size_t max_bytes,
+                                        uint32_t max_delay_us);
+
+/* Configure flow control, before mach_client_connect. The server may have
+ * receive_window (0 = unlimited) of its messages unhandled here at once.
+ * Sends wait up to send_wait_ms (0 = never) for a credit of the server
+ * before failing with IPC_ERROR_WOULD_BLOCK. port_queue_limit sets the
+ * queue length of the receive port (0 = system default) */
+ipc_status_t mach_client_set_flow_control(mach_client_t *client, uint32_t receive_window,
+                                          uint32_t send_wait_ms, uint32_t port_queue_limit);
+
+/* Receive through a shared context instead of a thread of its own, before
+ * mach_client_connect. The client has to be destroyed before the context */
+ipc_status_t mach_client_set_context(mach_client_t *client, mach_client_context_t *context);
+
+/* Send coalesced messages now */
+ipc_status_t mach_client_flush(mach_client_t *client);
+
+/* Receive messages the server publishes to topic */
+ipc_status_t mach_client_subscribe(mach_client_t *client, uint32_t topic, uint32_t timeout_ms);
+
+/* Stop receiving messages published to topic */
+ipc_status_t mach_client_unsubscribe(mach_client_t *client, uint32_t topic, uint32_t timeout_ms);
+
+/* Open a shared memory ring of at least capacity bytes to the server.
+ * Channel messages reach on_message without a Mach message per send (the
+ * server only gets a doorbell when it went idle), their data points into
+ * the mapping and is only valid during the callback. They are not ordered
+ * with messages sent through the other send functions */
+ipc_status_t mach_client_open_channel(mach_client_t *client, size_t capacity,
+                                      uint32_t timeout_ms);
+
+/* Reserve size bytes in the channel to write a message in place, NULL if the
+ * ring is full, the channel is closed or size exceeds half the capacity. A
+ * successful reserve must be followed by mach_client_channel_commit */
+void* mach_client_channel_reserve(mach_client_t *client, size_t size);
+
+/* Publish the reserved message, size may be smaller than reserved */
+ipc_status_t mach_client_channel_commit(mach_client_t *client, uint32_t msg_type, size_t size);
+
+/* Copy a message into the channel, IPC_ERROR_WOULD_BLOCK if the ring is full */
+ipc_status_t mach_client_channel_send(mach_client_t *client, uint32_t msg_type,
+                                      const void *data, size_t size);
+
+/* Send a buffer of ipc_payload_alloc, its pages move to the server instead
+ * of being copied. The buffer belongs to the framework afterwards, also on
+ * failure. size may be smaller than allocated */
+ipc_status_t mach_client_send_owned(mach_client_t *client, uint32_t msg_type,
+                                    void *buffer, size_t size);
+
 /* Send a message and wait for reply (blocking with timeout) */
 ipc_status_t mach_client_send_with_port_and_reply(mach_client_t *client, mach_port_t local_port,
                                          uint32_t msg_type, const void *data, size_t size,
@@ -238,12 +542,49 @@ ipc_status_t mach_client_send_with_reply(mach_client_t *client, uint32_t msg_typ
                                          const void **reply_data, size_t *reply_size,
                                          uint32_t timeout_ms);
 
+/* mach_client_send_with_reply with the data gathered from iovcnt segments */
+ipc_status_t mach_client_sendv_with_reply(mach_client_t *client, uint32_t msg_type,
+                                          const struct iovec *iov, int iovcnt,
+                                          const void **reply_data, size_t *reply_size,
+                                          uint32_t timeout_ms);
+
+/* Like mach_client_send_with_reply, but the calling thread sends and receives
+ * the reply in one mach_msg on its own reply port. Lowest round trip latency,
+ * no port can be passed along */
+ipc_status_t mach_client_call(mach_client_t *client, uint32_t msg_type,
+                              const void *data, size_t size,
+                              const void **reply_data, size_t *reply_size,
+                              uint32_t timeout_ms);
+
+/* Completion of an asynchronous request, runs sequentially with the other
+ * client callbacks. reply_data is only valid during the call */
+typedef void (*client_reply_callback_t)(mach_client_t *client, ipc_status_t status,
+                                        const void *reply_data, size_t reply_size,
+                                        void *context);
+
+/* Send a message without blocking, completion runs once the reply arrives
+ * or timeout_ms (0 = none) passes. Not called if sending fails */
+ipc_status_t mach_client_send_async(mach_client_t *client, uint32_t msg_type,
+                                    const void *data, size_t size, uint32_t timeout_ms,
+                                    client_reply_callback_t completion, void *context);
+
+/* Snapshot the client statistics (see ipc_stats_t) */
+ipc_status_t mach_client_get_stats(mach_client_t *client, ipc_stats_t *stats);
+
 /* Disconnect from server */
 void mach_client_disconnect(mach_client_t *client);
 
 /* Cleanup and free client */
 void mach_client_destroy(mach_client_t *client);
 
+/* receiver_threads threads (0 = 1) receiving for every client attached with
+ * mach_client_set_context. Each client is pinned to one of them, so handlers
+ * of one client still run in order on its own queue */
+mach_client_context_t* mach_client_context_create(uint32_t receiver_threads);
+
+/* Stop the receivers and free the context, after its clients were destroyed */
+void mach_client_context_destroy(mach_client_context_t *context);
+
 /* ============================================================================
  * UTILITY FUNCTIONS
  * ============================================================================ */
@@ -256,12 +597,57 @@ void set_user_ipc_status_string(const char *(*_user_ipc_status_string)(ipc_statu
 // /* Allocate memory for reply data (use in callbacks) */
 void* ipc_alloc(size_t size);
 
+/* Allocate a reply buffer of on_message_with_reply from the server's arena,
+ * reused across calls. Replies larger than a page class are page-aligned
+ * and moved to the client instead of copied */
+void* ipc_reply_alloc(mach_server_t *server, size_t size);
+
 /* Free memory allocated by framework */
 void ipc_free(void *ptr);
 
 /* Free payload data */
 void ply_free(void *ptr, size_t size);
 
+/* Reference on the payload of a received message, see ipc_message_retain */
+typedef struct ipc_message ipc_message_t;
+
+/* Keep the payload of the message being handled valid after the callback
+ * returns, from on_message, on_message_with_reply or on_publish. *data is
+ * the pointer the callback got (or into it) and is updated to the one to
+ * use from now on: out-of-line payloads are taken over as they are, inline
+ * and channel ones copied once. Every retain needs an ipc_message_release,
+ * from any thread. NULL outside a callback or for empty payloads */
+ipc_message_t* ipc_message_retain(const void **data);
+
+/* Drop a reference, the last one frees the payload */
+void ipc_message_release(ipc_message_t *message);
+
+/* Allocate a page-aligned buffer for mach_client_send_owned */
+void* ipc_payload_alloc(size_t size);
+
+/* Free a buffer of ipc_payload_alloc that was not sent */
+void ipc_payload_free(void *ptr);
+
+/* Set the user payload size up to which messages are sent inline in the
+ * message body instead of out-of-line (clamped to the build-time maximum,
+ * 0 disables inlining) */
+void ipc_set_inline_threshold(size_t size);
+
+/* Get the current inline threshold */
+size_t ipc_get_inline_threshold(void);
+
+/* Receives every log line of the framework. Unless built with LOG_ASYNC=0
+ * it runs on a background thread, after the line was formatted on the
+ * logging thread. level is 0 (debug) to 3 (error), message has no newline */
+typedef void (*ipc_log_sink_t)(int level, const char *file, int line,
+                               uint64_t timestamp_ns, const char *message, void *context);
+
+/* Route the log to sink (NULL = stdout, errors to stderr), e.g. os_log */
+void ipc_set_log_sink(ipc_log_sink_t sink, void *context);
+
+/* Write out the lines still buffered (runs at exit too) */
+void ipc_log_flush(void);
+
 /* ============================================================================
  * SHARED MEMORY
  * ============================================================================ */
@@ -0,0 +1,131 @@
+#include "arena.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <mach/mach.h>
+#include <mach/mach_vm.h>
+#include <malloc/malloc.h>
+
+#define ARENA_PAGES_MAGIC 0x6172656e61706773ULL  // "arenapgs"
+
+// Page in front of a page block, the data starts on the next page
+typedef struct {
+    uint64_t magic;                 // ARENA_PAGES_MAGIC ^ data address
+    size_t size;                    // Data bytes, page rounded
+} arena_pages_t;
+
+static size_t class_size(int index) {
+    return (size_t)ARENA_MIN_CLASS << (2 * index);
+}
+
+static mach_vm_size_t round_pages(size_t size) {
+    return (size + vm_page_size - 1) & ~((mach_vm_size_t)vm_page_size - 1);
+}
+
+bool arena_init(arena_t *arena, int per_class) {
+    *arena = (arena_t){0};
+    for (int i = 0; i < ARENA_CLASSES; i++) {
+        if (!slab_init(&arena->classes[i], per_class, class_size(i))) {
+            arena_destroy(arena);
+            return false;
+        }
+    }
+    return true;
+}
+
+void* arena_alloc(arena_t *arena, size_t size) {
+    for (int i = 0; i < ARENA_CLASSES; i++) {
+        if (size <= class_size(i)) {
+            void *ptr = slab_alloc(&arena->classes[i]);
+            return ptr ? ptr : malloc(size ? size : 1);
+        }
+    }
+    
+    return arena_pages_alloc(size);
+}
+
+void* arena_pages_alloc(size_t size) {
+    mach_vm_size_t data_size = round_pages(size ? size : 1);
+    mach_vm_address_t address = 0;
+    kern_return_t kr = mach_vm_allocate(mach_task_self(), &address,
+                                        vm_page_size + data_size, VM_FLAGS_ANYWHERE);
+    if (kr != KERN_SUCCESS) {
+        return NULL;
+    }
+    *(arena_pages_t*)address = (arena_pages_t){
+        .magic = ARENA_PAGES_MAGIC ^ (address + vm_page_size),
+        .size = data_size
+    };
+    return (void*)(address + vm_page_size);
+}
+
+// Header of the page block at ptr, false if it isn't one. Read through the
+// kernel, in front of a foreign pointer there may be no mapping
+static bool read_pages_header(const void *ptr, arena_pages_t *header) {
+    mach_vm_address_t data = (mach_vm_address_t)ptr;
+    if (!data || (data & vm_page_mask) || data < vm_page_size) {
+        return false;
+    }
+    mach_vm_size_t read = 0;
+    kern_return_t kr = mach_vm_read_overwrite(mach_task_self(), data - vm_page_size,
+                                              sizeof(*header), (mach_vm_address_t)header,
+                                              &read);
+    return kr == KERN_SUCCESS && read == sizeof(*header) &&
+           header->magic == (ARENA_PAGES_MAGIC ^ data);
+}
+
+static int owning_class(arena_t *arena, const void *ptr) {
+    for (int i = 0; i < ARENA_CLASSES; i++) {
+        if (slab_owns(&arena->classes[i], ptr)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool arena_is_pages(arena_t *arena, const void *ptr) {
+    arena_pages_t header;
+    return ptr && owning_class(arena, ptr) < 0 && !malloc_zone_from_ptr(ptr) &&
+           read_pages_header(ptr, &header);
+}
+
+void arena_free(arena_t *arena, void *ptr, size_t used, bool moved) {
+    if (!ptr) {
+        return;
+    }
+    
+    int index = owning_class(arena, ptr);
+    if (index >= 0) {
+        slab_free(&arena->classes[index], ptr);
+        return;
+    }
+    if (malloc_zone_from_ptr(ptr)) {
+        free(ptr);
+        return;
+    }
+    
+    arena_pages_free(ptr, used, moved);
+}
+
+void arena_pages_free(void *ptr, size_t used, bool moved) {
+    arena_pages_t header;
+    if (!read_pages_header(ptr, &header)) {
+        return;
+    }
+    
+    mach_vm_address_t data = (mach_vm_address_t)ptr;
+    mach_vm_size_t data_size = header.size;
+    mach_vm_deallocate(mach_task_self(), data - vm_page_size, vm_page_size);
+    
+    // The moved pages left with the message, the unused tail is still ours
+    mach_vm_size_t gone = moved ? round_pages(used) : 0;
+    if (gone < data_size) {
+        mach_vm_deallocate(mach_task_self(), data + gone, data_size - gone);
+    }
+}
+
+void arena_destroy(void *arena) {
+    arena_t *self = (arena_t*)arena;
+    for (int i = 0; i < ARENA_CLASSES; i++) {
+        slab_destroy(&self->classes[i]);
+    }
+}
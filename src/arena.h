@@ -0,0 +1,46 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "slab.h"
+
+// Size classes of the slabs, larger blocks are whole pages
+#define ARENA_CLASSES 4
+#define ARENA_MIN_CLASS 64          // Classes grow by 4x up to 4096
+
+// Reusable buffers in size classes, safe to use from any thread. Blocks
+// beyond the largest class are page-aligned so their pages can be moved
+// to another task instead of copied
+typedef struct {
+    slab_t classes[ARENA_CLASSES];
+} arena_t;
+
+// Initialize with per_class buffers in each class, false if out of memory
+bool arena_init(arena_t *arena, int per_class);
+
+// Buffer of at least size bytes, from the heap once a class is exhausted
+// (NULL if out of memory)
+void* arena_alloc(arena_t *arena, size_t size);
+
+// Check whether a buffer is a page block, its first used bytes can be
+// sent with deallocate=true. Page blocks are tagged in their header page,
+// any other pointer is not one
+bool arena_is_pages(arena_t *arena, const void *ptr);
+
+// Page-aligned block of at least size bytes, without an arena (NULL if
+// out of memory)
+void* arena_pages_alloc(size_t size);
+
+// Release a page block, moved as in arena_free. Untagged pointers are ignored
+void arena_pages_free(void *ptr, size_t used, bool moved);
+
+// Release a buffer of arena_alloc. moved: the first used bytes of a page
+// block were sent with deallocate=true and are gone already. A pointer
+// neither of the arena, the heap nor a page block is left alone
+void arena_free(arena_t *arena, void *ptr, size_t used, bool moved);
+
+// Cleanup arena memory (outstanding slab buffers become invalid)
+void arena_destroy(void *arena);
+
+#endif // ARENA_H
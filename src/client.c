@@ -13,141 +13,319 @@
  * MESSAGE HANDLERS
  * ============================================================================ */
 
-static void handle_user_message(
-    mach_client_t *client,
-    mach_msg_header_t *header,
-    internal_payload_t *payload,
-    size_t payload_size,
-    const void *user_payload,
-    size_t user_payload_size
-) {
-    uint32_t user_msg_type = header->msgh_id & INTERNAL_MSG_TYPE_MASK;
-    bool needs_reply = HAS_FEATURE_WACK(header->msgh_id);
+/* Run the handler of one queued message and release its payloads (on message_queue) */
+static void deliver_user_message(mach_client_t *client, delivery_t *delivery) {
+    uint32_t msgh_id = delivery->msgh_id;
+    uint32_t user_msg_type = msgh_id & INTERNAL_MSG_TYPE_MASK;
+    bool needs_reply = HAS_FEATURE_WACK(msgh_id);
+    internal_payload_t *payload = delivery->payload;
+    const void *user_payload = delivery->user_payload;
+    size_t user_payload_size = delivery->user_payload_size;
+    mach_port_t remote_port = delivery->remote_port;
     
-    LOG_DEBUG_MSG("Received user message: type=%u, needs_reply=%d, has_user_payload=%d",
-                 user_msg_type, needs_reply, user_payload != NULL);
+    STATS_SINCE(client->stats.queue_latency, delivery->received_ns);
+    uint64_t handler_ns = STATS_NOW();
+    STATS_INTERVAL_BEGIN(signpost, "handle message");
     
-    // Dispatch to message queue for asynchronous processing
-    // Header will be overwritten, can only use copies in async dispatch
-    // But payload cleanup has been signaled as being handled here
-    // So it stays available without expensive copies
-    uint32_t msgh_id = header->msgh_id;
-    mach_port_t server_port = client->server_port;
-    uint64_t correlation_id = payload->correlation_id;
-    int correlation_slot = payload->correlation_slot;
-    uint32_t client_id = client->client_id;
-    int client_slot = client->client_slot;
-    struct timespec user_payload_deadline = payload->user_payload_deadline;
-    mach_port_t _remote_port = header->msgh_remote_port;
-    
-    dispatch_async(client->message_queue, ^{
-        bool user_payload_is_save =
-            has_no_deadline(user_payload_deadline) ||
-            !is_deadline_expired(user_payload_deadline, USER_PLY_SAFETY_MS);
-        mach_port_t remote_port = _remote_port;
-        if (needs_reply) {
-            // Message with reply
-            if (user_payload_is_save) {
-                if (client->callbacks.on_message_with_reply) {
-                    size_t reply_size = 0;
-                    int reply_status = IPC_SUCCESS;
-                    void *reply_data = client->callbacks.on_message_with_reply(
-                        client,
-                        &remote_port,
-                        user_msg_type,
-                        user_payload,
-                        user_payload_size,
-                        &reply_size,
-                        client->user_data,
-                        &reply_status
-                    );
-                    
-                    // Send acknowledgment
-                    internal_payload_t ack = (internal_payload_t){
-                        .client_id = client_id,
-                        .client_slot = client_slot,
-                        .status = reply_status
-                    };
-                    protocol_send_ack(
-                        server_port,
-                        msgh_id,
-                        correlation_id,
-                        correlation_slot,
-                        &ack,
-                        sizeof(ack),
-                        reply_data,
-                        reply_size
-                    );
-                    
-                    ipc_free(reply_data);
-                }
-            } else {
-                // User payload considered dangerous
-                LOG_ERROR_MSG("Message with id=%u and reply rejected because the user payload has reached it's deadline", msgh_id);
+    bool user_payload_is_save =
+        has_no_deadline(payload->user_payload_deadline) ||
+        !is_deadline_expired(payload->user_payload_deadline, USER_PLY_SAFETY_MS);
+    if (!user_payload_is_save) {
+        STATS_INC(client->stats.deadline_expired);
+    }
+    
+    // Out-of-line payloads are regions ipc_message_retain can take
+    handler_scope_t scope;
+    protocol_scope_enter(&scope, user_payload, user_payload_size, !HAS_FEATURE_INLN(msgh_id));
+    
+    if (needs_reply) {
+        // Message with reply
+        if (user_payload_is_save) {
+            if (client->callbacks.on_message_with_reply) {
+                size_t reply_size = 0;
+                int reply_status = IPC_SUCCESS;
+                void *reply_data = client->callbacks.on_message_with_reply(
+                    client,
+                    &remote_port,
+                    user_msg_type,
+                    user_payload,
+                    user_payload_size,
+                    &reply_size,
+                    client->user_data,
+                    &reply_status
+                );
+                
+                // Send acknowledgment
                 internal_payload_t ack = (internal_payload_t){
-                    .client_id = client_id,
-                    .client_slot = client_slot,
-                    .status = IPC_ERROR_TIMEOUT
+                    .client_id = client->client_id,
+                    .client_slot = client->client_slot,
+                    .status = reply_status
                 };
                 protocol_send_ack(
-                    server_port,
+                    SERVER_ACK_PORT(client),
+                    MACH_PORT_NULL,
                     msgh_id,
-                    correlation_id,
-                    correlation_slot,
+                    payload->correlation_id,
+                    payload->correlation_slot,
                     &ack,
                     sizeof(ack),
-                    NULL,
-                    0
+                    reply_data,
+                    reply_size,
+                    false
                 );
+                
+                ipc_free(reply_data);
             }
         } else {
-            // Fire-and-forget message
-            if (user_payload_is_save) {
-                // User payload considered save
-                if (client->callbacks.on_message) {
+            // User payload considered dangerous
+            LOG_ERROR_MSG("Message with id=%u and reply rejected because the user payload has reached it's deadline", msgh_id);
+            internal_payload_t ack = (internal_payload_t){
+                .client_id = client->client_id,
+                .client_slot = client->client_slot,
+                .status = IPC_ERROR_TIMEOUT
+            };
+            protocol_send_ack(
+                SERVER_ACK_PORT(client),
+                MACH_PORT_NULL,
+                msgh_id,
+                payload->correlation_id,
+                payload->correlation_slot,
+                &ack,
+                sizeof(ack),
+                NULL,
+                0,
+                false
+            );
+        }
+    } else {
+        // Fire-and-forget message
+        if (user_payload_is_save) {
+            // User payload considered save
+            if (client->callbacks.on_message && HAS_FEATURE_BTCH(msgh_id)) {
+                // Batch, one callback per record
+                size_t offset = 0;
+                uint32_t record_type;
+                const void *record_data;
+                size_t record_size;
+                while (protocol_batch_next(user_payload, user_payload_size, &offset,
+                                           &record_type, &record_data, &record_size)) {
                     client->callbacks.on_message(
                         client,
                         &remote_port,
-                        user_msg_type,
-                        user_payload,
-                        user_payload_size,
+                        record_type & INTERNAL_MSG_TYPE_MASK,
+                        record_data,
+                        record_size,
                         client->user_data
                     );
                 }
-            } else {
-                // User payload considered dangerous
-                LOG_ERROR_MSG("Message with id=%u ignored because the user payload has reached it's deadline", msgh_id);
-            }
-        }
-        
-        // Cleanup after processing
-        kern_return_t kr;
-        if (remote_port != MACH_PORT_NULL) {
-            kr = mach_port_deallocate(mach_task_self(), remote_port);
-            if (kr != KERN_SUCCESS) {
-                LOG_ERROR_MSG("Failed to clean remote port: 0x%x (%s)", kr, mach_error_string(kr));
+            } else if (client->callbacks.on_message) {
+                client->callbacks.on_message(
+                    client,
+                    &remote_port,
+                    user_msg_type,
+                    user_payload,
+                    user_payload_size,
+                    client->user_data
+                );
             }
+        } else {
+            // User payload considered dangerous
+            LOG_ERROR_MSG("Message with id=%u ignored because the user payload has reached it's deadline", msgh_id);
         }
-        kr = vm_deallocate(mach_task_self(), (vm_address_t)payload, payload_size);
+    }
+    bool retained = protocol_scope_leave(&scope);
+    
+    STATS_INTERVAL_END(signpost, "handle message");
+    STATS_SINCE(client->stats.handler_latency, handler_ns);
+    STATS_DEC(client->stats.queue_depth);
+    
+    // Cleanup after processing
+    kern_return_t kr;
+    if (remote_port != MACH_PORT_NULL) {
+        kr = mach_port_deallocate(mach_task_self(), remote_port);
         if (kr != KERN_SUCCESS) {
-            LOG_ERROR_MSG("Failed to clean payload: 0x%x (%s)", kr, mach_error_string(kr));
+            LOG_ERROR_MSG("Failed to clean remote port: 0x%x (%s)", kr, mach_error_string(kr));
         }
-        if (user_payload && user_payload_size) {
-            kr = vm_deallocate(mach_task_self(), (vm_address_t)user_payload, user_payload_size);
-            if (kr != KERN_SUCCESS) {
-                LOG_ERROR_MSG("Failed to clean user payload: 0x%x (%s)", kr, mach_error_string(kr));
+    }
+    protocol_release_payload(msgh_id, payload, delivery->payload_size,
+                             retained ? NULL : user_payload, retained ? 0 : user_payload_size);
+}
+
+/* Hand handled messages back to the server as credits */
+static void return_credits(mach_client_t *client, uint32_t credits) {
+    if (!client->connected) {
+        // Arrived ahead of the connect ack, the server doesn't know our id yet
+        atomic_fetch_add_explicit(&client->flow.owed, credits, memory_order_relaxed);
+        return;
+    }
+    
+    internal_payload_t payload = (internal_payload_t){
+        .client_id = client->client_id,
+        .client_slot = client->client_slot,
+        .status = IPC_SUCCESS,
+        .credits = credits
+    };
+    kern_return_t kr = protocol_send_message(client->send_port, MACH_PORT_NULL,
+                                             WIRE_MSG_ID(client, MSG_ID_CREDIT),
+                                             &payload, sizeof(payload), NULL, 0, 0);
+    if (kr != KERN_SUCCESS) {
+        // Carried by the next return
+        atomic_fetch_add_explicit(&client->flow.owed, credits, memory_order_relaxed);
+    }
+}
+
+/* A message of the server was handled or dropped */
+static void message_handled(mach_client_t *client) {
+    uint32_t credits = flow_handled(&client->flow);
+    if (credits) {
+        return_credits(client, credits);
+    }
+}
+
+/* Run the on_publish handler of one queued publish (on message_queue) */
+static void deliver_publish(mach_client_t *client, delivery_t *delivery) {
+    uint32_t msgh_id = delivery->msgh_id;
+    const void *user_payload = delivery->user_payload;
+    size_t user_payload_size = delivery->user_payload_size;
+    
+    STATS_SINCE(client->stats.queue_latency, delivery->received_ns);
+    uint64_t handler_ns = STATS_NOW();
+    
+    handler_scope_t scope;
+    protocol_scope_enter(&scope, user_payload, user_payload_size, !HAS_FEATURE_INLN(msgh_id));
+    client->callbacks.on_publish(client, delivery->payload->topic, user_payload,
+                                 user_payload_size, client->user_data);
+    bool retained = protocol_scope_leave(&scope);
+    
+    STATS_SINCE(client->stats.handler_latency, handler_ns);
+    STATS_DEC(client->stats.queue_depth);
+    
+    if (delivery->remote_port != MACH_PORT_NULL) {
+        mach_port_deallocate(mach_task_self(), delivery->remote_port);
+    }
+    protocol_release_payload(msgh_id, delivery->payload, delivery->payload_size,
+                             retained ? NULL : user_payload, retained ? 0 : user_payload_size);
+}
+
+/* Drain everything queued, scheduled once per empty to non-empty transition.
+ * Publishes share the queue, so they keep their order with user messages */
+static void drain_deliveries(void *context) {
+    mach_client_t *client = (mach_client_t*)context;
+    
+    do {
+        mpsc_node_t *node;
+        while ((node = mpsc_pop(&client->deliveries))) {
+            delivery_t *delivery = (delivery_t*)node;
+            if (IS_INTERNAL_MSG_TYPE(delivery->msgh_id, INTERNAL_MSG_TYPE_PUBLISH)) {
+                deliver_publish(client, delivery);
+            } else {
+                deliver_user_message(client, delivery);
             }
+            delivery_free(&client->delivery_slab, delivery);
+            message_handled(client);
         }
-    });
+    } while (mpsc_finish(&client->deliveries));
 }
 
-static void handle_death_notification(mach_client_t *client, mach_msg_header_t *header) {
-    (void)header;
+/* Queue a user message or publish for drain_deliveries, false if it was
+ * dropped (its payloads are still the caller's then) */
+static bool queue_delivery(
+    mach_client_t *client,
+    mach_msg_header_t *header,
+    internal_payload_t *payload,
+    size_t payload_size,
+    const void *user_payload,
+    size_t user_payload_size
+) {
+    uint32_t msgh_id = header->msgh_id;
     
-    LOG_INFO_MSG("Server died");
+    delivery_t *delivery = delivery_alloc(&client->delivery_slab);
+    if (!delivery) {
+        message_handled(client);
+        LOG_ERROR_MSG("Failed to queue message");
+        return false;
+    }
     
-    client->connected = 0;
+    // Queue for sequential processing
+    // Header will be overwritten, so the record holds copies
+    // But payload cleanup has been signaled as being handled here
+    // So it stays available without expensive copies
+    if (!protocol_detach_payload(msgh_id, &payload, payload_size,
+                                 &user_payload, user_payload_size)) {
+        delivery_free(&client->delivery_slab, delivery);
+        message_handled(client);
+        return false;
+    }
+    
+    delivery->msgh_id = msgh_id;
+    delivery->payload = payload;
+    delivery->payload_size = payload_size;
+    delivery->user_payload = user_payload;
+    delivery->user_payload_size = user_payload_size;
+    delivery->remote_port = header->msgh_remote_port;
+    delivery->received_ns = STATS_NOW();
+    
+    // One queue, so its depth is also the deepest
+    STATS_INC(client->stats.messages_received);
+    STATS_ADD(client->stats.bytes_received, user_payload_size);
+    STATS_MAX(client->stats.queue_depth_peak, STATS_INC(client->stats.queue_depth) + 1);
+    
+    if (mpsc_push(&client->deliveries, &delivery->node)) {
+        dispatch_async_f(client->message_queue, client, drain_deliveries);
+    }
+
+    return true;
+}
+
+static bool handle_user_message(
+    mach_client_t *client,
+    mach_msg_header_t *header,
+    internal_payload_t *payload,
+    size_t payload_size,
+    const void *user_payload,
+    size_t user_payload_size
+) {
+    LOG_DEBUG_MSG("Received user message: type=%u, needs_reply=%d, has_user_payload=%d",
+                 header->msgh_id & INTERNAL_MSG_TYPE_MASK, HAS_FEATURE_WACK(header->msgh_id),
+                 user_payload != NULL);
+    
+    return queue_delivery(client, header, payload, payload_size,
+                          user_payload, user_payload_size);
+}
+
+static bool handle_publish_message(
+    mach_client_t *client,
+    mach_msg_header_t *header,
+    internal_payload_t *payload,
+    size_t payload_size,
+    const void *user_payload,
+    size_t user_payload_size
+) {
+    if (!client->callbacks.on_publish) {
+        message_handled(client);
+        return false;
+    }
+    return queue_delivery(client, header, payload, payload_size,
+                          user_payload, user_payload_size);
+}
+
+/* Receive loops block until a message arrives, wake them to see the flag */
+static void stop_receivers(mach_client_t *client) {
     client->running = 0;
+    if (!client->context) {
+        protocol_wakeup(client->local_port, 1);
+    }
+    protocol_wakeup(client->reply_port, 1);
+}
+
+/* The server is gone or dropped us, on a receiver thread. Once only, its
+ * death may still follow a disconnect notice */
+static void handle_disconnect(mach_client_t *client) {
+    if (!client->connected) {
+        return;
+    }
+    client->connected = 0;
+    stop_receivers(client);
     
     // Notify user
     if (client->callbacks.on_disconnected) {
@@ -155,6 +333,13 @@ static void handle_death_notification(mach_client_t *client, mach_msg_header_t *
     }
 }
 
+static void handle_death_notification(mach_client_t *client, mach_msg_header_t *header) {
+    (void)header;
+    
+    LOG_INFO_MSG("Server died");
+    handle_disconnect(client);
+}
+
 static bool client_message_handler(
     mach_port_t service_port,
     mach_msg_header_t *header,
@@ -177,10 +362,20 @@ static bool client_message_handler(
     
     // Handle our protocol messages
     if (IS_INTERNAL_MSG(header->msgh_id)) {
-        
+        if (IS_INTERNAL_MSG_TYPE(header->msgh_id, INTERNAL_MSG_TYPE_PUBLISH)) {
+            // Payload cleanup handled by async dispatch unless the message was dropped
+            return !handle_publish_message(client, header, payload, payload_size,
+                                           user_payload, user_payload_size);
+        } else if (IS_INTERNAL_MSG_TYPE(header->msgh_id, INTERNAL_MSG_TYPE_CREDIT)) {
+            flow_release(&client->flow, &client->flow_wait, payload->credits);
+        } else if (IS_INTERNAL_MSG_TYPE(header->msgh_id, INTERNAL_MSG_TYPE_DISCONNECT)) {
+            LOG_WARN_MSG("Disconnected by the server (status=%d)", payload->status);
+            handle_disconnect(client);
+        }
     } else if (IS_EXTERNAL_MSG(header->msgh_id)) {
-        handle_user_message(client, header, payload, payload_size, user_payload, user_payload_size);
-        return false;  // Payload cleanup handled by async dispatch
+        // Payload cleanup handled by async dispatch unless the message was dropped
+        return !handle_user_message(client, header, payload, payload_size,
+                                    user_payload, user_payload_size);
     }
 
     return true;
@@ -198,8 +393,7 @@ static void* client_receiver_thread(void *arg) {
     protocol_receive_loop(
         client->local_port,
         &client->running,
-        &client->ack_pool,
-        &client->ack_lock,
+        &client->acks,
         client_message_handler,
         client
     );
@@ -208,216 +402,1074 @@ static void* client_receiver_thread(void *arg) {
     return NULL;
 }
 
-/* ============================================================================
- * PUBLIC API
- * ============================================================================ */
-
-mach_client_t* mach_client_create(
-    const client_callbacks_t *callbacks,
-    void *user_data
-) {
-    mach_client_t *client = calloc(1, sizeof(mach_client_t));
-    if (!client) return NULL;
-    
-    // Initialize resource tracker
-    client->resources = resource_tracker_create();
-    if (!client->resources) {
-        free(client);
-        return NULL;
-    }
-    
-    // Initialize pools
-    pool_init(&client->ack_pool, MAX_ACKS, sizeof(ack_waiter_t));
-    resource_tracker_add(client->resources, RES_TYPE_POOL, &client->ack_pool,
-                        (void(*)(void*))pool_free, "ack_pool");
-    
-    // Create message processing queue
-    client->message_queue = dispatch_queue_create("com.ipc.client.messages", 
-                                                  DISPATCH_QUEUE_SERIAL);
-    if (!client->message_queue) {
-        resource_tracker_cleanup_all(client->resources);
-        resource_tracker_destroy(client->resources);
-        free(client);
-        return NULL;
-    }
-    resource_tracker_add(client->resources, RES_TYPE_QUEUE, &client->message_queue,
-                        (void(*)(void*))dispatch_release, "message_queue");
-    
-    // Initialize lock
-    pthread_mutex_init(&client->ack_lock, NULL);
-    resource_tracker_add(client->resources, RES_TYPE_MUTEX, &client->ack_lock,
-                        (void(*)(void*))pthread_mutex_destroy, "ack_lock");
-    
-    client->next_correlation_id = 1;
-    
-    if (callbacks) {
-        client->callbacks = *callbacks;
-    }
-    client->user_data = user_data;
+static void* client_reply_thread(void *arg) {
+    mach_client_t *client = (mach_client_t*)arg;
     
-    LOG_INFO_MSG("Client created");
-    return client;
+    protocol_receive_loop(
+        client->reply_port,
+        &client->running,
+        &client->acks,
+        protocol_drop_message,
+        client
+    );
+    return NULL;
 }
 
-ipc_status_t mach_client_connect(
-    mach_client_t *client,
-    const char *service_name,
-    uint32_t timeout_ms
-) {
-    if (!client || !service_name) {
-        return IPC_ERROR_INVALID_PARAM;
-    }
-    
-    if (client->connected) {
-        return IPC_ERROR_INTERNAL;
-    }
-    
-    strncpy(client->service_name, service_name, sizeof(client->service_name) - 1);
-    
-    // Lookup server
-    kern_return_t kr = bootstrap_look_up(
-        bootstrap_port,
-        service_name,
-        &client->server_port
-    );
-    
-    if (kr != KERN_SUCCESS) {
-        LOG_ERROR_MSG("Failed to lookup service '%s': %s",
-                     service_name, mach_error_string(kr));
-        return IPC_ERROR_NOT_CONNECTED;
-    }
-    
-    resource_tracker_add(client->resources, RES_TYPE_PORT, &client->server_port,
-                        NULL, "server_port");
-    
-    // Create local receive port
-    kr = mach_port_allocate(mach_task_self(), MACH_PORT_RIGHT_RECEIVE,
-                           &client->local_port);
+/* Create the reply port and its receiver, acks only move there once exchanged */
+static bool start_reply_port(mach_client_t *client) {
+    kern_return_t kr = mach_port_allocate(mach_task_self(), MACH_PORT_RIGHT_RECEIVE,
+                                          &client->reply_port);
     if (kr != KERN_SUCCESS) {
-        LOG_ERROR_MSG("Failed to allocate local port: %s", mach_error_string(kr));
-        return IPC_ERROR_INTERNAL;
+        LOG_ERROR_MSG("Failed to allocate reply port: %s", mach_error_string(kr));
+        return false;
     }
+    resource_tracker_add(client->resources, RES_TYPE_PORT, &client->reply_port,
+                        NULL, "reply_port");
     
-    resource_tracker_add(client->resources, RES_TYPE_PORT, &client->local_port,
-                        NULL, "local_port");
-    
-    // Add send right
-    kr = mach_port_insert_right(mach_task_self(), client->local_port,
-                               client->local_port, MACH_MSG_TYPE_MAKE_SEND);
-    if (kr != KERN_SUCCESS) {
-        LOG_ERROR_MSG("Failed to insert send right: %s", mach_error_string(kr));
-        return IPC_ERROR_INTERNAL;
+    if (pthread_create(&client->reply_thread, NULL, client_reply_thread, client) != 0) {
+        LOG_ERROR_MSG("Failed to create reply thread");
+        return false;
     }
-    
-    // Setup death notification for server
-    kr = mach_port_request_notification(
-        mach_task_self(),
-        client->server_port,
-        MACH_NOTIFY_DEAD_NAME,
-        1,
-        client->local_port,
-        MACH_MSG_TYPE_MAKE_SEND_ONCE,
-        &(mach_port_t){MACH_PORT_NULL}
-    );
-    
+    resource_tracker_add(client->resources, RES_TYPE_THREAD, &client->reply_thread,
+                        NULL, "reply_thread");
+    return true;
+}
+
+/* Swap reply ports with the server. On failure both sides keep acking to the
+ * ports user messages travel on */
+static void exchange_reply_ports(mach_client_t *client, uint32_t timeout_ms) {
+    kern_return_t kr = mach_port_insert_right(mach_task_self(), client->reply_port,
+                                              client->reply_port, MACH_MSG_TYPE_MAKE_SEND);
     if (kr != KERN_SUCCESS) {
-        LOG_ERROR_MSG("Failed to setup death notification: %s",
-                     mach_error_string(kr));
-        return IPC_ERROR_INTERNAL;
+        LOG_ERROR_MSG("Failed to make reply send right: %s", mach_error_string(kr));
+        return;
     }
     
-    // Start receiver thread
-    client->running = 1;
-    int err = pthread_create(&client->receiver_thread, NULL,
-                            client_receiver_thread, client);
-    if (err != 0) {
-        LOG_ERROR_MSG("Failed to create receiver thread");
-        client->running = 0;
-        return IPC_ERROR_INTERNAL;
-    }
-    
-    resource_tracker_add(client->resources, RES_TYPE_THREAD, &client->receiver_thread,
-                        NULL, "receiver_thread");
-    
-    // Send connect message
     internal_payload_t payload = (internal_payload_t){
-        .client_id = 0,    // Will be assigned by server
-        .client_slot = -1, // Will be assigned by server
+        .client_id = client->client_id,
+        .client_slot = client->client_slot,
         .status = IPC_SUCCESS
     };
     
-    internal_payload_t *ack_payload = NULL;
-    size_t ack_size = 0;
+    internal_payload_t ack_payload;
     const void *ack_user_payload = NULL;
     size_t ack_user_size = 0;
+    mach_port_t server_reply = MACH_PORT_NULL;
     
     kr = protocol_send_with_ack(
-        client->server_port,
-        client->local_port,
-        &client->ack_pool,
-        &client->ack_lock,
-        &client->next_correlation_id,
-        MSG_ID_CONNECT,
+        client->send_port,
+        client->reply_port,
+        &client->acks,
+        MSG_ID_REPLY_PORT,
         &payload,
         sizeof(payload),
         NULL,
         0,
         &ack_payload,
-        &ack_size,
         &ack_user_payload,
         &ack_user_size,
+        &server_reply,
         timeout_ms
     );
     
     if (kr != KERN_SUCCESS) {
-        LOG_ERROR_MSG("Connect failed: %s", mach_error_string(kr));
-        return kr == KERN_OPERATION_TIMED_OUT ? IPC_ERROR_TIMEOUT : IPC_ERROR_SEND_FAILED;
+        if (kr != KERN_OPERATION_TIMED_OUT) {
+            // Unsent, so the send right is still ours
+            mach_port_deallocate(mach_task_self(), client->reply_port);
+        }
+        LOG_WARN_MSG("Reply port exchange failed: %s", mach_error_string(kr));
+        return;
     }
+    ply_free((void*)ack_user_payload, ack_user_size);
     
-    if (!ack_payload) {
-        LOG_ERROR_MSG("Connect ack missing");
-        ply_free((void*)ack_user_payload, ack_user_size);
-        return IPC_ERROR_INTERNAL;
+    if (server_reply == MACH_PORT_NULL) {
+        LOG_WARN_MSG("Server has no reply port (status=%d)", ack_payload.status);
+        return;
     }
+    client->ack_port = server_reply;
+    resource_tracker_add(client->resources, RES_TYPE_PORT, &client->ack_port,
+                        NULL, "ack_port");
+}
+
+/* ============================================================================
+ * CLIENT CONTEXT
+ * ============================================================================ */
+
+static bool context_route(mach_port_t local_port, receive_target_t *target, void *arg) {
+    context_receiver_t *receiver = (context_receiver_t*)arg;
     
-    if (ack_payload->status != IPC_SUCCESS) {
-        LOG_ERROR_MSG("Connect rejected by server (status=%d)", ack_payload->status);
-        ply_free((void*)ack_payload, ack_size);
-        ply_free((void*)ack_user_payload, ack_user_size);
-        return ack_payload->status;
+    mach_client_t *client = receiver->buckets[CONTEXT_PORT_BUCKET(receiver, local_port)];
+    while (client && client->local_port != local_port) {
+        client = client->context_next;
     }
+    if (!client) {
+        return false;
+    }
+    *target = (receive_target_t){
+        .port = local_port,
+        .acks = &client->acks,
+        .handler = client_message_handler,
+        .context = client
+    };
+    return true;
+}
+
+static void* context_receiver_thread(void *arg) {
+    context_receiver_t *receiver = (context_receiver_t*)arg;
     
-    client->client_id = ack_payload->client_id;
-    client->client_slot = ack_payload->client_slot;
-    client->connected = 1;
+    protocol_receive_set_loop(
+        receiver->port_set,
+        &receiver->context->running,
+        &receiver->members_lock,
+        context_route,
+        receiver
+    );
+    return NULL;
+}
+
+// Members lock held exclusively
+static bool context_grow_buckets(context_receiver_t *receiver) {
+    uint32_t count = (receiver->bucket_mask + 1) * 2;
+    mach_client_t **buckets = calloc(count, sizeof(*buckets));
+    if (!buckets) {
+        return false;
+    }
+    
+    mach_client_t **old = receiver->buckets;
+    uint32_t old_count = receiver->bucket_mask + 1;
+    receiver->buckets = buckets;
+    receiver->bucket_mask = count - 1;
+    for (uint32_t i = 0; i < old_count; i++) {
+        mach_client_t *client = old[i];
+        while (client) {
+            mach_client_t *next = client->context_next;
+            uint32_t bucket = CONTEXT_PORT_BUCKET(receiver, client->local_port);
+            client->context_next = buckets[bucket];
+            buckets[bucket] = client;
+            client = next;
+        }
+    }
+    free(old);
+    return true;
+}
+
+static bool context_attach(mach_client_t *client) {
+    mach_client_context_t *context = client->context;
+    uint32_t index = atomic_fetch_add_explicit(&context->next_receiver, 1,
+                                               memory_order_relaxed);
+    context_receiver_t *receiver = &context->receivers[index % context->receiver_count];
+    
+    pthread_rwlock_wrlock(&receiver->members_lock);
+    if (receiver->member_count > receiver->bucket_mask && !context_grow_buckets(receiver)) {
+        pthread_rwlock_unlock(&receiver->members_lock);
+        return false;
+    }
+    
+    kern_return_t kr = mach_port_insert_member(mach_task_self(), client->local_port,
+                                               receiver->port_set);
+    if (kr != KERN_SUCCESS) {
+        pthread_rwlock_unlock(&receiver->members_lock);
+        LOG_ERROR_MSG("Failed to add local port to context: %s", mach_error_string(kr));
+        return false;
+    }
+    uint32_t bucket = CONTEXT_PORT_BUCKET(receiver, client->local_port);
+    client->context_next = receiver->buckets[bucket];
+    receiver->buckets[bucket] = client;
+    receiver->member_count++;
+    client->context_receiver = receiver;
+    pthread_rwlock_unlock(&receiver->members_lock);
+    return true;
+}
+
+// Waits for the receiver if it is still dispatching to the client
+static void context_detach(mach_client_t *client) {
+    context_receiver_t *receiver = client->context_receiver;
+    if (!receiver) {
+        return;
+    }
+    
+    pthread_rwlock_wrlock(&receiver->members_lock);
+    mach_client_t **link = &receiver->buckets[CONTEXT_PORT_BUCKET(receiver, client->local_port)];
+    while (*link && *link != client) {
+        link = &(*link)->context_next;
+    }
+    if (*link) {
+        // Queued messages stay on the port and go with it
+        mach_port_extract_member(mach_task_self(), client->local_port, receiver->port_set);
+        *link = client->context_next;
+        receiver->member_count--;
+    }
+    client->context_receiver = NULL;
+    client->context_next = NULL;
+    pthread_rwlock_unlock(&receiver->members_lock);
+}
+
+static void context_receiver_destroy(context_receiver_t *receiver) {
+    if (receiver->wakeup_port != MACH_PORT_NULL) {
+        mach_port_mod_refs(mach_task_self(), receiver->wakeup_port, MACH_PORT_RIGHT_RECEIVE, -1);
+    }
+    if (receiver->port_set != MACH_PORT_NULL) {
+        mach_port_mod_refs(mach_task_self(), receiver->port_set, MACH_PORT_RIGHT_PORT_SET, -1);
+    }
+    pthread_rwlock_destroy(&receiver->members_lock);
+    free(receiver->buckets);
+}
+
+static bool context_receiver_init(mach_client_context_t *context, context_receiver_t *receiver) {
+    receiver->context = context;
+    receiver->bucket_mask = 15;
+    receiver->buckets = calloc(receiver->bucket_mask + 1, sizeof(*receiver->buckets));
+    if (!receiver->buckets) {
+        return false;
+    }
+    pthread_rwlock_init(&receiver->members_lock, NULL);
+    
+    kern_return_t kr = mach_port_allocate(mach_task_self(), MACH_PORT_RIGHT_PORT_SET,
+                                          &receiver->port_set);
+    if (kr != KERN_SUCCESS) {
+        LOG_ERROR_MSG("Failed to allocate port set: %s", mach_error_string(kr));
+        receiver->port_set = MACH_PORT_NULL;
+        context_receiver_destroy(receiver);
+        return false;
+    }
+    
+    // The receiver blocks on the set, destroy wakes it through this member
+    kr = mach_port_allocate(mach_task_self(), MACH_PORT_RIGHT_RECEIVE, &receiver->wakeup_port);
+    if (kr != KERN_SUCCESS) {
+        receiver->wakeup_port = MACH_PORT_NULL;
+    } else {
+        kr = mach_port_move_member(mach_task_self(), receiver->wakeup_port, receiver->port_set);
+    }
+    if (kr != KERN_SUCCESS) {
+        LOG_ERROR_MSG("Failed to create context wakeup port: %s", mach_error_string(kr));
+        context_receiver_destroy(receiver);
+        return false;
+    }
+    port_set_queue_limit(receiver->wakeup_port, 1);
+    
+    if (pthread_create(&receiver->thread, NULL, context_receiver_thread, receiver) != 0) {
+        LOG_ERROR_MSG("Failed to create context receiver thread");
+        context_receiver_destroy(receiver);
+        return false;
+    }
+    return true;
+}
+
+mach_client_context_t* mach_client_context_create(uint32_t receiver_threads) {
+    if (receiver_threads == 0) {
+        receiver_threads = 1;
+    }
+    
+    mach_client_context_t *context = calloc(1, sizeof(mach_client_context_t));
+    if (!context) return NULL;
+    
+    context->receivers = calloc(receiver_threads, sizeof(context_receiver_t));
+    if (!context->receivers) {
+        free(context);
+        return NULL;
+    }
+    
+    context->running = 1;
+    for (uint32_t i = 0; i < receiver_threads; i++) {
+        if (!context_receiver_init(context, &context->receivers[i])) {
+            mach_client_context_destroy(context);
+            return NULL;
+        }
+        context->receiver_count++;
+    }
+    
+    LOG_INFO_MSG("Client context created (%u receivers)", receiver_threads);
+    return context;
+}
+
+void mach_client_context_destroy(mach_client_context_t *context) {
+    if (!context) return;
+    
+    context->running = 0;
+    for (uint32_t i = 0; i < context->receiver_count; i++) {
+        protocol_wakeup(context->receivers[i].wakeup_port, 1);
+    }
+    
+    size_t member_count = 0;
+    for (uint32_t i = 0; i < context->receiver_count; i++) {
+        context_receiver_t *receiver = &context->receivers[i];
+        pthread_join(receiver->thread, NULL);
+        member_count += receiver->member_count;
+        context_receiver_destroy(receiver);
+    }
+    
+    if (member_count > 0) {
+        LOG_WARN_MSG("Destroying context with %zu clients attached", member_count);
+    }
+    
+    free(context->receivers);
+    free(context);
+}
+
+/* ============================================================================
+ * SEND COALESCING
+ * ============================================================================ */
+
+/* Spend a server credit for one user message */
+static ipc_status_t take_credit(mach_client_t *client) {
+    ipc_status_t status = flow_acquire(&client->flow, &client->flow_wait,
+                                       client->flow_send_wait_ms);
+    if (status != IPC_SUCCESS) {
+        STATS_INC(client->stats.flow_blocked);
+    }
+    return status;
+}
+
+static void refund_credit(mach_client_t *client) {
+    flow_release(&client->flow, &client->flow_wait, 1);
+}
+
+// credited: the caller already spent the credit of the batch
+static ipc_status_t flush_batch_locked(mach_client_t *client, bool credited) {
+    if (client->batch_size == 0) {
+        if (credited) {
+            refund_credit(client);
+        }
+        return IPC_SUCCESS;
+    }
+    
+    if (!client->connected) {
+        LOG_WARN_MSG("Dropping %zu coalesced bytes, not connected", client->batch_size);
+        client->batch_size = 0;
+        return IPC_ERROR_NOT_CONNECTED;
+    }
+    
+    if (!credited) {
+        // Keep the batch and retry from the timer
+        ipc_status_t status = take_credit(client);
+        if (status != IPC_SUCCESS) {
+            if (client->batch_timer && client->batch_max_delay_us) {
+                dispatch_source_set_timer(
+                    client->batch_timer,
+                    dispatch_time(DISPATCH_TIME_NOW, client->batch_max_delay_us * NSEC_PER_USEC),
+                    DISPATCH_TIME_FOREVER,
+                    client->batch_max_delay_us * NSEC_PER_USEC / 10
+                );
+            }
+            return status;
+        }
+    }
+    
+    size_t batch_size = client->batch_size;
+    client->batch_size = 0;
+    
+    internal_payload_t payload = (internal_payload_t){
+        .client_id = client->client_id,
+        .client_slot = client->client_slot,
+        .status = IPC_SUCCESS
+    };
+    
+    kern_return_t kr = protocol_send_message(
+        client->send_port,
+        MACH_PORT_NULL,
+        WIRE_MSG_ID(client, SET_FEATURE(MSG_ID_USER(0), INTERNAL_FEATURE_BTCH)),
+        &payload,
+        sizeof(payload),
+        client->batch_buffer,
+        batch_size,
+        0
+    );
+    
+    if (kr != KERN_SUCCESS) {
+        refund_credit(client);
+        LOG_ERROR_MSG("Failed to flush %zu coalesced bytes: %s", batch_size, mach_error_string(kr));
+        return IPC_ERROR_SEND_FAILED;
+    }
+    return IPC_SUCCESS;
+}
+
+// Returns false if the message has to be sent on its own
+static bool coalesce_message(
+    mach_client_t *client,
+    uint32_t msg_type,
+    const void *data,
+    size_t size,
+    ipc_status_t *status
+) {
+    pthread_mutex_lock(&client->batch_lock);
+    
+    if (client->batch_max_bytes == 0 ||
+        INTERNAL_BATCH_RECORD_SIZE(size) > client->batch_max_bytes) {
+        pthread_mutex_unlock(&client->batch_lock);
+        return false;
+    }
+    
+    // A message that fills the batch is only taken with the credit to send it
+    bool first = client->batch_size == 0;
+    bool full = client->batch_size + INTERNAL_BATCH_RECORD_SIZE(size) >= client->batch_max_bytes;
+    if (full && (*status = take_credit(client)) != IPC_SUCCESS) {
+        // Not queued
+    } else if (!protocol_batch_append(&client->batch_buffer, &client->batch_size,
+                                      &client->batch_capacity, msg_type, data, size)) {
+        if (full) {
+            refund_credit(client);
+        }
+        *status = IPC_ERROR_NO_MEMORY;
+    } else if (full) {
+        *status = flush_batch_locked(client, true);
+    } else {
+        *status = IPC_SUCCESS;
+        if (first && client->batch_max_delay_us) {
+            dispatch_source_set_timer(
+                client->batch_timer,
+                dispatch_time(DISPATCH_TIME_NOW, client->batch_max_delay_us * NSEC_PER_USEC),
+                DISPATCH_TIME_FOREVER,
+                client->batch_max_delay_us * NSEC_PER_USEC / 10
+            );
+        }
+    }
+    
+    pthread_mutex_unlock(&client->batch_lock);
+    return true;
+}
+
+static void destroy_batch_timer(void *res) {
+    mach_client_t *client = (mach_client_t*)res;
+    if (client->batch_timer) {
+        dispatch_source_cancel(client->batch_timer);
+        // Wait out a flush in progress
+        dispatch_sync(client->batch_queue, ^{});
+        dispatch_release(client->batch_timer);
+        dispatch_release(client->batch_queue);
+        client->batch_timer = NULL;
+        client->batch_queue = NULL;
+    }
+}
+
+/* ============================================================================
+ * PUBLIC API
+ * ============================================================================ */
+
+mach_client_t* mach_client_create(
+    const client_callbacks_t *callbacks,
+    void *user_data
+) {
+    mach_client_t *client = calloc(1, sizeof(mach_client_t));
+    if (!client) return NULL;
+    
+    // Initialize resource tracker
+    client->resources = resource_tracker_create();
+    if (!client->resources) {
+        free(client);
+        return NULL;
+    }
+    
+    // Initialize ack table
+    if (!ack_table_init(&client->acks, MAX_ACKS)) {
+        resource_tracker_destroy(client->resources);
+        free(client);
+        return NULL;
+    }
+    resource_tracker_add(client->resources, RES_TYPE_CUSTOM, &client->acks,
+                        ack_table_destroy, "acks");
+    
+    if (!slab_init(&client->delivery_slab, DELIVERY_SLAB_SIZE, sizeof(delivery_t))) {
+        resource_tracker_cleanup_all(client->resources);
+        resource_tracker_destroy(client->resources);
+        free(client);
+        return NULL;
+    }
+    resource_tracker_add(client->resources, RES_TYPE_CUSTOM, &client->delivery_slab,
+                        slab_destroy, "delivery_slab");
+    mpsc_init(&client->deliveries);
+    
+    if (!flow_wait_init(&client->flow_wait)) {
+        resource_tracker_cleanup_all(client->resources);
+        resource_tracker_destroy(client->resources);
+        free(client);
+        return NULL;
+    }
+    resource_tracker_add(client->resources, RES_TYPE_CUSTOM, &client->flow_wait,
+                        flow_wait_destroy, "flow_wait");
+    
+    // Create message processing queue
+    client->message_queue = dispatch_queue_create("com.ipc.client.messages", 
+                                                  DISPATCH_QUEUE_SERIAL);
+    if (!client->message_queue) {
+        resource_tracker_cleanup_all(client->resources);
+        resource_tracker_destroy(client->resources);
+        free(client);
+        return NULL;
+    }
+    resource_tracker_add(client->resources, RES_TYPE_QUEUE, &client->message_queue,
+                        (void(*)(void*))dispatch_release, "message_queue");
+    
+    pthread_mutex_init(&client->batch_lock, NULL);
+    resource_tracker_add(client->resources, RES_TYPE_MUTEX, &client->batch_lock,
+                        (void(*)(void*))pthread_mutex_destroy, "batch_lock");
+    resource_tracker_add(client->resources, RES_TYPE_MEMORY, &client->batch_buffer,
+                        NULL, "batch_buffer");
+    
+    pthread_mutex_init(&client->channel_lock, NULL);
+    resource_tracker_add(client->resources, RES_TYPE_MUTEX, &client->channel_lock,
+                        (void(*)(void*))pthread_mutex_destroy, "channel_lock");
+
+    
+    if (callbacks) {
+        client->callbacks = *callbacks;
+    }
+    client->user_data = user_data;
+    
+    LOG_INFO_MSG("Client created");
+    return client;
+}
+
+ipc_status_t mach_client_connect(
+    mach_client_t *client,
+    const char *service_name,
+    uint32_t timeout_ms
+) {
+    if (!client || !service_name) {
+        return IPC_ERROR_INVALID_PARAM;
+    }
+    
+    if (client->connected) {
+        return IPC_ERROR_INTERNAL;
+    }
+    
+    strncpy(client->service_name, service_name, sizeof(client->service_name) - 1);
+    
+    // Lookup server
+    kern_return_t kr = bootstrap_look_up(
+        bootstrap_port,
+        service_name,
+        &client->server_port
+    );
+    
+    if (kr != KERN_SUCCESS) {
+        LOG_ERROR_MSG("Failed to lookup service '%s': %s",
+                     service_name, mach_error_string(kr));
+        return IPC_ERROR_NOT_CONNECTED;
+    }
+    
+    resource_tracker_add(client->resources, RES_TYPE_PORT, &client->server_port,
+                        NULL, "server_port");
+    client->send_port = client->server_port;
+    
+    // Create local receive port
+    kr = mach_port_allocate(mach_task_self(), MACH_PORT_RIGHT_RECEIVE,
+                           &client->local_port);
+    if (kr != KERN_SUCCESS) {
+        LOG_ERROR_MSG("Failed to allocate local port: %s", mach_error_string(kr));
+        return IPC_ERROR_INTERNAL;
+    }
+    
+    resource_tracker_add(client->resources, RES_TYPE_PORT, &client->local_port,
+                        NULL, "local_port");
+    port_set_queue_limit(client->local_port, client->port_queue_limit);
+    
+    // Add send right
+    kr = mach_port_insert_right(mach_task_self(), client->local_port,
+                               client->local_port, MACH_MSG_TYPE_MAKE_SEND);
+    if (kr != KERN_SUCCESS) {
+        LOG_ERROR_MSG("Failed to insert send right: %s", mach_error_string(kr));
+        return IPC_ERROR_INTERNAL;
+    }
+    
+    // Setup death notification for server
+    kr = mach_port_request_notification(
+        mach_task_self(),
+        client->server_port,
+        MACH_NOTIFY_DEAD_NAME,
+        1,
+        client->local_port,
+        MACH_MSG_TYPE_MAKE_SEND_ONCE,
+        &(mach_port_t){MACH_PORT_NULL}
+    );
+    
+    if (kr != KERN_SUCCESS) {
+        LOG_ERROR_MSG("Failed to setup death notification: %s",
+                     mach_error_string(kr));
+        return IPC_ERROR_INTERNAL;
+    }
+    
+    // Start receiver thread, or let the context receive for us
+    client->running = 1;
+    if (!client->context && !start_reply_port(client)) {
+        client->running = 0;
+        return IPC_ERROR_INTERNAL;
+    }
+    if (client->context) {
+        if (!context_attach(client)) {
+            client->running = 0;
+            return IPC_ERROR_INTERNAL;
+        }
+    } else {
+        int err = pthread_create(&client->receiver_thread, NULL,
+                                client_receiver_thread, client);
+        if (err != 0) {
+            LOG_ERROR_MSG("Failed to create receiver thread");
+            stop_receivers(client);
+            return IPC_ERROR_INTERNAL;
+        }
+        
+        resource_tracker_add(client->resources, RES_TYPE_THREAD, &client->receiver_thread,
+                            NULL, "receiver_thread");
+    }
+    
+    // Receiving side first, server messages may overtake the connect ack
+    flow_init(&client->flow, 0, client->flow_receive_window);
+    
+    // Send connect message
+    internal_payload_t payload = (internal_payload_t){
+        .client_id = 0,    // Will be assigned by server
+        .client_slot = -1, // Will be assigned by server
+        .status = IPC_SUCCESS,
+        .credits = client->flow_receive_window,
+        .wire_version = INTERNAL_WIRE_VERSION
+    };
+    
+    internal_payload_t ack_payload;
+    const void *ack_user_payload = NULL;
+    size_t ack_user_size = 0;
+    mach_port_t lane_port = MACH_PORT_NULL;
+    
+    kr = protocol_send_with_ack(
+        client->server_port,
+        client->local_port,
+        &client->acks,
+        MSG_ID_CONNECT,
+        &payload,
+        sizeof(payload),
+        NULL,
+        0,
+        &ack_payload,
+        &ack_user_payload,
+        &ack_user_size,
+        &lane_port,
+        timeout_ms
+    );
+    
+    if (kr != KERN_SUCCESS) {
+        LOG_ERROR_MSG("Connect failed: %s", mach_error_string(kr));
+        return kr == KERN_OPERATION_TIMED_OUT ? IPC_ERROR_TIMEOUT : IPC_ERROR_SEND_FAILED;
+    }
     
-    ply_free((void*)ack_payload, ack_size);
     ply_free((void*)ack_user_payload, ack_user_size);
     
+    if (ack_payload.status != IPC_SUCCESS) {
+        if (lane_port != MACH_PORT_NULL) {
+            mach_port_deallocate(mach_task_self(), lane_port);
+        }
+        LOG_ERROR_MSG("Connect rejected by server (status=%d)", ack_payload.status);
+        return ack_payload.status;
+    }
+    
+    // Multi-threaded servers hand out the lane of our receiver
+    if (lane_port != MACH_PORT_NULL) {
+        client->send_port = lane_port;
+        resource_tracker_add(client->resources, RES_TYPE_PORT, &client->send_port,
+                            NULL, "send_port");
+    }
+    
+    client->client_id = ack_payload.client_id;
+    client->client_slot = ack_payload.client_slot;
+    client->wire_version = ack_payload.wire_version > INTERNAL_WIRE_VERSION
+        ? INTERNAL_WIRE_VERSION
+        : ack_payload.wire_version;
+    client->flow.send_window = ack_payload.credits;
+    atomic_store_explicit(&client->flow.credits, (int32_t)ack_payload.credits,
+                          memory_order_relaxed);
+    
+    // Replies travel apart from the user traffic from here on
+    if (client->reply_port != MACH_PORT_NULL) {
+        exchange_reply_ports(client, timeout_ms);
+    }
+    client->connected = 1;
+    
     LOG_INFO_MSG("Connected to server (id=%u, slot=%d)", client->client_id, client->client_slot);
     
-    // Notify user
-    if (client->callbacks.on_connected) {
-        client->callbacks.on_connected(client, client->user_data);
+    // Notify user
+    if (client->callbacks.on_connected) {
+        client->callbacks.on_connected(client, client->user_data);
+    }
+    
+    return IPC_SUCCESS;
+}
+
+bool mach_client_is_connected(mach_client_t *client) {
+    return client && client->connected;
+}
+
+ipc_status_t mach_client_send_with_port(
+    mach_client_t *client,
+    mach_port_t local_port,
+    uint32_t msg_type,
+    const void *data,
+    size_t size
+) {
+    if (!client || !client->connected) {
+        return IPC_ERROR_NOT_CONNECTED;
+    }
+    
+    // Priority messages never wait in a batch
+    ipc_status_t status;
+    if (local_port == MACH_PORT_NULL && !HAS_FEATURE_PRIO(msg_type) &&
+        coalesce_message(client, msg_type, data, size, &status)) {
+        return status;
+    }
+    
+    // Keep the order with previously coalesced messages
+    mach_client_flush(client);
+    
+    internal_payload_t payload = (internal_payload_t){
+        .client_id = client->client_id,
+        .client_slot = client->client_slot,
+        .status = IPC_SUCCESS
+    };
+    
+    status = take_credit(client);
+    if (status != IPC_SUCCESS) {
+        return status;
+    }
+    
+    kern_return_t kr = protocol_send_message(
+        client->send_port,
+        local_port,
+        WIRE_MSG_ID(client, MSG_ID_USER(msg_type)),
+        &payload,
+        sizeof(payload),
+        data,
+        size,
+        0
+    );
+    
+    if (kr != KERN_SUCCESS) {
+        refund_credit(client);
+        return IPC_ERROR_SEND_FAILED;
+    }
+    return IPC_SUCCESS;
+}
+
+ipc_status_t mach_client_send(
+    mach_client_t *client,
+    uint32_t msg_type,
+    const void *data,
+    size_t size
+) {
+    return mach_client_send_with_port(
+        client,
+        MACH_PORT_NULL,
+        msg_type,
+        data,
+        size
+    );
+}
+
+ipc_status_t mach_client_sendv(
+    mach_client_t *client,
+    uint32_t msg_type,
+    const struct iovec *iov,
+    int iovcnt
+) {
+    if (!client || !client->connected) {
+        return IPC_ERROR_NOT_CONNECTED;
+    }
+    
+    protocol_gather_t gather;
+    ipc_status_t status = protocol_gather(&gather, iov, iovcnt);
+    if (status != IPC_SUCCESS) {
+        return status;
+    }
+    
+    // A page block is ours, send it like an owned buffer
+    if (gather.pages) {
+        return mach_client_send_owned(client, msg_type, (void*)gather.data, gather.size);
+    }
+    return mach_client_send(client, msg_type, gather.data, gather.size);
+}
+
+ipc_status_t mach_client_send_owned(
+    mach_client_t *client,
+    uint32_t msg_type,
+    void *buffer,
+    size_t size
+) {
+    if (!client || !client->connected || !buffer) {
+        ipc_payload_free(buffer);
+        return IPC_ERROR_INVALID_PARAM;
+    }
+    
+    // Keep the order with previously coalesced messages
+    mach_client_flush(client);
+    
+    internal_payload_t payload = (internal_payload_t){
+        .client_id = client->client_id,
+        .client_slot = client->client_slot,
+        .status = IPC_SUCCESS
+    };
+    
+    ipc_status_t status = take_credit(client);
+    if (status != IPC_SUCCESS) {
+        ipc_payload_free(buffer);
+        return status;
+    }
+    
+    kern_return_t kr = protocol_send_owned_message(client->send_port,
+                                                   WIRE_MSG_ID(client, MSG_ID_USER(msg_type)),
+                                                   &payload, buffer, size);
+    arena_pages_free(buffer, size, SEND_MOVED_PAYLOAD(kr));
+    
+    if (kr != KERN_SUCCESS) {
+        refund_credit(client);
+        return IPC_ERROR_SEND_FAILED;
+    }
+    return IPC_SUCCESS;
+}
+
+ipc_status_t mach_client_send_with_port_and_reply(
+    mach_client_t *client,
+    mach_port_t local_port,
+    uint32_t msg_type,
+    const void *data,
+    size_t size,
+    const void **reply_data,
+    size_t *reply_size,
+    uint32_t timeout_ms
+) {
+    if (!client || !client->connected) {
+        return IPC_ERROR_INVALID_PARAM;
+    }
+    
+    // Keep the order with previously coalesced messages
+    mach_client_flush(client);
+    
+    internal_payload_t payload = (internal_payload_t){
+        .client_id = client->client_id,
+        .client_slot = client->client_slot,
+        .status = IPC_SUCCESS
+    };
+    
+    internal_payload_t ack_payload;
+    const void *ack_user_payload = NULL;
+    size_t ack_user_size = 0;
+    
+    ipc_status_t status = take_credit(client);
+    if (status != IPC_SUCCESS) {
+        if (reply_size && reply_data) {
+            *reply_data = NULL;
+            *reply_size = 0;
+        }
+        return status;
+    }
+    
+    kern_return_t kr = protocol_send_with_ack(
+        client->send_port,
+        local_port,
+        &client->acks,
+        WIRE_MSG_ID(client, MSG_ID_USER(msg_type)),
+        &payload,
+        sizeof(payload),
+        data,
+        size,
+        &ack_payload,
+        &ack_user_payload,
+        &ack_user_size,
+        NULL,
+        timeout_ms
+    );
+
+    if (kr != KERN_SUCCESS) {
+        if (kr != KERN_OPERATION_TIMED_OUT) {
+            // Never sent
+            refund_credit(client);
+        }
+        if (reply_size && reply_data) {
+            *reply_data = NULL;
+            *reply_size = 0;
+        }
+        return kr == KERN_OPERATION_TIMED_OUT ? IPC_ERROR_TIMEOUT : IPC_ERROR_SEND_FAILED;
+    }
+
+    if (reply_size && reply_data) {
+        *reply_size = ack_user_size;
+        *reply_data = ack_user_payload;
+    } else {
+        ply_free((void*)ack_user_payload, ack_user_size);
+    }
+    
+    return ack_payload.status;
+}
+
+ipc_status_t mach_client_send_with_reply(
+    mach_client_t *client,
+    uint32_t msg_type,
+    const void *data,
+    size_t size,
+    const void **reply_data,
+    size_t *reply_size,
+    uint32_t timeout_ms
+) {
+    return mach_client_send_with_port_and_reply(
+        client,
+        MACH_PORT_NULL,
+        msg_type,
+        data,
+        size,
+        reply_data,
+        reply_size,
+        timeout_ms
+    );
+}
+
+ipc_status_t mach_client_sendv_with_reply(
+    mach_client_t *client,
+    uint32_t msg_type,
+    const struct iovec *iov,
+    int iovcnt,
+    const void **reply_data,
+    size_t *reply_size,
+    uint32_t timeout_ms
+) {
+    protocol_gather_t gather;
+    ipc_status_t status = protocol_gather(&gather, iov, iovcnt);
+    if (status != IPC_SUCCESS) {
+        return status;
+    }
+    
+    // Requests have no move path, a page block is still copied lazily
+    status = mach_client_send_with_reply(client, msg_type, gather.data, gather.size,
+                                         reply_data, reply_size, timeout_ms);
+    protocol_gather_release(&gather, false);
+    return status;
+}
+
+ipc_status_t mach_client_call(
+    mach_client_t *client,
+    uint32_t msg_type,
+    const void *data,
+    size_t size,
+    const void **reply_data,
+    size_t *reply_size,
+    uint32_t timeout_ms
+) {
+    if (reply_size && reply_data) {
+        *reply_data = NULL;
+        *reply_size = 0;
+    }
+    if (!client || !client->connected) {
+        return IPC_ERROR_INVALID_PARAM;
+    }
+    
+    // Keep the order with previously coalesced messages
+    mach_client_flush(client);
+    
+    internal_payload_t payload = (internal_payload_t){
+        .client_id = client->client_id,
+        .client_slot = client->client_slot,
+        .status = IPC_SUCCESS
+    };
+    
+    ipc_status_t status = take_credit(client);
+    if (status != IPC_SUCCESS) {
+        return status;
+    }
+    
+    internal_payload_t reply_payload;
+    const void *reply_user_payload = NULL;
+    size_t reply_user_size = 0;
+    
+    kern_return_t kr = protocol_send_rpc(
+        client->send_port,
+        &client->acks,
+        WIRE_MSG_ID(client, MSG_ID_USER(msg_type)),
+        &payload,
+        data,
+        size,
+        &reply_payload,
+        &reply_user_payload,
+        &reply_user_size,
+        timeout_ms
+    );
+    
+    if (kr == KERN_OPERATION_TIMED_OUT) {
+        return IPC_ERROR_TIMEOUT;
+    }
+    if (kr == KERN_ABORTED) {
+        return IPC_ERROR_INTERNAL;
+    }
+    if (kr == MACH_SEND_TIMED_OUT) {
+        // Never sent
+        refund_credit(client);
+        return IPC_ERROR_TIMEOUT;
+    }
+    if (kr != KERN_SUCCESS) {
+        // Never sent
+        refund_credit(client);
+        return IPC_ERROR_SEND_FAILED;
+    }
+    
+    if (reply_size && reply_data) {
+        *reply_size = reply_user_size;
+        *reply_data = reply_user_payload;
+    } else {
+        ply_free((void*)reply_user_payload, reply_user_size);
     }
     
-    return IPC_SUCCESS;
+    return reply_payload.status;
 }
 
-bool mach_client_is_connected(mach_client_t *client) {
-    return client && client->connected;
+typedef struct {
+    mach_client_t *client;
+    client_reply_callback_t callback;
+    void *context;
+} client_async_request_t;
+
+static void client_async_complete(
+    kern_return_t kr,
+    const internal_payload_t *ack_payload,
+    const void *ack_user_payload,
+    size_t ack_user_size,
+    void *context
+) {
+    client_async_request_t *request = (client_async_request_t*)context;
+    
+    ipc_status_t status = kr == KERN_SUCCESS ? (ipc_status_t)ack_payload->status
+        : kr == KERN_OPERATION_TIMED_OUT ? IPC_ERROR_TIMEOUT
+        : IPC_ERROR_NOT_CONNECTED;
+    request->callback(request->client, status, ack_user_payload, ack_user_size,
+                      request->context);
+    
+    ply_free((void*)ack_user_payload, ack_user_size);
+    free(request);
 }
 
-ipc_status_t mach_client_send_with_port(
+ipc_status_t mach_client_send_async(
     mach_client_t *client,
-    mach_port_t local_port,
     uint32_t msg_type,
     const void *data,
-    size_t size
+    size_t size,
+    uint32_t timeout_ms,
+    client_reply_callback_t completion,
+    void *context
 ) {
-    if (!client || !client->connected) {
-        return IPC_ERROR_NOT_CONNECTED;
+    if (!client || !client->connected || !completion) {
+        return IPC_ERROR_INVALID_PARAM;
+    }
+    
+    // Keep the order with previously coalesced messages
+    mach_client_flush(client);
+    
+    ipc_status_t status = take_credit(client);
+    if (status != IPC_SUCCESS) {
+        return status;
+    }
+    
+    client_async_request_t *request = malloc(sizeof(client_async_request_t));
+    if (!request) {
+        refund_credit(client);
+        return IPC_ERROR_NO_MEMORY;
     }
+    *request = (client_async_request_t){
+        .client = client,
+        .callback = completion,
+        .context = context
+    };
     
     internal_payload_t payload = (internal_payload_t){
         .client_id = client->client_id,
@@ -425,48 +1477,252 @@ ipc_status_t mach_client_send_with_port(
         .status = IPC_SUCCESS
     };
     
-    kern_return_t kr = protocol_send_message(
-        client->server_port,
-        local_port,
-        MSG_ID_USER(msg_type),
+    kern_return_t kr = protocol_send_async(
+        client->send_port,
+        MACH_PORT_NULL,
+        &client->acks,
+        WIRE_MSG_ID(client, MSG_ID_USER(msg_type)),
         &payload,
         sizeof(payload),
         data,
         size,
+        timeout_ms,
+        client->message_queue,
+        client_async_complete,
+        request,
+        NULL
+    );
+    
+    if (kr != KERN_SUCCESS) {
+        refund_credit(client);
+        free(request);
+        return IPC_ERROR_SEND_FAILED;
+    }
+    
+    return IPC_SUCCESS;
+}
+
+ipc_status_t mach_client_send_batch(
+    mach_client_t *client,
+    const ipc_batch_entry_t *entries,
+    size_t count
+) {
+    if (!client || !entries || count == 0) {
+        return IPC_ERROR_INVALID_PARAM;
+    }
+    if (!client->connected) {
+        return IPC_ERROR_NOT_CONNECTED;
+    }
+    
+    // Keep the order with previously coalesced messages
+    mach_client_flush(client);
+    
+    uint8_t *batch = NULL;
+    size_t batch_size = 0;
+    size_t batch_capacity = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (!protocol_batch_append(&batch, &batch_size, &batch_capacity,
+                                   entries[i].msg_type, entries[i].data, entries[i].size)) {
+            free(batch);
+            return IPC_ERROR_NO_MEMORY;
+        }
+    }
+    
+    internal_payload_t payload = (internal_payload_t){
+        .client_id = client->client_id,
+        .client_slot = client->client_slot,
+        .status = IPC_SUCCESS
+    };
+    
+    // A batch is queued as one message
+    ipc_status_t status = take_credit(client);
+    if (status != IPC_SUCCESS) {
+        free(batch);
+        return status;
+    }
+    
+    kern_return_t kr = protocol_send_message(
+        client->send_port,
+        MACH_PORT_NULL,
+        WIRE_MSG_ID(client, SET_FEATURE(MSG_ID_USER(0), INTERNAL_FEATURE_BTCH)),
+        &payload,
+        sizeof(payload),
+        batch,
+        batch_size,
         0
     );
     
-    return kr == KERN_SUCCESS ? IPC_SUCCESS : IPC_ERROR_SEND_FAILED;
+    free(batch);
+    if (kr != KERN_SUCCESS) {
+        refund_credit(client);
+        return IPC_ERROR_SEND_FAILED;
+    }
+    return IPC_SUCCESS;
 }
 
-ipc_status_t mach_client_send(
+ipc_status_t mach_client_set_flow_control(
     mach_client_t *client,
-    uint32_t msg_type,
-    const void *data,
-    size_t size
+    uint32_t receive_window,
+    uint32_t send_wait_ms,
+    uint32_t port_queue_limit
 ) {
-    return mach_client_send_with_port(
-        client,
+    if (!client) return IPC_ERROR_INVALID_PARAM;
+    if (client->connected) {
+        // Windows are negotiated at connect
+        return IPC_ERROR_INTERNAL;
+    }
+    
+    client->flow_receive_window = receive_window;
+    client->flow_send_wait_ms = send_wait_ms;
+    client->port_queue_limit = port_queue_limit;
+    return IPC_SUCCESS;
+}
+
+ipc_status_t mach_client_set_context(mach_client_t *client, mach_client_context_t *context) {
+    if (!client) return IPC_ERROR_INVALID_PARAM;
+    if (client->connected) {
+        // The local port is already being received
+        return IPC_ERROR_INTERNAL;
+    }
+    
+    client->context = context;
+    return IPC_SUCCESS;
+}
+
+ipc_status_t mach_client_set_coalescing(
+    mach_client_t *client,
+    size_t max_bytes,
+    uint32_t max_delay_us
+) {
+    if (!client) return IPC_ERROR_INVALID_PARAM;
+    
+    pthread_mutex_lock(&client->batch_lock);
+    
+    ipc_status_t status = flush_batch_locked(client, false);
+    
+    if (max_bytes && !client->batch_timer) {
+        client->batch_queue = dispatch_queue_create("com.ipc.client.batch", DISPATCH_QUEUE_SERIAL);
+        client->batch_timer = client->batch_queue
+            ? dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, client->batch_queue)
+            : NULL;
+        if (!client->batch_timer) {
+            if (client->batch_queue) {
+                dispatch_release(client->batch_queue);
+                client->batch_queue = NULL;
+            }
+            pthread_mutex_unlock(&client->batch_lock);
+            LOG_ERROR_MSG("Failed to create coalescing timer");
+            return IPC_ERROR_NO_MEMORY;
+        }
+        
+        dispatch_source_set_event_handler(client->batch_timer, ^{
+            mach_client_flush(client);
+        });
+        // Armed per batch in coalesce_message
+        dispatch_source_set_timer(client->batch_timer, DISPATCH_TIME_FOREVER,
+                                  DISPATCH_TIME_FOREVER, 0);
+        dispatch_resume(client->batch_timer);
+        
+        resource_tracker_add(client->resources, RES_TYPE_CUSTOM, client,
+                            destroy_batch_timer, "batch_timer");
+    }
+    
+    client->batch_max_bytes = max_bytes;
+    client->batch_max_delay_us = max_delay_us;
+    
+    pthread_mutex_unlock(&client->batch_lock);
+    return status;
+}
+
+ipc_status_t mach_client_flush(mach_client_t *client) {
+    if (!client) return IPC_ERROR_INVALID_PARAM;
+    
+    pthread_mutex_lock(&client->batch_lock);
+    ipc_status_t status = flush_batch_locked(client, false);
+    pthread_mutex_unlock(&client->batch_lock);
+    
+    return status;
+}
+
+static ipc_status_t send_subscription(
+    mach_client_t *client,
+    mach_msg_id_t msg_id,
+    uint32_t topic,
+    uint32_t timeout_ms
+) {
+    if (!client) return IPC_ERROR_INVALID_PARAM;
+    if (!client->connected) return IPC_ERROR_NOT_CONNECTED;
+    
+    internal_payload_t payload = (internal_payload_t){
+        .client_id = client->client_id,
+        .client_slot = client->client_slot,
+        .status = IPC_SUCCESS
+    };
+    
+    internal_payload_t ack_payload;
+    const void *ack_user_payload = NULL;
+    size_t ack_user_size = 0;
+    
+    kern_return_t kr = protocol_send_with_ack(
+        client->send_port,
         MACH_PORT_NULL,
-        msg_type,
-        data,
-        size
+        &client->acks,
+        msg_id,
+        &payload,
+        sizeof(payload),
+        &topic,
+        sizeof(topic),
+        &ack_payload,
+        &ack_user_payload,
+        &ack_user_size,
+        NULL,
+        timeout_ms
     );
+    
+    if (kr != KERN_SUCCESS) {
+        return kr == KERN_OPERATION_TIMED_OUT ? IPC_ERROR_TIMEOUT : IPC_ERROR_SEND_FAILED;
+    }
+    
+    ply_free((void*)ack_user_payload, ack_user_size);
+    return ack_payload.status;
 }
 
-ipc_status_t mach_client_send_with_port_and_reply(
+ipc_status_t mach_client_subscribe(mach_client_t *client, uint32_t topic, uint32_t timeout_ms) {
+    return send_subscription(client, MSG_ID_SUBSCRIBE, topic, timeout_ms);
+}
+
+ipc_status_t mach_client_unsubscribe(mach_client_t *client, uint32_t topic, uint32_t timeout_ms) {
+    return send_subscription(client, MSG_ID_UNSUBSCRIBE, topic, timeout_ms);
+}
+
+ipc_status_t mach_client_open_channel(
     mach_client_t *client,
-    mach_port_t local_port,
-    uint32_t msg_type,
-    const void *data,
-    size_t size,
-    const void **reply_data,
-    size_t *reply_size,
+    size_t capacity,
     uint32_t timeout_ms
 ) {
-    if (!client || !client->connected) {
+    if (!client || capacity == 0 || capacity > CHANNEL_MAX_SIZE / 2) {
         return IPC_ERROR_INVALID_PARAM;
     }
+    if (!client->connected) {
+        return IPC_ERROR_NOT_CONNECTED;
+    }
+    if (client->channel_shmem) {
+        return IPC_ERROR_INTERNAL;
+    }
+    
+    uint64_t mapping_size = ring_mapping_size(capacity);
+    shared_memory_t *shmem = NULL;
+    kern_return_t kr = shared_memory_create(mapping_size, &shmem);
+    if (kr != KERN_SUCCESS) {
+        LOG_ERROR_MSG("Failed to create channel memory: %s", mach_error_string(kr));
+        return IPC_ERROR_NO_MEMORY;
+    }
+    
+    ring_t ring;
+    if (!ring_create(&ring, shared_memory_get_data(shmem), mapping_size)) {
+        shared_memory_destroy(shmem);
+        return IPC_ERROR_INTERNAL;
+    }
     
     internal_payload_t payload = (internal_payload_t){
         .client_id = client->client_id,
@@ -474,90 +1730,146 @@ ipc_status_t mach_client_send_with_port_and_reply(
         .status = IPC_SUCCESS
     };
     
-    internal_payload_t *ack_payload = NULL;
-    size_t ack_size = 0;
+    internal_payload_t ack_payload;
     const void *ack_user_payload = NULL;
     size_t ack_user_size = 0;
     
-    kern_return_t kr = protocol_send_with_ack(
-        client->server_port,
-        local_port,
-        &client->ack_pool,
-        &client->ack_lock,
-        &client->next_correlation_id,
-        MSG_ID_USER(msg_type),
+    // The memory entry travels as the local port, we keep our right
+    kr = protocol_send_with_ack(
+        client->send_port,
+        shared_memory_get_port(shmem),
+        &client->acks,
+        SET_FEATURE(MSG_ID_CHANNEL, INTERNAL_FEATURE_LPCY),
         &payload,
         sizeof(payload),
-        data,
-        size,
+        &mapping_size,
+        sizeof(mapping_size),
         &ack_payload,
-        &ack_size,
         &ack_user_payload,
         &ack_user_size,
+        NULL,
         timeout_ms
     );
+    
+    if (kr != KERN_SUCCESS) {
+        LOG_ERROR_MSG("Channel request failed: %s", mach_error_string(kr));
+        shared_memory_destroy(shmem);
+        return kr == KERN_OPERATION_TIMED_OUT ? IPC_ERROR_TIMEOUT : IPC_ERROR_SEND_FAILED;
+    }
+    
+    ply_free((void*)ack_user_payload, ack_user_size);
+    
+    if (ack_payload.status != IPC_SUCCESS) {
+        LOG_ERROR_MSG("Channel rejected by server (status=%d)", ack_payload.status);
+        shared_memory_destroy(shmem);
+        return ack_payload.status;
+    }
+    
+    pthread_mutex_lock(&client->channel_lock);
+    client->channel = ring;
+    client->channel_shmem = shmem;
+    pthread_mutex_unlock(&client->channel_lock);
+    
+    resource_tracker_add(client->resources, RES_TYPE_CUSTOM, shmem,
+                        (void(*)(void*))shared_memory_destroy, "channel");
+    
+    LOG_INFO_MSG("Channel opened (%llu bytes)", (unsigned long long)ring.capacity);
+    return IPC_SUCCESS;
+}
 
-    int ack_status;
-    bool is_ack_status;
-
-    if (ack_payload && ack_size) {
-        ack_status = ack_payload->status;
-        is_ack_status = true;
-        vm_deallocate(mach_task_self(), (vm_address_t)ack_payload, ack_size);
-    } else {
-        is_ack_status = false;
+void* mach_client_channel_reserve(mach_client_t *client, size_t size) {
+    if (!client) return NULL;
+    
+    pthread_mutex_lock(&client->channel_lock);
+    
+    void *data = client->connected && client->channel_shmem
+        ? ring_reserve(&client->channel, size)
+        : NULL;
+    if (!data) {
+        pthread_mutex_unlock(&client->channel_lock);
     }
+    
+    // Stays locked until the commit
+    return data;
+}
 
-    if (ack_user_payload && ack_user_size) {
-        if (kr == KERN_SUCCESS) {
-            if (reply_size && reply_data) {
-                *reply_size = ack_user_size;
-                *reply_data = ack_user_payload;
-            } else {
-                ply_free((void*)ack_user_payload, ack_user_size);
-            }
-            return is_ack_status ? ack_status : IPC_SUCCESS;
-        } else {
-            if (reply_size && reply_data) {
-                *reply_data = NULL;
-                *reply_size = 0;
-            } else {
-                ply_free((void*)ack_user_payload, ack_user_size);
-            }
-        }
-        vm_deallocate(mach_task_self(), (vm_address_t)ack_user_payload, ack_user_size);
-    } else {
-        if (reply_size && reply_data) {
-            *reply_data = NULL;
-            *reply_size = 0;
-        }
-        if (kr == KERN_SUCCESS) {
-            return is_ack_status ? ack_status : IPC_SUCCESS;
-        }
+ipc_status_t mach_client_channel_commit(mach_client_t *client, uint32_t msg_type, size_t size) {
+    if (!client) return IPC_ERROR_INVALID_PARAM;
+    
+    bool wake = false;
+    bool committed = ring_commit(&client->channel, msg_type, size, &wake);
+    
+    pthread_mutex_unlock(&client->channel_lock);
+    
+    if (!committed) {
+        return IPC_ERROR_INVALID_PARAM;
     }
+    if (!wake) {
+        return IPC_SUCCESS;
+    }
+    
+    // The server parked, ring the doorbell
+    internal_payload_t payload = (internal_payload_t){
+        .client_id = client->client_id,
+        .client_slot = client->client_slot,
+        .status = IPC_SUCCESS
+    };
+    
+    kern_return_t kr = protocol_send_message(
+        client->send_port,
+        MACH_PORT_NULL,
+        WIRE_MSG_ID(client, MSG_ID_DOORBELL),
+        &payload,
+        sizeof(payload),
+        NULL,
+        0,
+        0
+    );
     
-    return kr == KERN_OPERATION_TIMED_OUT ? IPC_ERROR_TIMEOUT : IPC_ERROR_SEND_FAILED;
+    if (kr != KERN_SUCCESS) {
+        // The record stays queued, the next commit rings again
+        ring_rearm(&client->channel);
+        LOG_ERROR_MSG("Failed to ring channel doorbell: %s", mach_error_string(kr));
+        return IPC_ERROR_SEND_FAILED;
+    }
+    return IPC_SUCCESS;
 }
 
-ipc_status_t mach_client_send_with_reply(
+ipc_status_t mach_client_channel_send(
     mach_client_t *client,
     uint32_t msg_type,
     const void *data,
-    size_t size,
-    const void **reply_data,
-    size_t *reply_size,
-    uint32_t timeout_ms
+    size_t size
 ) {
-    return mach_client_send_with_port_and_reply(
-        client,
-        MACH_PORT_NULL,
-        msg_type,
-        data,
-        size,
-        reply_data,
-        reply_size,
-        timeout_ms
-    );
+    if (!client || (!data && size > 0)) {
+        return IPC_ERROR_INVALID_PARAM;
+    }
+    if (!client->connected || !client->channel_shmem) {
+        return IPC_ERROR_NOT_CONNECTED;
+    }
+    if (size > ring_max_record(&client->channel)) {
+        return IPC_ERROR_INVALID_PARAM;
+    }
+    
+    void *record = mach_client_channel_reserve(client, size);
+    if (!record) {
+        return client->connected ? IPC_ERROR_WOULD_BLOCK : IPC_ERROR_NOT_CONNECTED;
+    }
+    
+    if (size > 0) {
+        memcpy(record, data, size);
+    }
+    return mach_client_channel_commit(client, msg_type, size);
+}
+
+ipc_status_t mach_client_get_stats(mach_client_t *client, ipc_stats_t *stats) {
+    if (!client || !stats) {
+        return IPC_ERROR_INVALID_PARAM;
+    }
+    
+    stats_snapshot(&client->stats, stats);
+    ack_table_snapshot(&client->acks, stats);
+    return IPC_SUCCESS;
 }
 
 void mach_client_disconnect(mach_client_t *client) {
@@ -565,8 +1877,11 @@ void mach_client_disconnect(mach_client_t *client) {
     
     LOG_INFO_MSG("Disconnecting from server...");
     
+    // Deliver what's still coalesced
+    mach_client_flush(client);
+    
     client->connected = 0;
-    client->running = 0;
+    stop_receivers(client);
     
     // Notify user
     if (client->callbacks.on_disconnected) {
@@ -581,12 +1896,22 @@ void mach_client_destroy(mach_client_t *client) {
         mach_client_disconnect(client);
     }
     
-    client->running = 0;
+    stop_receivers(client);
     
     // Wait for receiver thread
-    if (client->receiver_thread) {
+    if (client->context) {
+        context_detach(client);
+    } else if (client->receiver_thread) {
         pthread_join(client->receiver_thread, NULL);
+        client->receiver_thread = 0;
     }
+    if (client->reply_thread) {
+        pthread_join(client->reply_thread, NULL);
+        client->reply_thread = 0;
+    }
+    
+    // No acks arrive anymore, fail what's still in flight
+    ack_table_abort_pending(&client->acks);
     
     // Drain message queue before cleanup
     if (client->message_queue) {
@@ -12,9 +12,16 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdatomic.h>
+#include <stddef.h>
 #include "mach_ipc.h"
 #include "pool.h"
-#include "event_framework.h"
+#include "ring.h"
+#include "mpsc.h"
+#include "slab.h"
+#include "arena.h"
+#include "region_cache.h"
+#include "stats.h"
+#include "timer_wheel.h"
 
 /* ============================================================================
  * MACH MESSAGE STRUCTURES
@@ -35,10 +42,119 @@ typedef struct {
     uint64_t correlation_id;    // For ack matching (0 = no ack needed)
     int correlation_slot;       // For ack lookup
     int32_t status;             // Status code (0 = success)
+    uint32_t topic;             // Publish topic
+    uint32_t credits;           // Connect: receive window, credit: credits returned
+    uint32_t wire_version;      // Connect: highest wire version, ack: the one agreed on
     struct timespec user_payload_deadline;
 } internal_payload_t;
 
-#define INTERNAL_RCV_BUFFER_SIZE (sizeof(internal_mach_msg_t) + 1024)
+/* Wire version this build offers on connect, a peer sends compact headers
+ * from INTERNAL_WIRE_COMPACT on (0 = always the full internal_payload_t) */
+#ifndef INTERNAL_WIRE_VERSION
+#define INTERNAL_WIRE_VERSION 1
+#endif
+#define INTERNAL_WIRE_COMPACT 1
+
+/* Compact header, followed by the fields flagged in fields in flag order.
+ * Absent fields are 0, slots -1 */
+typedef struct {
+    uint8_t version;
+    uint8_t fields;
+    uint16_t size;              // Header and fields
+} internal_compact_header_t;
+
+#define INTERNAL_FIELD_CLIENT       (1U << 0)   // client_id, client_slot
+#define INTERNAL_FIELD_CORRELATION  (1U << 1)   // correlation_id (64 bit), correlation_slot
+#define INTERNAL_FIELD_STATUS       (1U << 2)
+#define INTERNAL_FIELD_TOPIC        (1U << 3)
+#define INTERNAL_FIELD_CREDITS      (1U << 4)
+#define INTERNAL_FIELD_DEADLINE     (1U << 5)   // Nanoseconds of user_payload_deadline (64 bit)
+
+#define INTERNAL_COMPACT_MAX_SIZE (sizeof(internal_compact_header_t) + 8 + 12 + 4 + 4 + 4 + 8)
+
+/* Message id towards a peer (client or server side connection), compact
+ * once the connect agreed on it */
+#define WIRE_MSG_ID(peer, id) \
+    ((peer)->wire_version >= INTERNAL_WIRE_COMPACT ? SET_FEATURE((id), INTERNAL_FEATURE_CMPT) : (id))
+
+/* Inline message structure (payloads below the inline threshold) */
+typedef struct {
+    mach_msg_header_t header;
+    internal_payload_t payload;
+    uint32_t user_payload_size;
+    uint8_t user_payload[];
+} internal_inline_mach_msg_t;
+
+/* Largest user payload that may travel inline, both peers must agree */
+#ifndef INTERNAL_INLINE_MAX_SIZE
+#define INTERNAL_INLINE_MAX_SIZE 256
+#endif
+
+/* Mach requires message sizes to be a multiple of 4 bytes */
+#define INTERNAL_MSG_ROUND(size) (((size) + 3) & ~((size_t)3))
+
+#define INTERNAL_INLINE_MSG_SIZE(user_size) \
+    INTERNAL_MSG_ROUND(offsetof(internal_inline_mach_msg_t, user_payload) + (user_size))
+
+#define INTERNAL_INLINE_MSG_MAX_SIZE INTERNAL_INLINE_MSG_SIZE(INTERNAL_INLINE_MAX_SIZE)
+
+/* Inline message with a compact header */
+typedef struct {
+    mach_msg_header_t header;
+    uint32_t user_payload_size;
+    uint8_t data[];             // Compact header, then the user payload
+} internal_compact_inline_msg_t;
+
+/* Out-of-line message with a compact header, the user payload is its only
+ * descriptor. msgh_size ends after the used part of data */
+typedef struct {
+    mach_msg_header_t header;
+    mach_msg_body_t body;
+    mach_msg_ool_descriptor_t user_payload;
+    uint8_t data[INTERNAL_COMPACT_MAX_SIZE];
+} internal_compact_mach_msg_t;
+
+/* Shared message structure, the user payload travels as a read-only memory
+ * entry the receiver maps (large broadcasts) */
+typedef struct {
+    mach_msg_header_t header;
+    mach_msg_body_t body;
+    mach_msg_ool_descriptor_t payload;
+    mach_msg_port_descriptor_t user_payload;
+    uint64_t user_payload_size;
+} internal_shared_mach_msg_t;
+
+/* Smallest broadcast payload shared instead of copied per receiver */
+#ifndef INTERNAL_SHARED_MIN_SIZE
+#define INTERNAL_SHARED_MIN_SIZE (64 * 1024)
+#endif
+
+/* Batch record header, followed by the data padded to INTERNAL_BATCH_ALIGN */
+typedef struct {
+    uint32_t msg_type;
+    uint32_t size;
+} internal_batch_record_t;
+
+#define INTERNAL_BATCH_ALIGN 8
+#define INTERNAL_BATCH_RECORD_SIZE(size) \
+    ((sizeof(internal_batch_record_t) + (size) + INTERNAL_BATCH_ALIGN - 1) & ~((size_t)INTERNAL_BATCH_ALIGN - 1))
+
+/* Largest message layout plus trailer, the initial receive buffer */
+#define INTERNAL_MSG_MAX(a, b) ((a) > (b) ? (a) : (b))
+#define INTERNAL_RCV_BUFFER_SIZE \
+    (INTERNAL_MSG_MAX(INTERNAL_INLINE_MSG_MAX_SIZE, sizeof(internal_shared_mach_msg_t)) + \
+     sizeof(mach_msg_max_trailer_t))
+
+/* A receive buffer grown past this is shrunk again after the message */
+#define INTERNAL_RCV_BUFFER_KEEP_SIZE (64 * 1024)
+
+/* Larger messages are dropped instead of growing the buffer */
+#define INTERNAL_RCV_BUFFER_MAX_SIZE (16 * 1024 * 1024)
+
+/* Every receive asks the kernel for the sender audit token */
+#define INTERNAL_RCV_TRAILER \
+    (MACH_RCV_TRAILER_TYPE(MACH_MSG_TRAILER_FORMAT_0) | \
+     MACH_RCV_TRAILER_ELEMENTS(MACH_RCV_TRAILER_AUDIT))
 
 /* ============================================================================
  * RESOURCE TRACKING
@@ -67,29 +183,170 @@ void resource_tracker_destroy(resource_tracker_t *tracker);
  * ACK MANAGEMENT
  * ============================================================================ */
 
+/* Waiter states, packed with the correlation id into ack_waiter_t.ticket */
+#define ACK_STATE_FREE      0ULL
+#define ACK_STATE_WAITING   1ULL    // Registered, reply not yet matched
+#define ACK_STATE_FILLING   2ULL    // Receiver won the race, writing reply
+#define ACK_STATE_RECEIVED  3ULL    // Reply stored, semaphore signaled
+#define ACK_STATE_CANCELLED 4ULL    // Waiter timed out, late acks are discarded
+#define ACK_STATE_SENDING   5ULL    // Async request still being sent, the timeout waits
+#define ACK_STATE_BITS      3
+#define ACK_STATE_MASK      ((1ULL << ACK_STATE_BITS) - 1)
+#define ACK_TICKET(correlation_id, state) (((uint64_t)(correlation_id) << ACK_STATE_BITS) | (state))
+
+/* Completion of an asynchronous request, owns the ack user payload.
+ * kr is KERN_SUCCESS, KERN_OPERATION_TIMED_OUT or KERN_ABORTED */
+typedef void (*ack_completion_t)(kern_return_t kr, const internal_payload_t *ack_payload,
+                                 const void *ack_user_payload, size_t ack_user_size,
+                                 void *context);
+
+/*
+ * A slot is addressed by (correlation_slot, correlation_id). Both are
+ * compared in one CAS on the ticket, so a late ack can never fill a slot
+ * that has since been reused by another request.
+ */
 typedef struct {
-    uint64_t correlation_id;
-    event_t *event;
-    internal_payload_t *reply_payload;
-    size_t reply_size;
+    _Atomic uint64_t ticket;
+    dispatch_semaphore_t sem;           // Preallocated, balanced on release
+    internal_payload_t reply_payload;   // Copied, so inline acks need no allocation
+    mach_port_t reply_port;             // Port right carried by the ack (if any)
     const void *reply_user_payload;
     size_t reply_user_size;
-    atomic_bool received;
-    atomic_bool cancelled;  // Prevents use-after-free on timeout race
+    // Asynchronous waiters only (completion != NULL)
+    ack_completion_t completion;
+    void *completion_context;
+    const void *owner;                  // Aborted with ack_table_abort_owner
+    dispatch_queue_t queue;             // Completion target (retained)
+    timer_entry_t timeout;              // Armed on the timer wheel while waiting
+    uint64_t sent_ns;                   // Round trip start (stats)
 } ack_waiter_t;
 
+/* Fixed size waiter table with a lock-free free list */
+typedef struct {
+    ack_waiter_t *waiters;
+    _Atomic int *next;                  // Free list chain
+    int capacity;
+    _Atomic uint64_t free_head;         // ABA tag in high 32 bits, index + 1 in low
+    _Atomic uint64_t next_correlation_id;
+    // Statistics
+    stats_counter_t pending;
+    stats_counter_t pending_peak;
+    stats_counter_t matched;
+    stats_counter_t discarded;
+    stats_histogram_t round_trip;
+} ack_table_t;
+
+bool ack_table_init(ack_table_t *table, int capacity);
+void ack_table_destroy(void *table);
+
+/* Fail pending asynchronous requests with KERN_ABORTED (no acks may arrive anymore) */
+void ack_table_abort_pending(ack_table_t *table);
+
+/* ack_table_abort_pending for the requests sent with owner only */
+void ack_table_abort_owner(ack_table_t *table, const void *owner);
+
+/* Fill the acknowledgment part of a stats snapshot */
+void ack_table_snapshot(ack_table_t *table, ipc_stats_t *out);
+
 #define USER_PLY_SAFETY_MS 10ULL
 
+/* ============================================================================
+ * FLOW CONTROL
+ * ============================================================================ */
+
+/* Credits of one connection. The sender spends one per user message (a
+ * batch counts once) and the receiver returns them once the handlers ran,
+ * half a window at a time so the sender never runs dry while idle */
+typedef struct {
+    _Atomic int32_t credits;        // Messages the peer still accepts
+    uint32_t send_window;           // Advertised by the peer (0 = unlimited)
+    _Atomic uint32_t owed;          // Handled messages not yet returned
+    uint32_t receive_window;        // Advertised to the peer (0 = none returned)
+} flow_control_t;
+
+/* Senders waiting for credits of any connection of a server or client */
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    _Atomic int waiters;
+} flow_wait_t;
+
+void flow_init(flow_control_t *flow, uint32_t send_window, uint32_t receive_window);
+bool flow_wait_init(flow_wait_t *wait);
+void flow_wait_destroy(void *wait);
+
+/* Spend a credit without waiting */
+bool flow_try_acquire(flow_control_t *flow);
+
+/* Spend a credit, waiting up to wait_ms for one. IPC_ERROR_WOULD_BLOCK if none came */
+ipc_status_t flow_acquire(flow_control_t *flow, flow_wait_t *wait, uint32_t wait_ms);
+
+/* Add credits (returned by the peer or of an unsent message), capped at the window */
+void flow_release(flow_control_t *flow, flow_wait_t *wait, uint32_t credits);
+
+/* A message was handled, the number of credits to return now (0 = keep collecting) */
+uint32_t flow_handled(flow_control_t *flow);
+
+/* Set the queue length of a receive port (0 = leave the default) */
+kern_return_t port_set_queue_limit(mach_port_t port, uint32_t limit);
+
+/* ============================================================================
+ * DELIVERY QUEUE
+ * ============================================================================ */
+
+#define DELIVERY_SLAB_SIZE 1024     // Preallocated records per server or client
+#define REPLY_ARENA_SIZE 128        // Reply buffers per size class of a server
+#define REGION_CACHE_BUDGET (256ULL * 1024 * 1024)  // Default mapped bytes per client
+
+/* Received user message waiting for its handler, queued per client and
+ * drained in order on the client's dispatch queue */
+typedef struct delivery {
+    mpsc_node_t node;               // First, records are cast from their node
+    uint32_t msgh_id;
+    internal_payload_t *payload;    // Detached, released after the handler
+    size_t payload_size;
+    const void *user_payload;
+    size_t user_payload_size;
+    mach_port_t remote_port;
+    uint64_t deadline_ns;           // Monotonic, safety margin included (0 = none)
+    uint64_t received_ns;           // Stats
+    // Worker pool only (unordered message types)
+    struct delivery *work_next;
+    void *owner;                    // client_info_t
+} delivery_t;
+
+/* Record from the slab, or from the heap once it is exhausted (NULL if out of memory) */
+delivery_t* delivery_alloc(slab_t *slab);
+void delivery_free(slab_t *slab, delivery_t *delivery);
+
 /* ============================================================================
  * CLIENT INFO (Server-side)
  * ============================================================================ */
 
 typedef struct {
     uint32_t id;                    // Unique client ID
+    uint32_t wire_version;          // Agreed on connect
     mach_port_t port;               // Client's reply port
+    mach_port_t reply_port;         // Acks go here once exchanged (NULL = port)
     dispatch_queue_t queue;         // Sequential message processing
+    mpsc_queue_t deliveries;        // User messages, drained on queue
+    dispatch_queue_t priority_queue; // Targets queue, higher QoS
+    mpsc_queue_t priority_deliveries; // IPC_MSG_PRIORITY messages, drained first
+    dispatch_group_t workers;       // Unordered messages in the worker pool
+    mach_server_t *server;
     bool death_notif_setup;         // Death notification registered
     volatile bool active;           // Client is active
+    int slot;                       // Slot in the server client table
+    int port_next;                  // Next slot in the port hash chain (-1 = end)
+    shared_memory_t *channel_shmem; // Client to server ring (NULL = none)
+    ring_t channel;                 // Drained on queue
+    stats_counter_t queue_depth;    // Messages dispatched on queue, not handled yet
+    // Queued for the handlers and not released yet, against the quotas
+    _Atomic uint64_t queued_bytes;  // User payload bytes
+    _Atomic uint32_t queued_messages;
+    flow_control_t flow;
+    pid_t pid;                      // From the connect audit trailer (0 = unknown)
+    region_cache_t regions;         // Memory entries mapped for the user
     char debug_name[64];            // For logging
 } client_info_t;
 
@@ -97,8 +354,26 @@ typedef struct {
  * SERVER STRUCTURE (Internal)
  * ============================================================================ */
 
-#define MAX_CLIENTS 100
+#define MAX_CLIENTS 100             // Default client capacity
+#define MAX_CLIENTS_LIMIT (1 << 20)
 #define MAX_ACKS 256
+#define CHANNEL_MAX_SIZE (1ULL << 30)
+#define MAX_TOPICS 4096
+
+/* Subscribers of one topic, a bit per client slot */
+typedef struct {
+    uint32_t topic;
+    int subscriber_count;
+    uint64_t *subscribers;
+} server_topic_t;
+
+/* Receiver thread with its own lane port (thread 0 runs on the caller of mach_server_run) */
+typedef struct {
+    mach_server_t *server;
+    mach_port_t lane_port;          // Clients pinned to this receiver send here
+    mach_port_t rcv_port;           // Port (set) the receive loop runs on
+    pthread_t thread;
+} server_receiver_t;
 
 struct mach_server {
     // Mach resources
@@ -106,23 +381,61 @@ struct mach_server {
     char service_name[128];
     
     // Client management
-    client_info_t *clients[MAX_CLIENTS];
+    // clients holds a client_info_t* per slot, port_buckets chains slots by
+    // port (through client_info_t.port_next), both guarded by clients_lock
+    Pool clients;
+    int *port_buckets;
+    uint32_t port_bucket_mask;
     pthread_mutex_t clients_lock;
     int client_count;
     uint32_t next_client_id;
     
+    // Subscriptions, sorted by topic and guarded by clients_lock
+    server_topic_t *topics;
+    int topic_count;
+    int topic_capacity;
+    int topic_words;                // Bitmap words per topic
+    
     // Message handling
-    pthread_t receiver_thread;
+    // With more than one receiver, every client is pinned to the lane port
+    // of one receiver thread, so its messages keep their order. Receiver 0
+    // also serves the service port (through lane_set).
+    int receiver_count;
+    server_receiver_t *receivers;
+    mach_port_t lane_set;
     
-    // Acknowledgment tracking
-    Pool ack_pool;
-    uint64_t next_correlation_id;
-    pthread_mutex_t ack_lock;
+    // Acknowledgment tracking, acks of clients arrive on reply_port and
+    // are matched on reply_thread, away from the user traffic
+    ack_table_t acks;
+    mach_port_t reply_port;
+    pthread_t reply_thread;
+    
+    // Unordered message types (a bit per type) are handled by up to
+    // worker_limit workers on the global queue, from one FIFO of all clients
+    uint64_t unordered_types[4];
+    pthread_mutex_t work_lock;
+    dispatch_group_t work_group;    // Running workers, waited for on destroy
+    delivery_t *work_head;
+    delivery_t *work_tail;
+    int worker_count;
+    int worker_limit;
+    
+    // Records of queued user messages, shared by all clients
+    slab_t delivery_slab;
+    
+    // Buffers of ipc_reply_alloc
+    arena_t reply_arena;
+    
+    // Senders waiting for client credits
+    flow_wait_t flow_wait;
+    
+    stats_endpoint_t stats;
     
     // Lifecycle
     volatile sig_atomic_t running;
     
-    // Callbacks & user data
+    // Options, callbacks & user data
+    server_options_t options;
     server_callbacks_t callbacks;
     void *user_data;
     
@@ -137,19 +450,54 @@ struct mach_server {
 struct mach_client {
     // Connection state
     mach_port_t server_port;
+    mach_port_t send_port;          // Server lane (or server_port) messages go to
     mach_port_t local_port;
     char service_name[128];
     uint32_t client_id;             // Server-assigned ID
     int client_slot;                // Server-assigned slot
+    uint32_t wire_version;          // Agreed on connect
     
     // Message handling
-    pthread_t receiver_thread;
+    pthread_t receiver_thread;       // Not started when a context receives for us
+    mach_client_context_t *context;
+    struct context_receiver *context_receiver;  // Pinned to while attached
+    mach_client_t *context_next;     // Chain of a context_receiver bucket
     dispatch_queue_t message_queue;  // Sequential processing queue
+    mpsc_queue_t deliveries;         // User messages, drained on message_queue
+    slab_t delivery_slab;
+    
+    // Acknowledgment tracking. Without a context acks of the server arrive
+    // on reply_port (reply_thread), acks to it go to ack_port once exchanged
+    ack_table_t acks;
+    mach_port_t reply_port;
+    pthread_t reply_thread;
+    mach_port_t ack_port;
+    
+    // Coalescing of fire-and-forget sends (batch_max_bytes 0 = off),
+    // the timer flushes on batch_queue
+    pthread_mutex_t batch_lock;
+    uint8_t *batch_buffer;
+    size_t batch_size;
+    size_t batch_capacity;
+    size_t batch_max_bytes;
+    uint32_t batch_max_delay_us;
+    dispatch_queue_t batch_queue;
+    dispatch_source_t batch_timer;
+    
+    // Flow control, configured before connect
+    flow_control_t flow;
+    flow_wait_t flow_wait;
+    uint32_t flow_receive_window;
+    uint32_t flow_send_wait_ms;
+    uint32_t port_queue_limit;
+    
+    // Shared memory channel, channel_lock serializes the producers and is
+    // held from reserve to commit
+    pthread_mutex_t channel_lock;
+    shared_memory_t *channel_shmem;
+    ring_t channel;
     
-    // Acknowledgment tracking
-    Pool ack_pool;
-    uint64_t next_correlation_id;
-    pthread_mutex_t ack_lock;
+    stats_endpoint_t stats;
     
     // Lifecycle
     volatile sig_atomic_t connected;
@@ -163,9 +511,59 @@ struct mach_client {
     resource_tracker_t *resources;
 };
 
+/* A receiver thread of a context and the clients pinned to it. Their local
+ * ports are members of its port_set only, so the messages of a client are
+ * taken in order by one thread */
+typedef struct context_receiver {
+    mach_client_context_t *context;
+    pthread_t thread;
+    mach_port_t port_set;
+    mach_port_t wakeup_port;        // Member of port_set, destroy wakes the receiver on it
+    pthread_rwlock_t members_lock;  // Shared while the receiver dispatches
+    mach_client_t **buckets;        // By local port, chained through context_next
+    uint32_t bucket_mask;
+    size_t member_count;
+} context_receiver_t;
+
+#define CONTEXT_PORT_BUCKET(receiver, port) \
+    (((uint32_t)(port) * 2654435761u) & (receiver)->bucket_mask)
+
+/* Receive side shared by clients, each pinned to one of its receivers on attach */
+struct mach_client_context {
+    context_receiver_t *receivers;
+    uint32_t receiver_count;
+    atomic_uint next_receiver;      // Round robin of attaching clients
+    volatile sig_atomic_t running;
+};
+
+/* Where acks of a client to its server go */
+#define SERVER_ACK_PORT(client) \
+    ((client)->ack_port != MACH_PORT_NULL ? (client)->ack_port : (client)->send_port)
+
+/* Where acks to a client go */
+#define CLIENT_ACK_PORT(client) \
+    ((client)->reply_port != MACH_PORT_NULL ? (client)->reply_port : (client)->port)
+
+#define CLIENT_PORT_BUCKET(server, port) \
+    (((uint32_t)(port) * 2654435761u) & (server)->port_bucket_mask)
+
+/* Client in a slot, NULL if free or out of range (clients_lock held) */
+static inline client_info_t* client_at_locked(mach_server_t *server, int slot) {
+    client_info_t **entry = (client_info_t**)pool_get(&server->clients, slot);
+    return entry ? *entry : NULL;
+}
+
+/* Subscription table (clients_lock held) */
+server_topic_t* find_topic_locked(mach_server_t *server, uint32_t topic);
+ipc_status_t subscribe_locked(mach_server_t *server, uint32_t topic, int slot);
+void unsubscribe_locked(mach_server_t *server, uint32_t topic, int slot);
+void unsubscribe_all_locked(mach_server_t *server, int slot);
+void destroy_topics(void *server);
+
 client_info_t* create_client(uint32_t id, mach_port_t port);
 void destroy_client(client_info_t *client);
 void remove_client(mach_server_t *server, client_info_t *client);
+void remove_client_locked(mach_server_t *server, client_info_t *client);
 
 /* ============================================================================
  * LOW-LEVEL PROTOCOL FUNCTIONS
@@ -183,37 +581,238 @@ kern_return_t protocol_send_message(
     uint64_t user_payload_tio_ms
 );
 
+/* protocol_send_message of a bare payload that never blocks: with the queue
+ * of the peer full the message is dropped and MACH_SEND_TIMED_OUT returned */
+kern_return_t protocol_try_send_message(
+    mach_port_t dest_port,
+    mach_msg_id_t msg_id,
+    internal_payload_t *payload
+);
+
 /* Send a message and wait for ack */
 kern_return_t protocol_send_with_ack(
     mach_port_t dest_port,
     mach_port_t reply_port,
-    Pool *ack_pool,
-    pthread_mutex_t *ack_lock,
-    uint64_t *next_correlation_id,
+    ack_table_t *acks,
     mach_msg_id_t msg_id,
     internal_payload_t *payload,
     size_t payload_size,
     const void *user_payload,
     size_t user_payload_size,
-    internal_payload_t **ack_payload,
-    size_t *ack_size,
+    internal_payload_t *ack_payload,
     const void **ack_user_payload,
     size_t *ack_user_size,
+    mach_port_t *ack_port,
     uint64_t timeout_ms
 );
 
+/* Send a message without waiting, completion runs on queue once the ack
+ * arrives or timeout_ms (0 = none) passes. It never runs when the send
+ * fails, the failure is returned. owner (may be NULL) tags the request for
+ * ack_table_abort_owner */
+kern_return_t protocol_send_async(
+    mach_port_t dest_port,
+    mach_port_t reply_port,
+    ack_table_t *acks,
+    mach_msg_id_t msg_id,
+    internal_payload_t *payload,
+    size_t payload_size,
+    const void *user_payload,
+    size_t user_payload_size,
+    uint64_t timeout_ms,
+    dispatch_queue_t queue,
+    ack_completion_t completion,
+    void *context,
+    const void *owner
+);
+
+/* protocol_send_message that moves the user payload pages to the receiver
+ * (deallocate=true) instead of copying them, see SEND_MOVED_PAYLOAD */
+kern_return_t protocol_send_owned_message(
+    mach_port_t dest_port,
+    mach_msg_id_t msg_id,
+    internal_payload_t *payload,
+    const void *user_payload,
+    size_t user_payload_size
+);
+
 /* Send an acknowledgment */
 kern_return_t protocol_send_ack(
     mach_port_t dest_port,
+    mach_port_t local_port,
     mach_msg_id_t original_msg_id,
     uint64_t correlation_id,
     int correlation_slot,
     internal_payload_t *ack_payload,
     size_t ack_payload_size,
     const void *ack_user_payload,
-    size_t ack_user_payload_size
+    size_t ack_user_payload_size,
+    bool move_user_payload
+);
+
+/* Answer a request sent with protocol_send_rpc, consumes reply_port */
+kern_return_t protocol_send_rpc_reply(
+    mach_port_t reply_port,
+    mach_msg_id_t original_msg_id,
+    uint64_t correlation_id,
+    internal_payload_t *ack_payload,
+    size_t ack_payload_size,
+    const void *ack_user_payload,
+    size_t ack_user_payload_size,
+    bool move_user_payload
+);
+
+/* protocol_send_ack and protocol_send_rpc_reply of a bare ack payload that
+ * never block: with the queue of the peer full the ack is dropped and
+ * MACH_SEND_TIMED_OUT returned. reply_port is consumed then as on success */
+kern_return_t protocol_try_send_ack(
+    mach_port_t dest_port,
+    mach_msg_id_t original_msg_id,
+    uint64_t correlation_id,
+    int correlation_slot,
+    internal_payload_t *ack_payload
+);
+
+kern_return_t protocol_try_send_rpc_reply(
+    mach_port_t reply_port,
+    mach_msg_id_t original_msg_id,
+    uint64_t correlation_id,
+    internal_payload_t *ack_payload
+);
+
+/* Whether a send with move_user_payload took the pages. Failures in the
+ * header stage leave the message untouched, later ones destroy it */
+#define SEND_MOVED_PAYLOAD(kr) \
+    ((kr) != KERN_INVALID_ARGUMENT && (kr) != MACH_SEND_INVALID_DEST && \
+     (kr) != MACH_SEND_INVALID_HEADER && (kr) != MACH_SEND_INVALID_REPLY && \
+     (kr) != MACH_SEND_MSG_TOO_SMALL)
+
+/* Send a request and receive its reply in one mach_msg on a reply port cached
+ * per thread, without the ack table. KERN_OPERATION_TIMED_OUT and KERN_ABORTED
+ * (dropped without reply) mean the request was sent, MACH_SEND_TIMED_OUT that
+ * the queue of the server stayed full for timeout_ms. The reply user payload
+ * is released with ply_free */
+kern_return_t protocol_send_rpc(
+    mach_port_t dest_port,
+    ack_table_t *acks,
+    mach_msg_id_t msg_id,
+    internal_payload_t *payload,
+    const void *user_payload,
+    size_t user_payload_size,
+    internal_payload_t *reply_payload,
+    const void **reply_user_payload,
+    size_t *reply_user_size,
+    uint32_t timeout_ms
+);
+
+/* Move inline payloads out of the receive buffer so they outlive the receive
+ * loop iteration (no-op for OOL payloads). Returns false on allocation failure. */
+bool protocol_detach_payload(
+    mach_msg_id_t msg_id,
+    internal_payload_t **payload,
+    size_t payload_size,
+    const void **user_payload,
+    size_t user_payload_size
+);
+
+/* Release payloads a handler took ownership of (OOL regions or a detached
+ * inline block), matching how they were transferred */
+void protocol_release_payload(
+    mach_msg_id_t msg_id,
+    internal_payload_t *payload,
+    size_t payload_size,
+    const void *user_payload,
+    size_t user_payload_size
+);
+
+/* Message built once and sent to many ports */
+typedef struct {
+    union {
+        mach_msg_header_t header;
+        internal_mach_msg_t ool;
+        internal_inline_mach_msg_t inln;
+        internal_shared_mach_msg_t shared;
+        char raw[INTERNAL_MSG_MAX(INTERNAL_INLINE_MSG_MAX_SIZE, sizeof(internal_shared_mach_msg_t))];
+    } msg;
+    internal_payload_t payload;     // OOL source, referenced by msg
+    mach_port_t memory_entry;       // Shared user payload (MACH_PORT_NULL = copied)
+} protocol_broadcast_t;
+
+/* Build a broadcast for receiver_count ports. Large payloads are placed in one
+ * read-only memory entry so receivers share the pages. The user payload is
+ * referenced, not copied, unless shared, so it has to outlive the sends, and
+ * broadcast must stay in place until released. */
+kern_return_t protocol_broadcast_prepare(
+    protocol_broadcast_t *broadcast,
+    mach_msg_id_t msg_id,
+    const internal_payload_t *payload,
+    const void *user_payload,
+    size_t user_payload_size,
+    size_t receiver_count
+);
+
+/* Send a prepared broadcast to one port, waiting at most timeout_ms (0 = never block) */
+kern_return_t protocol_broadcast_send(
+    protocol_broadcast_t *broadcast,
+    mach_port_t dest_port,
+    mach_msg_timeout_t timeout_ms
 );
 
+void protocol_broadcast_release(protocol_broadcast_t *broadcast);
+
+/* User payload handed to the callbacks running on this thread, where
+ * ipc_message_retain finds it. Scopes nest */
+typedef struct handler_scope {
+    const void *data;
+    size_t size;
+    bool region;                    // data is a VM region of its own
+    ipc_message_t *message;         // Retained by a callback, the scope holds a reference
+    struct handler_scope *outer;
+} handler_scope_t;
+
+void protocol_scope_enter(handler_scope_t *scope, const void *data, size_t size, bool region);
+
+/* End the scope, true if a callback took over the region (the caller
+ * must not release the user payload then) */
+bool protocol_scope_leave(handler_scope_t *scope);
+
+/* Append a record to a growing batch buffer. Returns false on allocation failure. */
+bool protocol_batch_append(
+    uint8_t **buffer,
+    size_t *size,
+    size_t *capacity,
+    uint32_t msg_type,
+    const void *data,
+    size_t data_size
+);
+
+/* Iterate the records of a batch, *offset starts at 0. Returns false at the
+ * end or on a malformed record. */
+bool protocol_batch_next(
+    const void *buffer,
+    size_t size,
+    size_t *offset,
+    uint32_t *msg_type,
+    const void **data,
+    size_t *data_size
+);
+
+/* User payload of a vectored send. One segment is used in place, more are
+ * copied into small up to the inline threshold, else into a page block
+ * (pages) the send can move */
+typedef struct {
+    const void *data;
+    size_t size;
+    bool pages;
+    uint8_t small[INTERNAL_INLINE_MAX_SIZE];
+} protocol_gather_t;
+
+/* Gather iovcnt segments into one user payload */
+ipc_status_t protocol_gather(protocol_gather_t *gather, const struct iovec *iov, int iovcnt);
+
+/* Release a gathered payload, moved as in arena_free */
+void protocol_gather_release(protocol_gather_t *gather, bool moved);
+
 /* Receive and dispatch messages (blocking with timeout) */
 typedef bool (*message_handler_t)(
     mach_port_t service_port,
@@ -225,15 +824,63 @@ typedef bool (*message_handler_t)(
     void *context
 );
 
+/* Receive until *running is cleared. The loops block without a timeout,
+ * clear the flag and then wake them with protocol_wakeup */
 void protocol_receive_loop(
     mach_port_t service_port,
     volatile sig_atomic_t *running,
-    Pool *ack_pool,
-    pthread_mutex_t *ack_lock,
+    ack_table_t *acks,
     message_handler_t handler,
     void *context
 );
 
+/* Queue count wakeup messages on a port this task receives on, so blocked
+ * receive loops check their running flag. Never blocks, a full queue wakes
+ * its receiver anyway */
+void protocol_wakeup(mach_port_t port, uint32_t count);
+
+/* Where a message received on a port set member goes */
+typedef struct {
+    mach_port_t port;               // Passed to the handler as service_port
+    ack_table_t *acks;
+    message_handler_t handler;
+    void *context;
+} receive_target_t;
+
+/* Look up the target of member local_port, false drops the message */
+typedef bool (*receive_route_t)(
+    mach_port_t local_port,
+    receive_target_t *target,
+    void *context
+);
+
+/* Receive for every member of port_set. route_lock is held shared from the
+ * route lookup until the handler returned, detach members exclusively */
+void protocol_receive_set_loop(
+    mach_port_t port_set,
+    volatile sig_atomic_t *running,
+    pthread_rwlock_t *route_lock,
+    receive_route_t route,
+    void *context
+);
+
+/* Handler of reply-only ports, acks are matched by the loop and the rest dropped */
+bool protocol_drop_message(
+    mach_port_t service_port,
+    mach_msg_header_t *header,
+    internal_payload_t *payload,
+    size_t payload_size,
+    const void *user_payload,
+    size_t user_payload_size,
+    void *context
+);
+
+/* Audit trailer of a message from protocol_receive_loop (NULL if missing) */
+const mach_msg_audit_trailer_t* protocol_audit_trailer(const mach_msg_header_t *header);
+
+/* Sender pid from an audit trailer */
+#define AUDIT_TRAILER_PID(trailer) ((pid_t)(trailer)->msgh_audit.val[5])
+
 /* ============================================================================
  * HELPER FUNCTIONS
  * ============================================================================ */
@@ -259,4 +906,10 @@ bool is_deadline_expired(struct timespec deadline, uint64_t safety_ms);
 
 bool has_no_deadline(struct timespec deadline);
 
+/* Monotonic time of a deadline plus safety_ms, comparable to
+ * monotonic_now_ns (0 = no deadline) */
+uint64_t deadline_to_ns(struct timespec deadline, uint64_t safety_ms);
+
+uint64_t monotonic_now_ns(void);
+
 #endif /* INTERNAL_H */
\ No newline at end of file
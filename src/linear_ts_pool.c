@@ -2,17 +2,37 @@
 #include <stdlib.h>
 #include <string.h>
 
+#define WORD_BITS 64
+
+static pthread_rwlock_t* entry_lock(LinearTSPool *pool, int index) {
+    return (pthread_rwlock_t*)(pool->slots + (size_t)index * pool->stride);
+}
+
+static void* entry_data(LinearTSPool *pool, int index) {
+    return pool->slots + (size_t)index * pool->stride + sizeof(pthread_rwlock_t);
+}
+
+static bool is_used(LinearTSPool *pool, int index) {
+    uint64_t word = atomic_load_explicit(&pool->used[index / WORD_BITS], memory_order_acquire);
+    return (word >> (index % WORD_BITS)) & 1;
+}
+
 void linear_ts_pool_init(LinearTSPool *pool, int capacity, int sizeof_data) {
     pool->capacity = capacity;
     pool->sizeof_data = sizeof_data;
-    pool->data = malloc(sizeof_data * capacity);
-    pool->used = calloc(capacity, sizeof(bool));
-    pool->locks = malloc(sizeof(pthread_mutex_t) * capacity);
+    pool->words = (capacity + WORD_BITS - 1) / WORD_BITS;
     
-    pthread_mutex_init(&pool->pool_lock, NULL);
+    // Neighbouring slots never share a cache line
+    size_t size = sizeof(pthread_rwlock_t) + (size_t)sizeof_data;
+    pool->stride = (size + LINEAR_TS_POOL_CACHELINE - 1) & ~(size_t)(LINEAR_TS_POOL_CACHELINE - 1);
+    if (posix_memalign((void**)&pool->slots, LINEAR_TS_POOL_CACHELINE,
+                       pool->stride * capacity) != 0) {
+        pool->slots = NULL;
+    }
+    pool->used = calloc(pool->words, sizeof(*pool->used));
     
-    for (int i = 0; i < capacity; i++) {
-        pthread_mutex_init(&pool->locks[i], NULL);
+    for (int i = 0; pool->slots && i < capacity; i++) {
+        pthread_rwlock_init(entry_lock(pool, i), NULL);
     }
 }
 
@@ -21,144 +41,119 @@ bool linear_ts_pool_set(LinearTSPool *pool, int index, void *value) {
         return false;
     }
     
-    pthread_mutex_lock(&pool->pool_lock);
-    
     if (value) {
-        memcpy(
-            (char*)pool->data + index * pool->sizeof_data,
-            value,
-            pool->sizeof_data
-        );
+        memcpy(entry_data(pool, index), value, pool->sizeof_data);
     }
-    pool->used[index] = true;
-    
-    pthread_mutex_unlock(&pool->pool_lock);
+    // Release publishes the value with the bit
+    atomic_fetch_or_explicit(&pool->used[index / WORD_BITS], 1ULL << (index % WORD_BITS),
+                             memory_order_release);
     return true;
 }
 
 void linear_ts_pool_remove(LinearTSPool *pool, int index) {
     if (index < 0 || index >= pool->capacity) return;
     
-    pthread_mutex_lock(&pool->pool_lock);
-    pool->used[index] = false;
-    pthread_mutex_unlock(&pool->pool_lock);
+    atomic_fetch_and_explicit(&pool->used[index / WORD_BITS], ~(1ULL << (index % WORD_BITS)),
+                              memory_order_release);
 }
 
 void* linear_ts_pool_get(LinearTSPool *pool, int index) {
-    if (index < 0 || index >= pool->capacity) {
-        return NULL;
-    }
-    
-    pthread_mutex_lock(&pool->pool_lock);
-    bool active = pool->used[index];
-    pthread_mutex_unlock(&pool->pool_lock);
-    
-    if (!active) {
+    if (index < 0 || index >= pool->capacity || !is_used(pool, index)) {
         return NULL;
     }
-    
-    return (char*)pool->data + index * pool->sizeof_data;
+    return entry_data(pool, index);
 }
 
 bool linear_ts_pool_is_active(LinearTSPool *pool, int index) {
     if (index < 0 || index >= pool->capacity) {
         return false;
     }
-    
-    pthread_mutex_lock(&pool->pool_lock);
-    bool active = pool->used[index];
-    pthread_mutex_unlock(&pool->pool_lock);
-    
-    return active;
+    return is_used(pool, index);
 }
 
 int linear_ts_pool_find_free(LinearTSPool *pool) {
-    pthread_mutex_lock(&pool->pool_lock);
-    
-    int result = -1;
-    for (int i = 0; i < pool->capacity; i++) {
-        if (!pool->used[i]) {
-            result = i;
-            break;
+    for (int w = 0; w < pool->words; w++) {
+        uint64_t free_bits = ~atomic_load_explicit(&pool->used[w], memory_order_relaxed);
+        if (free_bits) {
+            int index = w * WORD_BITS + __builtin_ctzll(free_bits);
+            return index < pool->capacity ? index : -1;
         }
     }
-    
-    pthread_mutex_unlock(&pool->pool_lock);
-    return result;
+    return -1;
 }
 
-bool linear_ts_pool_lock_entry(LinearTSPool *pool, int index) {
-    if (index < 0 || index >= pool->capacity) {
+int linear_ts_pool_claim_free(LinearTSPool *pool, void *value) {
+    for (int w = 0; w < pool->words; w++) {
+        uint64_t word = atomic_load_explicit(&pool->used[w], memory_order_relaxed);
+        while (~word) {
+            int bit = __builtin_ctzll(~word);
+            int index = w * WORD_BITS + bit;
+            if (index >= pool->capacity) {
+                return -1;
+            }
+            // The bit is published with the entry locked, a locker that sees
+            // it active waits until the value is in
+            pthread_rwlock_wrlock(entry_lock(pool, index));
+            if (atomic_compare_exchange_weak_explicit(&pool->used[w], &word,
+                                                      word | (1ULL << bit),
+                                                      memory_order_acquire,
+                                                      memory_order_relaxed)) {
+                if (value) {
+                    memcpy(entry_data(pool, index), value, pool->sizeof_data);
+                }
+                pthread_rwlock_unlock(entry_lock(pool, index));
+                return index;
+            }
+            pthread_rwlock_unlock(entry_lock(pool, index));
+        }
+    }
+    return -1;
+}
+
+// Lock, then check the entry is still active
+static bool lock_active(LinearTSPool *pool, int index, int (*lock)(pthread_rwlock_t*)) {
+    if (index < 0 || index >= pool->capacity || !is_used(pool, index)) {
         return false;
     }
     
-    // Check if entry is active before locking
-    pthread_mutex_lock(&pool->pool_lock);
-    bool active = pool->used[index];
-    pthread_mutex_unlock(&pool->pool_lock);
-    
-    if (!active) {
+    if (lock(entry_lock(pool, index)) != 0) {
         return false;
     }
     
-    pthread_mutex_lock(&pool->locks[index]);
-    
     // Double-check after acquiring lock
-    pthread_mutex_lock(&pool->pool_lock);
-    active = pool->used[index];
-    pthread_mutex_unlock(&pool->pool_lock);
-    
-    if (!active) {
-        pthread_mutex_unlock(&pool->locks[index]);
+    if (!is_used(pool, index)) {
+        pthread_rwlock_unlock(entry_lock(pool, index));
         return false;
     }
     
     return true;
 }
 
+bool linear_ts_pool_lock_entry(LinearTSPool *pool, int index) {
+    return lock_active(pool, index, pthread_rwlock_wrlock);
+}
+
+bool linear_ts_pool_lock_entry_shared(LinearTSPool *pool, int index) {
+    return lock_active(pool, index, pthread_rwlock_rdlock);
+}
+
 void linear_ts_pool_unlock_entry(LinearTSPool *pool, int index) {
     if (index < 0 || index >= pool->capacity) {
         return;
     }
-    pthread_mutex_unlock(&pool->locks[index]);
+    pthread_rwlock_unlock(entry_lock(pool, index));
 }
 
 bool linear_ts_pool_trylock_entry(LinearTSPool *pool, int index) {
-    if (index < 0 || index >= pool->capacity) {
-        return false;
-    }
-    
-    pthread_mutex_lock(&pool->pool_lock);
-    bool active = pool->used[index];
-    pthread_mutex_unlock(&pool->pool_lock);
-    
-    if (!active) {
-        return false;
-    }
-    
-    if (pthread_mutex_trylock(&pool->locks[index]) != 0) {
-        return false;
-    }
-    
-    // Double-check after acquiring lock
-    pthread_mutex_lock(&pool->pool_lock);
-    active = pool->used[index];
-    pthread_mutex_unlock(&pool->pool_lock);
-    
-    if (!active) {
-        pthread_mutex_unlock(&pool->locks[index]);
-        return false;
-    }
-    
-    return true;
+    return lock_active(pool, index, pthread_rwlock_trywrlock);
 }
 
 void linear_ts_pool_free(LinearTSPool *pool) {
-    for (int i = 0; i < pool->capacity; i++) {
-        pthread_mutex_destroy(&pool->locks[i]);
+    for (int i = 0; pool->slots && i < pool->capacity; i++) {
+        pthread_rwlock_destroy(entry_lock(pool, i));
     }
-    free(pool->locks);
-    free(pool->data);
-    free(pool->used);
-    pthread_mutex_destroy(&pool->pool_lock);
-}
\ No newline at end of file
+    free(pool->slots);
+    free((void*)pool->used);
+    pool->slots = NULL;
+    pool->used = NULL;
+}
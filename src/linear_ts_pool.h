@@ -2,15 +2,19 @@
 #define LINEAR_POOL_H
 
 #include <stdbool.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <pthread.h>
 
+#define LINEAR_TS_POOL_CACHELINE 128    // Apple silicon cache line
+
 typedef struct {
-    void *data;              // actual values
-    pthread_mutex_t *locks;  // per-entry locks
-    bool *used;              // whether a slot is in use
-    int capacity;            // total capacity
-    int sizeof_data;         // size of each element
-    pthread_mutex_t pool_lock; // for structural changes (set/remove)
+    uint8_t *slots;                 // Per entry: lock, then the value, cache line padded
+    size_t stride;                  // Bytes per slot
+    _Atomic uint64_t *used;         // Bitmap of slots in use
+    int words;                      // Bitmap words
+    int capacity;                   // total capacity
+    int sizeof_data;                // size of each element
 } LinearTSPool;
 
 // Initialize pool with given capacity and element size
@@ -32,11 +36,18 @@ bool linear_ts_pool_is_active(LinearTSPool *pool, int index);
 // Find first free slot, return index or -1 if full
 int linear_ts_pool_find_free(LinearTSPool *pool);
 
+// Take the first free slot and set its value in one step, index or -1 if full
+int linear_ts_pool_claim_free(LinearTSPool *pool, void *value);
+
 // Lock an entry for exclusive access (blocks other threads from this entry only)
 // Returns true if locked successfully, false if entry is not active
 bool linear_ts_pool_lock_entry(LinearTSPool *pool, int index);
 
-// Unlock an entry
+// Lock an entry for reading, readers of the same entry run concurrently
+// Returns true if locked successfully, false if entry is not active
+bool linear_ts_pool_lock_entry_shared(LinearTSPool *pool, int index);
+
+// Unlock an entry (exclusive or shared)
 void linear_ts_pool_unlock_entry(LinearTSPool *pool, int index);
 
 // Try to lock an entry (non-blocking)
@@ -45,4 +56,4 @@ bool linear_ts_pool_trylock_entry(LinearTSPool *pool, int index);
 // Cleanup pool memory
 void linear_ts_pool_free(LinearTSPool *pool);
 
-#endif // LINEAR_POOL_H
\ No newline at end of file
+#endif // LINEAR_POOL_H
@@ -0,0 +1,335 @@
+#include "log.h"
+#include "ring.h"
+#include "mach_ipc.h"
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define LOG_LINE_MAX        512             // Longer lines are truncated
+#define LOG_BUFFER_SIZE     (64 * 1024)     // Ring of one thread
+#define LOG_IDLE_WAIT_MS    100             // Drainer wakes up to free rings of exited threads
+
+// Record in a thread ring, the text follows NUL terminated
+typedef struct {
+    const log_site_t *site;
+    uint64_t timestamp_ns;
+} log_record_t;
+
+// Ring of one thread, freed by the drainer once the thread is gone and the
+// ring is empty
+typedef struct log_buffer {
+    ring_t producer;
+    ring_t consumer;
+    void *memory;
+    atomic_bool orphaned;
+    bool drained;                   // Orphaned and emptied, drainer only
+    struct log_buffer *next;
+} log_buffer_t;
+
+static _Atomic(ipc_log_sink_t) log_sink;
+static void *_Atomic log_sink_context;
+
+static pthread_once_t log_once = PTHREAD_ONCE_INIT;
+static pthread_key_t buffer_key;
+static pthread_mutex_t buffers_lock = PTHREAD_MUTEX_INITIALIZER;
+static log_buffer_t *buffers;
+static bool drainer_started;
+
+// Held for a drain pass, so ipc_log_flush never races the drainer
+static pthread_mutex_t drain_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t wake_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake_cond = PTHREAD_COND_INITIALIZER;
+static bool wake_pending;
+
+static _Atomic uint64_t dropped_lines;
+
+// Lines logged while a drain runs (by the sink) are written directly, so a
+// logging sink doesn't keep its own drain going
+static _Thread_local bool draining;
+
+static uint64_t log_now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+static void default_sink(int level, const char *file, int line, uint64_t timestamp_ns,
+                         const char *message, void *context) {
+    (void)context;
+    static const char *names[] = { "DEBUG", "INFO", "WARN", "ERROR" };
+    
+    time_t seconds = (time_t)(timestamp_ns / 1000000000ULL);
+    struct tm time_info;
+    char time_str[20];
+    localtime_r(&seconds, &time_info);
+    strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", &time_info);
+    
+    fprintf(level >= LOG_ERROR ? stderr : stdout, "[%s] [%s] %s:%d: %s\n",
+            time_str, names[level < LOG_ERROR ? level : LOG_ERROR], file, line, message);
+}
+
+static void emit(const log_site_t *site, uint64_t timestamp_ns, const char *message) {
+    ipc_log_sink_t sink = atomic_load_explicit(&log_sink, memory_order_acquire);
+    void *context = atomic_load_explicit(&log_sink_context, memory_order_relaxed);
+    (sink ? sink : default_sink)(site->level, site->file, site->line, timestamp_ns,
+                                 message, context);
+}
+
+/* ============================================================================
+ * Drainer
+ * ============================================================================ */
+
+static const log_site_t dropped_site = { LOG_WARN, "WARN", __FILE__, __LINE__ };
+
+// drain_lock held. The sink runs without buffers_lock, threads logging for
+// the first time register their ring meanwhile
+static void drain_buffers(void) {
+    draining = true;
+    
+    // New rings only go in front and only the drain unlinks, so the list
+    // from this head on stays as it is
+    pthread_mutex_lock(&buffers_lock);
+    log_buffer_t *head = buffers;
+    pthread_mutex_unlock(&buffers_lock);
+    
+    bool drained = false;
+    for (log_buffer_t *buffer = head; buffer; buffer = buffer->next) {
+        // Orphaned before the last peek, so nothing can follow it
+        bool orphaned = atomic_load_explicit(&buffer->orphaned, memory_order_acquire);
+        uint32_t type;
+        const void *data;
+        size_t size;
+        while (ring_peek(&buffer->consumer, &type, &data, &size)) {
+            const log_record_t *record = (const log_record_t*)data;
+            emit(record->site, record->timestamp_ns, (const char*)(record + 1));
+            ring_consume(&buffer->consumer);
+        }
+        buffer->drained = orphaned;
+        drained = drained || orphaned;
+    }
+    
+    if (drained) {
+        log_buffer_t *orphans = NULL;
+        pthread_mutex_lock(&buffers_lock);
+        log_buffer_t **link = &buffers;
+        while (*link) {
+            log_buffer_t *buffer = *link;
+            if (buffer->drained) {
+                *link = buffer->next;
+                buffer->next = orphans;
+                orphans = buffer;
+            } else {
+                link = &buffer->next;
+            }
+        }
+        pthread_mutex_unlock(&buffers_lock);
+        
+        while (orphans) {
+            log_buffer_t *buffer = orphans;
+            orphans = buffer->next;
+            free(buffer->memory);
+            free(buffer);
+        }
+    }
+    
+    uint64_t dropped = atomic_exchange_explicit(&dropped_lines, 0, memory_order_relaxed);
+    if (dropped) {
+        char message[64];
+        snprintf(message, sizeof(message), "%llu log lines dropped, buffer full",
+                 (unsigned long long)dropped);
+        emit(&dropped_site, log_now_ns(), message);
+    }
+    draining = false;
+}
+
+// False if a ring got records meanwhile
+static bool park_buffers(void) {
+    bool parked = true;
+    pthread_mutex_lock(&buffers_lock);
+    for (log_buffer_t *buffer = buffers; buffer; buffer = buffer->next) {
+        parked = ring_park(&buffer->consumer) && parked;
+    }
+    pthread_mutex_unlock(&buffers_lock);
+    return parked;
+}
+
+static void* drain_thread(void *arg) {
+    (void)arg;
+    
+    for (;;) {
+        pthread_mutex_lock(&drain_lock);
+        drain_buffers();
+        pthread_mutex_unlock(&drain_lock);
+        
+        if (!park_buffers()) {
+            continue;
+        }
+        
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += LOG_IDLE_WAIT_MS * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        
+        pthread_mutex_lock(&wake_lock);
+        while (!wake_pending &&
+               pthread_cond_timedwait(&wake_cond, &wake_lock, &deadline) == 0) {
+        }
+        wake_pending = false;
+        pthread_mutex_unlock(&wake_lock);
+    }
+    return NULL;
+}
+
+static void wake_drainer(void) {
+    pthread_mutex_lock(&wake_lock);
+    wake_pending = true;
+    pthread_cond_signal(&wake_cond);
+    pthread_mutex_unlock(&wake_lock);
+}
+
+static void release_buffer(void *arg) {
+    log_buffer_t *buffer = (log_buffer_t*)arg;
+    atomic_store_explicit(&buffer->orphaned, true, memory_order_release);
+    wake_drainer();
+}
+
+static void log_init(void) {
+    pthread_key_create(&buffer_key, release_buffer);
+    
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, drain_thread, NULL) == 0) {
+        pthread_detach(thread);
+        drainer_started = true;
+        atexit(ipc_log_flush);
+    }
+}
+
+// Ring of the calling thread, NULL if lines have to be written directly
+static log_buffer_t* thread_buffer(void) {
+    pthread_once(&log_once, log_init);
+    if (!drainer_started) {
+        return NULL;
+    }
+    
+    log_buffer_t *buffer = pthread_getspecific(buffer_key);
+    if (buffer) {
+        return buffer;
+    }
+    
+    buffer = calloc(1, sizeof(log_buffer_t));
+    size_t memory_size = ring_mapping_size(LOG_BUFFER_SIZE);
+    void *memory = buffer ? malloc(memory_size) : NULL;
+    if (!memory || !ring_create(&buffer->producer, memory, memory_size) ||
+        !ring_attach(&buffer->consumer, memory, memory_size)) {
+        free(memory);
+        free(buffer);
+        return NULL;
+    }
+    buffer->memory = memory;
+    atomic_init(&buffer->orphaned, false);
+    
+    pthread_mutex_lock(&buffers_lock);
+    buffer->next = buffers;
+    buffers = buffer;
+    pthread_mutex_unlock(&buffers_lock);
+    
+    pthread_setspecific(buffer_key, buffer);
+    return buffer;
+}
+
+/* ============================================================================
+ * Producers
+ * ============================================================================ */
+
+static size_t format_line(char *text, uint32_t suppressed, const char *fmt, va_list args) {
+    int length = vsnprintf(text, LOG_LINE_MAX, fmt, args);
+    if (length < 0) {
+        text[0] = '\0';
+        length = 0;
+    } else if (length >= LOG_LINE_MAX) {
+        length = LOG_LINE_MAX - 1;
+    }
+    
+    if (suppressed && length < LOG_LINE_MAX - 1) {
+        int extra = snprintf(text + length, LOG_LINE_MAX - length,
+                             " (%u similar suppressed)", suppressed);
+        length = extra < 0 ? length
+               : length + extra >= LOG_LINE_MAX ? LOG_LINE_MAX - 1
+               : length + extra;
+    }
+    return (size_t)length;
+}
+
+void log_write(const log_site_t *site, uint32_t suppressed, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    
+    log_buffer_t *buffer = LOG_ASYNC && !draining ? thread_buffer() : NULL;
+    if (!buffer) {
+        char text[LOG_LINE_MAX];
+        format_line(text, suppressed, fmt, args);
+        emit(site, log_now_ns(), text);
+        va_end(args);
+        return;
+    }
+    
+    // Never wait for the drainer, a full ring drops the line
+    log_record_t *record = ring_reserve(&buffer->producer, sizeof(log_record_t) + LOG_LINE_MAX);
+    if (!record) {
+        atomic_fetch_add_explicit(&dropped_lines, 1, memory_order_relaxed);
+        va_end(args);
+        return;
+    }
+    
+    record->site = site;
+    record->timestamp_ns = log_now_ns();
+    size_t length = format_line((char*)(record + 1), suppressed, fmt, args);
+    va_end(args);
+    
+    bool wake = false;
+    ring_commit(&buffer->producer, (uint32_t)site->level,
+                sizeof(log_record_t) + length + 1, &wake);
+    if (wake) {
+        wake_drainer();
+    }
+}
+
+bool log_limit(log_limit_t *limit, uint32_t *suppressed) {
+    uint64_t now = log_now_ns();
+    uint64_t start = atomic_load_explicit(&limit->window_start, memory_order_relaxed);
+    
+    if (now - start >= LOG_BURST_WINDOW_NS &&
+        atomic_compare_exchange_strong_explicit(&limit->window_start, &start, now,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        atomic_store_explicit(&limit->count, 0, memory_order_relaxed);
+    }
+    
+    if (atomic_fetch_add_explicit(&limit->count, 1, memory_order_relaxed) >= LOG_BURST) {
+        atomic_fetch_add_explicit(&limit->suppressed, 1, memory_order_relaxed);
+        return false;
+    }
+    *suppressed = atomic_exchange_explicit(&limit->suppressed, 0, memory_order_relaxed);
+    return true;
+}
+
+/* ============================================================================
+ * Public API
+ * ============================================================================ */
+
+void ipc_set_log_sink(ipc_log_sink_t sink, void *context) {
+    atomic_store_explicit(&log_sink_context, context, memory_order_relaxed);
+    atomic_store_explicit(&log_sink, sink, memory_order_release);
+}
+
+void ipc_log_flush(void) {
+    pthread_mutex_lock(&drain_lock);
+    drain_buffers();
+    pthread_mutex_unlock(&drain_lock);
+}
@@ -1,49 +1,92 @@
-#include <stdio.h>
-#include <time.h>
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
 
 // Define the log levels
 #define LOG_DEBUG  0
 #define LOG_INFO   1
 #define LOG_WARN   2
 #define LOG_ERROR  3
+#define LOG_NONE   4    // Compiles every log statement away
 
 // Set the active log level here
 #ifndef LOG_LEVEL
 #define LOG_LEVEL LOG_DEBUG
 #endif
 
+// Lines are formatted into a ring of the calling thread and written by a
+// background thread, LOG_ASYNC=0 hands them to the sink right away
+#ifndef LOG_ASYNC
+#define LOG_ASYNC 1
+#endif
+
+// Warnings and errors of one call site beyond LOG_BURST a second are
+// dropped, the next line that passes reports how many
+#define LOG_BURST 20
+#define LOG_BURST_WINDOW_NS 1000000000ULL
+
+// Static per call site, a record refers to it instead of copying it
+typedef struct {
+    int level;
+    const char *name;
+    const char *file;
+    int line;
+} log_site_t;
+
+typedef struct {
+    _Atomic uint64_t window_start;
+    _Atomic uint32_t count;
+    _Atomic uint32_t suppressed;
+} log_limit_t;
+
+void log_write(const log_site_t *site, uint32_t suppressed, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+// Count a line of a rate limited site, false if it is dropped. *suppressed
+// gets the lines dropped since the last one that passed
+bool log_limit(log_limit_t *limit, uint32_t *suppressed);
+
 // Helper macro to handle variable arguments with file and line info
-#define LOG_PRINT(stream, level, fmt, ...) do { \
-    time_t now = time(NULL); \
-    struct tm time_info; \
-    char time_str[20]; \
-    localtime_r(&now, &time_info); \
-    strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", &time_info); \
-    fprintf(stream, "[%s] [%s] %s:%d: " fmt "\n", \
-            time_str, level, __FILE__, __LINE__, ##__VA_ARGS__); \
+#define LOG_PRINT(level, name, fmt, ...) do { \
+    static const log_site_t log_site = { level, name, __FILE__, __LINE__ }; \
+    log_write(&log_site, 0, fmt, ##__VA_ARGS__); \
+} while(0)
+
+#define LOG_PRINT_LIMITED(level, name, fmt, ...) do { \
+    static const log_site_t log_site = { level, name, __FILE__, __LINE__ }; \
+    static log_limit_t log_site_limit; \
+    uint32_t log_suppressed; \
+    if (log_limit(&log_site_limit, &log_suppressed)) { \
+        log_write(&log_site, log_suppressed, fmt, ##__VA_ARGS__); \
+    } \
 } while(0)
 
 // Macros for logging messages
 #if LOG_LEVEL <= LOG_DEBUG
-    #define LOG_DEBUG_MSG(fmt, ...) LOG_PRINT(stdout, "DEBUG", fmt, ##__VA_ARGS__)
+    #define LOG_DEBUG_MSG(fmt, ...) LOG_PRINT(LOG_DEBUG, "DEBUG", fmt, ##__VA_ARGS__)
 #else
     #define LOG_DEBUG_MSG(fmt, ...)  // Disabled
 #endif
 
 #if LOG_LEVEL <= LOG_INFO
-    #define LOG_INFO_MSG(fmt, ...) LOG_PRINT(stdout, "INFO", fmt, ##__VA_ARGS__)
+    #define LOG_INFO_MSG(fmt, ...) LOG_PRINT(LOG_INFO, "INFO", fmt, ##__VA_ARGS__)
 #else
     #define LOG_INFO_MSG(fmt, ...)  // Disabled
 #endif
 
 #if LOG_LEVEL <= LOG_WARN
-    #define LOG_WARN_MSG(fmt, ...) LOG_PRINT(stdout, "WARN", fmt, ##__VA_ARGS__)
+    #define LOG_WARN_MSG(fmt, ...) LOG_PRINT_LIMITED(LOG_WARN, "WARN", fmt, ##__VA_ARGS__)
 #else
     #define LOG_WARN_MSG(fmt, ...)  // Disabled
 #endif
 
 #if LOG_LEVEL <= LOG_ERROR
-    #define LOG_ERROR_MSG(fmt, ...) LOG_PRINT(stderr, "ERROR", fmt, ##__VA_ARGS__)
+    #define LOG_ERROR_MSG(fmt, ...) LOG_PRINT_LIMITED(LOG_ERROR, "ERROR", fmt, ##__VA_ARGS__)
 #else
     #define LOG_ERROR_MSG(fmt, ...)  // Disabled
 #endif
+
+#endif // LOG_H
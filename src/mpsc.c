@@ -0,0 +1,64 @@
+#include "mpsc.h"
+#include <stddef.h>
+
+void mpsc_init(mpsc_queue_t *queue) {
+    atomic_init(&queue->stub.next, NULL);
+    atomic_init(&queue->tail, &queue->stub);
+    queue->head = &queue->stub;
+    atomic_init(&queue->scheduled, false);
+}
+
+static void link_node(mpsc_queue_t *queue, mpsc_node_t *node) {
+    atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+    // seq_cst orders it before the scheduled exchange, see mpsc_finish
+    mpsc_node_t *prev = atomic_exchange_explicit(&queue->tail, node, memory_order_seq_cst);
+    atomic_store_explicit(&prev->next, node, memory_order_release);
+}
+
+bool mpsc_push(mpsc_queue_t *queue, mpsc_node_t *node) {
+    link_node(queue, node);
+    return !atomic_exchange_explicit(&queue->scheduled, true, memory_order_seq_cst);
+}
+
+mpsc_node_t* mpsc_pop(mpsc_queue_t *queue) {
+    mpsc_node_t *head = queue->head;
+    mpsc_node_t *next = atomic_load_explicit(&head->next, memory_order_acquire);
+
+    if (head == &queue->stub) {
+        if (!next) {
+            return NULL;
+        }
+        queue->head = next;
+        head = next;
+        next = atomic_load_explicit(&head->next, memory_order_acquire);
+    }
+
+    if (next) {
+        queue->head = next;
+        return head;
+    }
+
+    if (atomic_load_explicit(&queue->tail, memory_order_acquire) != head) {
+        // Producer between exchange and link
+        return NULL;
+    }
+
+    // head is the last node, put the stub behind it so it can be handed out
+    link_node(queue, &queue->stub);
+    next = atomic_load_explicit(&head->next, memory_order_acquire);
+    if (next) {
+        queue->head = next;
+        return head;
+    }
+    return NULL;
+}
+
+bool mpsc_finish(mpsc_queue_t *queue) {
+    atomic_store_explicit(&queue->scheduled, false, memory_order_seq_cst);
+
+    // A push that saw scheduled still set is visible here
+    if (atomic_load_explicit(&queue->tail, memory_order_seq_cst) == queue->head) {
+        return false;
+    }
+    return !atomic_exchange_explicit(&queue->scheduled, true, memory_order_seq_cst);
+}
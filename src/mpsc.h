@@ -0,0 +1,33 @@
+#ifndef MPSC_H
+#define MPSC_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+// Intrusive link, embedded in the queued record
+typedef struct mpsc_node {
+    struct mpsc_node *_Atomic next;
+} mpsc_node_t;
+
+// Unbounded multi-producer single-consumer queue (Vyukov). The scheduled
+// flag makes sure exactly one consumer runs, without a lock on either side
+typedef struct {
+    mpsc_node_t *_Atomic tail;      // Producers
+    mpsc_node_t *head;              // Consumer
+    mpsc_node_t stub;
+    atomic_bool scheduled;
+} mpsc_queue_t;
+
+void mpsc_init(mpsc_queue_t *queue);
+
+// Append a node, true if the caller has to schedule the consumer
+bool mpsc_push(mpsc_queue_t *queue, mpsc_node_t *node);
+
+// Oldest node or NULL (consumer only). NULL may also mean a producer is
+// still linking its node, mpsc_finish catches that case
+mpsc_node_t* mpsc_pop(mpsc_queue_t *queue);
+
+// Consumer found the queue empty, true if it has to keep draining
+bool mpsc_finish(mpsc_queue_t *queue);
+
+#endif // MPSC_H
@@ -3,12 +3,21 @@
 #include <string.h>
 #include <stdio.h>
 
-void pool_init(Pool *pool, int capacity, int sizeof_data) {
+bool pool_init(Pool *pool, int capacity, int sizeof_data) {
     pool->capacity = capacity;
     pool->sizeof_data = sizeof_data;
-    pool->data = malloc(sizeof_data * capacity);
+    pool->data = malloc((size_t)sizeof_data * capacity);
     pool->next = malloc(sizeof(int) * capacity);
     pool->used = calloc(capacity, sizeof(bool));
+    if (!pool->data || !pool->next || !pool->used) {
+        pool_free(pool);
+        pool->data = NULL;
+        pool->next = NULL;
+        pool->used = NULL;
+        pool->capacity = 0;
+        pool->free_head = -1;
+        return false;
+    }
 
     // link all indices into a free list
     for (int i = 0; i < capacity - 1; i++) {
@@ -16,6 +25,7 @@ void pool_init(Pool *pool, int capacity, int sizeof_data) {
     }
     pool->next[capacity - 1] = -1; // end of list
     pool->free_head = 0;
+    return true;
 }
 
 int pool_push(Pool *pool, void *value) {
@@ -12,8 +12,8 @@ typedef struct {
     bool *used;       // whether a slot is in use
 } Pool;
 
-// Initialize pool with given capacity and element size
-void pool_init(Pool *pool, int capacity, int sizeof_data);
+// Initialize pool with given capacity and element size, false if out of memory
+bool pool_init(Pool *pool, int capacity, int sizeof_data);
 
 // Push a value, return its index or -1 if full
 int pool_push(Pool *pool, void *value);
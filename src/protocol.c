@@ -36,23 +36,576 @@
 //     }
 // }
 
+bool protocol_detach_payload(
+    mach_msg_id_t msg_id,
+    internal_payload_t **payload,
+    size_t payload_size,
+    const void **user_payload,
+    size_t user_payload_size
+) {
+    if (!HAS_FEATURE_INLN(msg_id)) {
+        if (!HAS_FEATURE_CMPT(msg_id)) {
+            // OOL regions are owned by us already
+            return true;
+        }
+        
+        // Decoded compact header, only the user payload is a region
+        internal_payload_t *copy = malloc(payload_size);
+        if (!copy) {
+            LOG_ERROR_MSG("Failed to detach compact payload of size %zu", payload_size);
+            return false;
+        }
+        memcpy(copy, *payload, payload_size);
+        *payload = copy;
+        return true;
+    }
+
+    // One block for both, released together in protocol_release_payload
+    char *block = malloc(payload_size + user_payload_size);
+    if (!block) {
+        LOG_ERROR_MSG("Failed to detach inline payload of size %zu",
+                      payload_size + user_payload_size);
+        return false;
+    }
+
+    memcpy(block, *payload, payload_size);
+    *payload = (internal_payload_t*)block;
+
+    if (*user_payload && user_payload_size) {
+        memcpy(block + payload_size, *user_payload, user_payload_size);
+        *user_payload = block + payload_size;
+    }
+
+    return true;
+}
+
+void protocol_release_payload(
+    mach_msg_id_t msg_id,
+    internal_payload_t *payload,
+    size_t payload_size,
+    const void *user_payload,
+    size_t user_payload_size
+) {
+    if (HAS_FEATURE_INLN(msg_id)) {
+        // Detached block holds both payloads
+        free(payload);
+        return;
+    }
+
+    kern_return_t kr;
+    if (HAS_FEATURE_CMPT(msg_id)) {
+        // Detached copy of the decoded header
+        free(payload);
+    } else {
+        kr = vm_deallocate(mach_task_self(), (vm_address_t)payload, payload_size);
+        if (kr != KERN_SUCCESS) {
+            LOG_ERROR_MSG("Failed to clean payload: 0x%x (%s)", kr, mach_error_string(kr));
+        }
+    }
+    if (user_payload && user_payload_size) {
+        kr = vm_deallocate(mach_task_self(), (vm_address_t)user_payload, user_payload_size);
+        if (kr != KERN_SUCCESS) {
+            LOG_ERROR_MSG("Failed to clean user payload: 0x%x (%s)", kr, mach_error_string(kr));
+        }
+    }
+}
+
+/* ============================================================================
+ * RETAINED MESSAGES
+ * ============================================================================ */
+
+struct ipc_message {
+    _Atomic uint32_t refs;
+    void *data;
+    size_t size;
+    bool region;                    // vm_deallocate, else a heap copy
+};
+
+static _Thread_local handler_scope_t *current_scope;
+
+void protocol_scope_enter(handler_scope_t *scope, const void *data, size_t size, bool region) {
+    *scope = (handler_scope_t){
+        .data = size ? data : NULL,
+        .size = size,
+        .region = region,
+        .outer = current_scope
+    };
+    current_scope = scope;
+}
+
+bool protocol_scope_leave(handler_scope_t *scope) {
+    current_scope = scope->outer;
+    if (!scope->message) {
+        return false;
+    }
+    // Read before the scope's reference goes, it may be the last
+    bool taken = scope->message->region;
+    ipc_message_release(scope->message);
+    return taken;
+}
+
+ipc_message_t* ipc_message_retain(const void **data) {
+    handler_scope_t *scope = current_scope;
+    if (!scope || !scope->data || !data) {
+        return NULL;
+    }
+    
+    // Batch records point into the payload
+    const uint8_t *base = scope->data;
+    const uint8_t *ptr = *data;
+    if (ptr < base || ptr > base + scope->size) {
+        return NULL;
+    }
+    
+    ipc_message_t *message = scope->message;
+    if (!message) {
+        message = malloc(sizeof(*message));
+        if (!message) {
+            return NULL;
+        }
+        message->data = (void*)scope->data;
+        message->size = scope->size;
+        message->region = scope->region;
+        if (!scope->region) {
+            message->data = malloc(scope->size);
+            if (!message->data) {
+                LOG_ERROR_MSG("Failed to retain payload of size %zu", scope->size);
+                free(message);
+                return NULL;
+            }
+            memcpy(message->data, scope->data, scope->size);
+        }
+        // One reference of the scope, dropped when it is left
+        atomic_init(&message->refs, 1);
+        scope->message = message;
+    }
+    
+    atomic_fetch_add_explicit(&message->refs, 1, memory_order_relaxed);
+    *data = (const uint8_t*)message->data + (ptr - base);
+    return message;
+}
+
+void ipc_message_release(ipc_message_t *message) {
+    if (!message ||
+        atomic_fetch_sub_explicit(&message->refs, 1, memory_order_acq_rel) != 1) {
+        return;
+    }
+    
+    if (message->region) {
+        kern_return_t kr = vm_deallocate(mach_task_self(), (vm_address_t)message->data,
+                                         message->size);
+        if (kr != KERN_SUCCESS) {
+            LOG_ERROR_MSG("Failed to clean retained payload: 0x%x (%s)", kr,
+                          mach_error_string(kr));
+        }
+    } else {
+        free(message->data);
+    }
+    free(message);
+}
+
+bool protocol_batch_append(
+    uint8_t **buffer,
+    size_t *size,
+    size_t *capacity,
+    uint32_t msg_type,
+    const void *data,
+    size_t data_size
+) {
+    if (data_size > UINT32_MAX || (data_size && !data)) {
+        LOG_ERROR_MSG("Invalid batch record of size %zu", data_size);
+        return false;
+    }
+    
+    size_t record_size = INTERNAL_BATCH_RECORD_SIZE(data_size);
+    if (*size + record_size > *capacity) {
+        size_t new_capacity = *capacity ? *capacity * 2 : 256;
+        while (new_capacity < *size + record_size) {
+            new_capacity *= 2;
+        }
+        uint8_t *grown = realloc(*buffer, new_capacity);
+        if (!grown) {
+            LOG_ERROR_MSG("Failed to grow batch to %zu bytes", new_capacity);
+            return false;
+        }
+        *buffer = grown;
+        *capacity = new_capacity;
+    }
+    
+    internal_batch_record_t record = {
+        .msg_type = msg_type,
+        .size = (uint32_t)data_size
+    };
+    uint8_t *dst = *buffer + *size;
+    memcpy(dst, &record, sizeof(record));
+    if (data_size) {
+        memcpy(dst + sizeof(record), data, data_size);
+    }
+    // Zero the padding, it goes on the wire
+    memset(dst + sizeof(record) + data_size, 0, record_size - sizeof(record) - data_size);
+    *size += record_size;
+    
+    return true;
+}
+
+bool protocol_batch_next(
+    const void *buffer,
+    size_t size,
+    size_t *offset,
+    uint32_t *msg_type,
+    const void **data,
+    size_t *data_size
+) {
+    if (!buffer || *offset >= size) {
+        return false;
+    }
+    
+    if (size - *offset < sizeof(internal_batch_record_t)) {
+        LOG_ERROR_MSG("Truncated batch record header at offset %zu", *offset);
+        return false;
+    }
+    
+    // Inline payloads are not aligned, copy the header out
+    internal_batch_record_t record;
+    const uint8_t *src = (const uint8_t*)buffer + *offset;
+    memcpy(&record, src, sizeof(record));
+    
+    if (record.size > size - *offset - sizeof(record)) {
+        LOG_ERROR_MSG("Truncated batch record at offset %zu", *offset);
+        return false;
+    }
+    
+    *msg_type = record.msg_type;
+    *data = record.size ? src + sizeof(record) : NULL;
+    *data_size = record.size;
+    
+    // The last record's padding may be cut off
+    size_t record_size = INTERNAL_BATCH_RECORD_SIZE(record.size);
+    *offset = record_size < size - *offset ? *offset + record_size : size;
+    
+    return true;
+}
+
+ipc_status_t protocol_gather(protocol_gather_t *gather, const struct iovec *iov, int iovcnt) {
+    gather->data = NULL;
+    gather->size = 0;
+    gather->pages = false;
+    if (iovcnt < 0 || (iovcnt && !iov)) {
+        return IPC_ERROR_INVALID_PARAM;
+    }
+    
+    size_t size = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        if ((iov[i].iov_len && !iov[i].iov_base) || iov[i].iov_len > SIZE_MAX - size) {
+            LOG_ERROR_MSG("Invalid iovec segment %d", i);
+            return IPC_ERROR_INVALID_PARAM;
+        }
+        size += iov[i].iov_len;
+    }
+    
+    if (iovcnt == 1) {
+        gather->data = iov[0].iov_base;
+        gather->size = size;
+        return IPC_SUCCESS;
+    }
+    
+    // Inline payloads are copied into the message body once more, larger
+    // ones skip the VM copy of the send by moving the block
+    uint8_t *dst = gather->small;
+    if (size > ipc_get_inline_threshold()) {
+        dst = arena_pages_alloc(size);
+        if (!dst) {
+            LOG_ERROR_MSG("Failed to gather user payload of size %zu", size);
+            return IPC_ERROR_NO_MEMORY;
+        }
+        gather->pages = true;
+    }
+    
+    size_t offset = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len) {
+            memcpy(dst + offset, iov[i].iov_base, iov[i].iov_len);
+            offset += iov[i].iov_len;
+        }
+    }
+    gather->data = size ? dst : NULL;
+    gather->size = size;
+    return IPC_SUCCESS;
+}
+
+void protocol_gather_release(protocol_gather_t *gather, bool moved) {
+    if (gather->pages) {
+        arena_pages_free((void*)gather->data, gather->size, moved);
+        gather->pages = false;
+    }
+    gather->data = NULL;
+}
+
+/* ============================================================================
+ * DELIVERY RECORDS
+ * ============================================================================ */
+
+delivery_t* delivery_alloc(slab_t *slab) {
+    delivery_t *delivery = slab_alloc(slab);
+    return delivery ? delivery : calloc(1, sizeof(delivery_t));
+}
+
+void delivery_free(slab_t *slab, delivery_t *delivery) {
+    if (slab_owns(slab, delivery)) {
+        slab_free(slab, delivery);
+    } else {
+        free(delivery);
+    }
+}
+
+/* ============================================================================
+ * FLOW CONTROL
+ * ============================================================================ */
+
+void flow_init(flow_control_t *flow, uint32_t send_window, uint32_t receive_window) {
+    flow->send_window = send_window;
+    flow->receive_window = receive_window;
+    atomic_store_explicit(&flow->credits, (int32_t)send_window, memory_order_relaxed);
+    atomic_store_explicit(&flow->owed, 0, memory_order_relaxed);
+}
+
+bool flow_wait_init(flow_wait_t *wait) {
+    atomic_init(&wait->waiters, 0);
+    if (pthread_mutex_init(&wait->lock, NULL) != 0) {
+        return false;
+    }
+    if (pthread_cond_init(&wait->cond, NULL) != 0) {
+        pthread_mutex_destroy(&wait->lock);
+        return false;
+    }
+    return true;
+}
+
+void flow_wait_destroy(void *res) {
+    flow_wait_t *wait = (flow_wait_t*)res;
+    pthread_cond_destroy(&wait->cond);
+    pthread_mutex_destroy(&wait->lock);
+}
+
+bool flow_try_acquire(flow_control_t *flow) {
+    if (flow->send_window == 0) {
+        return true;
+    }
+    int32_t credits = atomic_load_explicit(&flow->credits, memory_order_relaxed);
+    while (credits > 0) {
+        if (atomic_compare_exchange_weak_explicit(&flow->credits, &credits, credits - 1,
+                                                  memory_order_relaxed,
+                                                  memory_order_relaxed)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+ipc_status_t flow_acquire(flow_control_t *flow, flow_wait_t *wait, uint32_t wait_ms) {
+    if (flow_try_acquire(flow)) {
+        return IPC_SUCCESS;
+    }
+    if (wait_ms == 0) {
+        return IPC_ERROR_WOULD_BLOCK;
+    }
+    
+    uint64_t deadline = clock_gettime_nsec_np(CLOCK_UPTIME_RAW) + wait_ms * NSEC_PER_MSEC;
+    ipc_status_t status = IPC_ERROR_WOULD_BLOCK;
+    
+    pthread_mutex_lock(&wait->lock);
+    // Registered before the check, pairs with the credit add in flow_release
+    atomic_fetch_add_explicit(&wait->waiters, 1, memory_order_seq_cst);
+    for (;;) {
+        if (flow_try_acquire(flow)) {
+            status = IPC_SUCCESS;
+            break;
+        }
+        uint64_t now = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+        if (now >= deadline) {
+            break;
+        }
+        uint64_t remaining = deadline - now;
+        struct timespec timeout = {
+            .tv_sec = (time_t)(remaining / NSEC_PER_SEC),
+            .tv_nsec = (long)(remaining % NSEC_PER_SEC)
+        };
+        pthread_cond_timedwait_relative_np(&wait->cond, &wait->lock, &timeout);
+    }
+    atomic_fetch_sub_explicit(&wait->waiters, 1, memory_order_relaxed);
+    pthread_mutex_unlock(&wait->lock);
+    
+    return status;
+}
+
+void flow_release(flow_control_t *flow, flow_wait_t *wait, uint32_t credits) {
+    if (flow->send_window == 0 || credits == 0) {
+        return;
+    }
+    
+    int32_t current = atomic_load_explicit(&flow->credits, memory_order_relaxed);
+    int32_t updated;
+    do {
+        // A peer can't hand out more than its window
+        updated = current + (int32_t)credits;
+        if (updated > (int32_t)flow->send_window || updated < current) {
+            updated = (int32_t)flow->send_window;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&flow->credits, &current, updated,
+                                                    memory_order_seq_cst,
+                                                    memory_order_relaxed));
+    
+    if (atomic_load_explicit(&wait->waiters, memory_order_seq_cst) > 0) {
+        pthread_mutex_lock(&wait->lock);
+        pthread_cond_broadcast(&wait->cond);
+        pthread_mutex_unlock(&wait->lock);
+    }
+}
+
+uint32_t flow_handled(flow_control_t *flow) {
+    if (flow->receive_window == 0) {
+        return 0;
+    }
+    uint32_t owed = atomic_fetch_add_explicit(&flow->owed, 1, memory_order_relaxed) + 1;
+    if (owed < (flow->receive_window + 1) / 2) {
+        return 0;
+    }
+    return atomic_exchange_explicit(&flow->owed, 0, memory_order_relaxed);
+}
+
 /* ============================================================================
  * LOW-LEVEL MESSAGE SENDING
  * ============================================================================ */
 
-kern_return_t protocol_send_message(
+/* Outgoing message, large enough to also receive an rpc reply in place */
+typedef union {
+    internal_mach_msg_t ool;
+    internal_inline_mach_msg_t inln;
+    internal_compact_mach_msg_t compact;
+    internal_compact_inline_msg_t compact_inln;
+    char raw[INTERNAL_RCV_BUFFER_SIZE];
+} message_buffer_t;
+
+static uint8_t* put_field(uint8_t *dst, const void *value, size_t size) {
+    memcpy(dst, value, size);
+    return dst + size;
+}
+
+/* Write the compact header of payload to out (INTERNAL_COMPACT_MAX_SIZE
+ * bytes), fields left at their defaults are not sent. Returns its size */
+static size_t compact_encode(const internal_payload_t *payload, uint8_t *out) {
+    internal_compact_header_t head = {.version = INTERNAL_WIRE_COMPACT};
+    uint8_t *dst = out + sizeof(head);
+    
+    if (payload->client_id || payload->client_slot != -1) {
+        head.fields |= INTERNAL_FIELD_CLIENT;
+        dst = put_field(dst, &payload->client_id, sizeof(payload->client_id));
+        dst = put_field(dst, &payload->client_slot, sizeof(payload->client_slot));
+    }
+    if (payload->correlation_id || payload->correlation_slot != -1) {
+        head.fields |= INTERNAL_FIELD_CORRELATION;
+        dst = put_field(dst, &payload->correlation_id, sizeof(payload->correlation_id));
+        dst = put_field(dst, &payload->correlation_slot, sizeof(payload->correlation_slot));
+    }
+    if (payload->status) {
+        head.fields |= INTERNAL_FIELD_STATUS;
+        dst = put_field(dst, &payload->status, sizeof(payload->status));
+    }
+    if (payload->topic) {
+        head.fields |= INTERNAL_FIELD_TOPIC;
+        dst = put_field(dst, &payload->topic, sizeof(payload->topic));
+    }
+    if (payload->credits) {
+        head.fields |= INTERNAL_FIELD_CREDITS;
+        dst = put_field(dst, &payload->credits, sizeof(payload->credits));
+    }
+    const struct timespec *deadline = &payload->user_payload_deadline;
+    if (deadline->tv_sec || deadline->tv_nsec) {
+        uint64_t deadline_ns = (uint64_t)deadline->tv_sec * NSEC_PER_SEC + (uint64_t)deadline->tv_nsec;
+        head.fields |= INTERNAL_FIELD_DEADLINE;
+        dst = put_field(dst, &deadline_ns, sizeof(deadline_ns));
+    }
+    
+    head.size = (uint16_t)(dst - out);
+    memcpy(out, &head, sizeof(head));
+    return head.size;
+}
+
+static bool get_field(const uint8_t **src, const uint8_t *end, void *value, size_t size) {
+    if ((size_t)(end - *src) < size) {
+        return false;
+    }
+    memcpy(value, *src, size);
+    *src += size;
+    return true;
+}
+
+/* Read a compact header of at most size bytes into payload, false if it is
+ * malformed or of an unknown version. *used is its size */
+static bool compact_decode(const uint8_t *data, size_t size, internal_payload_t *payload,
+                           size_t *used) {
+    internal_compact_header_t head;
+    if (size < sizeof(head)) {
+        return false;
+    }
+    memcpy(&head, data, sizeof(head));
+    if (head.version != INTERNAL_WIRE_COMPACT || head.size < sizeof(head) ||
+        head.size > size || (head.fields & ~(INTERNAL_FIELD_DEADLINE * 2 - 1))) {
+        return false;
+    }
+    
+    *payload = (internal_payload_t){.client_slot = -1, .correlation_slot = -1};
+    const uint8_t *src = data + sizeof(head);
+    const uint8_t *end = data + head.size;
+    bool ok = true;
+    
+    if (head.fields & INTERNAL_FIELD_CLIENT) {
+        ok = ok && get_field(&src, end, &payload->client_id, sizeof(payload->client_id));
+        ok = ok && get_field(&src, end, &payload->client_slot, sizeof(payload->client_slot));
+    }
+    if (head.fields & INTERNAL_FIELD_CORRELATION) {
+        ok = ok && get_field(&src, end, &payload->correlation_id, sizeof(payload->correlation_id));
+        ok = ok && get_field(&src, end, &payload->correlation_slot,
+                             sizeof(payload->correlation_slot));
+    }
+    if (head.fields & INTERNAL_FIELD_STATUS) {
+        ok = ok && get_field(&src, end, &payload->status, sizeof(payload->status));
+    }
+    if (head.fields & INTERNAL_FIELD_TOPIC) {
+        ok = ok && get_field(&src, end, &payload->topic, sizeof(payload->topic));
+    }
+    if (head.fields & INTERNAL_FIELD_CREDITS) {
+        ok = ok && get_field(&src, end, &payload->credits, sizeof(payload->credits));
+    }
+    if (head.fields & INTERNAL_FIELD_DEADLINE) {
+        uint64_t deadline_ns = 0;
+        ok = ok && get_field(&src, end, &deadline_ns, sizeof(deadline_ns));
+        payload->user_payload_deadline = (struct timespec){
+            .tv_sec = (time_t)(deadline_ns / NSEC_PER_SEC),
+            .tv_nsec = (long)(deadline_ns % NSEC_PER_SEC)
+        };
+    }
+    
+    *used = head.size;
+    return ok && src == end;
+}
+
+static mach_msg_header_t* build_message(
+    message_buffer_t *msg,
     mach_port_t dest_port,
     mach_port_t local_port,
+    mach_msg_bits_t port_bits,
     mach_msg_id_t msg_id,
     internal_payload_t *payload,
     size_t payload_size,
     const void *user_payload,
     size_t user_payload_size,
-    uint64_t user_payload_tio_ms
+    uint64_t user_payload_tio_ms,
+    bool move_user_payload
 ) {
     if (!payload || payload_size < sizeof(internal_payload_t)) {
         LOG_ERROR_MSG("Invalid payload");
-        return KERN_INVALID_ARGUMENT;
+        return NULL;
     }
 
     if (!HAS_FEATURE_WACK(msg_id) && !HAS_FEATURE_IACK(msg_id)) {
@@ -60,84 +613,450 @@ kern_return_t protocol_send_message(
         payload->correlation_slot = -1;
     }
 
-    if (local_port == MACH_PORT_NULL) {
-        msg_id = UNSET_FEATURE(msg_id, INTERNAL_FEATURE_LPCY);
+    // Small payloads travel in the message body, avoiding two VM copies
+    // on send and two vm_deallocate calls on receive
+    size_t inline_threshold = ipc_get_inline_threshold();
+    // Moved pages always travel out-of-line
+    bool send_inline = !move_user_payload && inline_threshold > 0 &&
+                       user_payload_size <= inline_threshold &&
+                       payload_size == sizeof(internal_payload_t);
+    msg_id = send_inline
+        ? SET_FEATURE(msg_id, INTERNAL_FEATURE_INLN)
+        : UNSET_FEATURE(msg_id, INTERNAL_FEATURE_INLN);
+    // Requested by the caller once the peer agreed on it
+    bool compact = HAS_FEATURE_CMPT(msg_id) && payload_size == sizeof(internal_payload_t);
+    if (!compact) {
+        msg_id = UNSET_FEATURE(msg_id, INTERNAL_FEATURE_CMPT);
     }
-    
-    internal_mach_msg_t msg;
-    memset(&msg, 0, sizeof(msg));
-    
-    // Set up header
-    msg.header.msgh_bits = (local_port)
-        ? (
-            HAS_FEATURE_LPCY(msg_id)
-            ? (MACH_MSGH_BITS_COMPLEX | 
-               MACH_MSGH_BITS(MACH_MSG_TYPE_COPY_SEND, MACH_MSG_TYPE_COPY_SEND))
-            : (MACH_MSGH_BITS_COMPLEX | 
-               MACH_MSGH_BITS(MACH_MSG_TYPE_COPY_SEND, MACH_MSG_TYPE_MOVE_SEND))
-        )
-        : (MACH_MSGH_BITS_COMPLEX | 
-           MACH_MSGH_BITS(MACH_MSG_TYPE_COPY_SEND, 0));
-    msg.header.msgh_size = sizeof(msg);
-    msg.header.msgh_remote_port = dest_port;
-    msg.header.msgh_local_port = local_port;
-    msg.header.msgh_id = msg_id;
-    
-    // Set up body and OOL descriptor
-    msg.body.msgh_descriptor_count = 2;
 
     if (user_payload_tio_ms) {
         if (user_payload_tio_ms < USER_PLY_SAFETY_MS) {
             LOG_ERROR_MSG("Timeout for shared user payload must at least be the safety "
                           "margin of %" PRIu64 "ms", USER_PLY_SAFETY_MS);
-            return KERN_INVALID_ARGUMENT;
+            return NULL;
         }
         payload->user_payload_deadline = calc_deadline(user_payload_tio_ms);
     } else {
         payload->user_payload_deadline = (struct timespec){ .tv_sec = 0, .tv_nsec = 0 };
     }
 
-    msg.payload.address = payload;
-    msg.payload.size = payload_size;
-    msg.payload.copy = MACH_MSG_VIRTUAL_COPY;
-    msg.payload.deallocate = false;
-    msg.payload.type = MACH_MSG_OOL_DESCRIPTOR;
+    mach_msg_header_t *header;
+    uint8_t head[INTERNAL_COMPACT_MAX_SIZE];
+    size_t head_size = compact ? compact_encode(payload, head) : 0;
+
+    if (compact && send_inline) {
+        size_t msg_size = INTERNAL_MSG_ROUND(offsetof(internal_compact_inline_msg_t, data) +
+                                             head_size + user_payload_size);
+        memset(msg, 0, msg_size);
+
+        msg->compact_inln.header.msgh_bits = port_bits;
+        msg->compact_inln.header.msgh_size = (mach_msg_size_t)msg_size;
+        msg->compact_inln.user_payload_size = (uint32_t)user_payload_size;
+        memcpy(msg->compact_inln.data, head, head_size);
+        if (user_payload && user_payload_size) {
+            memcpy(msg->compact_inln.data + head_size, user_payload, user_payload_size);
+        }
+        header = &msg->compact_inln.header;
+    } else if (compact) {
+        memset(&msg->compact, 0, sizeof(msg->compact));
+
+        // The header rides in the body, the user payload is the only descriptor
+        msg->compact.header.msgh_bits = MACH_MSGH_BITS_COMPLEX | port_bits;
+        msg->compact.header.msgh_size =
+            (mach_msg_size_t)(offsetof(internal_compact_mach_msg_t, data) + head_size);
+        msg->compact.body.msgh_descriptor_count = 1;
+
+        msg->compact.user_payload.address = (void*)user_payload;
+        msg->compact.user_payload.size = user_payload_size;
+        msg->compact.user_payload.copy = MACH_MSG_VIRTUAL_COPY;
+        msg->compact.user_payload.deallocate = move_user_payload && user_payload_size;
+        msg->compact.user_payload.type = MACH_MSG_OOL_DESCRIPTOR;
+        memcpy(msg->compact.data, head, head_size);
+        header = &msg->compact.header;
+    } else if (send_inline) {
+        size_t msg_size = INTERNAL_INLINE_MSG_SIZE(user_payload_size);
+        memset(msg, 0, msg_size);
+
+        msg->inln.header.msgh_bits = port_bits;
+        msg->inln.header.msgh_size = (mach_msg_size_t)msg_size;
+        msg->inln.payload = *payload;
+        msg->inln.user_payload_size = (uint32_t)user_payload_size;
+        if (user_payload && user_payload_size) {
+            memcpy(msg->inln.user_payload, user_payload, user_payload_size);
+        }
+        header = &msg->inln.header;
+    } else {
+        memset(&msg->ool, 0, sizeof(msg->ool));
+
+        msg->ool.header.msgh_bits = MACH_MSGH_BITS_COMPLEX | port_bits;
+        msg->ool.header.msgh_size = sizeof(msg->ool);
+
+        // Set up body and OOL descriptor
+        msg->ool.body.msgh_descriptor_count = 2;
+
+        msg->ool.payload.address = payload;
+        msg->ool.payload.size = payload_size;
+        msg->ool.payload.copy = MACH_MSG_VIRTUAL_COPY;
+        msg->ool.payload.deallocate = false;
+        msg->ool.payload.type = MACH_MSG_OOL_DESCRIPTOR;
+
+        msg->ool.user_payload.address = (void*)user_payload;
+        msg->ool.user_payload.size = user_payload_size;
+        msg->ool.user_payload.copy = MACH_MSG_VIRTUAL_COPY;
+        msg->ool.user_payload.deallocate = move_user_payload && user_payload_size;
+        msg->ool.user_payload.type = MACH_MSG_OOL_DESCRIPTOR;
+        header = &msg->ool.header;
+    }
+
+    header->msgh_remote_port = dest_port;
+    header->msgh_local_port = local_port;
+    header->msgh_id = msg_id;
+    
+    LOG_DEBUG_MSG("Sending message: id=0x%x, size=%zu, inline=%d compact=%d",
+                  msg_id, compact ? head_size : payload_size, send_inline, compact);
+    return header;
+}
+
+/* options is 0 to block until the peer has room, or MACH_SEND_TIMEOUT to
+ * give up at once on a full queue, the message is dropped then */
+static kern_return_t send_built_message(mach_msg_header_t *header, mach_msg_option_t options) {
+    kern_return_t kr = mach_msg(
+        header,
+        MACH_SEND_MSG | options,
+        header->msgh_size,
+        0,
+        MACH_PORT_NULL,
+        0,  // Only with MACH_SEND_TIMEOUT: don't wait
+        MACH_PORT_NULL
+    );
+    
+    if (kr == MACH_SEND_TIMED_OUT || kr == MACH_SEND_INTERRUPTED) {
+        // Pseudo-received, release the rights and memory copied in
+        mach_msg_destroy(header);
+    }
+    if (kr == MACH_SEND_TIMED_OUT) {
+        STATS_INC(stats_transport.send_failures);
+        LOG_WARN_MSG("Message id=0x%x dropped, queue of the peer is full", header->msgh_id);
+    } else if (kr != KERN_SUCCESS) {
+        STATS_INC(stats_transport.send_failures);
+        LOG_ERROR_MSG("mach_msg send failed: 0x%x (%s)", kr, mach_error_string(kr));
+    } else {
+        STATS_INC(stats_transport.messages_sent);
+        LOG_DEBUG_MSG("Message sent successfully");
+    }
+    
+    return kr;
+}
+
+static kern_return_t send_message(
+    mach_port_t dest_port,
+    mach_port_t local_port,
+    mach_msg_id_t msg_id,
+    internal_payload_t *payload,
+    size_t payload_size,
+    const void *user_payload,
+    size_t user_payload_size,
+    uint64_t user_payload_tio_ms,
+    bool move_user_payload,
+    mach_msg_option_t options
+) {
+    if (local_port == MACH_PORT_NULL) {
+        msg_id = UNSET_FEATURE(msg_id, INTERNAL_FEATURE_LPCY);
+    }
+
+    mach_msg_bits_t port_bits = (local_port)
+        ? (
+            HAS_FEATURE_LPCY(msg_id)
+            ? MACH_MSGH_BITS(MACH_MSG_TYPE_COPY_SEND, MACH_MSG_TYPE_COPY_SEND)
+            : MACH_MSGH_BITS(MACH_MSG_TYPE_COPY_SEND, MACH_MSG_TYPE_MOVE_SEND)
+        )
+        : MACH_MSGH_BITS(MACH_MSG_TYPE_COPY_SEND, 0);
+
+    message_buffer_t msg;
+    mach_msg_header_t *header = build_message(&msg, dest_port, local_port, port_bits,
+                                              msg_id, payload, payload_size,
+                                              user_payload, user_payload_size,
+                                              user_payload_tio_ms, move_user_payload);
+    if (!header) {
+        return KERN_INVALID_ARGUMENT;
+    }
+    return send_built_message(header, options);
+}
+
+kern_return_t protocol_send_message(
+    mach_port_t dest_port,
+    mach_port_t local_port,
+    mach_msg_id_t msg_id,
+    internal_payload_t *payload,
+    size_t payload_size,
+    const void *user_payload,
+    size_t user_payload_size,
+    uint64_t user_payload_tio_ms
+) {
+    return send_message(dest_port, local_port, msg_id, payload, payload_size,
+                        user_payload, user_payload_size, user_payload_tio_ms, false, 0);
+}
+
+kern_return_t protocol_try_send_message(
+    mach_port_t dest_port,
+    mach_msg_id_t msg_id,
+    internal_payload_t *payload
+) {
+    return send_message(dest_port, MACH_PORT_NULL, msg_id, payload, sizeof(*payload),
+                        NULL, 0, 0, false, MACH_SEND_TIMEOUT);
+}
+
+kern_return_t protocol_send_owned_message(
+    mach_port_t dest_port,
+    mach_msg_id_t msg_id,
+    internal_payload_t *payload,
+    const void *user_payload,
+    size_t user_payload_size
+) {
+    return send_message(dest_port, MACH_PORT_NULL, msg_id, payload, sizeof(*payload),
+                        user_payload, user_payload_size, 0, true, 0);
+}
+
+/* ============================================================================
+ * BROADCAST
+ * ============================================================================ */
+
+// Copy the user payload into a read-only memory entry, receivers map it
+static bool create_shared_payload(
+    const void *user_payload,
+    size_t user_payload_size,
+    mach_port_t *out_entry
+) {
+    mach_vm_address_t address = 0;
+    kern_return_t kr = mach_vm_allocate(mach_task_self(), &address,
+                                        user_payload_size, VM_FLAGS_ANYWHERE);
+    if (kr != KERN_SUCCESS) {
+        LOG_ERROR_MSG("Failed to allocate shared payload: %s", mach_error_string(kr));
+        return false;
+    }
+    memcpy((void*)address, user_payload, user_payload_size);
     
-    msg.user_payload.address = (void*)user_payload;
-    msg.user_payload.size = user_payload_size;
-    msg.user_payload.copy = MACH_MSG_VIRTUAL_COPY;
-    msg.user_payload.deallocate = false;
-    msg.user_payload.type = MACH_MSG_OOL_DESCRIPTOR;
+    memory_object_size_t entry_size = user_payload_size;
+    kr = mach_make_memory_entry_64(
+        mach_task_self(),
+        &entry_size,
+        address,
+        VM_PROT_READ,
+        out_entry,
+        MACH_PORT_NULL
+    );
     
-    LOG_DEBUG_MSG("Sending message: id=0x%x, size=%zu", msg_id, payload_size);
+    // The entry keeps the pages alive, we never write them again
+    mach_vm_deallocate(mach_task_self(), address, user_payload_size);
+    
+    if (kr != KERN_SUCCESS) {
+        LOG_ERROR_MSG("Failed to create shared payload entry: %s", mach_error_string(kr));
+        *out_entry = MACH_PORT_NULL;
+        return false;
+    }
+    return true;
+}
+
+kern_return_t protocol_broadcast_prepare(
+    protocol_broadcast_t *broadcast,
+    mach_msg_id_t msg_id,
+    const internal_payload_t *payload,
+    const void *user_payload,
+    size_t user_payload_size,
+    size_t receiver_count
+) {
+    if (!payload || (user_payload_size && !user_payload)) {
+        return KERN_INVALID_ARGUMENT;
+    }
+    
+    memset(broadcast, 0, sizeof(*broadcast));
+    broadcast->payload = *payload;
+    broadcast->payload.correlation_id = 0;
+    broadcast->payload.correlation_slot = -1;
+    broadcast->payload.user_payload_deadline = (struct timespec){ .tv_sec = 0, .tv_nsec = 0 };
+    broadcast->memory_entry = MACH_PORT_NULL;
+    
+    msg_id = UNSET_FEATURE(msg_id, INTERNAL_FEATURE_WACK | INTERNAL_FEATURE_LPCY |
+                                   INTERNAL_FEATURE_INLN | INTERNAL_FEATURE_SHRD);
+    mach_msg_bits_t port_bits = MACH_MSGH_BITS(MACH_MSG_TYPE_COPY_SEND, 0);
+    
+    size_t inline_threshold = ipc_get_inline_threshold();
+    if (inline_threshold > 0 && user_payload_size <= inline_threshold) {
+        internal_inline_mach_msg_t *msg = &broadcast->msg.inln;
+        msg->header.msgh_bits = port_bits;
+        msg->header.msgh_size = (mach_msg_size_t)INTERNAL_INLINE_MSG_SIZE(user_payload_size);
+        msg->payload = broadcast->payload;
+        msg->user_payload_size = (uint32_t)user_payload_size;
+        if (user_payload_size) {
+            memcpy(msg->user_payload, user_payload, user_payload_size);
+        }
+        msg_id = SET_FEATURE(msg_id, INTERNAL_FEATURE_INLN);
+    } else if (receiver_count > 1 && user_payload_size >= INTERNAL_SHARED_MIN_SIZE &&
+               create_shared_payload(user_payload, user_payload_size, &broadcast->memory_entry)) {
+        internal_shared_mach_msg_t *msg = &broadcast->msg.shared;
+        msg->header.msgh_bits = MACH_MSGH_BITS_COMPLEX | port_bits;
+        msg->header.msgh_size = sizeof(*msg);
+        msg->body.msgh_descriptor_count = 2;
+        
+        msg->payload.address = &broadcast->payload;
+        msg->payload.size = sizeof(broadcast->payload);
+        msg->payload.copy = MACH_MSG_VIRTUAL_COPY;
+        msg->payload.deallocate = false;
+        msg->payload.type = MACH_MSG_OOL_DESCRIPTOR;
+        
+        msg->user_payload.name = broadcast->memory_entry;
+        msg->user_payload.disposition = MACH_MSG_TYPE_COPY_SEND;
+        msg->user_payload.type = MACH_MSG_PORT_DESCRIPTOR;
+        msg->user_payload_size = user_payload_size;
+        msg_id = SET_FEATURE(msg_id, INTERNAL_FEATURE_SHRD);
+    } else {
+        internal_mach_msg_t *msg = &broadcast->msg.ool;
+        msg->header.msgh_bits = MACH_MSGH_BITS_COMPLEX | port_bits;
+        msg->header.msgh_size = sizeof(*msg);
+        msg->body.msgh_descriptor_count = 2;
+        
+        msg->payload.address = &broadcast->payload;
+        msg->payload.size = sizeof(broadcast->payload);
+        msg->payload.copy = MACH_MSG_VIRTUAL_COPY;
+        msg->payload.deallocate = false;
+        msg->payload.type = MACH_MSG_OOL_DESCRIPTOR;
+        
+        msg->user_payload.address = (void*)user_payload;
+        msg->user_payload.size = user_payload_size;
+        msg->user_payload.copy = MACH_MSG_VIRTUAL_COPY;
+        msg->user_payload.deallocate = false;
+        msg->user_payload.type = MACH_MSG_OOL_DESCRIPTOR;
+    }
+    
+    broadcast->msg.header.msgh_local_port = MACH_PORT_NULL;
+    broadcast->msg.header.msgh_id = msg_id;
+    return KERN_SUCCESS;
+}
+
+kern_return_t protocol_broadcast_send(
+    protocol_broadcast_t *broadcast,
+    mach_port_t dest_port,
+    mach_msg_timeout_t timeout_ms
+) {
+    // A failed send hands the message back rewritten, so send from a copy
+    union {
+        mach_msg_header_t header;
+        char raw[sizeof(broadcast->msg)];
+    } msg __attribute__((aligned(8)));
+    memcpy(&msg, &broadcast->msg, broadcast->msg.header.msgh_size);
+    msg.header.msgh_remote_port = dest_port;
     
     kern_return_t kr = mach_msg(
         &msg.header,
-        MACH_SEND_MSG,
+        MACH_SEND_MSG | MACH_SEND_TIMEOUT,
         msg.header.msgh_size,
         0,
         MACH_PORT_NULL,
-        100,  // 100ms timeout
+        timeout_ms,
         MACH_PORT_NULL
     );
     
-    if (kr != KERN_SUCCESS) {
-        LOG_ERROR_MSG("mach_msg send failed: 0x%x (%s)", kr, mach_error_string(kr));
+    if (kr == MACH_SEND_TIMED_OUT || kr == MACH_SEND_INTERRUPTED) {
+        // Pseudo-received, release the rights and memory copied in
+        mach_msg_destroy(&msg.header);
+    }
+    if (kr == KERN_SUCCESS) {
+        STATS_INC(stats_transport.messages_sent);
     } else {
-        LOG_DEBUG_MSG("Message sent successfully");
+        STATS_INC(stats_transport.send_failures);
     }
-    
     return kr;
 }
 
+void protocol_broadcast_release(protocol_broadcast_t *broadcast) {
+    if (broadcast->memory_entry != MACH_PORT_NULL) {
+        // Receivers hold their own rights or mappings
+        mach_port_deallocate(mach_task_self(), broadcast->memory_entry);
+        broadcast->memory_entry = MACH_PORT_NULL;
+    }
+}
+
 /* ============================================================================
  * ACKNOWLEDGMENT HANDLING
  * ============================================================================ */
 
+bool ack_table_init(ack_table_t *table, int capacity) {
+    *table = (ack_table_t){ .capacity = capacity };
+    
+    table->waiters = calloc(capacity, sizeof(ack_waiter_t));
+    table->next = calloc(capacity, sizeof(*table->next));
+    if (!table->waiters || !table->next) {
+        ack_table_destroy(table);
+        return false;
+    }
+    
+    for (int i = 0; i < capacity; i++) {
+        table->waiters[i].sem = dispatch_semaphore_create(0);
+        if (!table->waiters[i].sem) {
+            ack_table_destroy(table);
+            return false;
+        }
+        atomic_init(&table->waiters[i].ticket, ACK_TICKET(0, ACK_STATE_FREE));
+        // Chain stores index + 1, 0 terminates
+        atomic_init(&table->next[i], i + 1 < capacity ? i + 2 : 0);
+    }
+    
+    atomic_init(&table->free_head, capacity > 0 ? 1 : 0);
+    atomic_init(&table->next_correlation_id, 1);
+    return true;
+}
+
+void ack_table_destroy(void *res) {
+    ack_table_t *table = (ack_table_t*)res;
+    if (table->waiters) {
+        for (int i = 0; i < table->capacity; i++) {
+            timer_cancel(&table->waiters[i].timeout);
+            if (table->waiters[i].sem) {
+                dispatch_release(table->waiters[i].sem);
+            }
+        }
+    }
+    free(table->waiters);
+    free((void*)table->next);
+    table->waiters = NULL;
+    table->next = NULL;
+    table->capacity = 0;
+}
+
+static int ack_slot_pop(ack_table_t *table) {
+    uint64_t head = atomic_load_explicit(&table->free_head, memory_order_acquire);
+    for (;;) {
+        uint32_t index = (uint32_t)head;
+        if (index == 0) {
+            return -1;
+        }
+        int next = atomic_load_explicit(&table->next[index - 1], memory_order_relaxed);
+        uint64_t new_head = ((head >> 32) + 1) << 32 | (uint32_t)next;
+        if (atomic_compare_exchange_weak_explicit(&table->free_head, &head, new_head,
+                                                  memory_order_acquire,
+                                                  memory_order_acquire)) {
+            return (int)index - 1;
+        }
+    }
+}
+
+static void ack_slot_push(ack_table_t *table, int slot) {
+    uint64_t head = atomic_load_explicit(&table->free_head, memory_order_relaxed);
+    for (;;) {
+        atomic_store_explicit(&table->next[slot], (int)(uint32_t)head, memory_order_relaxed);
+        uint64_t new_head = ((head >> 32) + 1) << 32 | (uint32_t)(slot + 1);
+        if (atomic_compare_exchange_weak_explicit(&table->free_head, &head, new_head,
+                                                  memory_order_release,
+                                                  memory_order_relaxed)) {
+            return;
+        }
+    }
+}
+
 static int register_ack_waiter(
-    Pool *ack_pool,
-    pthread_mutex_t *ack_lock,
+    ack_table_t *acks,
     uint64_t correlation_id,
+    const ack_waiter_t *async,
     ack_waiter_t **waiter_out
 ) {
     if (correlation_id == 0) {
@@ -145,64 +1064,148 @@ static int register_ack_waiter(
         return -1;
     }
     
-    pthread_mutex_lock(ack_lock);
-    
-    int slot = pool_push(ack_pool, NULL);
+    int slot = ack_slot_pop(acks);
     if (slot == -1) {
-        pthread_mutex_unlock(ack_lock);
-        LOG_ERROR_MSG("Ack pool is full");
+        LOG_ERROR_MSG("Ack table is full");
         return -1;
     }
     
-    ack_waiter_t *waiter = (ack_waiter_t*)pool_get(ack_pool, slot);
-    if (!waiter) {
-        pool_pop(ack_pool, slot);
-        pthread_mutex_unlock(ack_lock);
-        LOG_ERROR_MSG("Failed to get ack waiter from pool");
-        return -1;
-    }
+    ack_waiter_t *waiter = &acks->waiters[slot];
+    waiter->reply_payload = (internal_payload_t){0};
+    waiter->reply_port = MACH_PORT_NULL;
+    waiter->reply_user_payload = NULL;
+    waiter->reply_user_size = 0;
+    waiter->completion = async ? async->completion : NULL;
+    waiter->completion_context = async ? async->completion_context : NULL;
+    waiter->owner = async ? async->owner : NULL;
+    waiter->queue = async ? async->queue : NULL;
+    waiter->sent_ns = STATS_NOW();
+    STATS_MAX(acks->pending_peak, STATS_INC(acks->pending) + 1);
     
-    event_t *evt = event_create();
-    if (!evt) {
-        pool_pop(ack_pool, slot);
-        pthread_mutex_unlock(ack_lock);
-        LOG_ERROR_MSG("Failed to create ack event");
-        return -1;
+    // Publish last, a receiver only touches the slot once the ticket matches.
+    // An async one is SENDING until its sender is through
+    atomic_store_explicit(&waiter->ticket,
+                          ACK_TICKET(correlation_id, async ? ACK_STATE_SENDING : ACK_STATE_WAITING),
+                          memory_order_release);
+    
+    *waiter_out = waiter;
+    return slot;
+}
+
+static void release_ack_waiter(ack_table_t *acks, int slot) {
+    STATS_DEC(acks->pending);
+    atomic_store_explicit(&acks->waiters[slot].ticket, ACK_TICKET(0, ACK_STATE_FREE),
+                          memory_order_relaxed);
+    ack_slot_push(acks, slot);
+}
+
+/* Caller won the waiter (FILLING or CANCELLED), hands the reply to the completion queue */
+static void complete_async_waiter(ack_table_t *acks, int slot, kern_return_t kr) {
+    ack_waiter_t *waiter = &acks->waiters[slot];
+    
+    ack_completion_t completion = waiter->completion;
+    void *context = waiter->completion_context;
+    dispatch_queue_t queue = waiter->queue;
+    internal_payload_t reply_payload = waiter->reply_payload;
+    const void *reply_user_payload = waiter->reply_user_payload;
+    size_t reply_user_size = waiter->reply_user_size;
+    
+    if (kr != KERN_SUCCESS) {
+        reply_payload = (internal_payload_t){
+            .status = kr == KERN_OPERATION_TIMED_OUT ? IPC_ERROR_TIMEOUT : IPC_ERROR_NOT_CONNECTED
+        };
+    }
+    if (waiter->reply_port != MACH_PORT_NULL) {
+        mach_port_deallocate(mach_task_self(), waiter->reply_port);
     }
     
-    // Initialize atomic fields with atomic_init (must be done before any concurrent access)
-    *waiter = (ack_waiter_t){
-        .correlation_id = correlation_id,
-        .event = evt,
-        .reply_payload = NULL,
-        .reply_size = 0,
-        .reply_user_payload = NULL,
-        .reply_user_size = 0
-    };
-    atomic_init(&waiter->received, false);
-    atomic_init(&waiter->cancelled, false);
+    waiter->completion = NULL;
+    waiter->owner = NULL;
+    waiter->queue = NULL;
+    timer_cancel(&waiter->timeout);
+    release_ack_waiter(acks, slot);
     
-    *waiter_out = waiter;
+    dispatch_async(queue, ^{
+        completion(kr, &reply_payload, reply_user_payload, reply_user_size, context);
+    });
+    dispatch_release(queue);
+}
+
+/* Timer wheel callback, the tag is the correlation id the timer was armed for */
+static void ack_timeout(timer_entry_t *entry, uint64_t correlation_id, void *context) {
+    ack_table_t *acks = (ack_table_t*)context;
+    ack_waiter_t *waiter = (ack_waiter_t*)((char*)entry - offsetof(ack_waiter_t, timeout));
     
-    pthread_mutex_unlock(ack_lock);
-    return slot;
+    // Cancel only if the receiver has not claimed the slot yet
+    uint64_t expected = ACK_TICKET(correlation_id, ACK_STATE_WAITING);
+    if (!atomic_compare_exchange_strong_explicit(
+            &waiter->ticket, &expected,
+            ACK_TICKET(correlation_id, ACK_STATE_CANCELLED),
+            memory_order_acq_rel, memory_order_acquire)) {
+        if (expected == ACK_TICKET(correlation_id, ACK_STATE_SENDING)) {
+            // The sender decides while the send runs, a failed one is not a timeout
+            timer_arm(entry, 1, ack_timeout, acks, correlation_id);
+        }
+        return;
+    }
+    
+    LOG_DEBUG_MSG("Ack timeout (correlation_id=%llu)", correlation_id);
+    if (waiter->completion) {
+        complete_async_waiter(acks, (int)(waiter - acks->waiters), KERN_OPERATION_TIMED_OUT);
+    } else {
+        dispatch_semaphore_signal(waiter->sem);
+    }
+}
+
+void ack_table_snapshot(ack_table_t *table, ipc_stats_t *out) {
+    out->acks_matched = atomic_load_explicit(&table->matched, memory_order_relaxed);
+    out->acks_discarded = atomic_load_explicit(&table->discarded, memory_order_relaxed);
+    out->acks_pending = (uint32_t)atomic_load_explicit(&table->pending, memory_order_relaxed);
+    out->acks_pending_peak = (uint32_t)atomic_load_explicit(&table->pending_peak,
+                                                            memory_order_relaxed);
+    out->acks_capacity = (uint32_t)table->capacity;
+    stats_histogram_snapshot(&table->round_trip, &out->round_trip);
+}
+
+// owner NULL aborts every async waiter
+static void abort_waiters(ack_table_t *table, const void *owner) {
+    for (int i = 0; i < table->capacity; i++) {
+        ack_waiter_t *waiter = &table->waiters[i];
+        uint64_t ticket = atomic_load_explicit(&waiter->ticket, memory_order_acquire);
+        if ((ticket & ACK_STATE_MASK) != ACK_STATE_WAITING || !waiter->completion ||
+            (owner && waiter->owner != owner)) {
+            continue;
+        }
+        if (atomic_compare_exchange_strong_explicit(
+                &waiter->ticket, &ticket,
+                (ticket & ~ACK_STATE_MASK) | ACK_STATE_CANCELLED,
+                memory_order_acq_rel, memory_order_acquire)) {
+            complete_async_waiter(table, i, KERN_ABORTED);
+        }
+    }
+}
+
+void ack_table_abort_pending(ack_table_t *table) {
+    abort_waiters(table, NULL);
+}
+
+void ack_table_abort_owner(ack_table_t *table, const void *owner) {
+    abort_waiters(table, owner);
 }
 
 kern_return_t protocol_send_with_ack(
     mach_port_t dest_port,
     mach_port_t reply_port,
-    Pool *ack_pool,
-    pthread_mutex_t *ack_lock,
-    uint64_t *next_correlation_id,
+    ack_table_t *acks,
     mach_msg_id_t msg_id,
     internal_payload_t *payload,
     size_t payload_size,
     const void *user_payload,
     size_t user_payload_size,
-    internal_payload_t **ack_payload,
-    size_t *ack_size,
+    internal_payload_t *ack_payload,
     const void **ack_user_payload,
     size_t *ack_user_size,
+    mach_port_t *ack_port,
     uint64_t timeout_ms
 ) {
     if (!payload || payload_size < sizeof(internal_payload_t)) {
@@ -211,15 +1214,19 @@ kern_return_t protocol_send_with_ack(
     }
 
     // Assign correlation ID
-    pthread_mutex_lock(ack_lock);
-    uint64_t correlation_id = (*next_correlation_id)++;
-    pthread_mutex_unlock(ack_lock);
+    uint64_t correlation_id = atomic_fetch_add_explicit(&acks->next_correlation_id, 1,
+                                                        memory_order_relaxed);
     
     payload->correlation_id = correlation_id;
     
+    if (timeout_ms && !timer_wheel_start()) {
+        LOG_ERROR_MSG("Timer wheel unavailable");
+        return KERN_RESOURCE_SHORTAGE;
+    }
+    
     // Register ack waiter
     ack_waiter_t *waiter = NULL;
-    int ack_slot = register_ack_waiter(ack_pool, ack_lock, correlation_id, &waiter);
+    int ack_slot = register_ack_waiter(acks, correlation_id, NULL, &waiter);
     if (ack_slot < 0) {
         return KERN_FAILURE;
     }
@@ -234,89 +1241,152 @@ kern_return_t protocol_send_with_ack(
                                              timeout_ms);
     
     if (kr != KERN_SUCCESS) {
-        // Cleanup waiter
-        pthread_mutex_lock(ack_lock);
-        event_destroy(waiter->event);
-        int slot = ((char*)waiter - (char*)ack_pool->data) / ack_pool->sizeof_data;
-        pool_pop(ack_pool, slot);
-        pthread_mutex_unlock(ack_lock);
+        // Nothing was sent, no ack can race us
+        release_ack_waiter(acks, ack_slot);
         return kr;
     }
     
     LOG_DEBUG_MSG("Waiting for ack (correlation_id=%llu, timeout=%" PRIu64 "ms)",
                   correlation_id, timeout_ms);
+    STATS_INTERVAL_BEGIN(signpost, "request");
     
-    // Wait for reply (lock is released during wait)
-    bool got_reply;
+    // Whoever wins the ticket (receiver or timer) signals exactly once
     if (timeout_ms) {
-        got_reply = event_wait_timeout(waiter->event, timeout_ms);
-    } else {
-        // no timeout means wait indefinitely
-        event_wait(waiter->event);
-        got_reply = true;
+        timer_arm(&waiter->timeout, timeout_ms, ack_timeout, acks, correlation_id);
     }
-    
-    // CRITICAL FIX: Set cancelled atomically BEFORE checking received
-    // This prevents the race where ack arrives between timeout and lock acquisition
-    if (!got_reply) {
-        atomic_store_explicit(&waiter->cancelled, true, memory_order_release);
+    dispatch_semaphore_wait(waiter->sem, DISPATCH_TIME_FOREVER);
+    if (timeout_ms) {
+        timer_cancel(&waiter->timeout);
     }
+    STATS_INTERVAL_END(signpost, "request");
     
-    // Now acquire lock for final state check and cleanup
-    pthread_mutex_lock(ack_lock);
-    
+    // Pairs with the release store of the receiver
+    uint64_t ticket = atomic_load_explicit(&waiter->ticket, memory_order_acquire);
     kern_return_t result;
     
-    // Load received flag atomically
-    bool was_received = atomic_load_explicit(&waiter->received, memory_order_acquire);
-    bool was_cancelled = atomic_load_explicit(&waiter->cancelled, memory_order_acquire);
-    
-    if (was_received) {
-        // SUCCESS: Got reply before timeout
-        if (was_cancelled || !got_reply) {
-            // RACE CONDITION: Ack arrived after timeout but before we set cancelled
-            // we have now have the ownership of the payload
-            // time passed since timeout it minimal, still conidered success
-            LOG_WARN_MSG("Ack arrived but already during timeout handling (correlation_id=%llu)", correlation_id);
-        } else {
-            LOG_DEBUG_MSG("Ack received (correlation_id=%llu)", correlation_id);
-        }
+    if ((ticket & ACK_STATE_MASK) == ACK_STATE_RECEIVED) {
+        LOG_DEBUG_MSG("Ack received (correlation_id=%llu)", correlation_id);
         
         *ack_payload = waiter->reply_payload;
-        *ack_size = waiter->reply_size;
         *ack_user_payload = waiter->reply_user_payload;
         *ack_user_size = waiter->reply_user_size;
+        if (ack_port) {
+            *ack_port = waiter->reply_port;
+        } else if (waiter->reply_port != MACH_PORT_NULL) {
+            mach_port_deallocate(mach_task_self(), waiter->reply_port);
+        }
         result = KERN_SUCCESS;
     } else {
-        // TIMEOUT: No ack arrived (or arrived way too late)
-        LOG_DEBUG_MSG("Ack timeout (correlation_id=%llu)", correlation_id);
-        
-        *ack_payload = NULL;
-        *ack_size = 0;
+        // TIMEOUT: No ack arrived, a late one is discarded
+        *ack_payload = (internal_payload_t){ .status = IPC_ERROR_TIMEOUT };
         *ack_user_payload = NULL;
         *ack_user_size = 0;
+        if (ack_port) {
+            *ack_port = MACH_PORT_NULL;
+        }
         result = KERN_OPERATION_TIMED_OUT;
     }
     
-    // Cleanup waiter
-    event_destroy(waiter->event);
-    int slot = ((char*)waiter - (char*)ack_pool->data) / ack_pool->sizeof_data;
-    pool_pop(ack_pool, slot);
-    
-    pthread_mutex_unlock(ack_lock);
+    release_ack_waiter(acks, ack_slot);
     
     return result;
 }
 
-kern_return_t protocol_send_ack(
+kern_return_t protocol_send_async(
+    mach_port_t dest_port,
+    mach_port_t reply_port,
+    ack_table_t *acks,
+    mach_msg_id_t msg_id,
+    internal_payload_t *payload,
+    size_t payload_size,
+    const void *user_payload,
+    size_t user_payload_size,
+    uint64_t timeout_ms,
+    dispatch_queue_t queue,
+    ack_completion_t completion,
+    void *context,
+    const void *owner
+) {
+    if (!payload || payload_size < sizeof(internal_payload_t) || !queue || !completion) {
+        LOG_ERROR_MSG("Invalid async request");
+        return KERN_INVALID_ARGUMENT;
+    }
+    
+    ack_waiter_t async = {
+        .completion = completion,
+        .completion_context = context,
+        .owner = owner,
+        .queue = queue
+    };
+    
+    if (timeout_ms && !timer_wheel_start()) {
+        LOG_ERROR_MSG("Timer wheel unavailable");
+        return KERN_RESOURCE_SHORTAGE;
+    }
+    
+    uint64_t correlation_id = atomic_fetch_add_explicit(&acks->next_correlation_id, 1,
+                                                        memory_order_relaxed);
+    payload->correlation_id = correlation_id;
+    
+    dispatch_retain(queue);
+    ack_waiter_t *waiter = NULL;
+    int ack_slot = register_ack_waiter(acks, correlation_id, &async, &waiter);
+    if (ack_slot < 0) {
+        dispatch_release(queue);
+        return KERN_FAILURE;
+    }
+    
+    payload->correlation_slot = ack_slot;
+    
+    // Armed before the send, once out the ack may free the slot any time.
+    // Nothing of the waiter may be set up after it: an ack completing the
+    // request first would find it half done
+    if (timeout_ms) {
+        timer_arm(&waiter->timeout, timeout_ms, ack_timeout, acks, correlation_id);
+    }
+    
+    mach_msg_id_t ack_msg_id = SET_FEATURE(msg_id, INTERNAL_FEATURE_WACK);
+    kern_return_t kr = protocol_send_message(dest_port, reply_port,
+                                             ack_msg_id, payload, payload_size,
+                                             user_payload, user_payload_size,
+                                             timeout_ms);
+    
+    if (kr != KERN_SUCCESS) {
+        // Nothing was sent and the timer waits while SENDING, the waiter is
+        // still ours alone
+        timer_cancel(&waiter->timeout);
+        waiter->completion = NULL;
+        waiter->owner = NULL;
+        waiter->queue = NULL;
+        release_ack_waiter(acks, ack_slot);
+        dispatch_release(queue);
+        return kr;
+    }
+    
+    // An ack may have claimed it already, then the ticket moved on
+    uint64_t expected = ACK_TICKET(correlation_id, ACK_STATE_SENDING);
+    atomic_compare_exchange_strong_explicit(&waiter->ticket, &expected,
+                                            ACK_TICKET(correlation_id, ACK_STATE_WAITING),
+                                            memory_order_release, memory_order_relaxed);
+    
+    // waiter may be completed and reused already, only locals from here
+    LOG_DEBUG_MSG("Async request sent (correlation_id=%llu, timeout=%" PRIu64 "ms)",
+                  correlation_id, timeout_ms);
+    return KERN_SUCCESS;
+}
+
+static kern_return_t send_ack(
     mach_port_t dest_port,
+    mach_port_t local_port,
     mach_msg_id_t original_msg_id,
     uint64_t correlation_id,
     int correlation_slot,
     internal_payload_t *ack_payload,
     size_t ack_payload_size,
     const void *ack_user_payload,
-    size_t ack_user_payload_size
+    size_t ack_user_payload_size,
+    bool move_user_payload,
+    mach_msg_option_t options
 ) {
     if (correlation_id == 0) {
         LOG_ERROR_MSG("Cannot send ack with correlation_id=0");
@@ -328,20 +1398,107 @@ kern_return_t protocol_send_ack(
     }
     
     ack_payload->correlation_id = correlation_id;
-    ack_payload->correlation_slot = correlation_slot;
+    ack_payload->correlation_slot = correlation_slot;
+    
+    // Set IACK feature, remove WACK if present
+    mach_msg_id_t ack_msg_id = original_msg_id;
+    ack_msg_id = UNSET_FEATURE(ack_msg_id, INTERNAL_FEATURE_WACK);
+    ack_msg_id = SET_FEATURE(ack_msg_id, INTERNAL_FEATURE_IACK);
+    // upsh not save right now
+    // user payload in ack is allocated in the ack handle
+    // but after being sent immediately set free
+    // ack_msg_id = UNSET_FEATURE(ack_msg_id, INTERNAL_FEATURE_UPSH);
+    
+    return send_message(dest_port, local_port, 
+                        ack_msg_id, ack_payload, ack_payload_size,
+                        ack_user_payload, ack_user_payload_size, 0, move_user_payload,
+                        options);
+}
+
+kern_return_t protocol_send_ack(
+    mach_port_t dest_port,
+    mach_port_t local_port,
+    mach_msg_id_t original_msg_id,
+    uint64_t correlation_id,
+    int correlation_slot,
+    internal_payload_t *ack_payload,
+    size_t ack_payload_size,
+    const void *ack_user_payload,
+    size_t ack_user_payload_size,
+    bool move_user_payload
+) {
+    return send_ack(dest_port, local_port, original_msg_id, correlation_id, correlation_slot,
+                    ack_payload, ack_payload_size, ack_user_payload, ack_user_payload_size,
+                    move_user_payload, 0);
+}
+
+kern_return_t protocol_try_send_ack(
+    mach_port_t dest_port,
+    mach_msg_id_t original_msg_id,
+    uint64_t correlation_id,
+    int correlation_slot,
+    internal_payload_t *ack_payload
+) {
+    return send_ack(dest_port, MACH_PORT_NULL, original_msg_id, correlation_id,
+                    correlation_slot, ack_payload, sizeof(*ack_payload), NULL, 0, false,
+                    MACH_SEND_TIMEOUT);
+}
+
+static kern_return_t send_rpc_reply(
+    mach_port_t reply_port,
+    mach_msg_id_t original_msg_id,
+    uint64_t correlation_id,
+    internal_payload_t *ack_payload,
+    size_t ack_payload_size,
+    const void *ack_user_payload,
+    size_t ack_user_payload_size,
+    bool move_user_payload,
+    mach_msg_option_t options
+) {
+    ack_payload->correlation_id = correlation_id;
+    ack_payload->correlation_slot = -1;
     
-    // Set IACK feature, remove WACK if present
     mach_msg_id_t ack_msg_id = original_msg_id;
     ack_msg_id = UNSET_FEATURE(ack_msg_id, INTERNAL_FEATURE_WACK);
+    ack_msg_id = UNSET_FEATURE(ack_msg_id, INTERNAL_FEATURE_RPLY);
     ack_msg_id = SET_FEATURE(ack_msg_id, INTERNAL_FEATURE_IACK);
-    // upsh not save right now
-    // user payload in ack is allocated in the ack handle
-    // but after being sent immediately set free
-    // ack_msg_id = UNSET_FEATURE(ack_msg_id, INTERNAL_FEATURE_UPSH);
     
-    return protocol_send_message(dest_port, MACH_PORT_NULL, 
-                                 ack_msg_id, ack_payload, ack_payload_size,
-                                 ack_user_payload, ack_user_payload_size, 0);
+    message_buffer_t msg;
+    mach_msg_header_t *header = build_message(
+        &msg, reply_port, MACH_PORT_NULL,
+        MACH_MSGH_BITS(MACH_MSG_TYPE_MOVE_SEND_ONCE, 0),
+        ack_msg_id, ack_payload, ack_payload_size,
+        ack_user_payload, ack_user_payload_size, 0, move_user_payload
+    );
+    if (!header) {
+        return KERN_INVALID_ARGUMENT;
+    }
+    return send_built_message(header, options);
+}
+
+kern_return_t protocol_send_rpc_reply(
+    mach_port_t reply_port,
+    mach_msg_id_t original_msg_id,
+    uint64_t correlation_id,
+    internal_payload_t *ack_payload,
+    size_t ack_payload_size,
+    const void *ack_user_payload,
+    size_t ack_user_payload_size,
+    bool move_user_payload
+) {
+    return send_rpc_reply(reply_port, original_msg_id, correlation_id, ack_payload,
+                          ack_payload_size, ack_user_payload, ack_user_payload_size,
+                          move_user_payload, 0);
+}
+
+kern_return_t protocol_try_send_rpc_reply(
+    mach_port_t reply_port,
+    mach_msg_id_t original_msg_id,
+    uint64_t correlation_id,
+    internal_payload_t *ack_payload
+) {
+    return send_rpc_reply(reply_port, original_msg_id, correlation_id, ack_payload,
+                          sizeof(*ack_payload), NULL, 0, false, MACH_SEND_TIMEOUT);
 }
 
 /* ============================================================================
@@ -349,10 +1506,10 @@ kern_return_t protocol_send_ack(
  * ============================================================================ */
 
 static bool handle_ack_message(
-    Pool *ack_pool,
-    pthread_mutex_t *ack_lock,
+    ack_table_t *acks,
+    mach_msg_id_t msg_id,
+    mach_port_t *remote_port,
     internal_payload_t *payload,
-    size_t payload_size,
     const void *user_payload,
     size_t user_payload_size
 ) {
@@ -365,77 +1522,371 @@ static bool handle_ack_message(
     }
 
     int correlation_slot = payload->correlation_slot;
-    
-    pthread_mutex_lock(ack_lock);
-    
-    // Find matching waiter
-    // pool will validate the slot index and that it's active
-    ack_waiter_t *waiter = (ack_waiter_t*)pool_get(ack_pool, correlation_slot);
-    if (!waiter || waiter->correlation_id != correlation_id) {
-        pthread_mutex_unlock(ack_lock);
-        LOG_WARN_MSG("Ack for unknown correlation_id=%llu (already cleaned up?)", 
-                     correlation_id);
+    if (correlation_slot < 0 || correlation_slot >= acks->capacity) {
+        LOG_WARN_MSG("Ack with invalid correlation_slot=%d", correlation_slot);
+        STATS_INC(acks->discarded);
         return false;
     }
     
-    // CRITICAL: Check if waiter was cancelled (timed out) - use atomic load
-    // Memory order acquire ensures we see the timeout thread's cancellation
-    bool was_cancelled = atomic_load_explicit(&waiter->cancelled, memory_order_acquire);
-    
-    if (was_cancelled) {
-        pthread_mutex_unlock(ack_lock);
-        LOG_WARN_MSG("Ack arrived after timeout (correlation_id=%llu), discarding", 
-                     correlation_id);
+    // Claim the waiter, fails if it timed out or the slot was reused. An
+    // ack may overtake its async sender, still SENDING then
+    ack_waiter_t *waiter = &acks->waiters[correlation_slot];
+    uint64_t expected = ACK_TICKET(correlation_id, ACK_STATE_WAITING);
+    bool claimed;
+    do {
+        claimed = atomic_compare_exchange_strong_explicit(
+            &waiter->ticket, &expected,
+            ACK_TICKET(correlation_id, ACK_STATE_FILLING),
+            memory_order_acquire, memory_order_relaxed);
+    } while (!claimed && (expected == ACK_TICKET(correlation_id, ACK_STATE_SENDING) ||
+                          expected == ACK_TICKET(correlation_id, ACK_STATE_WAITING)));
+    if (!claimed) {
+        if (expected == ACK_TICKET(correlation_id, ACK_STATE_CANCELLED)) {
+            LOG_WARN_MSG("Ack arrived after timeout (correlation_id=%llu), discarding", 
+                         correlation_id);
+        } else {
+            LOG_WARN_MSG("Ack for unknown correlation_id=%llu (already cleaned up?)", 
+                         correlation_id);
+        }
+        STATS_INC(acks->discarded);
         // Caller will deallocate the payload
         return false;
     }
+
+    STATS_INC(acks->matched);
+    STATS_SINCE(acks->round_trip, waiter->sent_ns);
+    
+    // Inline user payloads live in the receive buffer, hand out a heap copy
+    // (ply_free tells both kinds apart)
+    if (HAS_FEATURE_INLN(msg_id) && user_payload && user_payload_size) {
+        void *copy = malloc(user_payload_size);
+        if (!copy) {
+            LOG_ERROR_MSG("Failed to copy inline ack user payload (correlation_id=%llu)",
+                          correlation_id);
+            user_payload_size = 0;
+        } else {
+            memcpy(copy, user_payload, user_payload_size);
+        }
+        user_payload = copy;
+    }
     
     // SUCCESS: Store reply data
-    // Use atomic store with release semantics so timeout thread sees our write
-    waiter->reply_payload = payload;
-    waiter->reply_size = payload_size;
+    // Use atomic store with release semantics so the waiter sees our write
+    waiter->reply_payload = *payload;
+    waiter->reply_port = *remote_port;
+    *remote_port = MACH_PORT_NULL;
     waiter->reply_user_payload = user_payload;
     waiter->reply_user_size = user_payload_size;
-    atomic_store_explicit(&waiter->received, true, memory_order_release);
-    
-    // Signal waiter thread
-    event_signal(waiter->event);
-
-    pthread_mutex_unlock(ack_lock);
+    if (waiter->completion) {
+        // Asynchronous request, nobody waits on the semaphore
+        complete_async_waiter(acks, correlation_slot, KERN_SUCCESS);
+    } else {
+        atomic_store_explicit(&waiter->ticket, ACK_TICKET(correlation_id, ACK_STATE_RECEIVED),
+                              memory_order_release);
+        
+        // Signal waiter thread
+        dispatch_semaphore_signal(waiter->sem);
+    }
     
     LOG_DEBUG_MSG("Matched ack to waiter (correlation_id=%llu)", 
                   correlation_id);
     
-    // Return true to indicate we took ownership of the payload
+    // Return true to indicate we took ownership of the user payload,
+    // the internal payload has been copied
     return true;
 }
 
-void protocol_receive_loop(
-    mach_port_t service_port,
+/* Receive buffer of one loop, page-aligned and grown for large messages */
+typedef struct {
+    mach_msg_header_t *header;
+    mach_msg_size_t size;
+} rcv_buffer_t;
+
+static bool rcv_buffer_resize(rcv_buffer_t *buffer, mach_msg_size_t size) {
+    mach_vm_size_t rounded = (size + vm_page_size - 1) & ~((mach_vm_size_t)vm_page_size - 1);
+    mach_vm_address_t address = 0;
+    kern_return_t kr = mach_vm_allocate(mach_task_self(), &address, rounded, VM_FLAGS_ANYWHERE);
+    if (kr != KERN_SUCCESS) {
+        LOG_ERROR_MSG("Failed to allocate %llu byte receive buffer: %s",
+                      (unsigned long long)rounded, mach_error_string(kr));
+        return false;
+    }
+    
+    if (buffer->header) {
+        mach_vm_deallocate(mach_task_self(), (mach_vm_address_t)buffer->header, buffer->size);
+    }
+    buffer->header = (mach_msg_header_t*)address;
+    buffer->size = (mach_msg_size_t)rounded;
+    return true;
+}
+
+const mach_msg_audit_trailer_t* protocol_audit_trailer(const mach_msg_header_t *header) {
+    const mach_msg_audit_trailer_t *trailer = (const mach_msg_audit_trailer_t*)
+        ((const char*)header + round_msg(header->msgh_size));
+    if (trailer->msgh_trailer_size < sizeof(mach_msg_audit_trailer_t)) {
+        return NULL;
+    }
+    return trailer;
+}
+
+/* parse_message of a compact message, the header is decoded into decoded */
+static bool parse_compact_message(
+    mach_msg_header_t *header,
+    internal_payload_t *decoded,
+    const void **user_payload,
+    size_t *user_payload_size
+) {
+    size_t used = 0;
+    
+    if (HAS_FEATURE_INLN(header->msgh_id)) {
+        internal_compact_inline_msg_t *msg = (internal_compact_inline_msg_t*)header;
+        size_t header_size = offsetof(internal_compact_inline_msg_t, data);
+        if (header->msgh_size < header_size ||
+            !compact_decode(msg->data, header->msgh_size - header_size, decoded, &used) ||
+            msg->user_payload_size > header->msgh_size - header_size - used) {
+            LOG_ERROR_MSG("Invalid compact inline message");
+            return false;
+        }
+        *user_payload_size = msg->user_payload_size;
+        *user_payload = *user_payload_size ? msg->data + used : NULL;
+        return true;
+    }
+    
+    internal_compact_mach_msg_t *msg = (internal_compact_mach_msg_t*)header;
+    size_t header_size = offsetof(internal_compact_mach_msg_t, data);
+    if (!(header->msgh_bits & MACH_MSGH_BITS_COMPLEX) ||
+        header->msgh_size < header_size ||
+        msg->body.msgh_descriptor_count != 1 ||
+        msg->user_payload.type != MACH_MSG_OOL_DESCRIPTOR ||
+        !compact_decode(msg->data, header->msgh_size - header_size, decoded, &used)) {
+        LOG_ERROR_MSG("Invalid compact message structure");
+        mach_msg_destroy(header);
+        return false;
+    }
+    *user_payload = (const void*)msg->user_payload.address;
+    *user_payload_size = msg->user_payload.size;
+    return true;
+}
+
+/* Locate the payloads of a received protocol message, false if it is malformed.
+ * Compact headers are decoded into *decoded, which then has to outlive the
+ * payload like the receive buffer does */
+static bool parse_message(
+    mach_msg_header_t *header,
+    internal_payload_t *decoded,
+    internal_payload_t **payload,
+    size_t *payload_size,
+    const void **user_payload,
+    size_t *user_payload_size
+) {
+    if (HAS_FEATURE_CMPT(header->msgh_id)) {
+        *payload = decoded;
+        *payload_size = sizeof(*decoded);
+        return parse_compact_message(header, decoded, user_payload, user_payload_size);
+    }
+    
+    internal_mach_msg_t *intrl_mach_msg = (internal_mach_msg_t*)header;
+    internal_inline_mach_msg_t *intrl_inline_msg = (internal_inline_mach_msg_t*)header;
+    internal_shared_mach_msg_t *intrl_shared_msg = (internal_shared_mach_msg_t*)header;
+    
+    if (HAS_FEATURE_INLN(header->msgh_id)) {
+        // Validate inline message structure
+        size_t header_size = offsetof(internal_inline_mach_msg_t, user_payload);
+        if (header->msgh_size < header_size ||
+            intrl_inline_msg->user_payload_size > header->msgh_size - header_size) {
+            LOG_ERROR_MSG("Invalid inline message size");
+            return false;
+        }
+
+        // Extract payload (points into the receive buffer)
+        *payload = &intrl_inline_msg->payload;
+        *payload_size = sizeof(internal_payload_t);
+        *user_payload_size = intrl_inline_msg->user_payload_size;
+        *user_payload = *user_payload_size ? intrl_inline_msg->user_payload : NULL;
+    } else if (HAS_FEATURE_SHRD(header->msgh_id)) {
+        // Validate shared message structure
+        if (!(header->msgh_bits & MACH_MSGH_BITS_COMPLEX) ||
+            header->msgh_size < sizeof(internal_shared_mach_msg_t) ||
+            intrl_shared_msg->body.msgh_descriptor_count != 2 ||
+            intrl_shared_msg->payload.type != MACH_MSG_OOL_DESCRIPTOR ||
+            intrl_shared_msg->user_payload.type != MACH_MSG_PORT_DESCRIPTOR) {
+            LOG_ERROR_MSG("Invalid shared message structure");
+            mach_msg_destroy(header);
+            return false;
+        }
+        
+        *payload = (internal_payload_t*)intrl_shared_msg->payload.address;
+        *payload_size = intrl_shared_msg->payload.size;
+        *user_payload_size = (size_t)intrl_shared_msg->user_payload_size;
+        
+        // Map the entry read-only, released like an OOL region
+        mach_port_t entry = intrl_shared_msg->user_payload.name;
+        mach_vm_address_t address = 0;
+        kern_return_t kr = *user_payload_size ? mach_vm_map(
+            mach_task_self(),
+            &address,
+            *user_payload_size,
+            0,
+            VM_FLAGS_ANYWHERE,
+            entry,
+            0,
+            FALSE,
+            VM_PROT_READ,
+            VM_PROT_READ,
+            VM_INHERIT_NONE
+        ) : KERN_SUCCESS;
+        mach_port_deallocate(mach_task_self(), entry);
+        intrl_shared_msg->user_payload.name = MACH_PORT_NULL;
+        
+        if (kr != KERN_SUCCESS) {
+            LOG_ERROR_MSG("Failed to map shared user payload: %s", mach_error_string(kr));
+            mach_msg_destroy(header);
+            return false;
+        }
+        *user_payload = *user_payload_size ? (const void*)address : NULL;
+    } else {
+        // Validate message structure
+        if (intrl_mach_msg->body.msgh_descriptor_count < 2) {
+            LOG_ERROR_MSG("Invalid descriptor count");
+            return false;
+        }
+        
+        if (intrl_mach_msg->payload.type != MACH_MSG_OOL_DESCRIPTOR) {
+            LOG_ERROR_MSG("Invalid payload type");
+            return false;
+        }
+        
+        // Extract payload
+        *payload = (internal_payload_t*)intrl_mach_msg->payload.address;
+        *payload_size = intrl_mach_msg->payload.size;
+        *user_payload = (const void *)intrl_mach_msg->user_payload.address;
+        *user_payload_size = intrl_mach_msg->user_payload.size;
+    }
+    
+    if (!*payload || *payload_size < sizeof(internal_payload_t)) {
+        LOG_ERROR_MSG("Invalid payload data");
+        return false;
+    }
+    return true;
+}
+
+/* Cleanup OOL memory nobody detached, inline payloads live in the receive
+ * buffer and decoded compact headers next to it */
+static void release_received(
+    mach_msg_id_t msg_id,
+    internal_payload_t *payload,
+    size_t payload_size,
+    const void *user_payload,
+    size_t user_payload_size
+) {
+    if (HAS_FEATURE_INLN(msg_id)) {
+        return;
+    }
+    if (!HAS_FEATURE_CMPT(msg_id)) {
+        protocol_release_payload(msg_id, payload, payload_size, user_payload, user_payload_size);
+    } else if (user_payload && user_payload_size) {
+        vm_deallocate(mach_task_self(), (vm_address_t)user_payload, user_payload_size);
+    }
+}
+
+/* Hand one received message to its target and release what the handler left */
+static void dispatch_message(mach_msg_header_t *header, const receive_target_t *target) {
+    // Check if it's our protocol message
+    if (!IS_THIS_PROTOCOL_MSG(header->msgh_id)) {
+        // Pass to handler (might be death notification, etc.)
+        target->handler(target->port, header, NULL, 0, NULL, 0, target->context);
+        return;
+    }
+    
+    internal_payload_t decoded;
+    internal_payload_t *payload;
+    size_t payload_size;
+    const void *user_payload;
+    size_t user_payload_size;
+    if (!parse_message(header, &decoded, &payload, &payload_size,
+                       &user_payload, &user_payload_size)) {
+        return;
+    }
+    
+    LOG_DEBUG_MSG("Received message: id=0x%x, size=%zu, user_size=%zu, correlation=%llu",
+                  header->msgh_id, payload_size, user_payload_size, payload->correlation_id);
+    
+    // Handle acknowledgments
+    if (HAS_FEATURE_IACK(header->msgh_id)) {
+        if (handle_ack_message(target->acks, header->msgh_id,
+                               &header->msgh_remote_port, payload,
+                               user_payload, user_payload_size)) {
+            // Ack was matched and accepted, the waiter owns the user payload
+            // and any carried port now and has a copy of the internal payload
+            user_payload = NULL;
+            user_payload_size = 0;
+        }
+        // Ack was rejected (timeout/unknown), fall through to deallocate
+    } else {
+        // Regular message - pass to handler
+        if (!target->handler(target->port, header, payload, payload_size,
+                             user_payload, user_payload_size, target->context)) {
+            // handler signaled it will handle the payload cleanup
+            return;
+        }
+    }
+
+    // Clean up remote port
+    if (header->msgh_remote_port != MACH_PORT_NULL) {
+        kern_return_t kr = mach_port_deallocate(mach_task_self(), header->msgh_remote_port);
+        if (kr != KERN_SUCCESS) {
+            LOG_ERROR_MSG("Failed to clean remote port: 0x%x (%s)", kr, mach_error_string(kr));
+        }
+    }
+
+    release_received(header->msgh_id, payload, payload_size, user_payload, user_payload_size);
+}
+
+/* Receive on a port or port set, route NULL dispatches everything to *fixed */
+static void receive_loop(
+    mach_port_t rcv_port,
     volatile sig_atomic_t *running,
-    Pool *ack_pool,
-    pthread_mutex_t *ack_lock,
-    message_handler_t handler,
-    void *context
+    pthread_rwlock_t *route_lock,
+    receive_route_t route,
+    const receive_target_t *fixed
 ) {
-    char rcv_buffer[INTERNAL_RCV_BUFFER_SIZE];
-    mach_msg_header_t *header = (mach_msg_header_t*)rcv_buffer;
-    internal_mach_msg_t *intrl_mach_msg = (internal_mach_msg_t*)rcv_buffer;
+    rcv_buffer_t buffer = {0};
+    if (!rcv_buffer_resize(&buffer, INTERNAL_RCV_BUFFER_SIZE)) {
+        return;
+    }
+    const mach_msg_size_t initial_size = buffer.size;
+    
+    // A too large message of a set has to be dropped from its member port
+    mach_msg_option_t large = route ? MACH_RCV_LARGE | MACH_RCV_LARGE_IDENTITY : MACH_RCV_LARGE;
     
-    LOG_INFO_MSG("Starting receive loop on port %u", service_port);
+    LOG_INFO_MSG("Starting receive loop on port %u", rcv_port);
     
     while (*running) {
+        mach_msg_header_t *header = buffer.header;
+        
+        // Blocks until a message arrives, stop sends a wakeup
         kern_return_t kr = mach_msg(
             header,
-            MACH_RCV_MSG | MACH_RCV_TIMEOUT,
+            MACH_RCV_MSG | large | INTERNAL_RCV_TRAILER,
             0,
-            INTERNAL_RCV_BUFFER_SIZE,
-            service_port,
-            1000,  // 1 second timeout for responsiveness
+            buffer.size,
+            rcv_port,
+            MACH_MSG_TIMEOUT_NONE,
             MACH_PORT_NULL
         );
         
-        if (kr == MACH_RCV_TIMED_OUT) {
+        if (kr == MACH_RCV_TOO_LARGE) {
+            // Still queued, msgh_size has its size without the trailer
+            mach_msg_size_t message_size = header->msgh_size;
+            if (message_size <= INTERNAL_RCV_BUFFER_MAX_SIZE &&
+                rcv_buffer_resize(&buffer, message_size + sizeof(mach_msg_max_trailer_t))) {
+                continue;
+            }
+            
+            // Without MACH_RCV_LARGE the kernel destroys it
+            LOG_ERROR_MSG("Dropping %u byte message", message_size);
+            mach_msg(header, MACH_RCV_MSG | MACH_RCV_TIMEOUT, 0, buffer.size,
+                     route ? header->msgh_local_port : rcv_port, 0, MACH_PORT_NULL);
             continue;
         }
         
@@ -445,76 +1896,268 @@ void protocol_receive_loop(
             continue;
         }
         
-        // Check if it's our protocol message
-        if (!IS_THIS_PROTOCOL_MSG(header->msgh_id)) {
-            // Pass to handler (might be death notification, etc.)
-            handler(service_port, header, NULL, 0, NULL, 0, context);
-            continue;
-        }
-        
-        // Validate message structure
-        if (intrl_mach_msg->body.msgh_descriptor_count < 2) {
-            LOG_ERROR_MSG("Invalid descriptor count");
-            continue;
-        }
-        
-        if (intrl_mach_msg->payload.type != MACH_MSG_OOL_DESCRIPTOR) {
-            LOG_ERROR_MSG("Invalid payload type");
-            continue;
-        }
-        
-        // Extract payload
-        internal_payload_t *payload = (internal_payload_t*)intrl_mach_msg->payload.address;
-        size_t payload_size = intrl_mach_msg->payload.size;
-        const void *user_payload = (const void *)intrl_mach_msg->user_payload.address;
-        size_t user_payload_size = intrl_mach_msg->user_payload.size;
-        
-        if (!payload || payload_size < sizeof(internal_payload_t)) {
-            LOG_ERROR_MSG("Invalid payload data");
+        if (IS_INTERNAL_MSG_TYPE(header->msgh_id, INTERNAL_MSG_TYPE_WAKEUP)) {
+            mach_msg_destroy(header);
             continue;
         }
         
-        LOG_DEBUG_MSG("Received message: id=0x%x, size=%zu, user_size=%zu, correlation=%llu",
-                      header->msgh_id, payload_size, user_payload_size, payload->correlation_id);
-        
-        // Handle acknowledgments
-        if (HAS_FEATURE_IACK(header->msgh_id)) {
-            if (handle_ack_message(ack_pool, ack_lock, payload, payload_size, user_payload, user_payload_size)) {
-                // Ack was matched and accepted, don't deallocate
-                // The waiter owns it now
-                continue;
-            }
-            // Ack was rejected (timeout/unknown), fall through to deallocate
+        if (!route) {
+            dispatch_message(header, fixed);
         } else {
-            // Regular message - pass to handler
-            if (!handler(service_port, header, payload, payload_size, user_payload, user_payload_size, context)) {
-                // handler signaled it will handle the payload cleanup
-                continue;
+            // Members only leave with the lock held exclusively, so the target
+            // stays valid until the handler returned
+            pthread_rwlock_rdlock(route_lock);
+            receive_target_t target;
+            if (route(header->msgh_local_port, &target, fixed->context)) {
+                dispatch_message(header, &target);
+            } else {
+                LOG_DEBUG_MSG("Dropping message for detached port %u", header->msgh_local_port);
+                mach_msg_destroy(header);
             }
+            pthread_rwlock_unlock(route_lock);
+        }
+        
+        // Handlers copy out of the buffer, so a grown one can go now that its
+        // message is through (never before, it would not fit again)
+        if (buffer.size > initial_size && buffer.size > INTERNAL_RCV_BUFFER_KEEP_SIZE) {
+            rcv_buffer_resize(&buffer, INTERNAL_RCV_BUFFER_SIZE);
         }
+    }
+    
+    mach_vm_deallocate(mach_task_self(), (mach_vm_address_t)buffer.header, buffer.size);
+    LOG_INFO_MSG("Receive loop stopped");
+}
 
-        // Clean up remote port
-        if (header->msgh_remote_port != MACH_PORT_NULL) {
-            kr = mach_port_deallocate(mach_task_self(), header->msgh_remote_port);
-            if (kr != KERN_SUCCESS) {
-                LOG_ERROR_MSG("Failed to clean remote port: 0x%x (%s)", kr, mach_error_string(kr));
-            }
+void protocol_receive_loop(
+    mach_port_t service_port,
+    volatile sig_atomic_t *running,
+    ack_table_t *acks,
+    message_handler_t handler,
+    void *context
+) {
+    receive_target_t target = {
+        .port = service_port,
+        .acks = acks,
+        .handler = handler,
+        .context = context
+    };
+    receive_loop(service_port, running, NULL, NULL, &target);
+}
+
+void protocol_wakeup(mach_port_t port, uint32_t count) {
+    if (port == MACH_PORT_NULL) {
+        return;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        mach_msg_header_t header = {
+            .msgh_bits = MACH_MSGH_BITS(MACH_MSG_TYPE_MAKE_SEND, 0),
+            .msgh_size = sizeof(header),
+            .msgh_remote_port = port,
+            .msgh_local_port = MACH_PORT_NULL,
+            .msgh_id = MSG_ID_WAKEUP
+        };
+        kern_return_t kr = mach_msg(&header, MACH_SEND_MSG | MACH_SEND_TIMEOUT, sizeof(header),
+                                    0, MACH_PORT_NULL, 0, MACH_PORT_NULL);
+        if (kr != KERN_SUCCESS && kr != MACH_SEND_TIMED_OUT) {
+            LOG_WARN_MSG("Failed to wake port %u: %s", port, mach_error_string(kr));
         }
+    }
+}
 
-        // Cleanup OOL memory
-        kr = vm_deallocate(mach_task_self(), (vm_address_t)payload, payload_size);
-        if (kr != KERN_SUCCESS) {
-            LOG_ERROR_MSG("Failed to clean payload: 0x%x (%s)", kr, mach_error_string(kr));
+bool protocol_drop_message(
+    mach_port_t service_port,
+    mach_msg_header_t *header,
+    internal_payload_t *payload,
+    size_t payload_size,
+    const void *user_payload,
+    size_t user_payload_size,
+    void *context
+) {
+    (void)payload;
+    (void)payload_size;
+    (void)user_payload;
+    (void)user_payload_size;
+    (void)context;
+    LOG_WARN_MSG("Dropping message 0x%x on reply port %u", header->msgh_id, service_port);
+    return true;
+}
+
+void protocol_receive_set_loop(
+    mach_port_t port_set,
+    volatile sig_atomic_t *running,
+    pthread_rwlock_t *route_lock,
+    receive_route_t route,
+    void *context
+) {
+    receive_target_t route_context = { .context = context };
+    receive_loop(port_set, running, route_lock, route, &route_context);
+}
+
+/* ============================================================================
+ * RPC
+ * ============================================================================ */
+
+static pthread_key_t rpc_port_key;
+static pthread_once_t rpc_port_once = PTHREAD_ONCE_INIT;
+
+static void destroy_rpc_port(void *value) {
+    mach_port_t port = (mach_port_t)(uintptr_t)value;
+    mach_port_mod_refs(mach_task_self(), port, MACH_PORT_RIGHT_RECEIVE, -1);
+}
+
+static void create_rpc_port_key(void) {
+    pthread_key_create(&rpc_port_key, destroy_rpc_port);
+}
+
+/* Reply port of the calling thread, destroyed when the thread exits */
+static mach_port_t rpc_reply_port(void) {
+    pthread_once(&rpc_port_once, create_rpc_port_key);
+    mach_port_t port = (mach_port_t)(uintptr_t)pthread_getspecific(rpc_port_key);
+    if (port != MACH_PORT_NULL) {
+        return port;
+    }
+    
+    kern_return_t kr = mach_port_allocate(mach_task_self(), MACH_PORT_RIGHT_RECEIVE, &port);
+    if (kr != KERN_SUCCESS) {
+        LOG_ERROR_MSG("Failed to allocate rpc reply port: %s", mach_error_string(kr));
+        return MACH_PORT_NULL;
+    }
+    pthread_setspecific(rpc_port_key, (void*)(uintptr_t)port);
+    return port;
+}
+
+/* A late reply must not meet the next call, start over with a fresh port */
+static void rpc_reply_port_reset(mach_port_t port) {
+    destroy_rpc_port((void*)(uintptr_t)port);
+    pthread_setspecific(rpc_port_key, NULL);
+}
+
+kern_return_t protocol_send_rpc(
+    mach_port_t dest_port,
+    ack_table_t *acks,
+    mach_msg_id_t msg_id,
+    internal_payload_t *payload,
+    const void *user_payload,
+    size_t user_payload_size,
+    internal_payload_t *reply_payload,
+    const void **reply_user_payload,
+    size_t *reply_user_size,
+    uint32_t timeout_ms
+) {
+    mach_port_t reply_port = rpc_reply_port();
+    if (reply_port == MACH_PORT_NULL) {
+        return KERN_RESOURCE_SHORTAGE;
+    }
+    
+    uint64_t correlation_id = atomic_fetch_add_explicit(&acks->next_correlation_id, 1,
+                                                        memory_order_relaxed);
+    payload->correlation_id = correlation_id;
+    payload->correlation_slot = -1;
+    
+    // The send-once right makes the kernel notify us if the request is dropped
+    message_buffer_t msg;
+    mach_msg_header_t *header = build_message(
+        &msg, dest_port, reply_port,
+        MACH_MSGH_BITS(MACH_MSG_TYPE_COPY_SEND, MACH_MSG_TYPE_MAKE_SEND_ONCE),
+        SET_FEATURE(SET_FEATURE(msg_id, INTERNAL_FEATURE_WACK), INTERNAL_FEATURE_RPLY),
+        payload, sizeof(*payload), user_payload, user_payload_size, 0, false
+    );
+    if (!header) {
+        return KERN_INVALID_ARGUMENT;
+    }
+    
+    uint64_t sent_ns = STATS_NOW();
+    STATS_INTERVAL_BEGIN(signpost, "rpc");
+    // timeout_ms bounds the send to a full queue and the wait for the reply each
+    kern_return_t kr = mach_msg(
+        header,
+        MACH_SEND_MSG | MACH_RCV_MSG | INTERNAL_RCV_TRAILER |
+            (timeout_ms ? MACH_SEND_TIMEOUT | MACH_RCV_TIMEOUT : 0),
+        header->msgh_size,
+        sizeof(msg),
+        reply_port,
+        timeout_ms,
+        MACH_PORT_NULL
+    );
+    STATS_INTERVAL_END(signpost, "rpc");
+    
+    if (kr == MACH_SEND_TIMED_OUT || kr == MACH_SEND_INTERRUPTED) {
+        // Pseudo-received, the released send-once right notifies the reply
+        // port, so it goes too
+        STATS_INC(stats_transport.send_failures);
+        mach_msg_destroy(header);
+        rpc_reply_port_reset(reply_port);
+        LOG_WARN_MSG("Rpc not sent, queue of the server is full (correlation_id=%llu)",
+                     correlation_id);
+        return kr;
+    }
+    if (kr >= MACH_SEND_IN_PROGRESS && kr < MACH_RCV_IN_PROGRESS) {
+        STATS_INC(stats_transport.send_failures);
+        LOG_ERROR_MSG("mach_msg rpc send failed: 0x%x (%s)", kr, mach_error_string(kr));
+        return kr;
+    }
+    STATS_INC(stats_transport.messages_sent);
+    
+    if (kr != KERN_SUCCESS) {
+        rpc_reply_port_reset(reply_port);
+        if (kr == MACH_RCV_TIMED_OUT) {
+            LOG_DEBUG_MSG("Rpc timed out (correlation_id=%llu)", correlation_id);
+            return KERN_OPERATION_TIMED_OUT;
         }
-        if (user_payload && user_payload_size) {
-            kr = vm_deallocate(mach_task_self(), (vm_address_t)user_payload, user_payload_size);
-            if (kr != KERN_SUCCESS) {
-                LOG_ERROR_MSG("Failed to clean user payload: 0x%x (%s)", kr, mach_error_string(kr));
+        LOG_ERROR_MSG("mach_msg rpc receive failed: 0x%x (%s)", kr, mach_error_string(kr));
+        return KERN_ABORTED;
+    }
+    
+    if (!IS_THIS_PROTOCOL_MSG(header->msgh_id) || !HAS_FEATURE_IACK(header->msgh_id)) {
+        // Send-once notification, the request was dropped
+        LOG_WARN_MSG("Rpc dropped without reply (correlation_id=%llu)", correlation_id);
+        mach_msg_destroy(header);
+        return KERN_ABORTED;
+    }
+    
+    internal_payload_t decoded;
+    internal_payload_t *received;
+    size_t received_size;
+    const void *received_user_payload;
+    size_t received_user_size;
+    if (!parse_message(header, &decoded, &received, &received_size,
+                       &received_user_payload, &received_user_size)) {
+        return KERN_ABORTED;
+    }
+    
+    if (received->correlation_id != correlation_id) {
+        LOG_ERROR_MSG("Rpc reply for correlation_id=%llu, expected %llu",
+                      received->correlation_id, correlation_id);
+        release_received(header->msgh_id, received, received_size,
+                         received_user_payload, received_user_size);
+        rpc_reply_port_reset(reply_port);
+        return KERN_ABORTED;
+    }
+    
+    STATS_SINCE(acks->round_trip, sent_ns);
+    *reply_payload = *received;
+    
+    if (HAS_FEATURE_INLN(header->msgh_id)) {
+        // Lives in msg, hand out a heap copy (ply_free tells both kinds apart)
+        void *copy = NULL;
+        if (received_user_payload && received_user_size) {
+            copy = malloc(received_user_size);
+            if (copy) {
+                memcpy(copy, received_user_payload, received_user_size);
+            } else {
+                LOG_ERROR_MSG("Failed to copy inline rpc reply (correlation_id=%llu)",
+                              correlation_id);
+                received_user_size = 0;
             }
         }
+        received_user_payload = copy;
+    } else if (!HAS_FEATURE_CMPT(header->msgh_id)) {
+        vm_deallocate(mach_task_self(), (vm_address_t)received, received_size);
     }
     
-    LOG_INFO_MSG("Receive loop stopped");
+    *reply_user_payload = received_user_payload;
+    *reply_user_size = received_user_size;
+    return KERN_SUCCESS;
 }
 
 /* ============================================================================
@@ -524,18 +2167,16 @@ void protocol_receive_loop(
 client_info_t* find_client_by_id_locked(mach_server_t *server, uint32_t client_id, int *slot) {
     if (slot && *slot >= 0) {
         // slot is defined, validate
-        if (*slot < MAX_CLIENTS) {
-            client_info_t *client = server->clients[*slot];
-            if (client && client->id == client_id && client->active) {
-                return client;
-            }
+        client_info_t *client = client_at_locked(server, *slot);
+        if (client && client->id == client_id && client->active) {
+            return client;
         }
         // out of range or invalid slot
         return NULL;
     }
     // slot undefined, search
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        client_info_t *client = server->clients[i];
+    for (int i = 0; i < server->clients.capacity; i++) {
+        client_info_t *client = client_at_locked(server, i);
         if (client && client->id == client_id && client->active) {
             if (slot) {
                 *slot = i;
@@ -549,24 +2190,23 @@ client_info_t* find_client_by_id_locked(mach_server_t *server, uint32_t client_i
 client_info_t* find_client_by_port_locked(mach_server_t *server, mach_port_t port, int *slot) {
     if (slot && *slot >= 0) {
         // slot is defined, validate
-        if (*slot < MAX_CLIENTS) {
-            client_info_t *client = server->clients[*slot];
-            if (client && client->port == port && client->active) {
-                return client;
-            }
+        client_info_t *client = client_at_locked(server, *slot);
+        if (client && client->port == port && client->active) {
+            return client;
         }
         // out of range or invalid slot
         return NULL;
     }
-    // slot undefined, search
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        client_info_t *client = server->clients[i];
-        if (client && client->port == port && client->active) {
+    // slot undefined, look up the port hash
+    for (int i = server->port_buckets[CLIENT_PORT_BUCKET(server, port)]; i != -1; ) {
+        client_info_t *client = client_at_locked(server, i);
+        if (client->port == port && client->active) {
             if (slot) {
                 *slot = i;
             }
             return client;
         }
+        i = client->port_next;
     }
     return NULL;
 }
\ No newline at end of file
@@ -0,0 +1,158 @@
+#include "region_cache.h"
+#include <mach/mach_vm.h>
+#include <stdlib.h>
+
+bool region_cache_init(region_cache_t *cache, mach_vm_size_t budget) {
+    *cache = (region_cache_t){ .budget = budget };
+    return pthread_mutex_init(&cache->lock, NULL) == 0;
+}
+
+static void unmap_entry_locked(region_cache_t *cache, int index) {
+    region_entry_t *entry = &cache->entries[index];
+    mach_vm_deallocate(mach_task_self(), entry->address, entry->size);
+    mach_port_deallocate(mach_task_self(), entry->mem_object);
+    cache->mapped -= entry->size;
+    cache->entries[index] = cache->entries[--cache->count];
+}
+
+// Evict unreferenced mappings until incoming more bytes fit the budget
+static void evict_locked(region_cache_t *cache, mach_vm_size_t incoming) {
+    while (cache->budget && cache->mapped + incoming > cache->budget) {
+        int oldest = -1;
+        for (int i = 0; i < cache->count; i++) {
+            if (cache->entries[i].refs == 0 &&
+                (oldest < 0 || cache->entries[i].last_used < cache->entries[oldest].last_used)) {
+                oldest = i;
+            }
+        }
+        if (oldest < 0) {
+            // Everything is in use, allow going over
+            return;
+        }
+        unmap_entry_locked(cache, oldest);
+    }
+}
+
+static int find_locked(region_cache_t *cache, mach_port_t mem_object) {
+    for (int i = 0; i < cache->count; i++) {
+        if (cache->entries[i].mem_object == mem_object) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+kern_return_t region_cache_map(region_cache_t *cache, mach_port_t mem_object,
+                               mach_vm_size_t size, void **address) {
+    if (mem_object == MACH_PORT_NULL) {
+        return KERN_INVALID_ARGUMENT;
+    }
+    if (size == 0 || !address) {
+        mach_port_deallocate(mach_task_self(), mem_object);
+        return KERN_INVALID_ARGUMENT;
+    }
+    
+    kern_return_t kr = KERN_SUCCESS;
+    
+    pthread_mutex_lock(&cache->lock);
+    
+    int index = find_locked(cache, mem_object);
+    if (index >= 0 && cache->entries[index].size >= size) {
+        // Hit, our right already keeps the entry, drop the new one
+        region_entry_t *entry = &cache->entries[index];
+        entry->refs++;
+        entry->last_used = ++cache->tick;
+        *address = (void*)entry->address;
+        pthread_mutex_unlock(&cache->lock);
+        mach_port_deallocate(mach_task_self(), mem_object);
+        return KERN_SUCCESS;
+    }
+    if (index >= 0) {
+        if (cache->entries[index].refs) {
+            // Still used with the smaller size
+            kr = KERN_INVALID_ARGUMENT;
+            goto fail;
+        }
+        unmap_entry_locked(cache, index);
+    }
+    
+    if (cache->count == cache->capacity) {
+        int capacity = cache->capacity ? cache->capacity * 2 : 8;
+        region_entry_t *entries = realloc(cache->entries, capacity * sizeof(*entries));
+        if (!entries) {
+            kr = KERN_RESOURCE_SHORTAGE;
+            goto fail;
+        }
+        cache->entries = entries;
+        cache->capacity = capacity;
+    }
+    
+    evict_locked(cache, size);
+    
+    mach_vm_address_t mapped = 0;
+    kr = mach_vm_map(
+        mach_task_self(),
+        &mapped,
+        size,
+        0,
+        VM_FLAGS_ANYWHERE,
+        mem_object,
+        0,
+        FALSE,
+        VM_PROT_READ | VM_PROT_WRITE,
+        VM_PROT_READ | VM_PROT_WRITE,
+        VM_INHERIT_NONE
+    );
+    if (kr != KERN_SUCCESS) {
+        goto fail;
+    }
+    
+    cache->entries[cache->count++] = (region_entry_t){
+        .mem_object = mem_object,
+        .address = mapped,
+        .size = size,
+        .refs = 1,
+        .last_used = ++cache->tick
+    };
+    cache->mapped += size;
+    *address = (void*)mapped;
+    
+    pthread_mutex_unlock(&cache->lock);
+    return KERN_SUCCESS;
+    
+fail:
+    pthread_mutex_unlock(&cache->lock);
+    mach_port_deallocate(mach_task_self(), mem_object);
+    return kr;
+}
+
+bool region_cache_release(region_cache_t *cache, const void *address) {
+    pthread_mutex_lock(&cache->lock);
+    
+    bool found = false;
+    for (int i = 0; i < cache->count; i++) {
+        region_entry_t *entry = &cache->entries[i];
+        if (entry->address == (mach_vm_address_t)address && entry->refs) {
+            entry->refs--;
+            found = true;
+            break;
+        }
+    }
+    evict_locked(cache, 0);
+    
+    pthread_mutex_unlock(&cache->lock);
+    return found;
+}
+
+void region_cache_destroy(void *cache) {
+    region_cache_t *self = (region_cache_t*)cache;
+    pthread_mutex_lock(&self->lock);
+    while (self->count) {
+        unmap_entry_locked(self, self->count - 1);
+    }
+    free(self->entries);
+    self->entries = NULL;
+    self->capacity = 0;
+    pthread_mutex_unlock(&self->lock);
+    pthread_mutex_destroy(&self->lock);
+}
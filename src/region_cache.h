@@ -0,0 +1,45 @@
+#ifndef REGION_CACHE_H
+#define REGION_CACHE_H
+
+#include <mach/mach.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Mapping of one received memory entry
+typedef struct {
+    mach_port_t mem_object;         // Stable name while we hold the right
+    mach_vm_address_t address;
+    mach_vm_size_t size;
+    uint32_t refs;                  // Unreleased region_cache_map calls
+    uint64_t last_used;             // LRU tick
+} region_entry_t;
+
+// Mapped memory entries kept across messages, so sending the same entry
+// again costs no mach_vm_map. Unreferenced mappings are evicted least
+// recently used first once the mapped size exceeds the budget
+typedef struct {
+    pthread_mutex_t lock;
+    region_entry_t *entries;
+    int count;
+    int capacity;
+    mach_vm_size_t mapped;
+    mach_vm_size_t budget;
+    uint64_t tick;
+} region_cache_t;
+
+// Initialize an empty cache, false if out of resources
+bool region_cache_init(region_cache_t *cache, mach_vm_size_t budget);
+
+// Map a memory entry read-write, taking one send right of mem_object (also
+// on failure). A cached mapping of at least size bytes is handed out again
+kern_return_t region_cache_map(region_cache_t *cache, mach_port_t mem_object,
+                               mach_vm_size_t size, void **address);
+
+// Drop a reference of region_cache_map, false if address is not mapped here
+bool region_cache_release(region_cache_t *cache, const void *address);
+
+// Unmap everything, outstanding addresses become invalid
+void region_cache_destroy(void *cache);
+
+#endif // REGION_CACHE_H
@@ -0,0 +1,177 @@
+#include "ring.h"
+#include <string.h>
+
+#define RING_RECORD_SIZE(size) \
+    ((sizeof(ring_record_t) + (uint64_t)(size) + RING_ALIGN - 1) & ~((uint64_t)RING_ALIGN - 1))
+
+size_t ring_mapping_size(size_t capacity) {
+    size_t data = RING_CACHELINE;
+    while (data < capacity) {
+        data <<= 1;
+    }
+    return sizeof(ring_header_t) + data;
+}
+
+bool ring_create(ring_t *ring, void *memory, size_t memory_size) {
+    if (!memory || memory_size < sizeof(ring_header_t) + RING_CACHELINE) {
+        return false;
+    }
+    
+    // Largest power of two that fits behind the header
+    uint64_t capacity = RING_CACHELINE;
+    while (capacity * 2 <= memory_size - sizeof(ring_header_t)) {
+        capacity <<= 1;
+    }
+    
+    ring_header_t *header = (ring_header_t*)memory;
+    atomic_init(&header->head, 0);
+    atomic_init(&header->tail, 0);
+    atomic_init(&header->consumer_idle, 1);
+    header->magic = RING_MAGIC;
+    header->capacity = capacity;
+    
+    *ring = (ring_t){
+        .header = header,
+        .data = (uint8_t*)memory + sizeof(ring_header_t),
+        .capacity = capacity
+    };
+    return true;
+}
+
+bool ring_attach(ring_t *ring, void *memory, size_t memory_size) {
+    if (!memory || memory_size < sizeof(ring_header_t)) {
+        return false;
+    }
+    
+    ring_header_t *header = (ring_header_t*)memory;
+    uint64_t capacity = header->capacity;
+    if (header->magic != RING_MAGIC ||
+        capacity < RING_CACHELINE || (capacity & (capacity - 1)) != 0 ||
+        capacity > memory_size - sizeof(ring_header_t)) {
+        return false;
+    }
+    
+    *ring = (ring_t){
+        .header = header,
+        .data = (uint8_t*)memory + sizeof(ring_header_t),
+        .capacity = capacity,
+        .position = atomic_load_explicit(&header->head, memory_order_acquire)
+    };
+    return true;
+}
+
+size_t ring_max_record(const ring_t *ring) {
+    // Half the ring, so a record always fits once the consumer caught up
+    return ring->capacity / 2 - sizeof(ring_record_t);
+}
+
+void* ring_reserve(ring_t *ring, size_t size) {
+    if (size > ring_max_record(ring)) {
+        return NULL;
+    }
+    
+    uint64_t record_size = RING_RECORD_SIZE(size);
+    uint64_t offset = ring->position & (ring->capacity - 1);
+    uint64_t contiguous = ring->capacity - offset;
+    uint64_t skip = record_size > contiguous ? contiguous : 0;
+    
+    uint64_t head = atomic_load_explicit(&ring->header->head, memory_order_acquire);
+    if (ring->position + skip + record_size - head > ring->capacity) {
+        return NULL;
+    }
+    
+    if (skip) {
+        // Not published before the commit
+        ring_record_t wrap = { .type = RING_WRAP, .size = 0 };
+        memcpy(ring->data + offset, &wrap, sizeof(wrap));
+        offset = 0;
+    }
+    
+    ring->pending = ring->position + skip;
+    ring->pending_end = ring->pending + record_size;
+    return ring->data + offset + sizeof(ring_record_t);
+}
+
+bool ring_commit(ring_t *ring, uint32_t type, size_t size, bool *wake) {
+    uint64_t record_size = RING_RECORD_SIZE(size);
+    if (ring->pending + record_size > ring->pending_end) {
+        return false;
+    }
+    
+    ring_record_t record = { .type = type, .size = (uint32_t)size };
+    memcpy(ring->data + (ring->pending & (ring->capacity - 1)), &record, sizeof(record));
+    
+    ring->position = ring->pending + record_size;
+    atomic_store_explicit(&ring->header->tail, ring->position, memory_order_release);
+    
+    // Pairs with the fence in ring_park, either we see the consumer idle
+    // or it sees our tail
+    atomic_thread_fence(memory_order_seq_cst);
+    *wake = atomic_load_explicit(&ring->header->consumer_idle, memory_order_relaxed) &&
+            atomic_exchange_explicit(&ring->header->consumer_idle, 0, memory_order_acq_rel);
+    return true;
+}
+
+void ring_rearm(ring_t *ring) {
+    atomic_store_explicit(&ring->header->consumer_idle, 1, memory_order_release);
+}
+
+bool ring_peek(ring_t *ring, uint32_t *type, const void **data, size_t *size) {
+    if (ring->broken) {
+        return false;
+    }
+    
+    uint64_t tail = atomic_load_explicit(&ring->header->tail, memory_order_acquire);
+    uint64_t position = ring->position;
+    
+    for (;;) {
+        if (position == tail) {
+            return false;
+        }
+        
+        uint64_t offset = position & (ring->capacity - 1);
+        uint64_t contiguous = ring->capacity - offset;
+        
+        // The peer may scribble on the memory, copy the header out once
+        ring_record_t record;
+        memcpy(&record, ring->data + offset, sizeof(record));
+        
+        if (record.type == RING_WRAP) {
+            position += contiguous;
+            continue;
+        }
+        
+        uint64_t record_size = RING_RECORD_SIZE(record.size);
+        if (tail - position > ring->capacity || record_size > contiguous ||
+            record_size > tail - position) {
+            ring->broken = true;
+            return false;
+        }
+        
+        ring->pending = position;
+        ring->pending_end = position + record_size;
+        *type = record.type;
+        *data = record.size ? ring->data + offset + sizeof(ring_record_t) : NULL;
+        *size = record.size;
+        return true;
+    }
+}
+
+void ring_consume(ring_t *ring) {
+    ring->position = ring->pending_end;
+    atomic_store_explicit(&ring->header->head, ring->position, memory_order_release);
+}
+
+bool ring_park(ring_t *ring) {
+    atomic_store_explicit(&ring->header->consumer_idle, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    
+    if (atomic_load_explicit(&ring->header->tail, memory_order_acquire) == ring->position) {
+        return true;
+    }
+    
+    // Records raced in, keep draining (a doorbell may still come, it finds
+    // the ring empty)
+    atomic_store_explicit(&ring->header->consumer_idle, 0, memory_order_relaxed);
+    return false;
+}
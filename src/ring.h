@@ -0,0 +1,76 @@
+#ifndef RING_H
+#define RING_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define RING_MAGIC      0x52494E47U   // "RING"
+#define RING_CACHELINE  128           // Apple silicon cache line
+#define RING_ALIGN      8             // Record alignment
+#define RING_WRAP       UINT32_MAX    // Record type marking the jump back to offset 0
+
+// Shared header at the start of the mapping, producer and consumer
+// positions live on their own cache lines
+typedef struct {
+    _Atomic uint64_t head;                  // Bytes consumed
+    uint8_t pad0[RING_CACHELINE - sizeof(uint64_t)];
+    _Atomic uint64_t tail;                  // Bytes committed
+    uint8_t pad1[RING_CACHELINE - sizeof(uint64_t)];
+    _Atomic uint32_t consumer_idle;         // Consumer waits for a doorbell
+    uint32_t magic;
+    uint64_t capacity;                      // Data bytes, power of two
+    uint8_t pad2[RING_CACHELINE - 2 * sizeof(uint32_t) - sizeof(uint64_t)];
+} ring_header_t;
+
+// Record header, followed by the data padded to RING_ALIGN
+typedef struct {
+    uint32_t type;
+    uint32_t size;
+} ring_record_t;
+
+// Process-local view of a ring (one producer and one consumer)
+typedef struct {
+    ring_header_t *header;
+    uint8_t *data;
+    uint64_t capacity;      // Local copy, the shared one is never trusted again
+    uint64_t position;      // Producer: tail, consumer: head
+    uint64_t pending;       // Producer: reserved record, consumer: peeked record
+    uint64_t pending_end;
+    bool broken;            // Consumer saw a malformed record
+} ring_t;
+
+// Mapping size needed for a ring with at least capacity data bytes
+size_t ring_mapping_size(size_t capacity);
+
+// Initialize a ring in fresh memory (producer side)
+bool ring_create(ring_t *ring, void *memory, size_t memory_size);
+
+// Attach to a ring created by the peer (consumer side), validates the header
+bool ring_attach(ring_t *ring, void *memory, size_t memory_size);
+
+// Largest record data size the ring accepts
+size_t ring_max_record(const ring_t *ring);
+
+// Reserve room for a record of size bytes, NULL if the ring is full
+void* ring_reserve(ring_t *ring, size_t size);
+
+// Publish the reserved record (size may shrink), *wake is set if the consumer
+// is idle and has to be woken up. False if size exceeds the reservation.
+bool ring_commit(ring_t *ring, uint32_t type, size_t size, bool *wake);
+
+// Give back a wake-up claimed by ring_commit that could not be delivered,
+// so the next commit tries again
+void ring_rearm(ring_t *ring);
+
+// Look at the next record, false if the ring is empty or broken
+bool ring_peek(ring_t *ring, uint32_t *type, const void **data, size_t *size);
+
+// Release the record returned by ring_peek
+void ring_consume(ring_t *ring);
+
+// Mark the consumer idle, returns false if records arrived meanwhile
+bool ring_park(ring_t *ring);
+
+#endif // RING_H
@@ -5,8 +5,10 @@
 #include "internal.h"
 #include "log.h"
 #include <servers/bootstrap.h>
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 /* ============================================================================
  * CLIENT MANAGEMENT
@@ -20,6 +22,14 @@ client_info_t* create_client(uint32_t id, mach_port_t port) {
     client->port = port;
     client->active = true;
     client->death_notif_setup = false;
+    client->slot = -1;
+    client->port_next = -1;
+    mpsc_init(&client->deliveries);
+    mpsc_init(&client->priority_deliveries);
+    if (!region_cache_init(&client->regions, REGION_CACHE_BUDGET)) {
+        free(client);
+        return NULL;
+    }
     
     // Create serial queue for this client
     char queue_name[64];
@@ -27,6 +37,32 @@ client_info_t* create_client(uint32_t id, mach_port_t port) {
     client->queue = dispatch_queue_create(queue_name, DISPATCH_QUEUE_SERIAL);
     
     if (!client->queue) {
+        region_cache_destroy(&client->regions);
+        free(client);
+        return NULL;
+    }
+    
+    // Runs on queue, so handlers stay serial, and boosts it while busy
+    snprintf(queue_name, sizeof(queue_name), "com.ipc.client.%u.priority", id);
+    client->priority_queue = dispatch_queue_create_with_target(
+        queue_name,
+        dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_SERIAL,
+                                                QOS_CLASS_USER_INTERACTIVE, 0),
+        client->queue
+    );
+    
+    if (!client->priority_queue) {
+        dispatch_release(client->queue);
+        region_cache_destroy(&client->regions);
+        free(client);
+        return NULL;
+    }
+    
+    client->workers = dispatch_group_create();
+    if (!client->workers) {
+        dispatch_release(client->priority_queue);
+        dispatch_release(client->queue);
+        region_cache_destroy(&client->regions);
         free(client);
         return NULL;
     }
@@ -40,12 +76,42 @@ void destroy_client(client_info_t *client) {
     
     client->active = false;
     
+    // No reply can come anymore. The completions run on queue and are in
+    // workers, so they are through before the client goes
+    if (client->server) {
+        ack_table_abort_owner(&client->server->acks, client);
+    }
+    
+    if (client->workers) {
+        dispatch_group_wait(client->workers, DISPATCH_TIME_FOREVER);
+        dispatch_release(client->workers);
+        client->workers = NULL;
+    }
+    
+    if (client->priority_queue) {
+        dispatch_sync(client->priority_queue, ^{}); // Drain queue
+        dispatch_release(client->priority_queue);
+        client->priority_queue = NULL;
+    }
+    
     if (client->queue) {
         dispatch_sync(client->queue, ^{}); // Drain queue
         dispatch_release(client->queue);
         client->queue = NULL;
     }
     
+    if (client->channel_shmem) {
+        shared_memory_destroy(client->channel_shmem);
+        client->channel_shmem = NULL;
+    }
+    
+    region_cache_destroy(&client->regions);
+    
+    if (client->reply_port != MACH_PORT_NULL) {
+        mach_port_deallocate(mach_task_self(), client->reply_port);
+        client->reply_port = MACH_PORT_NULL;
+    }
+    
     if (client->port != MACH_PORT_NULL) {
         mach_port_deallocate(mach_task_self(), client->port);
         client->port = MACH_PORT_NULL;
@@ -57,31 +123,193 @@ void destroy_client(client_info_t *client) {
 static int add_client(mach_server_t *server, client_info_t *client) {
     pthread_mutex_lock(&server->clients_lock);
     
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (server->clients[i] == NULL) {
-            server->clients[i] = client;
-            server->client_count++;
-            pthread_mutex_unlock(&server->clients_lock);
-            return i;
-        }
+    int slot = pool_push(&server->clients, &client);
+    if (slot != -1) {
+        uint32_t bucket = CLIENT_PORT_BUCKET(server, client->port);
+        client->slot = slot;
+        client->port_next = server->port_buckets[bucket];
+        server->port_buckets[bucket] = slot;
+        server->client_count++;
     }
     
     pthread_mutex_unlock(&server->clients_lock);
-    return -1;
+    return slot;
 }
 
 void remove_client(mach_server_t *server, client_info_t *client) {
     pthread_mutex_lock(&server->clients_lock);
+    remove_client_locked(server, client);
+    pthread_mutex_unlock(&server->clients_lock);
+}
+
+void remove_client_locked(mach_server_t *server, client_info_t *client) {
+    if (client_at_locked(server, client->slot) == client) {
+        // Unlink from the port chain
+        int *link = &server->port_buckets[CLIENT_PORT_BUCKET(server, client->port)];
+        while (*link != -1 && *link != client->slot) {
+            link = &client_at_locked(server, *link)->port_next;
+        }
+        if (*link == client->slot) {
+            *link = client->port_next;
+        }
+        
+        // A later client in this slot must not inherit the subscriptions
+        unsubscribe_all_locked(server, client->slot);
+        
+        pool_pop(&server->clients, client->slot);
+        server->client_count--;
+        client->port_next = -1;
+    }
+}
+
+static bool setup_client_table(mach_server_t *server) {
+    int capacity = server->options.max_clients > 0
+        ? server->options.max_clients
+        : MAX_CLIENTS;
     
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (server->clients[i] == client) {
-            server->clients[i] = NULL;
-            server->client_count--;
-            break;
+    if (!pool_init(&server->clients, capacity, sizeof(client_info_t*))) {
+        LOG_ERROR_MSG("Failed to allocate client table (%d clients)", capacity);
+        return false;
+    }
+    resource_tracker_add(server->resources, RES_TYPE_POOL, &server->clients,
+                        (void(*)(void*))pool_free, "clients");
+    
+    // Power of two buckets, at least one per slot
+    uint32_t buckets = 1;
+    while (buckets < (uint32_t)capacity) {
+        buckets <<= 1;
+    }
+    server->port_buckets = malloc(buckets * sizeof(int));
+    if (!server->port_buckets) {
+        LOG_ERROR_MSG("Failed to allocate client port index");
+        return false;
+    }
+    resource_tracker_add(server->resources, RES_TYPE_MEMORY, &server->port_buckets,
+                        NULL, "port_buckets");
+    for (uint32_t i = 0; i < buckets; i++) {
+        server->port_buckets[i] = -1;
+    }
+    server->port_bucket_mask = buckets - 1;
+    
+    server->topic_words = (capacity + 63) / 64;
+    resource_tracker_add(server->resources, RES_TYPE_CUSTOM, server,
+                        destroy_topics, "topics");
+    
+    return true;
+}
+
+/* ============================================================================
+ * SUBSCRIPTIONS
+ * ============================================================================ */
+
+// Index of topic, or where it would be inserted
+static int topic_index_locked(mach_server_t *server, uint32_t topic) {
+    int low = 0;
+    int high = server->topic_count;
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (server->topics[mid].topic < topic) {
+            low = mid + 1;
+        } else {
+            high = mid;
         }
     }
+    return low;
+}
+
+static void remove_topic_locked(mach_server_t *server, int index) {
+    free(server->topics[index].subscribers);
+    memmove(&server->topics[index], &server->topics[index + 1],
+            (server->topic_count - index - 1) * sizeof(server_topic_t));
+    server->topic_count--;
+}
+
+server_topic_t* find_topic_locked(mach_server_t *server, uint32_t topic) {
+    int index = topic_index_locked(server, topic);
+    return index < server->topic_count && server->topics[index].topic == topic
+        ? &server->topics[index]
+        : NULL;
+}
+
+ipc_status_t subscribe_locked(mach_server_t *server, uint32_t topic, int slot) {
+    int index = topic_index_locked(server, topic);
     
-    pthread_mutex_unlock(&server->clients_lock);
+    if (index == server->topic_count || server->topics[index].topic != topic) {
+        if (server->topic_count == MAX_TOPICS) {
+            LOG_ERROR_MSG("Topic table is full");
+            return IPC_ERROR_CLIENT_FULL;
+        }
+        if (server->topic_count == server->topic_capacity) {
+            int capacity = server->topic_capacity ? server->topic_capacity * 2 : 16;
+            server_topic_t *topics = realloc(server->topics, capacity * sizeof(server_topic_t));
+            if (!topics) {
+                return IPC_ERROR_NO_MEMORY;
+            }
+            server->topics = topics;
+            server->topic_capacity = capacity;
+        }
+        
+        uint64_t *subscribers = calloc(server->topic_words, sizeof(uint64_t));
+        if (!subscribers) {
+            return IPC_ERROR_NO_MEMORY;
+        }
+        memmove(&server->topics[index + 1], &server->topics[index],
+                (server->topic_count - index) * sizeof(server_topic_t));
+        server->topics[index] = (server_topic_t){
+            .topic = topic,
+            .subscriber_count = 0,
+            .subscribers = subscribers
+        };
+        server->topic_count++;
+    }
+    
+    server_topic_t *entry = &server->topics[index];
+    uint64_t bit = 1ULL << (slot % 64);
+    if (!(entry->subscribers[slot / 64] & bit)) {
+        entry->subscribers[slot / 64] |= bit;
+        entry->subscriber_count++;
+    }
+    return IPC_SUCCESS;
+}
+
+void unsubscribe_locked(mach_server_t *server, uint32_t topic, int slot) {
+    int index = topic_index_locked(server, topic);
+    if (index == server->topic_count || server->topics[index].topic != topic) {
+        return;
+    }
+    
+    server_topic_t *entry = &server->topics[index];
+    uint64_t bit = 1ULL << (slot % 64);
+    if (entry->subscribers[slot / 64] & bit) {
+        entry->subscribers[slot / 64] &= ~bit;
+        if (--entry->subscriber_count == 0) {
+            remove_topic_locked(server, index);
+        }
+    }
+}
+
+void unsubscribe_all_locked(mach_server_t *server, int slot) {
+    uint64_t bit = 1ULL << (slot % 64);
+    for (int i = server->topic_count - 1; i >= 0; i--) {
+        server_topic_t *entry = &server->topics[i];
+        if (entry->subscribers[slot / 64] & bit) {
+            entry->subscribers[slot / 64] &= ~bit;
+            if (--entry->subscriber_count == 0) {
+                remove_topic_locked(server, i);
+            }
+        }
+    }
+}
+
+void destroy_topics(void *res) {
+    mach_server_t *server = (mach_server_t*)res;
+    for (int i = 0; i < server->topic_count; i++) {
+        free(server->topics[i].subscribers);
+    }
+    free(server->topics);
+    server->topics = NULL;
+    server->topic_count = 0;
+    server->topic_capacity = 0;
 }
 
 /* ============================================================================
@@ -101,6 +329,7 @@ static void handle_connect_request(
     uint32_t client_id = 0;
     int client_slot = -1;
     client_info_t *client = NULL;
+    mach_port_t lane_port = MACH_PORT_NULL;
     
     if (client_port == MACH_PORT_NULL) {
         LOG_ERROR_MSG("Connect request with null port");
@@ -130,6 +359,23 @@ static void handle_connect_request(
         status = IPC_ERROR_NO_MEMORY;
         goto send_reply;
     }
+    client->server = server;
+    flow_init(&client->flow, payload->credits, server->options.receive_window);
+    // A client built with INTERNAL_WIRE_VERSION 0 offers 0 and keeps the
+    // full payload. Both share the layout of internal_payload_t, a build
+    // from before wire_version has another one and is not compatible
+    client->wire_version = payload->wire_version > INTERNAL_WIRE_VERSION
+        ? INTERNAL_WIRE_VERSION
+        : payload->wire_version;
+    if (server->options.region_cache_bytes) {
+        client->regions.budget = server->options.region_cache_bytes;
+    }
+    
+    const mach_msg_audit_trailer_t *trailer = protocol_audit_trailer(header);
+    if (trailer) {
+        client->pid = AUDIT_TRAILER_PID(trailer);
+        LOG_DEBUG_MSG("Client id=%u is pid %d", client_id, (int)client->pid);
+    }
     
     // Add to client list
     client_slot = add_client(server, client);
@@ -163,52 +409,483 @@ static void handle_connect_request(
     }
     
     client->death_notif_setup = true;
+    
+    // Pin the client to a receiver lane, a send right travels with the ack
+    if (server->receiver_count > 1) {
+        mach_port_t lane = server->receivers[client_slot % server->receiver_count].lane_port;
+        kr = mach_port_insert_right(mach_task_self(), lane, lane, MACH_MSG_TYPE_MAKE_SEND);
+        if (kr != KERN_SUCCESS) {
+            LOG_ERROR_MSG("Failed to make lane send right: %s", mach_error_string(kr));
+            remove_client(server, client);
+            destroy_client(client);
+            client = NULL;
+            status = IPC_ERROR_INTERNAL;
+            goto send_reply;
+        }
+        lane_port = lane;
+    }
+    
     status = IPC_SUCCESS;
     
+    // Notify user before the ack goes out, another receiver thread may
+    // already queue the client's first message once it arrives
+    if (server->callbacks.on_client_connected) {
+        dispatch_async(client->queue, ^{
+            server->callbacks.on_client_connected(
+                server,
+                (client_handle_t){.id = client->id, .slot = client_slot, .internal = client},
+                server->user_data
+            );
+        });
+    }
+    
 send_reply:
     ;
     // Send reply
     internal_payload_t reply = (internal_payload_t){
         .client_id = client_id,
         .client_slot = client_slot,
-        .status = status
+        .status = status,
+        .credits = server->options.receive_window,
+        .wire_version = client ? client->wire_version : 0
     };
     kr = protocol_send_ack(
         client_port,
+        lane_port,
         header->msgh_id,
         payload->correlation_id,
         payload->correlation_slot,
         &reply,
         sizeof(reply),
         NULL,
-        0
+        0,
+        false
     );
     
+    if (kr != KERN_SUCCESS && lane_port != MACH_PORT_NULL) {
+        // Unsent, so the send right is still ours
+        mach_port_deallocate(mach_task_self(), lane_port);
+    }
+    
     if (kr != KERN_SUCCESS || status != 0) {
         if (client) {
+            if (status == IPC_SUCCESS && server->callbacks.on_client_disconnected) {
+                // Balance the connected callback
+                dispatch_async(client->queue, ^{
+                    server->callbacks.on_client_disconnected(
+                        server,
+                        (client_handle_t){.id = client->id, .slot = client_slot, .internal = client},
+                        server->user_data
+                    );
+                });
+            }
             remove_client(server, client);
             destroy_client(client);
         }
         return;
     }
     
-    if (status == IPC_SUCCESS) {
-        LOG_INFO_MSG("Client %u connected at slot %d", client_id, client_slot);
-        
-        // Notify user
-        if (server->callbacks.on_client_connected) {
-            dispatch_async(client->queue, ^{
-                server->callbacks.on_client_connected(
+    LOG_INFO_MSG("Client %u connected at slot %d", client_id, client_slot);
+}
+
+/* Ack a request, an rpc is answered on its send-once reply right */
+static kern_return_t send_reply(client_info_t *client, uint32_t msgh_id,
+                                internal_payload_t *payload, mach_port_t *remote_port,
+                                internal_payload_t *ack, const void *reply_data,
+                                size_t reply_size, bool move_reply) {
+    if (HAS_FEATURE_RPLY(msgh_id)) {
+        kern_return_t kr = protocol_send_rpc_reply(*remote_port, msgh_id, payload->correlation_id,
+                                                   ack, sizeof(*ack), reply_data, reply_size,
+                                                   move_reply);
+        if (kr == KERN_SUCCESS) {
+            *remote_port = MACH_PORT_NULL;
+        }
+        return kr;
+    }
+    return protocol_send_ack(
+        CLIENT_ACK_PORT(client),
+        MACH_PORT_NULL,
+        msgh_id,
+        payload->correlation_id,
+        payload->correlation_slot,
+        ack,
+        sizeof(*ack),
+        reply_data,
+        reply_size,
+        move_reply
+    );
+}
+
+/* send_reply of a bare status that doesn't block, for the receiver threads.
+ * With the queue of the client full the status is dropped, the request
+ * times out there */
+static void try_send_status(client_info_t *client, uint32_t msgh_id,
+                            internal_payload_t *payload, mach_port_t *remote_port,
+                            int32_t status) {
+    internal_payload_t ack = (internal_payload_t){
+        .client_id = 0,
+        .client_slot = -1,
+        .status = status
+    };
+    if (HAS_FEATURE_RPLY(msgh_id)) {
+        kern_return_t kr = protocol_try_send_rpc_reply(*remote_port, msgh_id,
+                                                       payload->correlation_id, &ack);
+        if (kr == KERN_SUCCESS || kr == MACH_SEND_TIMED_OUT) {
+            *remote_port = MACH_PORT_NULL;
+        }
+        return;
+    }
+    protocol_try_send_ack(CLIENT_ACK_PORT(client), msgh_id, payload->correlation_id,
+                          payload->correlation_slot, &ack);
+}
+
+/* Refuse a message whose user payload passed its deadline, a request is
+ * answered with IPC_ERROR_TIMEOUT */
+static void reject_expired(mach_server_t *server, client_info_t *client, uint32_t msgh_id,
+                           internal_payload_t *payload, mach_port_t *rpc_port) {
+    STATS_INC(server->stats.deadline_expired);
+    
+    if (HAS_FEATURE_WACK(msgh_id)) {
+        LOG_ERROR_MSG("Message with id=%u and reply rejected because the user payload has reached it's deadline", msgh_id);
+        try_send_status(client, msgh_id, payload, rpc_port, IPC_ERROR_TIMEOUT);
+    } else {
+        LOG_ERROR_MSG("Message with id=%u ignored because the user payload has reached it's deadline", msgh_id);
+    }
+}
+
+/* Refuse a message over a hard quota of the client, a request is answered
+ * with IPC_ERROR_QUOTA_EXCEEDED */
+static void reject_over_quota(mach_server_t *server, client_info_t *client, uint32_t msgh_id,
+                              internal_payload_t *payload, mach_port_t *rpc_port) {
+    STATS_INC(server->stats.quota_rejected);
+    LOG_WARN_MSG("Message with id=%u of client id=%u refused, quota exceeded", msgh_id, client->id);
+    
+    if (HAS_FEATURE_WACK(msgh_id)) {
+        try_send_status(client, msgh_id, payload, rpc_port, IPC_ERROR_QUOTA_EXCEEDED);
+    }
+}
+
+/* Run the handler of one queued message and release its payloads (on
+ * client->queue, or a worker for unordered types) */
+static void deliver_user_message(mach_server_t *server, client_info_t *client,
+                                 delivery_t *delivery, bool expired) {
+    uint32_t msgh_id = delivery->msgh_id;
+    uint32_t user_msg_type = msgh_id & INTERNAL_MSG_TYPE_MASK;
+    bool needs_reply = HAS_FEATURE_WACK(msgh_id);
+    internal_payload_t *payload = delivery->payload;
+    const void *user_payload = delivery->user_payload;
+    size_t user_payload_size = delivery->user_payload_size;
+    mach_port_t remote_port = delivery->remote_port;
+    // The reply right of an rpc is not handed to the callbacks
+    mach_port_t rpc_port = MACH_PORT_NULL;
+    if (HAS_FEATURE_RPLY(msgh_id)) {
+        rpc_port = remote_port;
+        remote_port = MACH_PORT_NULL;
+    }
+    client_handle_t handle = {.id = client->id, .slot = client->slot, .internal = client};
+    
+    STATS_SINCE(server->stats.queue_latency, delivery->received_ns);
+    uint64_t handler_ns = STATS_NOW();
+    STATS_INTERVAL_BEGIN(signpost, "handle message");
+    
+    // Out-of-line and shared payloads are regions ipc_message_retain can take
+    handler_scope_t scope;
+    protocol_scope_enter(&scope, user_payload, user_payload_size, !HAS_FEATURE_INLN(msgh_id));
+    
+    if (expired) {
+        reject_expired(server, client, msgh_id, payload, &rpc_port);
+    } else if (needs_reply) {
+        // Message with reply
+        if (server->callbacks.on_message_with_reply) {
+            size_t reply_size = 0;
+            int reply_status = IPC_SUCCESS;
+            void *reply_data = server->callbacks.on_message_with_reply(
+                server,
+                handle,
+                &remote_port,
+                user_msg_type,
+                user_payload,
+                user_payload_size,
+                &reply_size,
+                server->user_data,
+                &reply_status
+            );
+
+            // Send acknowledgment
+            internal_payload_t ack = (internal_payload_t){
+                .client_id = 0,
+                .client_slot = -1,
+                .status = reply_status
+            };
+            // Page blocks of the reply arena are moved, not copied
+            bool move_reply = arena_is_pages(&server->reply_arena, reply_data);
+            kern_return_t kr = send_reply(client, msgh_id, payload, &rpc_port, &ack,
+                                          reply_data, reply_size, move_reply);
+            arena_free(&server->reply_arena, reply_data, reply_size,
+                       move_reply && SEND_MOVED_PAYLOAD(kr));
+        }
+    } else {
+        // Fire-and-forget message
+        if (server->callbacks.on_message && HAS_FEATURE_BTCH(msgh_id)) {
+            // Batch, one callback per record
+            size_t offset = 0;
+            uint32_t record_type;
+            const void *record_data;
+            size_t record_size;
+            while (protocol_batch_next(user_payload, user_payload_size, &offset,
+                                       &record_type, &record_data, &record_size)) {
+                server->callbacks.on_message(
                     server,
-                    (client_handle_t){.id = client->id, .slot = client_slot, .internal = client},
+                    handle,
+                    &remote_port,
+                    record_type & INTERNAL_MSG_TYPE_MASK,
+                    record_data,
+                    record_size,
                     server->user_data
                 );
-            });
+            }
+        } else if (server->callbacks.on_message) {
+            server->callbacks.on_message(
+                server,
+                handle,
+                &remote_port,
+                user_msg_type,
+                user_payload,
+                user_payload_size,
+                server->user_data
+            );
+        }
+    }
+    
+    bool retained = protocol_scope_leave(&scope);
+    
+    STATS_INTERVAL_END(signpost, "handle message");
+    STATS_SINCE(server->stats.handler_latency, handler_ns);
+    STATS_DEC(client->queue_depth);
+    STATS_DEC(server->stats.queue_depth);
+
+    // Cleanup after processing, an unanswered rpc right notifies the caller
+    kern_return_t kr;
+    if (remote_port != MACH_PORT_NULL) {
+        kr = mach_port_deallocate(mach_task_self(), remote_port);
+        if (kr != KERN_SUCCESS) {
+            LOG_ERROR_MSG("Failed to clean remote port: 0x%x (%s)", kr, mach_error_string(kr));
+        }
+    }
+    if (rpc_port != MACH_PORT_NULL) {
+        mach_port_deallocate(mach_task_self(), rpc_port);
+    }
+    protocol_release_payload(msgh_id, payload, delivery->payload_size,
+                             retained ? NULL : user_payload, retained ? 0 : user_payload_size);
+    
+    // A retained payload is the user's from here on, outside the quota
+    atomic_fetch_sub_explicit(&client->queued_bytes, user_payload_size, memory_order_seq_cst);
+    atomic_fetch_sub_explicit(&client->queued_messages, 1, memory_order_relaxed);
+    STATS_SUB(server->stats.queued_bytes, user_payload_size);
+}
+
+/* Hand handled messages back to the client as credits */
+static void return_credits(client_info_t *client, uint32_t credits) {
+    internal_payload_t payload = (internal_payload_t){
+        .client_id = 0,
+        .client_slot = -1,
+        .status = IPC_SUCCESS,
+        .credits = credits
+    };
+    kern_return_t kr = protocol_send_message(client->port, MACH_PORT_NULL,
+                                             WIRE_MSG_ID(client, MSG_ID_CREDIT),
+                                             &payload, sizeof(payload), NULL, 0, 0);
+    if (kr != KERN_SUCCESS) {
+        // Carried by the next return
+        atomic_fetch_add_explicit(&client->flow.owed, credits, memory_order_relaxed);
+    }
+}
+
+static bool over_soft_quota(client_info_t *client) {
+    mach_vm_size_t quota = client->server->options.client_soft_quota_bytes;
+    return quota &&
+           atomic_load_explicit(&client->queued_bytes, memory_order_seq_cst) > quota;
+}
+
+/* A message of the client was handled or dropped. Over the soft quota the
+ * credits are held back, so the sender stalls until the backlog shrinks */
+static void message_handled(client_info_t *client) {
+    uint32_t credits;
+    if (client->flow.receive_window && over_soft_quota(client)) {
+        atomic_fetch_add_explicit(&client->flow.owed, 1, memory_order_seq_cst);
+        // Checked again after owing, so the last message out of the
+        // backlog always sees what the others held back
+        if (over_soft_quota(client)) {
+            return;
+        }
+        credits = atomic_exchange_explicit(&client->flow.owed, 0, memory_order_relaxed);
+    } else {
+        credits = flow_handled(&client->flow);
+    }
+    if (credits) {
+        return_credits(client, credits);
+    }
+}
+
+/* Handle the oldest message of a lane, false if it is empty. *now_ns is
+ * only read again for a deadline it doesn't pass yet, so a run of expired
+ * messages is skipped without a clock read each */
+static bool deliver_next(client_info_t *client, mpsc_queue_t *lane, uint64_t *now_ns) {
+    mpsc_node_t *node = mpsc_pop(lane);
+    if (!node) {
+        return false;
+    }
+    
+    delivery_t *delivery = (delivery_t*)node;
+    bool expired = false;
+    if (delivery->deadline_ns) {
+        if (delivery->deadline_ns > *now_ns) {
+            *now_ns = monotonic_now_ns();
+        }
+        expired = delivery->deadline_ns <= *now_ns;
+    }
+    deliver_user_message(client->server, client, delivery, expired);
+    delivery_free(&client->server->delivery_slab, delivery);
+    message_handled(client);
+    return true;
+}
+
+/* Drain everything queued, scheduled once per empty to non-empty transition.
+ * Never re-dispatched, so the drain in destroy_client is always behind it.
+ * Both lanes are only popped on queue (priority_queue targets it), so the
+ * normal drain may take priority messages ahead of their own drain */
+static void drain_deliveries(void *context) {
+    client_info_t *client = (client_info_t*)context;
+    uint64_t now_ns = 0;
+    
+    do {
+        do {
+            while (deliver_next(client, &client->priority_deliveries, &now_ns)) {
+            }
+        } while (deliver_next(client, &client->deliveries, &now_ns));
+    } while (mpsc_finish(&client->deliveries));
+}
+
+static void drain_priority_deliveries(void *context) {
+    client_info_t *client = (client_info_t*)context;
+    uint64_t now_ns = 0;
+    
+    do {
+        while (deliver_next(client, &client->priority_deliveries, &now_ns)) {
+        }
+    } while (mpsc_finish(&client->priority_deliveries));
+}
+
+/* Worker of the pool, takes unordered messages of any client until none
+ * is left. The last message of a client may be gone with the client once
+ * its group is left, so nothing of it is touched after that */
+static void run_workers(void *context) {
+    mach_server_t *server = (mach_server_t*)context;
+    
+    for (;;) {
+        pthread_mutex_lock(&server->work_lock);
+        delivery_t *delivery = server->work_head;
+        if (!delivery) {
+            server->worker_count--;
+            pthread_mutex_unlock(&server->work_lock);
+            return;
+        }
+        server->work_head = delivery->work_next;
+        if (!server->work_head) {
+            server->work_tail = NULL;
         }
+        pthread_mutex_unlock(&server->work_lock);
+        
+        client_info_t *client = (client_info_t*)delivery->owner;
+        dispatch_group_t workers = client->workers;
+        bool expired = delivery->deadline_ns && monotonic_now_ns() >= delivery->deadline_ns;
+        deliver_user_message(server, client, delivery, expired);
+        delivery_free(&server->delivery_slab, delivery);
+        message_handled(client);
+        dispatch_group_leave(workers);
+    }
+}
+
+/* Queue an unordered message for the pool, a worker is started while
+ * fewer than worker_limit run */
+static void queue_unordered(mach_server_t *server, client_info_t *client,
+                            delivery_t *delivery) {
+    dispatch_group_enter(client->workers);
+    delivery->owner = client;
+    delivery->work_next = NULL;
+    
+    pthread_mutex_lock(&server->work_lock);
+    if (server->work_tail) {
+        server->work_tail->work_next = delivery;
+    } else {
+        server->work_head = delivery;
+    }
+    server->work_tail = delivery;
+    bool start = server->worker_count < server->worker_limit;
+    if (start) {
+        server->worker_count++;
     }
+    pthread_mutex_unlock(&server->work_lock);
+    
+    if (start) {
+        dispatch_group_async_f(server->work_group,
+                               dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0),
+                               server, run_workers);
+    }
+}
+
+static bool is_unordered(mach_server_t *server, uint32_t msgh_id) {
+    uint32_t type = msgh_id & INTERNAL_MSG_TYPE_MASK;
+    return !HAS_FEATURE_BTCH(msgh_id) &&
+           (server->unordered_types[type / 64] >> (type % 64)) & 1;
+}
+
+/* Whether queueing user_payload_size more bytes takes the client past a hard quota */
+static bool over_hard_quota(mach_server_t *server, client_info_t *client,
+                            size_t user_payload_size) {
+    mach_vm_size_t quota = server->options.client_hard_quota_bytes;
+    uint32_t max_messages = server->options.client_quota_messages;
+    if (quota && atomic_load_explicit(&client->queued_bytes, memory_order_relaxed) +
+                 user_payload_size > quota) {
+        return true;
+    }
+    return max_messages &&
+           atomic_load_explicit(&client->queued_messages, memory_order_relaxed) >= max_messages;
+}
+
+static void destroy_client_async(void *context) {
+    destroy_client((client_info_t*)context);
+}
+
+/* Finish the disconnect of a client over its quota, already removed from the
+ * table. Its backlog is drained off the receiver thread, so the other
+ * clients of the lane are not held up behind it */
+static void disconnect_over_quota(mach_server_t *server, client_info_t *client) {
+    LOG_WARN_MSG("Client id=%u slot=%d disconnected, quota exceeded", client->id, client->slot);
+    STATS_INC(server->stats.quota_disconnects);
+    
+    // Otherwise it keeps sending into the void, each request timing out.
+    // Dropped with a full queue, the client is not reading then anyway
+    internal_payload_t notice = (internal_payload_t){
+        .client_id = 0,
+        .client_slot = -1,
+        .status = IPC_ERROR_QUOTA_EXCEEDED
+    };
+    protocol_try_send_message(client->port, WIRE_MSG_ID(client, MSG_ID_DISCONNECT), &notice);
+    
+    if (server->callbacks.on_client_disconnected) {
+        client_handle_t handle = {.id = client->id, .slot = client->slot, .internal = client};
+        dispatch_async(client->queue, ^{
+            server->callbacks.on_client_disconnected(server, handle, server->user_data);
+        });
+    }
+    
+    // destroy waits for the group, the backlog still uses the server
+    dispatch_group_async_f(server->work_group, dispatch_get_global_queue(QOS_CLASS_UTILITY, 0),
+                           client, destroy_client_async);
 }
 
-static void handle_user_message(
+static bool handle_user_message(
     mach_server_t *server,
     mach_msg_header_t *header,
     internal_payload_t *payload,
@@ -217,146 +894,131 @@ static void handle_user_message(
     size_t user_payload_size
 ) {
     // Find client
+    // The lock is held until the message is queued, so a concurrent
+    // disconnect on another receiver thread can't destroy the client
+    // (and its queue) in between. What is answered here instead leaves it
+    // first, inside the worker group of the client
     pthread_mutex_lock(&server->clients_lock);
     int client_slot = payload->client_slot;
     client_info_t *client = find_client_by_id_locked(server, payload->client_id, &client_slot);
-    pthread_mutex_unlock(&server->clients_lock);
     
     if (!client) {
+        pthread_mutex_unlock(&server->clients_lock);
         LOG_ERROR_MSG("Message from unknown client %u", payload->client_id);
-        return;
+        return false;
     }
     
-    // Extract user message type from msg_id
     uint32_t msgh_id = header->msgh_id;
-    uint32_t user_msg_type = header->msgh_id & INTERNAL_MSG_TYPE_MASK;
-    bool needs_reply = HAS_FEATURE_WACK(header->msgh_id);
     
     LOG_DEBUG_MSG("User message from client id=%u slot=%d: type=%u, needs_reply=%d has_user_payload=%d",
-                  client->id, client_slot, user_msg_type, needs_reply, user_payload != NULL);
+                  client->id, client_slot, msgh_id & INTERNAL_MSG_TYPE_MASK,
+                  HAS_FEATURE_WACK(msgh_id), user_payload != NULL);
+    
+    // Expired on arrival, answered here without paying for the queueing
+    uint64_t deadline_ns = deadline_to_ns(payload->user_payload_deadline, USER_PLY_SAFETY_MS);
+    if (deadline_ns && monotonic_now_ns() >= deadline_ns) {
+        STATS_INC(server->stats.messages_received);
+        STATS_INC(server->stats.deadline_dropped);
+        dispatch_group_enter(client->workers);
+        pthread_mutex_unlock(&server->clients_lock);
+        
+        reject_expired(server, client, msgh_id, payload, &header->msgh_remote_port);
+        message_handled(client);
+        dispatch_group_leave(client->workers);
+        return false;
+    }
     
-    // Dispatch to client's queue for sequential processing
-    // reminder header will overwritten, can only use copies in async dispatch
-    // but payload cleanup has been signaled as being handled here
-    // so it stays available without expensive copies
-    mach_port_t client_port = client->port;
-    uint64_t correlation_id = payload->correlation_id;
-    int correlation_slot = payload->correlation_slot;
-    uint32_t client_id = client->id;
-    struct timespec user_payload_deadline = payload->user_payload_deadline;
-    mach_port_t _remote_port = header->msgh_remote_port;
-
-    dispatch_async(client->queue, ^{
-        bool user_payload_is_save =
-            has_no_deadline(user_payload_deadline) ||
-            !is_deadline_expired(user_payload_deadline, USER_PLY_SAFETY_MS);
-        mach_port_t remote_port = _remote_port;
-        if (needs_reply) {
-            // Message with reply
-            if (user_payload_is_save) {
-                // User payload considered save
-                if (server->callbacks.on_message_with_reply) {
-                    size_t reply_size = 0;
-                    int reply_status = IPC_SUCCESS;
-                    void *reply_data = server->callbacks.on_message_with_reply(
-                        server,
-                        (client_handle_t){.id = client_id, .slot = client_slot, .internal = client},
-                        &remote_port,
-                        user_msg_type,
-                        user_payload,
-                        user_payload_size,
-                        &reply_size,
-                        server->user_data,
-                        &reply_status
-                    );
-
-                    // Send acknowledgment
-                    internal_payload_t ack = (internal_payload_t){
-                        .client_id = 0,
-                        .client_slot = -1,
-                        .status = reply_status
-                    };
-                    protocol_send_ack(
-                        client_port,
-                        msgh_id,
-                        correlation_id,
-                        correlation_slot,
-                        &ack,
-                        sizeof(ack),
-                        reply_data,
-                        reply_size
-                    );
-                    
-                    ipc_free(reply_data);
-                }
-            } else {
-                // User payload considered dangerous
-                LOG_ERROR_MSG("Message with id=%u and reply rejected because the user payload has reached it's deadline", msgh_id);
-                internal_payload_t ack = (internal_payload_t){
-                    .client_id = 0,
-                    .client_slot = -1,
-                    .status = IPC_ERROR_TIMEOUT
-                };
-                protocol_send_ack(
-                    client_port,
-                    msgh_id,
-                    correlation_id,
-                    correlation_slot,
-                    &ack,
-                    sizeof(ack),
-                    NULL,
-                    0
-                );
-            }
+    // A client sending faster than its handlers keep up pins the memory
+    // of its backlog, it gets no further than its quota
+    if (over_hard_quota(server, client, user_payload_size)) {
+        STATS_INC(server->stats.messages_received);
+        bool disconnect = server->options.quota_disconnect;
+        if (disconnect) {
+            remove_client_locked(server, client);
         } else {
-            // Fire-and-forget message
-            if (user_payload_is_save) {
-                // User payload considered save
-                if (server->callbacks.on_message) {
-                    server->callbacks.on_message(
-                        server,
-                        (client_handle_t){.id = client->id, .slot = client_slot, .internal = client},
-                        &remote_port,
-                        user_msg_type,
-                        user_payload,
-                        user_payload_size,
-                        server->user_data
-                    );
-                }
-            } else {
-                // User payload considered dangerous
-                LOG_ERROR_MSG("Message with id=%u ignored because the user payload has reached it's deadline", msgh_id);
-            }
-        }
-
-        // Cleanup after processing
-        kern_return_t kr;
-        if (remote_port != MACH_PORT_NULL) {
-            kr = mach_port_deallocate(mach_task_self(), remote_port);
-            if (kr != KERN_SUCCESS) {
-                LOG_ERROR_MSG("Failed to clean remote port: 0x%x (%s)", kr, mach_error_string(kr));
-            }
+            dispatch_group_enter(client->workers);
         }
-        kr = vm_deallocate(mach_task_self(), (vm_address_t)payload, payload_size);
-        if (kr != KERN_SUCCESS) {
-            LOG_ERROR_MSG("Failed to clean payload: 0x%x (%s)", kr, mach_error_string(kr));
-        }
-        if (user_payload && user_payload_size) {
-            kr = vm_deallocate(mach_task_self(), (vm_address_t)user_payload, user_payload_size);
-            if (kr != KERN_SUCCESS) {
-                LOG_ERROR_MSG("Failed to clean user payload: 0x%x (%s)", kr, mach_error_string(kr));
-            }
+        pthread_mutex_unlock(&server->clients_lock);
+        
+        reject_over_quota(server, client, msgh_id, payload, &header->msgh_remote_port);
+        message_handled(client);
+        if (disconnect) {
+            disconnect_over_quota(server, client);
+        } else {
+            dispatch_group_leave(client->workers);
         }
-    });
-}
-
-static void handle_death_notification(mach_server_t *server, mach_msg_header_t *header) {
-    mach_dead_name_notification_t *notif = (mach_dead_name_notification_t*)header;
+        return false;
+    }
     
-    pthread_mutex_lock(&server->clients_lock);
-    int client_slot = -1;
-    client_info_t *client = find_client_by_port_locked(server, notif->not_port, &client_slot);
-    pthread_mutex_unlock(&server->clients_lock);
+    delivery_t *delivery = delivery_alloc(&server->delivery_slab);
+    if (!delivery) {
+        LOG_ERROR_MSG("Failed to queue message from client %u", client->id);
+        dispatch_group_enter(client->workers);
+        pthread_mutex_unlock(&server->clients_lock);
+        message_handled(client);
+        dispatch_group_leave(client->workers);
+        return false;
+    }
+    
+    // Queue on the client for sequential processing
+    // reminder header will overwritten, so the record holds copies
+    // but payload cleanup has been signaled as being handled here
+    // so it stays available without expensive copies
+    if (!protocol_detach_payload(msgh_id, &payload, payload_size,
+                                 &user_payload, user_payload_size)) {
+        delivery_free(&server->delivery_slab, delivery);
+        dispatch_group_enter(client->workers);
+        pthread_mutex_unlock(&server->clients_lock);
+        message_handled(client);
+        dispatch_group_leave(client->workers);
+        return false;
+    }
+    
+    delivery->msgh_id = msgh_id;
+    delivery->payload = payload;
+    delivery->payload_size = payload_size;
+    delivery->user_payload = user_payload;
+    delivery->user_payload_size = user_payload_size;
+    delivery->remote_port = header->msgh_remote_port;
+    delivery->deadline_ns = deadline_ns;
+    delivery->received_ns = STATS_NOW();
+    
+    STATS_INC(server->stats.messages_received);
+    STATS_ADD(server->stats.bytes_received, user_payload_size);
+    STATS_INC(server->stats.queue_depth);
+    STATS_MAX(server->stats.queue_depth_peak, STATS_INC(client->queue_depth) + 1);
+    
+    atomic_fetch_add_explicit(&client->queued_bytes, user_payload_size, memory_order_seq_cst);
+    atomic_fetch_add_explicit(&client->queued_messages, 1, memory_order_relaxed);
+    STATS_ADD(server->stats.queued_bytes, user_payload_size);
+    STATS_MAX(server->stats.queued_bytes_peak,
+              atomic_load_explicit(&client->queued_bytes, memory_order_relaxed));
+    
+    if (is_unordered(server, msgh_id)) {
+        queue_unordered(server, client, delivery);
+    } else if (HAS_FEATURE_PRIO(msgh_id)) {
+        if (mpsc_push(&client->priority_deliveries, &delivery->node)) {
+            dispatch_async_f(client->priority_queue, client, drain_priority_deliveries);
+        }
+    } else if (mpsc_push(&client->deliveries, &delivery->node)) {
+        dispatch_async_f(client->queue, client, drain_deliveries);
+    }
+
+    pthread_mutex_unlock(&server->clients_lock);
+    return true;
+}
+
+static void handle_death_notification(mach_server_t *server, mach_msg_header_t *header) {
+    mach_dead_name_notification_t *notif = (mach_dead_name_notification_t*)header;
+    
+    // Found and removed at once, a quota disconnect may race for it
+    pthread_mutex_lock(&server->clients_lock);
+    int client_slot = -1;
+    client_info_t *client = find_client_by_port_locked(server, notif->not_port, &client_slot);
+    if (client) {
+        remove_client_locked(server, client);
+    }
+    pthread_mutex_unlock(&server->clients_lock);
     
     if (client) {
         LOG_INFO_MSG("Client id=%u slot=%d died", client->id, client_slot);
@@ -372,11 +1034,323 @@ static void handle_death_notification(mach_server_t *server, mach_msg_header_t *
             });
         }
         
-        remove_client(server, client);
         destroy_client(client);
     }
 }
 
+/* ============================================================================
+ * SHARED MEMORY CHANNEL
+ * ============================================================================ */
+
+// Runs on the client queue until the ring is empty and the consumer parked
+static void drain_channel(mach_server_t *server, client_info_t *client) {
+    ring_t *ring = &client->channel;
+    bool was_broken = ring->broken;
+    
+    while (client->active) {
+        uint32_t msg_type;
+        const void *data;
+        size_t size;
+        while (client->active && ring_peek(ring, &msg_type, &data, &size)) {
+            STATS_INC(server->stats.messages_received);
+            STATS_ADD(server->stats.bytes_received, size);
+            // The ring slot is reused, a retain copies it
+            handler_scope_t scope;
+            protocol_scope_enter(&scope, data, size, false);
+            if (server->callbacks.on_message) {
+                server->callbacks.on_message(
+                    server,
+                    (client_handle_t){.id = client->id, .slot = client->slot, .internal = client},
+                    &(mach_port_t){MACH_PORT_NULL},
+                    msg_type & INTERNAL_MSG_TYPE_MASK,
+                    data,
+                    size,
+                    server->user_data
+                );
+            }
+            protocol_scope_leave(&scope);
+            ring_consume(ring);
+        }
+        
+        if (ring->broken || ring_park(ring)) {
+            break;
+        }
+    }
+    
+    if (ring->broken && !was_broken) {
+        LOG_ERROR_MSG("Malformed record in channel of client %u, channel stopped", client->id);
+    }
+}
+
+static void handle_channel_request(
+    mach_server_t *server,
+    mach_msg_header_t *header,
+    internal_payload_t *payload,
+    const void *user_payload,
+    size_t user_payload_size
+) {
+    mach_port_t mem_port = header->msgh_remote_port;
+    shared_memory_t *shmem = NULL;
+    ring_t ring = {0};
+    uint64_t mapping_size = 0;
+    int status = IPC_SUCCESS;
+    
+    if (mem_port == MACH_PORT_NULL || !user_payload ||
+        user_payload_size != sizeof(mapping_size)) {
+        LOG_ERROR_MSG("Malformed channel request");
+        status = IPC_ERROR_INVALID_PARAM;
+    } else {
+        memcpy(&mapping_size, user_payload, sizeof(mapping_size));
+        if (mapping_size == 0 || mapping_size > CHANNEL_MAX_SIZE) {
+            LOG_ERROR_MSG("Channel size %llu out of range", (unsigned long long)mapping_size);
+            status = IPC_ERROR_INVALID_PARAM;
+        } else if (shared_memory_map(mem_port, mapping_size, &shmem) != KERN_SUCCESS) {
+            status = IPC_ERROR_NO_MEMORY;
+        } else {
+            mem_port = MACH_PORT_NULL; // Owned by the mapping now
+            if (!ring_attach(&ring, shared_memory_get_data(shmem), mapping_size)) {
+                LOG_ERROR_MSG("Channel memory holds no valid ring");
+                status = IPC_ERROR_INVALID_PARAM;
+            }
+        }
+    }
+    
+    pthread_mutex_lock(&server->clients_lock);
+    int client_slot = payload->client_slot;
+    client_info_t *client = find_client_by_id_locked(server, payload->client_id, &client_slot);
+    
+    if (!client) {
+        pthread_mutex_unlock(&server->clients_lock);
+        LOG_ERROR_MSG("Channel request from unknown client %u", payload->client_id);
+        shared_memory_destroy(shmem);
+        if (mem_port != MACH_PORT_NULL) {
+            mach_port_deallocate(mach_task_self(), mem_port);
+        }
+        return;
+    }
+    
+    if (status == IPC_SUCCESS && client->channel_shmem) {
+        LOG_ERROR_MSG("Client %u already has a channel", client->id);
+        status = IPC_ERROR_INTERNAL;
+    }
+    
+    if (status == IPC_SUCCESS) {
+        client->channel = ring;
+        client->channel_shmem = shmem;
+        shmem = NULL;
+    }
+    
+    // Ack from the client queue, destroy_client drains it before the port goes
+    mach_port_t client_port = CLIENT_ACK_PORT(client);
+    mach_msg_id_t msgh_id = header->msgh_id;
+    uint64_t correlation_id = payload->correlation_id;
+    int correlation_slot = payload->correlation_slot;
+    dispatch_async(client->queue, ^{
+        internal_payload_t ack = (internal_payload_t){
+            .client_id = 0,
+            .client_slot = -1,
+            .status = status
+        };
+        protocol_send_ack(
+            client_port,
+            MACH_PORT_NULL,
+            msgh_id,
+            correlation_id,
+            correlation_slot,
+            &ack,
+            sizeof(ack),
+            NULL,
+            0,
+            false
+        );
+    });
+    
+    pthread_mutex_unlock(&server->clients_lock);
+    
+    shared_memory_destroy(shmem);
+    if (mem_port != MACH_PORT_NULL) {
+        mach_port_deallocate(mach_task_self(), mem_port);
+    }
+    
+    if (status == IPC_SUCCESS) {
+        LOG_INFO_MSG("Client %u opened a %llu byte channel", payload->client_id,
+                     (unsigned long long)mapping_size);
+    }
+}
+
+static void handle_doorbell(mach_server_t *server, internal_payload_t *payload) {
+    pthread_mutex_lock(&server->clients_lock);
+    int client_slot = payload->client_slot;
+    client_info_t *client = find_client_by_id_locked(server, payload->client_id, &client_slot);
+    
+    if (client && client->channel_shmem) {
+        dispatch_async(client->queue, ^{
+            drain_channel(server, client);
+        });
+    }
+    
+    pthread_mutex_unlock(&server->clients_lock);
+}
+
+/* Take the reply port of a client and answer with a send right to ours */
+static void handle_reply_port_request(
+    mach_server_t *server,
+    mach_msg_header_t *header,
+    internal_payload_t *payload
+) {
+    mach_port_t reply_port = header->msgh_remote_port;
+    
+    pthread_mutex_lock(&server->clients_lock);
+    int client_slot = payload->client_slot;
+    client_info_t *client = find_client_by_id_locked(server, payload->client_id, &client_slot);
+    
+    if (!client || reply_port == MACH_PORT_NULL) {
+        pthread_mutex_unlock(&server->clients_lock);
+        LOG_ERROR_MSG("Reply port request from unknown client %u", payload->client_id);
+        if (reply_port != MACH_PORT_NULL) {
+            mach_port_deallocate(mach_task_self(), reply_port);
+        }
+        return;
+    }
+    
+    int status = IPC_SUCCESS;
+    mach_port_t server_reply = server->reply_port;
+    kern_return_t kr = mach_port_insert_right(mach_task_self(), server_reply, server_reply,
+                                              MACH_MSG_TYPE_MAKE_SEND);
+    if (kr != KERN_SUCCESS) {
+        LOG_ERROR_MSG("Failed to make reply send right: %s", mach_error_string(kr));
+        server_reply = MACH_PORT_NULL;
+        status = IPC_ERROR_INTERNAL;
+    }
+    
+    // Acks queued on the client queue before keep the old port, both are
+    // released only after the queue drained
+    mach_port_t client_port = CLIENT_ACK_PORT(client);
+    if (status == IPC_SUCCESS) {
+        if (client->reply_port != MACH_PORT_NULL) {
+            mach_port_t old = client->reply_port;
+            dispatch_async(client->queue, ^{
+                mach_port_deallocate(mach_task_self(), old);
+            });
+        }
+        client->reply_port = reply_port;
+        client_port = reply_port;
+    } else {
+        mach_port_deallocate(mach_task_self(), reply_port);
+    }
+    
+    mach_msg_id_t msgh_id = header->msgh_id;
+    uint64_t correlation_id = payload->correlation_id;
+    int correlation_slot = payload->correlation_slot;
+    dispatch_async(client->queue, ^{
+        internal_payload_t ack = (internal_payload_t){
+            .client_id = 0,
+            .client_slot = -1,
+            .status = status
+        };
+        kern_return_t ack_kr = protocol_send_ack(
+            client_port,
+            server_reply,
+            msgh_id,
+            correlation_id,
+            correlation_slot,
+            &ack,
+            sizeof(ack),
+            NULL,
+            0,
+            false
+        );
+        if (ack_kr != KERN_SUCCESS && server_reply != MACH_PORT_NULL) {
+            // Unsent, so the send right is still ours
+            mach_port_deallocate(mach_task_self(), server_reply);
+        }
+    });
+    
+    pthread_mutex_unlock(&server->clients_lock);
+}
+
+static void handle_credit(mach_server_t *server, internal_payload_t *payload) {
+    pthread_mutex_lock(&server->clients_lock);
+    int client_slot = payload->client_slot;
+    client_info_t *client = find_client_by_id_locked(server, payload->client_id, &client_slot);
+    
+    if (client) {
+        flow_release(&client->flow, &server->flow_wait, payload->credits);
+    }
+    
+    pthread_mutex_unlock(&server->clients_lock);
+}
+
+/* ============================================================================
+ * SUBSCRIPTION REQUESTS
+ * ============================================================================ */
+
+static void handle_subscription_request(
+    mach_server_t *server,
+    mach_msg_header_t *header,
+    internal_payload_t *payload,
+    const void *user_payload,
+    size_t user_payload_size,
+    bool subscribe
+) {
+    uint32_t topic = 0;
+    int status = IPC_SUCCESS;
+    if (!user_payload || user_payload_size != sizeof(topic)) {
+        LOG_ERROR_MSG("Malformed subscription request");
+        status = IPC_ERROR_INVALID_PARAM;
+    } else {
+        memcpy(&topic, user_payload, sizeof(topic));
+    }
+    
+    pthread_mutex_lock(&server->clients_lock);
+    int client_slot = payload->client_slot;
+    client_info_t *client = find_client_by_id_locked(server, payload->client_id, &client_slot);
+    
+    if (!client) {
+        pthread_mutex_unlock(&server->clients_lock);
+        LOG_ERROR_MSG("Subscription request from unknown client %u", payload->client_id);
+        return;
+    }
+    
+    if (status == IPC_SUCCESS) {
+        if (subscribe) {
+            status = subscribe_locked(server, topic, client_slot);
+        } else {
+            unsubscribe_locked(server, topic, client_slot);
+        }
+    }
+    
+    // Ack from the client queue, destroy_client drains it before the port goes
+    mach_port_t client_port = CLIENT_ACK_PORT(client);
+    mach_msg_id_t msgh_id = header->msgh_id;
+    uint64_t correlation_id = payload->correlation_id;
+    int correlation_slot = payload->correlation_slot;
+    dispatch_async(client->queue, ^{
+        internal_payload_t ack = (internal_payload_t){
+            .client_id = 0,
+            .client_slot = -1,
+            .status = status
+        };
+        protocol_send_ack(
+            client_port,
+            MACH_PORT_NULL,
+            msgh_id,
+            correlation_id,
+            correlation_slot,
+            &ack,
+            sizeof(ack),
+            NULL,
+            0,
+            false
+        );
+    });
+    
+    pthread_mutex_unlock(&server->clients_lock);
+    
+    LOG_DEBUG_MSG("Client %u %s topic %u (status=%d)", payload->client_id,
+                  subscribe ? "subscribed to" : "unsubscribed from", topic, status);
+}
+
 static bool server_message_handler(
     mach_port_t service_port,
     mach_msg_header_t *header,
@@ -404,15 +1378,141 @@ static bool server_message_handler(
             // we wan't auto cleanup except for the port
             // so we can simply change it to null
             header->msgh_remote_port = MACH_PORT_NULL;
+        } else if (IS_INTERNAL_MSG_TYPE(header->msgh_id, INTERNAL_MSG_TYPE_CHANNEL)) {
+            // The memory entry port is taken over by the handler
+            handle_channel_request(server, header, payload, user_payload, user_payload_size);
+            header->msgh_remote_port = MACH_PORT_NULL;
+        } else if (IS_INTERNAL_MSG_TYPE(header->msgh_id, INTERNAL_MSG_TYPE_DOORBELL)) {
+            handle_doorbell(server, payload);
+        } else if (IS_INTERNAL_MSG_TYPE(header->msgh_id, INTERNAL_MSG_TYPE_CREDIT)) {
+            handle_credit(server, payload);
+        } else if (IS_INTERNAL_MSG_TYPE(header->msgh_id, INTERNAL_MSG_TYPE_REPLY_PORT)) {
+            // The client's reply port is taken over by the handler
+            handle_reply_port_request(server, header, payload);
+            header->msgh_remote_port = MACH_PORT_NULL;
+        } else if (IS_INTERNAL_MSG_TYPE(header->msgh_id, INTERNAL_MSG_TYPE_SUBSCRIBE)) {
+            handle_subscription_request(server, header, payload,
+                                        user_payload, user_payload_size, true);
+        } else if (IS_INTERNAL_MSG_TYPE(header->msgh_id, INTERNAL_MSG_TYPE_UNSUBSCRIBE)) {
+            handle_subscription_request(server, header, payload,
+                                        user_payload, user_payload_size, false);
         }
     } else if (IS_EXTERNAL_MSG(header->msgh_id)) {
-        handle_user_message(server, header, payload, payload_size, user_payload, user_payload_size);
-        return false;
+        // handler takes over the payload cleanup unless the message was dropped
+        return !handle_user_message(server, header, payload, payload_size,
+                                    user_payload, user_payload_size);
     }
 
     return true;
 }
 
+/* ============================================================================
+ * RECEIVER THREADS
+ * ============================================================================ */
+
+static void destroy_port_set(void *res) {
+    mach_port_t *port_set = (mach_port_t*)res;
+    if (*port_set != MACH_PORT_NULL) {
+        kern_return_t kr = mach_port_mod_refs(mach_task_self(), *port_set,
+                                              MACH_PORT_RIGHT_PORT_SET, -1);
+        if (kr != KERN_SUCCESS) {
+            LOG_ERROR_MSG("Port set destruction failed: %s", mach_error_string(kr));
+        }
+        *port_set = MACH_PORT_NULL;
+    }
+}
+
+static bool setup_receivers(mach_server_t *server) {
+    server->receivers = calloc(server->receiver_count, sizeof(server_receiver_t));
+    if (!server->receivers) {
+        LOG_ERROR_MSG("Failed to allocate receivers");
+        return false;
+    }
+    resource_tracker_add(server->resources, RES_TYPE_MEMORY, &server->receivers,
+                        NULL, "receivers");
+    
+    if (server->receiver_count == 1) {
+        // Single receiver serves everything on the service port
+        server->receivers[0] = (server_receiver_t){
+            .server = server,
+            .lane_port = MACH_PORT_NULL,
+            .rcv_port = server->service_port
+        };
+        return true;
+    }
+    
+    kern_return_t kr = mach_port_allocate(mach_task_self(), MACH_PORT_RIGHT_PORT_SET,
+                                          &server->lane_set);
+    if (kr != KERN_SUCCESS) {
+        LOG_ERROR_MSG("Failed to allocate lane set: %s", mach_error_string(kr));
+        return false;
+    }
+    resource_tracker_add(server->resources, RES_TYPE_CUSTOM, &server->lane_set,
+                        destroy_port_set, "lane_set");
+    
+    for (int i = 0; i < server->receiver_count; i++) {
+        server_receiver_t *receiver = &server->receivers[i];
+        receiver->server = server;
+        
+        kr = mach_port_allocate(mach_task_self(), MACH_PORT_RIGHT_RECEIVE,
+                               &receiver->lane_port);
+        if (kr != KERN_SUCCESS) {
+            LOG_ERROR_MSG("Failed to allocate lane port %d: %s", i, mach_error_string(kr));
+            return false;
+        }
+        resource_tracker_add(server->resources, RES_TYPE_PORT, &receiver->lane_port,
+                            NULL, "lane_port");
+        port_set_queue_limit(receiver->lane_port, server->options.port_queue_limit);
+        
+        receiver->rcv_port = receiver->lane_port;
+    }
+    
+    // Receiver 0 also handles connects and death notifications
+    kr = mach_port_move_member(mach_task_self(), server->service_port, server->lane_set);
+    if (kr == KERN_SUCCESS) {
+        kr = mach_port_move_member(mach_task_self(), server->receivers[0].lane_port,
+                                   server->lane_set);
+    }
+    if (kr != KERN_SUCCESS) {
+        LOG_ERROR_MSG("Failed to populate lane set: %s", mach_error_string(kr));
+        return false;
+    }
+    server->receivers[0].rcv_port = server->lane_set;
+    
+    return true;
+}
+
+static void* server_receiver_thread(void *arg) {
+    server_receiver_t *receiver = (server_receiver_t*)arg;
+    mach_server_t *server = receiver->server;
+    
+    LOG_DEBUG_MSG("Server receiver thread started on port %u", receiver->rcv_port);
+    
+    protocol_receive_loop(
+        receiver->rcv_port,
+        &server->running,
+        &server->acks,
+        server_message_handler,
+        server
+    );
+    
+    LOG_DEBUG_MSG("Server receiver thread stopped");
+    return NULL;
+}
+
+static void* server_reply_thread(void *arg) {
+    mach_server_t *server = (mach_server_t*)arg;
+    
+    protocol_receive_loop(
+        server->reply_port,
+        &server->running,
+        &server->acks,
+        protocol_drop_message,
+        server
+    );
+    return NULL;
+}
+
 /* ============================================================================
  * PUBLIC API
  * ============================================================================ */
@@ -421,8 +1521,22 @@ mach_server_t* mach_server_create(
     const char *service_name,
     const server_callbacks_t *callbacks,
     void *user_data
+) {
+    return mach_server_create_with_options(service_name, callbacks, NULL, user_data);
+}
+
+mach_server_t* mach_server_create_with_options(
+    const char *service_name,
+    const server_callbacks_t *callbacks,
+    const server_options_t *options,
+    void *user_data
 ) {
     if (!service_name) return NULL;
+    if (options && (options->receiver_threads < 0 || options->max_clients < 0 ||
+                    options->max_clients > MAX_CLIENTS_LIMIT ||
+                    options->worker_threads < 0)) {
+        return NULL;
+    }
     
     mach_server_t *server = calloc(1, sizeof(mach_server_t));
     if (!server) return NULL;
@@ -436,19 +1550,49 @@ mach_server_t* mach_server_create(
     
     strncpy(server->service_name, service_name, sizeof(server->service_name) - 1);
     
-    // Initialize pools
-    pool_init(&server->ack_pool, MAX_ACKS, sizeof(ack_waiter_t));
-    resource_tracker_add(server->resources, RES_TYPE_POOL, &server->ack_pool, 
-                        (void(*)(void*))pool_free, "ack_pool");
+    // Initialize ack table
+    if (!ack_table_init(&server->acks, MAX_ACKS)) {
+        resource_tracker_destroy(server->resources);
+        free(server);
+        return NULL;
+    }
+    resource_tracker_add(server->resources, RES_TYPE_CUSTOM, &server->acks,
+                        ack_table_destroy, "acks");
+    
+    if (!slab_init(&server->delivery_slab, DELIVERY_SLAB_SIZE, sizeof(delivery_t))) {
+        mach_server_destroy(server);
+        return NULL;
+    }
+    resource_tracker_add(server->resources, RES_TYPE_CUSTOM, &server->delivery_slab,
+                        slab_destroy, "delivery_slab");
+    
+    if (!arena_init(&server->reply_arena, REPLY_ARENA_SIZE)) {
+        mach_server_destroy(server);
+        return NULL;
+    }
+    resource_tracker_add(server->resources, RES_TYPE_CUSTOM, &server->reply_arena,
+                        arena_destroy, "reply_arena");
+    
+    if (!flow_wait_init(&server->flow_wait)) {
+        mach_server_destroy(server);
+        return NULL;
+    }
+    resource_tracker_add(server->resources, RES_TYPE_CUSTOM, &server->flow_wait,
+                        flow_wait_destroy, "flow_wait");
     
     // Initialize locks
     pthread_mutex_init(&server->clients_lock, NULL);
     resource_tracker_add(server->resources, RES_TYPE_MUTEX, &server->clients_lock,
                         (void(*)(void*))pthread_mutex_destroy, "clients_lock");
+    pthread_mutex_init(&server->work_lock, NULL);
+    resource_tracker_add(server->resources, RES_TYPE_MUTEX, &server->work_lock,
+                        (void(*)(void*))pthread_mutex_destroy, "work_lock");
     
-    pthread_mutex_init(&server->ack_lock, NULL);
-    resource_tracker_add(server->resources, RES_TYPE_MUTEX, &server->ack_lock,
-                        (void(*)(void*))pthread_mutex_destroy, "ack_lock");
+    server->work_group = dispatch_group_create();
+    if (!server->work_group) {
+        mach_server_destroy(server);
+        return NULL;
+    }
     
     // Register with bootstrap
     kern_return_t kr = bootstrap_check_in(
@@ -466,22 +1610,68 @@ mach_server_t* mach_server_create(
     resource_tracker_add(server->resources, RES_TYPE_PORT, &server->service_port,
                         NULL, "service_port");
     
+    // Acks of clients bypass the service and lane ports
+    kr = mach_port_allocate(mach_task_self(), MACH_PORT_RIGHT_RECEIVE, &server->reply_port);
+    if (kr != KERN_SUCCESS) {
+        LOG_ERROR_MSG("Failed to allocate reply port: %s", mach_error_string(kr));
+        mach_server_destroy(server);
+        return NULL;
+    }
+    resource_tracker_add(server->resources, RES_TYPE_PORT, &server->reply_port,
+                        NULL, "reply_port");
+    
+    if (options) {
+        server->options = *options;
+    }
+    port_set_queue_limit(server->service_port, server->options.port_queue_limit);
+    server->receiver_count = server->options.receiver_threads > 1
+        ? server->options.receiver_threads
+        : 1;
+    server->worker_limit = server->options.worker_threads;
+    if (!server->worker_limit) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        server->worker_limit = cpus > 0 ? (int)cpus : 1;
+    }
+    
+    if (!setup_client_table(server)) {
+        mach_server_destroy(server);
+        return NULL;
+    }
+    
+    if (!setup_receivers(server)) {
+        mach_server_destroy(server);
+        return NULL;
+    }
+    
     server->next_client_id = 1;
-    server->next_correlation_id = 1;
     
     if (callbacks) {
         server->callbacks = *callbacks;
     }
     server->user_data = user_data;
     
-    LOG_INFO_MSG("Server created: %s (port %u)", service_name, server->service_port);
+    LOG_INFO_MSG("Server created: %s (port %u, %d receiver(s))",
+                 service_name, server->service_port, server->receiver_count);
     return server;
 }
 
 size_t mach_server_max_clients(mach_server_t *server) {
-    return server 
-        ? (sizeof(server->clients) / sizeof(server->clients[0]))
-        : 0;
+    return server ? (size_t)server->clients.capacity : 0;
+}
+
+ipc_status_t mach_server_set_unordered(mach_server_t *server, uint32_t msg_type,
+                                       bool unordered) {
+    if (!server || server->running || msg_type > INTERNAL_MSG_TYPE_MASK) {
+        return IPC_ERROR_INVALID_PARAM;
+    }
+    
+    uint64_t bit = 1ULL << (msg_type % 64);
+    if (unordered) {
+        server->unordered_types[msg_type / 64] |= bit;
+    } else {
+        server->unordered_types[msg_type / 64] &= ~bit;
+    }
+    return IPC_SUCCESS;
 }
 
 ipc_status_t mach_server_run(mach_server_t *server) {
@@ -491,18 +1681,40 @@ ipc_status_t mach_server_run(mach_server_t *server) {
     
     LOG_INFO_MSG("Server running...");
     
-    // Run receive loop in current thread
-    protocol_receive_loop(
-        server->service_port,
-        &server->running,
-        &server->ack_pool,
-        &server->ack_lock,
-        server_message_handler,
-        server
-    );
+    if (pthread_create(&server->reply_thread, NULL, server_reply_thread, server) != 0) {
+        LOG_ERROR_MSG("Failed to create reply thread");
+        server->running = 0;
+        return IPC_ERROR_INTERNAL;
+    }
+    
+    // Start additional receivers, receiver 0 runs in current thread
+    int started = 1;
+    for (; started < server->receiver_count; started++) {
+        server_receiver_t *receiver = &server->receivers[started];
+        if (pthread_create(&receiver->thread, NULL, server_receiver_thread, receiver) != 0) {
+            LOG_ERROR_MSG("Failed to create receiver thread %d", started);
+            break;
+        }
+    }
+    
+    ipc_status_t status = IPC_SUCCESS;
+    if (started == server->receiver_count) {
+        server_receiver_thread(&server->receivers[0]);
+    } else {
+        // Clients pinned to a missing receiver would starve
+        mach_server_stop(server);
+        status = IPC_ERROR_INTERNAL;
+    }
+    
+    for (int i = 1; i < started; i++) {
+        pthread_join(server->receivers[i].thread, NULL);
+        server->receivers[i].thread = 0;
+    }
+    pthread_join(server->reply_thread, NULL);
+    server->reply_thread = 0;
     
     LOG_INFO_MSG("Server stopped");
-    return IPC_SUCCESS;
+    return status;
 }
 
 void mach_server_stop(mach_server_t *server) {
@@ -510,6 +1722,82 @@ void mach_server_stop(mach_server_t *server) {
     
     LOG_INFO_MSG("Stopping server...");
     server->running = 0;
+    
+    // Receivers block until a message arrives. Receiver 0 of a lane set
+    // is woken through its lane, a member of the set
+    for (int i = 0; i < server->receiver_count; i++) {
+        server_receiver_t *receiver = &server->receivers[i];
+        protocol_wakeup(receiver->lane_port != MACH_PORT_NULL
+                        ? receiver->lane_port : receiver->rcv_port, 1);
+    }
+    protocol_wakeup(server->reply_port, 1);
+}
+
+/* Spend a credit of the client for one user message */
+static ipc_status_t take_credit(mach_server_t *server, client_info_t *client) {
+    ipc_status_t status = flow_acquire(&client->flow, &server->flow_wait,
+                                       server->options.send_wait_ms);
+    if (status != IPC_SUCCESS) {
+        STATS_INC(server->stats.flow_blocked);
+    }
+    return status;
+}
+
+/* Send a user message to a client. A gathered page block is moved and
+ * released here on every path */
+static ipc_status_t send_user_message(
+    mach_server_t *server,
+    client_handle_t client,
+    uint32_t msg_type,
+    protocol_gather_t *gather
+) {
+    if (!server || !IS_VALID_CLIENT(client)) {
+        protocol_gather_release(gather, false);
+        return IPC_ERROR_INVALID_PARAM;
+    }
+    
+    client_info_t *client_info = (client_info_t*)client.internal;
+    if (!client_info->active) {
+        protocol_gather_release(gather, false);
+        return IPC_ERROR_NOT_CONNECTED;
+    }
+
+    internal_payload_t payload = (internal_payload_t){
+        .client_id = 0,    // Server doesn't have a client ID
+        .client_slot = -1, // Server doesn't have a client slot
+        .status = IPC_SUCCESS
+    };
+    
+    ipc_status_t status = take_credit(server, client_info);
+    if (status != IPC_SUCCESS) {
+        protocol_gather_release(gather, false);
+        return status;
+    }
+    
+    kern_return_t kr;
+    if (gather->pages) {
+        kr = protocol_send_owned_message(client_info->port,
+                                         WIRE_MSG_ID(client_info, MSG_ID_USER(msg_type)),
+                                         &payload, gather->data, gather->size);
+        protocol_gather_release(gather, SEND_MOVED_PAYLOAD(kr));
+    } else {
+        kr = protocol_send_message(
+            client_info->port,
+            MACH_PORT_NULL,
+            WIRE_MSG_ID(client_info, MSG_ID_USER(msg_type)),
+            &payload,
+            sizeof(payload),
+            gather->data,
+            gather->size,
+            0
+        );
+    }
+    
+    if (kr != KERN_SUCCESS) {
+        flow_release(&client_info->flow, &server->flow_wait, 1);
+        return IPC_ERROR_SEND_FAILED;
+    }
+    return IPC_SUCCESS;
 }
 
 ipc_status_t mach_server_send(
@@ -519,7 +1807,32 @@ ipc_status_t mach_server_send(
     const void *data,
     size_t size
 ) {
-    if (!server || !IS_VALID_CLIENT(client)) {
+    protocol_gather_t gather = {.data = data, .size = size};
+    return send_user_message(server, client, msg_type, &gather);
+}
+
+ipc_status_t mach_server_sendv(
+    mach_server_t *server,
+    client_handle_t client,
+    uint32_t msg_type,
+    const struct iovec *iov,
+    int iovcnt
+) {
+    protocol_gather_t gather;
+    ipc_status_t status = protocol_gather(&gather, iov, iovcnt);
+    if (status != IPC_SUCCESS) {
+        return status;
+    }
+    return send_user_message(server, client, msg_type, &gather);
+}
+
+ipc_status_t mach_server_send_batch(
+    mach_server_t *server,
+    client_handle_t client,
+    const ipc_batch_entry_t *entries,
+    size_t count
+) {
+    if (!server || !IS_VALID_CLIENT(client) || !entries || count == 0) {
         return IPC_ERROR_INVALID_PARAM;
     }
     
@@ -527,25 +1840,48 @@ ipc_status_t mach_server_send(
     if (!client_info->active) {
         return IPC_ERROR_NOT_CONNECTED;
     }
-
+    
+    uint8_t *batch = NULL;
+    size_t batch_size = 0;
+    size_t batch_capacity = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (!protocol_batch_append(&batch, &batch_size, &batch_capacity,
+                                   entries[i].msg_type, entries[i].data, entries[i].size)) {
+            free(batch);
+            return IPC_ERROR_NO_MEMORY;
+        }
+    }
+    
     internal_payload_t payload = (internal_payload_t){
         .client_id = 0,    // Server doesn't have a client ID
         .client_slot = -1, // Server doesn't have a client slot
         .status = IPC_SUCCESS
     };
     
+    // A batch is queued as one message
+    ipc_status_t status = take_credit(server, client_info);
+    if (status != IPC_SUCCESS) {
+        free(batch);
+        return status;
+    }
+    
     kern_return_t kr = protocol_send_message(
         client_info->port,
         MACH_PORT_NULL,
-        MSG_ID_USER(msg_type),
+        WIRE_MSG_ID(client_info, SET_FEATURE(MSG_ID_USER(0), INTERNAL_FEATURE_BTCH)),
         &payload,
         sizeof(payload),
-        data,
-        size,
+        batch,
+        batch_size,
         0
     );
     
-    return kr == KERN_SUCCESS ? IPC_SUCCESS : IPC_ERROR_SEND_FAILED;
+    free(batch);
+    if (kr != KERN_SUCCESS) {
+        flow_release(&client_info->flow, &server->flow_wait, 1);
+        return IPC_ERROR_SEND_FAILED;
+    }
+    return IPC_SUCCESS;
 }
 
 ipc_status_t mach_server_send_with_reply(
@@ -573,69 +1909,176 @@ ipc_status_t mach_server_send_with_reply(
         .status = IPC_SUCCESS
     };
     
-    internal_payload_t *ack_payload = NULL;
-    size_t ack_size = 0;
+    internal_payload_t ack_payload;
     const void *ack_user_payload = NULL;
     size_t ack_user_size = 0;
     
+    ipc_status_t status = take_credit(server, client_info);
+    if (status != IPC_SUCCESS) {
+        if (reply_size && reply_data) {
+            *reply_data = NULL;
+            *reply_size = 0;
+        }
+        return status;
+    }
+    
     kern_return_t kr = protocol_send_with_ack(
         client_info->port,
         MACH_PORT_NULL,
-        &server->ack_pool,
-        &server->ack_lock,
-        &server->next_correlation_id,
-        MSG_ID_USER(msg_type),
+        &server->acks,
+        WIRE_MSG_ID(client_info, MSG_ID_USER(msg_type)),
         &payload,
         sizeof(payload),
         data,
         size,
         &ack_payload,
-        &ack_size,
         &ack_user_payload,
         &ack_user_size,
+        NULL,
         timeout_ms
     );
     
-    int ack_status;
-    bool is_ack_status;
-
-    if (ack_payload && ack_size) {
-        ack_status = ack_payload->status;
-        is_ack_status = true;
-        vm_deallocate(mach_task_self(), (vm_address_t)ack_payload, ack_size);
-    } else {
-        is_ack_status = false;
-    }
-
-    if (ack_user_payload && ack_user_size) {
-        if (kr == KERN_SUCCESS) {
-            if (reply_size && reply_data) {
-                *reply_size = ack_user_size;
-                *reply_data = ack_user_payload;
-            } else {
-                ply_free((void*)ack_user_payload, ack_user_size);
-            }
-            return is_ack_status ? ack_status : IPC_SUCCESS;
-        } else {
-            if (reply_size && reply_data) {
-                *reply_data = NULL;
-                *reply_size = 0;
-            } else {
-                ply_free((void*)ack_user_payload, ack_user_size);
-            }
-            vm_deallocate(mach_task_self(), (vm_address_t)ack_user_payload, ack_user_size);
+    if (kr != KERN_SUCCESS) {
+        if (kr != KERN_OPERATION_TIMED_OUT) {
+            // Never sent
+            flow_release(&client_info->flow, &server->flow_wait, 1);
         }
-    } else {
         if (reply_size && reply_data) {
             *reply_data = NULL;
             *reply_size = 0;
         }
-        if (kr == KERN_SUCCESS) {
-            return is_ack_status ? ack_status : IPC_SUCCESS;
-        }
+        return kr == KERN_OPERATION_TIMED_OUT ? IPC_ERROR_TIMEOUT : IPC_ERROR_SEND_FAILED;
     }
+
+    if (reply_size && reply_data) {
+        *reply_size = ack_user_size;
+        *reply_data = ack_user_payload;
+    } else {
+        ply_free((void*)ack_user_payload, ack_user_size);
+    }
+    
+    return ack_payload.status;
+}
+
+typedef struct {
+    mach_server_t *server;
+    client_handle_t client;
+    server_reply_callback_t callback;
+    void *context;
+} server_async_request_t;
+
+static void server_async_complete(
+    kern_return_t kr,
+    const internal_payload_t *ack_payload,
+    const void *ack_user_payload,
+    size_t ack_user_size,
+    void *context
+) {
+    server_async_request_t *request = (server_async_request_t*)context;
     
-    return kr == KERN_OPERATION_TIMED_OUT ? IPC_ERROR_TIMEOUT : IPC_ERROR_SEND_FAILED;
+    ipc_status_t status = kr == KERN_SUCCESS ? (ipc_status_t)ack_payload->status
+        : kr == KERN_OPERATION_TIMED_OUT ? IPC_ERROR_TIMEOUT
+        : IPC_ERROR_NOT_CONNECTED;
+    request->callback(request->server, request->client, status,
+                      ack_user_payload, ack_user_size, request->context);
+    
+    ply_free((void*)ack_user_payload, ack_user_size);
+    dispatch_group_leave(((client_info_t*)request->client.internal)->workers);
+    free(request);
+}
+
+ipc_status_t mach_server_sendv_with_reply(
+    mach_server_t *server,
+    client_handle_t client,
+    uint32_t msg_type,
+    const struct iovec *iov,
+    int iovcnt,
+    const void **reply_data,
+    size_t *reply_size,
+    uint32_t timeout_ms
+) {
+    protocol_gather_t gather;
+    ipc_status_t status = protocol_gather(&gather, iov, iovcnt);
+    if (status != IPC_SUCCESS) {
+        return status;
+    }
+    
+    // Requests have no move path, a page block is still copied lazily
+    status = mach_server_send_with_reply(server, client, msg_type, gather.data, gather.size,
+                                         reply_data, reply_size, timeout_ms);
+    protocol_gather_release(&gather, false);
+    return status;
+}
+
+ipc_status_t mach_server_send_async(
+    mach_server_t *server,
+    client_handle_t client,
+    uint32_t msg_type,
+    const void *data,
+    size_t size,
+    uint32_t timeout_ms,
+    server_reply_callback_t completion,
+    void *context
+) {
+    if (!server || !IS_VALID_CLIENT(client) || !completion) {
+        return IPC_ERROR_INVALID_PARAM;
+    }
+    
+    client_info_t *client_info = (client_info_t*)client.internal;
+    if (!client_info->active) {
+        return IPC_ERROR_NOT_CONNECTED;
+    }
+    
+    ipc_status_t status = take_credit(server, client_info);
+    if (status != IPC_SUCCESS) {
+        return status;
+    }
+    
+    server_async_request_t *request = malloc(sizeof(server_async_request_t));
+    if (!request) {
+        flow_release(&client_info->flow, &server->flow_wait, 1);
+        return IPC_ERROR_NO_MEMORY;
+    }
+    *request = (server_async_request_t){
+        .server = server,
+        .client = client,
+        .callback = completion,
+        .context = context
+    };
+    
+    internal_payload_t payload = (internal_payload_t){
+        .client_id = 0,    // Server doesn't have a client ID
+        .client_slot = -1, // Server doesn't have a client slot
+        .status = IPC_SUCCESS
+    };
+    
+    // Left by the completion, destroy_client aborts what is pending and
+    // waits for it
+    dispatch_group_enter(client_info->workers);
+    kern_return_t kr = protocol_send_async(
+        client_info->port,
+        MACH_PORT_NULL,
+        &server->acks,
+        WIRE_MSG_ID(client_info, MSG_ID_USER(msg_type)),
+        &payload,
+        sizeof(payload),
+        data,
+        size,
+        timeout_ms,
+        client_info->queue,
+        server_async_complete,
+        request,
+        client_info
+    );
+    
+    if (kr != KERN_SUCCESS) {
+        dispatch_group_leave(client_info->workers);
+        flow_release(&client_info->flow, &server->flow_wait, 1);
+        free(request);
+        return IPC_ERROR_SEND_FAILED;
+    }
+    
+    return IPC_SUCCESS;
 }
 
 int mach_server_client_count(mach_server_t *server) {
@@ -648,6 +2091,91 @@ int mach_server_client_count(mach_server_t *server) {
     return count;
 }
 
+void* ipc_reply_alloc(mach_server_t *server, size_t size) {
+    return server ? arena_alloc(&server->reply_arena, size) : NULL;
+}
+
+ipc_status_t mach_server_map_region(
+    mach_server_t *server,
+    client_handle_t client,
+    mach_port_t mem_object,
+    mach_vm_size_t size,
+    void **address
+) {
+    if (!server || !IS_VALID_CLIENT(client) || !address) {
+        return IPC_ERROR_INVALID_PARAM;
+    }
+    
+    client_info_t *client_info = (client_info_t*)client.internal;
+    if (!client_info->active) {
+        return IPC_ERROR_NOT_CONNECTED;
+    }
+    
+    kern_return_t kr = region_cache_map(&client_info->regions, mem_object, size, address);
+    if (kr != KERN_SUCCESS) {
+        LOG_ERROR_MSG("Failed to map region of client %u: %s", client.id, mach_error_string(kr));
+        return kr == KERN_INVALID_ARGUMENT ? IPC_ERROR_INVALID_PARAM : IPC_ERROR_INTERNAL;
+    }
+    return IPC_SUCCESS;
+}
+
+ipc_status_t mach_server_release_region(
+    mach_server_t *server,
+    client_handle_t client,
+    const void *address
+) {
+    if (!server || !IS_VALID_CLIENT(client)) {
+        return IPC_ERROR_INVALID_PARAM;
+    }
+    
+    client_info_t *client_info = (client_info_t*)client.internal;
+    return region_cache_release(&client_info->regions, address)
+        ? IPC_SUCCESS : IPC_ERROR_INVALID_PARAM;
+}
+
+ipc_status_t mach_server_get_client_pid(mach_server_t *server, client_handle_t client, pid_t *pid) {
+    if (!server || !IS_VALID_CLIENT(client) || !pid) {
+        return IPC_ERROR_INVALID_PARAM;
+    }
+    
+    client_info_t *client_info = (client_info_t*)client.internal;
+    if (!client_info->active) {
+        return IPC_ERROR_NOT_CONNECTED;
+    }
+    
+    *pid = client_info->pid;
+    return IPC_SUCCESS;
+}
+
+ipc_status_t mach_server_get_client_usage(mach_server_t *server, client_handle_t client,
+                                          ipc_client_usage_t *usage) {
+    if (!server || !IS_VALID_CLIENT(client) || !usage) {
+        return IPC_ERROR_INVALID_PARAM;
+    }
+    
+    client_info_t *client_info = (client_info_t*)client.internal;
+    if (!client_info->active) {
+        return IPC_ERROR_NOT_CONNECTED;
+    }
+    
+    *usage = (ipc_client_usage_t){
+        .queued_messages = atomic_load_explicit(&client_info->queued_messages,
+                                                memory_order_relaxed),
+        .queued_bytes = atomic_load_explicit(&client_info->queued_bytes, memory_order_relaxed)
+    };
+    return IPC_SUCCESS;
+}
+
+ipc_status_t mach_server_get_stats(mach_server_t *server, ipc_stats_t *stats) {
+    if (!server || !stats) {
+        return IPC_ERROR_INVALID_PARAM;
+    }
+    
+    stats_snapshot(&server->stats, stats);
+    ack_table_snapshot(&server->acks, stats);
+    return IPC_SUCCESS;
+}
+
 void mach_server_destroy(mach_server_t *server) {
     if (!server) return;
     
@@ -655,14 +2183,24 @@ void mach_server_destroy(mach_server_t *server) {
         mach_server_stop(server);
     }
     
+    // Completions are queued on client queues, drained below
+    ack_table_abort_pending(&server->acks);
+    
     // Disconnect all clients
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (server->clients[i]) {
-            destroy_client(server->clients[i]);
-            server->clients[i] = NULL;
+    for (int i = 0; i < server->clients.capacity; i++) {
+        client_info_t *client = client_at_locked(server, i);
+        if (client) {
+            pool_pop(&server->clients, i);
+            destroy_client(client);
         }
     }
     
+    // The last workers may still be leaving run_workers
+    if (server->work_group) {
+        dispatch_group_wait(server->work_group, DISPATCH_TIME_FOREVER);
+        dispatch_release(server->work_group);
+    }
+    
     resource_tracker_destroy(server->resources);
     
     free(server);
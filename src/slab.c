@@ -0,0 +1,74 @@
+#include "slab.h"
+#include <stdlib.h>
+#include <string.h>
+
+bool slab_init(slab_t *slab, int capacity, size_t object_size) {
+    *slab = (slab_t){ .capacity = capacity };
+    if (capacity <= 0) {
+        return false;
+    }
+    
+    // Keep objects aligned for any member type
+    slab->object_size = (object_size + _Alignof(max_align_t) - 1) &
+                        ~(_Alignof(max_align_t) - 1);
+    slab->objects = calloc(capacity, slab->object_size);
+    slab->next = calloc(capacity, sizeof(*slab->next));
+    if (!slab->objects || !slab->next) {
+        slab_destroy(slab);
+        return false;
+    }
+    
+    for (int i = 0; i < capacity; i++) {
+        atomic_init(&slab->next[i], i + 1 < capacity ? i + 2 : 0);
+    }
+    atomic_init(&slab->free_head, 1);
+    return true;
+}
+
+void* slab_alloc(slab_t *slab) {
+    uint64_t head = atomic_load_explicit(&slab->free_head, memory_order_acquire);
+    for (;;) {
+        uint32_t index = (uint32_t)head;
+        if (index == 0) {
+            return NULL;
+        }
+        int next = atomic_load_explicit(&slab->next[index - 1], memory_order_relaxed);
+        uint64_t new_head = ((head >> 32) + 1) << 32 | (uint32_t)next;
+        if (atomic_compare_exchange_weak_explicit(&slab->free_head, &head, new_head,
+                                                  memory_order_acquire,
+                                                  memory_order_acquire)) {
+            void *object = slab->objects + (size_t)(index - 1) * slab->object_size;
+            memset(object, 0, slab->object_size);
+            return object;
+        }
+    }
+}
+
+void slab_free(slab_t *slab, void *object) {
+    int index = (int)(((uint8_t*)object - slab->objects) / slab->object_size);
+    uint64_t head = atomic_load_explicit(&slab->free_head, memory_order_relaxed);
+    for (;;) {
+        atomic_store_explicit(&slab->next[index], (int)(uint32_t)head, memory_order_relaxed);
+        uint64_t new_head = ((head >> 32) + 1) << 32 | (uint32_t)(index + 1);
+        if (atomic_compare_exchange_weak_explicit(&slab->free_head, &head, new_head,
+                                                  memory_order_release,
+                                                  memory_order_relaxed)) {
+            return;
+        }
+    }
+}
+
+bool slab_owns(const slab_t *slab, const void *object) {
+    const uint8_t *address = (const uint8_t*)object;
+    return slab->objects && address >= slab->objects &&
+           address < slab->objects + (size_t)slab->capacity * slab->object_size;
+}
+
+void slab_destroy(void *res) {
+    slab_t *slab = (slab_t*)res;
+    free(slab->objects);
+    free((void*)slab->next);
+    slab->objects = NULL;
+    slab->next = NULL;
+    slab->capacity = 0;
+}
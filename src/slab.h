@@ -0,0 +1,34 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Preallocated fixed size objects with a lock-free free list,
+// safe to allocate and free from any thread
+typedef struct {
+    uint8_t *objects;
+    _Atomic int *next;              // Free list chain, index + 1 (0 = end)
+    size_t object_size;
+    int capacity;
+    _Atomic uint64_t free_head;     // ABA tag in high 32 bits, index + 1 in low
+} slab_t;
+
+// Initialize a slab of capacity objects, false if out of memory
+bool slab_init(slab_t *slab, int capacity, size_t object_size);
+
+// Zeroed object or NULL if the slab is exhausted
+void* slab_alloc(slab_t *slab);
+
+// Return an object of this slab
+void slab_free(slab_t *slab, void *object);
+
+// Check whether an object was handed out by this slab
+bool slab_owns(const slab_t *slab, const void *object);
+
+// Cleanup slab memory (outstanding objects become invalid)
+void slab_destroy(void *slab);
+
+#endif // SLAB_H
@@ -0,0 +1,84 @@
+#include "stats.h"
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+stats_transport_t stats_transport;
+
+uint64_t stats_now_ns(void) {
+    return clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+}
+
+void stats_max(stats_counter_t *counter, uint64_t value) {
+    uint64_t current = atomic_load_explicit(counter, memory_order_relaxed);
+    while (current < value &&
+           !atomic_compare_exchange_weak_explicit(counter, &current, value,
+                                                  memory_order_relaxed,
+                                                  memory_order_relaxed)) {
+    }
+}
+
+void stats_histogram_record(stats_histogram_t *hist, uint64_t ns) {
+    int bucket = 63 - __builtin_clzll(ns | 1);
+    if (bucket >= IPC_STATS_BUCKETS) {
+        bucket = IPC_STATS_BUCKETS - 1;
+    }
+    atomic_fetch_add_explicit(&hist->buckets[bucket], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&hist->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&hist->sum_ns, ns, memory_order_relaxed);
+    stats_max(&hist->max_ns, ns);
+}
+
+void stats_histogram_snapshot(stats_histogram_t *hist, ipc_histogram_t *out) {
+    out->count = atomic_load_explicit(&hist->count, memory_order_relaxed);
+    out->sum_ns = atomic_load_explicit(&hist->sum_ns, memory_order_relaxed);
+    out->max_ns = atomic_load_explicit(&hist->max_ns, memory_order_relaxed);
+    for (int i = 0; i < IPC_STATS_BUCKETS; i++) {
+        out->buckets[i] = atomic_load_explicit(&hist->buckets[i], memory_order_relaxed);
+    }
+}
+
+void stats_snapshot(stats_endpoint_t *endpoint, ipc_stats_t *out) {
+    memset(out, 0, sizeof(*out));
+    out->enabled = IPC_STATS;
+    out->timestamp_ns = stats_now_ns();
+
+    out->messages_received = atomic_load_explicit(&endpoint->messages_received,
+                                                  memory_order_relaxed);
+    out->bytes_received = atomic_load_explicit(&endpoint->bytes_received, memory_order_relaxed);
+    out->deadline_expired = atomic_load_explicit(&endpoint->deadline_expired,
+                                                 memory_order_relaxed);
+    out->deadline_dropped = atomic_load_explicit(&endpoint->deadline_dropped,
+                                                 memory_order_relaxed);
+    out->flow_blocked = atomic_load_explicit(&endpoint->flow_blocked, memory_order_relaxed);
+    out->messages_sent = atomic_load_explicit(&stats_transport.messages_sent,
+                                              memory_order_relaxed);
+    out->send_failures = atomic_load_explicit(&stats_transport.send_failures,
+                                              memory_order_relaxed);
+    out->queue_depth = (uint32_t)atomic_load_explicit(&endpoint->queue_depth,
+                                                      memory_order_relaxed);
+    out->queue_depth_peak = (uint32_t)atomic_load_explicit(&endpoint->queue_depth_peak,
+                                                           memory_order_relaxed);
+    out->queued_bytes = atomic_load_explicit(&endpoint->queued_bytes, memory_order_relaxed);
+    out->queued_bytes_peak = atomic_load_explicit(&endpoint->queued_bytes_peak,
+                                                  memory_order_relaxed);
+    out->quota_rejected = atomic_load_explicit(&endpoint->quota_rejected, memory_order_relaxed);
+    out->quota_disconnects = atomic_load_explicit(&endpoint->quota_disconnects,
+                                                  memory_order_relaxed);
+    stats_histogram_snapshot(&endpoint->queue_latency, &out->queue_latency);
+    stats_histogram_snapshot(&endpoint->handler_latency, &out->handler_latency);
+}
+
+#if IPC_SIGNPOST
+static os_log_t signpost_log;
+static pthread_once_t signpost_once = PTHREAD_ONCE_INIT;
+
+static void create_signpost_log(void) {
+    signpost_log = os_log_create("com.mach_ipc", OS_LOG_CATEGORY_POINTS_OF_INTEREST);
+}
+
+os_log_t stats_signpost_log(void) {
+    pthread_once(&signpost_once, create_signpost_log);
+    return signpost_log;
+}
+#endif
@@ -0,0 +1,93 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include "mach_ipc.h"
+
+// Counters and histograms, IPC_STATS=0 compiles every update away
+#ifndef IPC_STATS
+#define IPC_STATS 1
+#endif
+
+// os_signpost intervals around handlers and requests (Instruments)
+#ifndef IPC_SIGNPOST
+#define IPC_SIGNPOST 0
+#endif
+
+typedef _Atomic uint64_t stats_counter_t;
+
+// Log2 latency histogram, bucket i counts samples in [2^i, 2^(i+1)) ns
+typedef struct {
+    stats_counter_t count;
+    stats_counter_t sum_ns;
+    stats_counter_t max_ns;
+    stats_counter_t buckets[IPC_STATS_BUCKETS];
+} stats_histogram_t;
+
+// Counters kept by a server or client
+typedef struct {
+    stats_counter_t messages_received;
+    stats_counter_t bytes_received;
+    stats_counter_t deadline_expired;
+    stats_counter_t deadline_dropped;
+    stats_counter_t flow_blocked;
+    stats_counter_t queue_depth;        // Dispatched, handler not finished yet
+    stats_counter_t queue_depth_peak;   // Deepest single queue seen
+    stats_counter_t queued_bytes;
+    stats_counter_t queued_bytes_peak;
+    stats_counter_t quota_rejected;
+    stats_counter_t quota_disconnects;
+    stats_histogram_t queue_latency;
+    stats_histogram_t handler_latency;
+} stats_endpoint_t;
+
+// Counters of the sends of this process
+typedef struct {
+    stats_counter_t messages_sent;
+    stats_counter_t send_failures;
+} stats_transport_t;
+
+extern stats_transport_t stats_transport;
+
+uint64_t stats_now_ns(void);
+void stats_max(stats_counter_t *counter, uint64_t value);
+void stats_histogram_record(stats_histogram_t *hist, uint64_t ns);
+void stats_histogram_snapshot(stats_histogram_t *hist, ipc_histogram_t *out);
+
+/* Fill the parts of a snapshot every endpoint has */
+void stats_snapshot(stats_endpoint_t *endpoint, ipc_stats_t *out);
+
+#if IPC_STATS
+#define STATS_INC(counter)          atomic_fetch_add_explicit(&(counter), 1, memory_order_relaxed)
+#define STATS_DEC(counter)          atomic_fetch_sub_explicit(&(counter), 1, memory_order_relaxed)
+#define STATS_ADD(counter, n)       atomic_fetch_add_explicit(&(counter), (n), memory_order_relaxed)
+#define STATS_SUB(counter, n)       atomic_fetch_sub_explicit(&(counter), (n), memory_order_relaxed)
+#define STATS_MAX(counter, value)   stats_max(&(counter), (value))
+#define STATS_NOW()                 stats_now_ns()
+#define STATS_SINCE(hist, start_ns) stats_histogram_record(&(hist), stats_now_ns() - (start_ns))
+#else
+#define STATS_INC(counter)          ((void)0)
+#define STATS_DEC(counter)          ((void)0)
+#define STATS_ADD(counter, n)       ((void)0)
+#define STATS_SUB(counter, n)       ((void)0)
+#define STATS_MAX(counter, value)   ((void)0)
+#define STATS_NOW()                 ((uint64_t)0)
+#define STATS_SINCE(hist, start_ns) ((void)(start_ns))
+#endif
+
+#if IPC_SIGNPOST
+#include <os/signpost.h>
+os_log_t stats_signpost_log(void);
+// name must be a string literal
+#define STATS_INTERVAL_BEGIN(id, name) \
+    os_signpost_id_t id = os_signpost_id_generate(stats_signpost_log()); \
+    os_signpost_interval_begin(stats_signpost_log(), id, name)
+#define STATS_INTERVAL_END(id, name) \
+    os_signpost_interval_end(stats_signpost_log(), id, name)
+#else
+#define STATS_INTERVAL_BEGIN(id, name) ((void)0)
+#define STATS_INTERVAL_END(id, name)   ((void)0)
+#endif
+
+#endif /* STATS_H */
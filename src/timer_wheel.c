@@ -0,0 +1,227 @@
+#include "timer_wheel.h"
+#include <pthread.h>
+#include <stddef.h>
+#include <time.h>
+
+#define LEVEL_SHIFT(level) ((level) * TIMER_BITS)
+#define SLOT_MASK          (TIMER_SLOTS - 1)
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;            // Wheel thread, an earlier timer was armed
+    pthread_cond_t done;            // Cancels waiting for a running callback
+    pthread_t thread;
+    timer_entry_t *slots[TIMER_LEVELS * TIMER_SLOTS];
+    uint64_t occupied[TIMER_LEVELS];    // Bit per non-empty slot
+    uint64_t base;                  // Last processed tick
+    uint64_t wake_tick;             // Thread sleeps until then (UINT64_MAX = forever)
+    timer_entry_t *running;         // Callback in progress
+} wheel = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER
+};
+
+static pthread_once_t wheel_once = PTHREAD_ONCE_INIT;
+static bool wheel_started;
+
+static uint64_t now_ns(void) {
+    return clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+}
+
+static int slot_of(int level, uint64_t index) {
+    return level * TIMER_SLOTS + (int)(index & SLOT_MASK);
+}
+
+static void link_entry(timer_entry_t *entry) {
+    uint64_t expires = entry->expires > wheel.base ? entry->expires : wheel.base + 1;
+
+    // A slot comes around again TIMER_SLOTS spans later, so that distance still fits
+    int level = 0;
+    while (level < TIMER_LEVELS - 1 &&
+           (expires >> LEVEL_SHIFT(level)) - (wheel.base >> LEVEL_SHIFT(level)) > TIMER_SLOTS) {
+        level++;
+    }
+    uint64_t index = expires >> LEVEL_SHIFT(level);
+    uint64_t base_index = wheel.base >> LEVEL_SHIFT(level);
+    if (index - base_index > TIMER_SLOTS) {
+        // Beyond the top level, placed again when its slot cascades
+        index = base_index + TIMER_SLOTS;
+    }
+
+    int slot = slot_of(level, index);
+    entry->slot = slot;
+    entry->next = wheel.slots[slot];
+    if (entry->next) {
+        entry->next->pprev = &entry->next;
+    }
+    entry->pprev = &wheel.slots[slot];
+    wheel.slots[slot] = entry;
+    wheel.occupied[level] |= 1ULL << (index & SLOT_MASK);
+}
+
+static void unlink_entry(timer_entry_t *entry) {
+    *entry->pprev = entry->next;
+    if (entry->next) {
+        entry->next->pprev = entry->pprev;
+    }
+    if (entry->slot >= 0 && !wheel.slots[entry->slot]) {
+        wheel.occupied[entry->slot / TIMER_SLOTS] &= ~(1ULL << (entry->slot & SLOT_MASK));
+    }
+    entry->next = NULL;
+    entry->pprev = NULL;
+}
+
+// First tick after base that has a slot to fire or cascade, UINT64_MAX if none
+static uint64_t next_event(void) {
+    uint64_t next = UINT64_MAX;
+    for (int level = 0; level < TIMER_LEVELS; level++) {
+        uint64_t occupied = wheel.occupied[level];
+        if (!occupied) {
+            continue;
+        }
+        uint64_t index = (wheel.base >> LEVEL_SHIFT(level)) + 1;
+        unsigned start = (unsigned)(index & SLOT_MASK);
+        uint64_t rotated = start ? occupied >> start | occupied << (TIMER_SLOTS - start) : occupied;
+        uint64_t tick = (index + (uint64_t)__builtin_ctzll(rotated)) << LEVEL_SHIFT(level);
+        if (tick < next) {
+            next = tick;
+        }
+    }
+    return next;
+}
+
+// Process tick with base one before it, lock held (dropped around callbacks)
+static void run_tick(uint64_t tick) {
+    // Higher levels first, what they hand down may be due right away
+    for (int level = TIMER_LEVELS - 1; level > 0; level--) {
+        if (tick & ((1ULL << LEVEL_SHIFT(level)) - 1)) {
+            continue;
+        }
+        uint64_t index = tick >> LEVEL_SHIFT(level);
+        int slot = slot_of(level, index);
+        timer_entry_t *entry = wheel.slots[slot];
+        wheel.slots[slot] = NULL;
+        wheel.occupied[level] &= ~(1ULL << (index & SLOT_MASK));
+        while (entry) {
+            timer_entry_t *next = entry->next;
+            link_entry(entry);
+            entry = next;
+        }
+    }
+
+    // Move the due entries to a list of their own, arms from callbacks may
+    // land in the same slot again
+    int slot = slot_of(0, tick);
+    timer_entry_t *due = wheel.slots[slot];
+    wheel.slots[slot] = NULL;
+    wheel.occupied[0] &= ~(1ULL << (tick & SLOT_MASK));
+    if (due) {
+        due->pprev = &due;
+    }
+    for (timer_entry_t *entry = due; entry; entry = entry->next) {
+        entry->slot = -1;
+    }
+    wheel.base = tick;
+
+    while (due) {
+        timer_entry_t *entry = due;
+        unlink_entry(entry);
+        timer_fn_t fn = entry->fn;
+        void *context = entry->context;
+        uint64_t tag = entry->tag;
+
+        wheel.running = entry;
+        pthread_mutex_unlock(&wheel.lock);
+        fn(entry, tag, context);
+        pthread_mutex_lock(&wheel.lock);
+        wheel.running = NULL;
+        pthread_cond_broadcast(&wheel.done);
+    }
+}
+
+static void* wheel_thread(void *arg) {
+    (void)arg;
+
+    pthread_mutex_lock(&wheel.lock);
+    for (;;) {
+        uint64_t now = now_ns();
+        uint64_t now_tick = now / TIMER_TICK_NS;
+
+        // Jump from event to event, the slots in between are empty
+        uint64_t next;
+        while ((next = next_event()) <= now_tick) {
+            wheel.base = next - 1;
+            run_tick(next);
+        }
+        if (wheel.base < now_tick) {
+            wheel.base = now_tick;
+        }
+
+        next = next_event();
+        wheel.wake_tick = next;
+        if (next == UINT64_MAX) {
+            pthread_cond_wait(&wheel.wake, &wheel.lock);
+        } else {
+            uint64_t remaining = next * TIMER_TICK_NS - now;
+            struct timespec timeout = {
+                .tv_sec = (time_t)(remaining / 1000000000ULL),
+                .tv_nsec = (long)(remaining % 1000000000ULL)
+            };
+            pthread_cond_timedwait_relative_np(&wheel.wake, &wheel.lock, &timeout);
+        }
+    }
+    return NULL;
+}
+
+static void wheel_init(void) {
+    wheel.base = now_ns() / TIMER_TICK_NS;
+    wheel.wake_tick = UINT64_MAX;
+
+    if (pthread_create(&wheel.thread, NULL, wheel_thread, NULL) == 0) {
+        pthread_detach(wheel.thread);
+        wheel_started = true;
+    }
+}
+
+bool timer_wheel_start(void) {
+    pthread_once(&wheel_once, wheel_init);
+    return wheel_started;
+}
+
+void timer_arm(timer_entry_t *entry, uint64_t timeout_ms, timer_fn_t fn, void *context,
+               uint64_t tag) {
+    // Rounded up, the current tick has partly passed
+    uint64_t expires = (now_ns() + timeout_ms * 1000000ULL) / TIMER_TICK_NS + 1;
+
+    pthread_mutex_lock(&wheel.lock);
+    entry->expires = expires;
+    entry->fn = fn;
+    entry->context = context;
+    entry->tag = tag;
+    link_entry(entry);
+
+    uint64_t next = next_event();
+    if (next < wheel.wake_tick) {
+        wheel.wake_tick = next;
+        pthread_cond_signal(&wheel.wake);
+    }
+    pthread_mutex_unlock(&wheel.lock);
+}
+
+bool timer_cancel(timer_entry_t *entry) {
+    pthread_mutex_lock(&wheel.lock);
+    bool pending = entry->pprev != NULL;
+    if (!pending && (!wheel_started || !pthread_equal(pthread_self(), wheel.thread))) {
+        while (wheel.running == entry) {
+            pthread_cond_wait(&wheel.done, &wheel.lock);
+        }
+        // The callback may have armed it again
+        pending = entry->pprev != NULL;
+    }
+    if (pending) {
+        unlink_entry(entry);
+    }
+    pthread_mutex_unlock(&wheel.lock);
+    return pending;
+}
@@ -0,0 +1,45 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Hierarchical timer wheel shared by the process: TIMER_LEVELS levels of
+// TIMER_SLOTS slots, a slot of level l spans TIMER_SLOTS^l ticks of
+// TIMER_TICK_NS. One thread runs the callbacks and only wakes up for the
+// next armed timer, with none armed it sleeps until one is
+#define TIMER_TICK_NS   1000000ULL
+#define TIMER_BITS      6
+#define TIMER_SLOTS     (1 << TIMER_BITS)
+#define TIMER_LEVELS    4
+
+typedef struct timer_entry timer_entry_t;
+
+// Runs on the wheel thread, must not block
+typedef void (*timer_fn_t)(timer_entry_t *entry, uint64_t tag, void *context);
+
+// Intrusive, embedded in the record that times out. Zeroed = not armed
+struct timer_entry {
+    struct timer_entry *next;
+    struct timer_entry **pprev;     // NULL = not armed
+    uint64_t expires;               // Tick
+    int slot;                       // level * TIMER_SLOTS + slot, -1 = firing
+    timer_fn_t fn;
+    void *context;
+    uint64_t tag;
+};
+
+// Start the wheel thread once, false if it could not be created
+bool timer_wheel_start(void);
+
+// Fire fn after at least timeout_ms, the wheel must have been started and
+// entry must not be armed
+void timer_arm(timer_entry_t *entry, uint64_t timeout_ms, timer_fn_t fn, void *context,
+               uint64_t tag);
+
+// Disarm entry, true if it had not fired yet. Waits for a running callback
+// of the entry unless called from it (and disarms what that armed again),
+// so the entry can be reused after
+bool timer_cancel(timer_entry_t *entry);
+
+#endif // TIMER_WHEEL_H
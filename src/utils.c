@@ -8,9 +8,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <pthread.h>
+#include <malloc/malloc.h>
 
 const char *(*user_ipc_status_string)(ipc_status_t) = NULL;
 
+static atomic_size_t inline_threshold = INTERNAL_INLINE_MAX_SIZE;
+
 const char* ipc_status_string(ipc_status_t status) {
     if (status >= 1000) {
         const char *st_str = NULL;
@@ -36,6 +39,10 @@ const char* ipc_status_string(ipc_status_t status) {
             return "Internal error";
         case IPC_ERROR_CLIENT_FULL:
             return "Client list full";
+        case IPC_ERROR_WOULD_BLOCK:
+            return "Operation would block";
+        case IPC_ERROR_QUOTA_EXCEEDED:
+            return "Quota exceeded";
         default:
             return "Unknown error";
     }
@@ -57,41 +64,266 @@ void ipc_free(void *ptr) {
 
 void ply_free(void *ptr, size_t size) {
     if (ptr && size) {
-        vm_deallocate(mach_task_self(), (vm_address_t)ptr, size);
+        if (malloc_zone_from_ptr(ptr)) {
+            // Heap copy of an inline payload
+            free(ptr);
+        } else {
+            vm_deallocate(mach_task_self(), (vm_address_t)ptr, size);
+        }
     }
 }
 
-ipc_status_t mach_server_broadcast(
+void* ipc_payload_alloc(size_t size) {
+    return arena_pages_alloc(size);
+}
+
+void ipc_payload_free(void *ptr) {
+    arena_pages_free(ptr, 0, false);
+}
+
+void ipc_set_inline_threshold(size_t size) {
+    if (size > INTERNAL_INLINE_MAX_SIZE) {
+        LOG_WARN_MSG("Inline threshold %zu exceeds maximum, clamping to %d",
+                     size, INTERNAL_INLINE_MAX_SIZE);
+        size = INTERNAL_INLINE_MAX_SIZE;
+    }
+    atomic_store_explicit(&inline_threshold, size, memory_order_relaxed);
+}
+
+size_t ipc_get_inline_threshold(void) {
+    return atomic_load_explicit(&inline_threshold, memory_order_relaxed);
+}
+
+typedef struct {
+    client_handle_t handle;
+    mach_port_t port;               // Extra send right, released after the send
+    ipc_status_t status;            // IPC_ERROR_WOULD_BLOCK = no credit, not sent
+} broadcast_target_t;
+
+static ipc_status_t broadcast_status(kern_return_t kr, uint32_t timeout_ms) {
+    switch (kr) {
+        case KERN_SUCCESS:
+            return IPC_SUCCESS;
+        case MACH_SEND_TIMED_OUT:
+            return timeout_ms ? IPC_ERROR_TIMEOUT : IPC_ERROR_WOULD_BLOCK;
+        case MACH_SEND_INVALID_DEST:
+            return IPC_ERROR_NOT_CONNECTED;
+        default:
+            return IPC_ERROR_SEND_FAILED;
+    }
+}
+
+// Retain the client port and a credit into the next target slot (clients_lock held)
+static bool add_target_locked(mach_server_t *server, broadcast_target_t *target,
+                              client_info_t *client) {
+    if (!client || !client->active) {
+        return false;
+    }
+    target->handle = (client_handle_t){
+        .id = client->id,
+        .slot = client->slot,
+        .internal = client
+    };
+    target->port = MACH_PORT_NULL;
+    
+    if (!flow_try_acquire(&client->flow)) {
+        STATS_INC(server->stats.flow_blocked);
+        target->status = IPC_ERROR_WOULD_BLOCK;
+        return true;
+    }
+    if (mach_port_mod_refs(mach_task_self(), client->port,
+                           MACH_PORT_RIGHT_SEND, 1) != KERN_SUCCESS) {
+        flow_release(&client->flow, &server->flow_wait, 1);
+        return false;
+    }
+    target->port = client->port;
+    target->status = IPC_SUCCESS;
+    return true;
+}
+
+// Give the credits of unsent messages back, if their clients are still there
+static void refund_targets(mach_server_t *server, broadcast_target_t *targets, int count) {
+    pthread_mutex_lock(&server->clients_lock);
+    for (int i = 0; i < count; i++) {
+        if (targets[i].port == MACH_PORT_NULL || targets[i].status == IPC_SUCCESS) {
+            continue;
+        }
+        int slot = targets[i].handle.slot;
+        client_info_t *client = find_client_by_id_locked(server, targets[i].handle.id, &slot);
+        if (client) {
+            flow_release(&client->flow, &server->flow_wait, 1);
+        }
+    }
+    pthread_mutex_unlock(&server->clients_lock);
+}
+
+// Build the message once, send it to every target and release their ports
+static ipc_status_t send_to_targets(
+    mach_server_t *server,
+    broadcast_target_t *targets,
+    int count,
+    mach_msg_id_t msg_id,
+    const internal_payload_t *payload,
+    const void *data,
+    size_t size,
+    uint32_t timeout_ms,
+    broadcast_failure_t *failures,
+    size_t failures_capacity,
+    size_t *failure_count
+) {
+    protocol_broadcast_t broadcast;
+    kern_return_t kr = protocol_broadcast_prepare(&broadcast, msg_id, payload,
+                                                  data, size, count);
+    
+    ipc_status_t result = IPC_SUCCESS;
+    size_t failed = 0;
+    bool refund = false;
+    for (int i = 0; i < count; i++) {
+        ipc_status_t status = targets[i].status;
+        if (targets[i].port != MACH_PORT_NULL) {
+            status = kr == KERN_SUCCESS
+                ? broadcast_status(protocol_broadcast_send(&broadcast, targets[i].port,
+                                                           timeout_ms),
+                                   timeout_ms)
+                : IPC_ERROR_INVALID_PARAM;
+            mach_port_deallocate(mach_task_self(), targets[i].port);
+            targets[i].status = status;
+            refund |= status != IPC_SUCCESS;
+        }
+        
+        if (status != IPC_SUCCESS) {
+            if (failed < failures_capacity) {
+                failures[failed] = (broadcast_failure_t){
+                    .client = targets[i].handle,
+                    .status = status
+                };
+            }
+            if (result == IPC_SUCCESS) {
+                result = status;
+            }
+            failed++;
+        }
+    }
+    
+    if (kr == KERN_SUCCESS) {
+        protocol_broadcast_release(&broadcast);
+    }
+    if (refund) {
+        refund_targets(server, targets, count);
+    }
+    
+    if (failed) {
+        LOG_WARN_MSG("Broadcast reached %d of %d clients", count - (int)failed, count);
+    }
+    if (failure_count) {
+        *failure_count = failed;
+    }
+    return result;
+}
+
+ipc_status_t mach_server_broadcast_with_report(
     mach_server_t *server,
     uint32_t msg_type,
     const void *data,
-    size_t size
+    size_t size,
+    uint32_t timeout_ms,
+    broadcast_failure_t *failures,
+    size_t failures_capacity,
+    size_t *failure_count
 ) {
-    if (!server) return IPC_ERROR_INVALID_PARAM;
+    if (!server || (size && !data) || (failures_capacity && !failures)) {
+        return IPC_ERROR_INVALID_PARAM;
+    }
+    if (failure_count) {
+        *failure_count = 0;
+    }
     
-    // Get snapshot of clients
-    client_handle_t clients[MAX_CLIENTS];
+    // Snapshot the clients once, each with its own send right so a
+    // concurrent disconnect can't release the port during the send loop
     int count = 0;
     
     pthread_mutex_lock(&server->clients_lock);
-    for (int i = 0; i < MAX_CLIENTS && count < MAX_CLIENTS; i++) {
-        if (server->clients[i] && server->clients[i]->active) {
-            clients[count].id = server->clients[i]->id;
-            clients[count].internal = server->clients[i];
+    broadcast_target_t *targets = malloc(server->client_count * sizeof(broadcast_target_t));
+    if (!targets && server->client_count > 0) {
+        pthread_mutex_unlock(&server->clients_lock);
+        return IPC_ERROR_NO_MEMORY;
+    }
+    for (int i = 0; i < server->clients.capacity && count < server->client_count; i++) {
+        if (add_target_locked(server, &targets[count], client_at_locked(server, i))) {
             count++;
         }
     }
     pthread_mutex_unlock(&server->clients_lock);
     
-    // Send to all clients
-    ipc_status_t result = IPC_SUCCESS;
-    for (int i = 0; i < count; i++) {
-        ipc_status_t status = mach_server_send(server, clients[i], msg_type, data, size);
-        if (status != IPC_SUCCESS) {
-            result = status; // Return last error
+    internal_payload_t payload = (internal_payload_t){
+        .client_id = 0,    // Server doesn't have a client ID
+        .client_slot = -1, // Server doesn't have a client slot
+        .status = IPC_SUCCESS
+    };
+    ipc_status_t result = send_to_targets(server, targets, count, MSG_ID_USER(msg_type),
+                                          &payload, data, size, timeout_ms,
+                                          failures, failures_capacity, failure_count);
+    free(targets);
+    return result;
+}
+
+ipc_status_t mach_server_broadcast(
+    mach_server_t *server,
+    uint32_t msg_type,
+    const void *data,
+    size_t size
+) {
+    return mach_server_broadcast_with_report(server, msg_type, data, size, 0, NULL, 0, NULL);
+}
+
+ipc_status_t mach_server_publish(
+    mach_server_t *server,
+    uint32_t topic,
+    const void *data,
+    size_t size
+) {
+    if (!server || (size && !data)) return IPC_ERROR_INVALID_PARAM;
+    
+    // Snapshot the subscribers, see mach_server_broadcast_with_report
+    int count = 0;
+    broadcast_target_t *targets = NULL;
+    
+    pthread_mutex_lock(&server->clients_lock);
+    server_topic_t *entry = find_topic_locked(server, topic);
+    if (entry) {
+        targets = malloc(entry->subscriber_count * sizeof(broadcast_target_t));
+        if (!targets) {
+            pthread_mutex_unlock(&server->clients_lock);
+            return IPC_ERROR_NO_MEMORY;
+        }
+        for (int word = 0; word < server->topic_words; word++) {
+            uint64_t bits = entry->subscribers[word];
+            while (bits) {
+                int slot = word * 64 + __builtin_ctzll(bits);
+                bits &= bits - 1;
+                if (add_target_locked(server, &targets[count],
+                                      client_at_locked(server, slot))) {
+                    count++;
+                }
+            }
         }
     }
+    pthread_mutex_unlock(&server->clients_lock);
+    
+    if (count == 0) {
+        free(targets);
+        return IPC_SUCCESS;
+    }
     
+    internal_payload_t payload = (internal_payload_t){
+        .client_id = 0,
+        .client_slot = -1,
+        .status = IPC_SUCCESS,
+        .topic = topic
+    };
+    ipc_status_t result = send_to_targets(server, targets, count, MSG_ID_PUBLISH, &payload,
+                                          data, size, 0, NULL, 0, NULL);
+    free(targets);
     return result;
 }
 
@@ -160,6 +392,37 @@ bool has_no_deadline(struct timespec deadline) {
     return deadline.tv_sec == 0 && deadline.tv_nsec == 0;
 }
 
+uint64_t deadline_to_ns(struct timespec deadline, uint64_t safety_ms) {
+    if (has_no_deadline(deadline)) {
+        return 0;
+    }
+    return (uint64_t)deadline.tv_sec * 1000000000ULL + (uint64_t)deadline.tv_nsec +
+           safety_ms * 1000000ULL;
+}
+
+uint64_t monotonic_now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+kern_return_t port_set_queue_limit(mach_port_t port, uint32_t limit) {
+    if (limit == 0) {
+        return KERN_SUCCESS;
+    }
+    mach_port_limits_t limits = {
+        .mpl_qlimit = limit < MACH_PORT_QLIMIT_MAX ? limit : MACH_PORT_QLIMIT_MAX
+    };
+    kern_return_t kr = mach_port_set_attributes(mach_task_self(), port, MACH_PORT_LIMITS_INFO,
+                                                (mach_port_info_t)&limits,
+                                                MACH_PORT_LIMITS_INFO_COUNT);
+    if (kr != KERN_SUCCESS) {
+        LOG_WARN_MSG("Failed to set queue limit %u on port %u: %s", limit, port,
+                     mach_error_string(kr));
+    }
+    return kr;
+}
+
 kern_return_t shared_memory_create(mach_vm_size_t size, shared_memory_t **out_shmem) {
     if (!out_shmem || size == 0) {
         return KERN_INVALID_ARGUMENT;